@@ -3,39 +3,30 @@
 
 #include <stdarg.h>
 
-// --- LOG_PRINTF MACRO ---
+// --- LOG_PRINTF / SERIAL_PRINTF MACROS ---
 #ifdef ARDUINO
 #include <Arduino.h>
 
 #ifdef __cplusplus
-// Helper to bridge C stdio to Arduino Serial
-static int serial_putchar(char c, FILE *f) {
-    if (c == '\n')
-        Serial.write('\r');
-    return Serial.write(c) == 1 ? 0 : 1;
-}
-
-static void SerialPrintf(const char *fmt, ...) {
-    static FILE serial_out;
-    static bool initialized = false;
-    if (!initialized) {
-        fdev_setup_stream(&serial_out, serial_putchar, NULL, _FDEV_SETUP_WRITE);
-        initialized = true;
-    }
-
-    va_list args;
-    va_start(args, fmt);
-    vfprintf_P(&serial_out, fmt, args); // _P version reads fmt from Flash
-    va_end(args);
+extern "C" {
+#endif
+// printf to Serial with the format in Flash; defined in main.cpp so C code can reach Serial
+void SerialPrintf(const char *fmt, ...);
+#ifdef __cplusplus
 }
+#endif
 
+#ifdef __cplusplus
 // PSTR(fmt) keeps the string in Flash memory instead of SRAM
 #define LOG_PRINTF(fmt, ...) SerialPrintf(PSTR(fmt), ##__VA_ARGS__)
 #else
-// Fallback for C on Arduino (direct logging is not easily bridged without C++ Serial)
+// The C console log stays off the device: printing each tick would stall the loop on Serial
 #define LOG_PRINTF(fmt, ...) ((void)0)
 #endif
 
+// Replies to serial commands (dumps, reports), from C as well. Needs an argument after fmt.
+#define SERIAL_PRINTF(fmt, ...) SerialPrintf(PSTR(fmt), __VA_ARGS__)
+
 // --- MS_DELAY MACRO ---
 #define MS_DELAY(ms) delay(ms)
 
@@ -43,6 +34,7 @@ static void SerialPrintf(const char *fmt, ...) {
 // --- PC / x86 logic ---
 #include <stdio.h>
 #define LOG_PRINTF(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#define SERIAL_PRINTF(fmt, ...) printf(fmt, __VA_ARGS__)
 
 #ifdef _WIN32
 #include <windows.h>
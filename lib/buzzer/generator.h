@@ -12,4 +12,13 @@
  */
 int generate_music_header(const char *midi_path, const char *output_path);
 
+/**
+ * @brief Convert one MIDI file to a note_t array named <song_name>_data
+ * @param path Path to the input MIDI file
+ * @param song_name Prefix of the array and its <song_name>_length
+ * @param out Stream the C definitions are written to
+ * @return 0 on success, non-zero on error
+ */
+int process_midi(const char *path, const char *song_name, FILE *out);
+
 #endif // GENERATOR_H
@@ -0,0 +1,167 @@
+#include "flight_recorder.h"
+
+#define FR_DELTA_FLAG 0x80
+#define FR_DELTA_MASK 0x07
+
+static void fr_pack(wm_state_t state, const wm_sensors_t *s, const wm_actuators_t *a,
+                    uint8_t buttons, uint8_t out[FR_SAMPLE_BYTES]) {
+    out[0] = (uint8_t)((state & 0x0F) | ((s->water_level & 0x03) << 4) |
+                       ((s->drain_check ? 1 : 0) << 6));
+    out[1] = (uint8_t)((a->inlet_valve ? 1 : 0) | ((a->soap_pump ? 1 : 0) << 1) |
+                       ((a->drain_pump ? 1 : 0) << 2) | ((a->motor_dir & 0x03) << 3) |
+                       ((a->buzzer & 0x03) << 5));
+    out[2] = buttons;
+}
+
+void fr_unpack(const uint8_t packed[FR_SAMPLE_BYTES], fr_sample_t *out) {
+    out->state = (wm_state_t)(packed[0] & 0x0F);
+    out->water_level = (water_level_t)((packed[0] >> 4) & 0x03);
+    out->drain_check = (packed[0] >> 6) & 0x01;
+    out->inlet_valve = packed[1] & 0x01;
+    out->soap_pump = (packed[1] >> 1) & 0x01;
+    out->drain_pump = (packed[1] >> 2) & 0x01;
+    out->motor_dir = (wm_motor_dir_t)((packed[1] >> 3) & 0x03);
+    out->buzzer = (wm_buzzer_mode_t)((packed[1] >> 5) & 0x03);
+    out->buttons = packed[2];
+}
+
+static uint16_t fr_next(uint16_t i) { return (uint16_t)((i + 1) == FR_BUF_SIZE ? 0 : i + 1); }
+
+/* Length in bytes of the record starting with 'hdr' */
+static uint8_t fr_record_len(uint8_t hdr) {
+    if (!(hdr & FR_DELTA_FLAG))
+        return 1;
+    uint8_t len = 1;
+    for (uint8_t m = hdr & FR_DELTA_MASK; m; m >>= 1)
+        len += m & 1;
+    return len;
+}
+
+/* Drop the oldest record, folding it into the base sample */
+static void fr_evict(flight_recorder_t *fr) {
+    uint8_t hdr = fr->buf[fr->tail];
+
+    if (fr->run_open && fr->run_pos == fr->tail)
+        fr->run_open = false;
+
+    if (hdr & FR_DELTA_FLAG) {
+        uint16_t i = fr_next(fr->tail);
+        for (uint8_t b = 0; b < FR_SAMPLE_BYTES; b++) {
+            if (hdr & (1 << b)) {
+                fr->base[b] ^= fr->buf[i];
+                i = fr_next(i);
+            }
+        }
+        fr->ticks--;
+    } else {
+        fr->ticks -= (uint32_t)hdr + 1;
+    }
+
+    uint8_t len = fr_record_len(hdr);
+    for (uint8_t k = 0; k < len; k++)
+        fr->tail = fr_next(fr->tail);
+    fr->used -= len;
+}
+
+/* Append a record, evicting old ones as needed. Returns the index of its first byte. */
+static uint16_t fr_push(flight_recorder_t *fr, const uint8_t *bytes, uint8_t len) {
+    while (FR_BUF_SIZE - fr->used < len)
+        fr_evict(fr);
+
+    uint16_t start = fr->head;
+    for (uint8_t k = 0; k < len; k++) {
+        fr->buf[fr->head] = bytes[k];
+        fr->head = fr_next(fr->head);
+    }
+    fr->used += len;
+    return start;
+}
+
+void fr_init(flight_recorder_t *fr, uint16_t tick_ms) {
+    *fr = (flight_recorder_t){0};
+    fr->tick_ms = tick_ms;
+}
+
+void fr_note_buttons(flight_recorder_t *fr, uint8_t buttons) { fr->pending_buttons |= buttons; }
+
+void fr_record(flight_recorder_t *fr, wm_state_t state, const wm_sensors_t *sens,
+               const wm_actuators_t *act) {
+    if (fr->frozen)
+        return;
+
+    uint8_t cur[FR_SAMPLE_BYTES];
+    fr_pack(state, sens, act, fr->pending_buttons, cur);
+    fr->pending_buttons = 0;
+
+    uint8_t rec[1 + FR_SAMPLE_BYTES];
+    uint8_t len = 1;
+    rec[0] = FR_DELTA_FLAG;
+    for (uint8_t b = 0; b < FR_SAMPLE_BYTES; b++) {
+        uint8_t x = cur[b] ^ fr->last[b];
+        if (x) {
+            rec[0] |= (uint8_t)(1 << b);
+            rec[len++] = x;
+        }
+    }
+
+    if (len == 1) {
+        /* Unchanged: extend the open run in place, or start a new one */
+        if (fr->run_open && fr->buf[fr->run_pos] < FR_RUN_MAX - 1) {
+            fr->buf[fr->run_pos]++;
+        } else {
+            uint8_t run = 0;
+            fr->run_pos = fr_push(fr, &run, 1);
+            fr->run_open = true;
+        }
+    } else {
+        fr_push(fr, rec, len);
+        fr->run_open = false;
+        for (uint8_t b = 0; b < FR_SAMPLE_BYTES; b++)
+            fr->last[b] = cur[b];
+    }
+    fr->ticks++;
+
+    /* Keep the history leading up to the fault */
+    if (state == WM_ERROR)
+        fr->frozen = true;
+}
+
+void fr_thaw(flight_recorder_t *fr) { fr->frozen = false; }
+
+uint8_t fr_byte_at(const flight_recorder_t *fr, uint16_t i) {
+    uint16_t idx = (uint16_t)(((uint32_t)fr->tail + i) % FR_BUF_SIZE);
+    return fr->buf[idx];
+}
+
+int32_t fr_decode(const uint8_t *data, uint16_t len, const uint8_t base[FR_SAMPLE_BYTES],
+                  fr_visit_t visit, void *user) {
+    uint8_t cur[FR_SAMPLE_BYTES];
+    fr_sample_t sample;
+    int32_t ticks = 0;
+
+    for (uint8_t b = 0; b < FR_SAMPLE_BYTES; b++)
+        cur[b] = base[b];
+
+    uint16_t i = 0;
+    while (i < len) {
+        uint8_t hdr = data[i];
+        if (hdr & FR_DELTA_FLAG) {
+            if ((uint16_t)(i + fr_record_len(hdr)) > len)
+                return -1;
+            i++;
+            for (uint8_t b = 0; b < FR_SAMPLE_BYTES; b++) {
+                if (hdr & (1 << b))
+                    cur[b] ^= data[i++];
+            }
+            fr_unpack(cur, &sample);
+            visit(user, &sample, 1);
+            ticks++;
+        } else {
+            fr_unpack(cur, &sample);
+            visit(user, &sample, (uint16_t)(hdr + 1));
+            ticks += hdr + 1;
+            i++;
+        }
+    }
+    return ticks;
+}
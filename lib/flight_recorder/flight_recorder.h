@@ -0,0 +1,121 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wm_control.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Black-box recorder for the controller.
+ *
+ * Every controller tick is packed into a 3-byte sample (state, sensors, actuators, button
+ * edges) and appended to a fixed SRAM ring using two record types:
+ *
+ *   0nnnnnnn           RUN:   previous sample repeated n+1 times (1..128 ticks)
+ *   1xxxxmmm [b0 b1 b2] DELTA: new sample, followed by one XOR byte per set bit in mmm
+ *
+ * When the ring is full the oldest records are folded into a base sample, so the buffer
+ * always decodes from its first byte. Recording freezes when the controller enters
+ * WM_ERROR and resumes after the history has been dumped.
+ */
+
+#ifndef FR_BUF_SIZE
+#define FR_BUF_SIZE 256 /* Ring size in bytes (roughly 5-10 minutes of a cycle) */
+#endif
+
+#define FR_SAMPLE_BYTES 3
+#define FR_DUMP_VERSION 2 /* In the dump's "FR BEGIN vN" (2: WM_SOAK renumbered the states) */
+#define FR_RUN_MAX 128
+
+/* Button edge bits */
+#define FR_BTN_A 0x01
+#define FR_BTN_B 0x02
+#define FR_BTN_C 0x04
+
+/* Unpacked view of one recorded tick */
+typedef struct {
+    wm_state_t state;
+    water_level_t water_level;
+    bool drain_check;
+    bool inlet_valve;
+    bool soap_pump;
+    bool drain_pump;
+    wm_motor_dir_t motor_dir;
+    wm_buzzer_mode_t buzzer;
+    uint8_t buttons; /* FR_BTN_* edges seen since the previous tick */
+} fr_sample_t;
+
+typedef struct {
+    uint8_t buf[FR_BUF_SIZE];
+    uint16_t head; /* Next byte to write */
+    uint16_t tail; /* Oldest byte */
+    uint16_t used; /* Bytes in the ring */
+
+    uint8_t base[FR_SAMPLE_BYTES]; /* Sample preceding the oldest record */
+    uint8_t last[FR_SAMPLE_BYTES]; /* Most recent sample */
+
+    uint16_t run_pos; /* Index of the open RUN record */
+    bool run_open;
+
+    uint32_t ticks; /* Ticks represented by the ring */
+    uint16_t tick_ms;
+    uint8_t pending_buttons;
+    bool frozen;
+} flight_recorder_t;
+
+/* Callback for fr_decode: one sample that lasted 'repeat' ticks */
+typedef void (*fr_visit_t)(void *user, const fr_sample_t *sample, uint16_t repeat);
+
+/**
+ * @brief Clear the recorder.
+ * @param tick_ms Controller tick period, stored for the dump header
+ */
+void fr_init(flight_recorder_t *fr, uint16_t tick_ms);
+
+/**
+ * @brief Remember button edges; they are attached to the next recorded tick.
+ * @param buttons FR_BTN_* mask
+ */
+void fr_note_buttons(flight_recorder_t *fr, uint8_t buttons);
+
+/**
+ * @brief Append one controller tick. Freezes the recorder when state is WM_ERROR.
+ */
+void fr_record(flight_recorder_t *fr, wm_state_t state, const wm_sensors_t *sens,
+               const wm_actuators_t *act);
+
+/**
+ * @brief Re-arm a frozen recorder, keeping the recorded history.
+ */
+void fr_thaw(flight_recorder_t *fr);
+
+/**
+ * @brief Read a byte of the ring in chronological order (0 = oldest).
+ */
+uint8_t fr_byte_at(const flight_recorder_t *fr, uint16_t i);
+
+/**
+ * @brief Expand a packed sample.
+ */
+void fr_unpack(const uint8_t packed[FR_SAMPLE_BYTES], fr_sample_t *out);
+
+/**
+ * @brief Decode a linear copy of the ring.
+ * @param data Record bytes, oldest first
+ * @param len Number of bytes
+ * @param base Base sample preceding the first record
+ * @return Number of ticks decoded, or -1 if the stream is truncated
+ */
+int32_t fr_decode(const uint8_t *data, uint16_t len, const uint8_t base[FR_SAMPLE_BYTES],
+                  fr_visit_t visit, void *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLIGHT_RECORDER_H
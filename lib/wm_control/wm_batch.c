@@ -0,0 +1,246 @@
+#include "wm_batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && !defined(__AVR__) && !defined(WM_BATCH_SCALAR)
+#define WM_BATCH_LANES 8
+typedef uint32_t lane_t __attribute__((vector_size(WM_BATCH_LANES * sizeof(uint32_t))));
+#define MASK(cond) ((lane_t)(cond)) /* Vector compares already give 0 / all-ones lanes */
+#else
+#define WM_BATCH_LANES 1
+typedef uint32_t lane_t;
+#define MASK(cond) ((lane_t)0 - (lane_t)(cond))
+#endif
+
+#define SEL(m, a, b) (((m) & (a)) | (~(m) & (b)))
+
+/* Pick the AVX2 build at load time on x86 Linux; SSE2 otherwise */
+#if WM_BATCH_LANES > 1 && defined(__x86_64__) && defined(__linux__)
+#define WM_BATCH_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define WM_BATCH_CLONES
+#endif
+
+#define BATCH_FIELDS 23
+
+bool wm_batch_init(wm_batch_t *b, size_t n) {
+    uint32_t **fields[BATCH_FIELDS] = {
+        &b->state,      &b->prev_state,  &b->state_time,  &b->error,       &b->is_wash,
+        &b->wash_done,  &b->rinse_done,  &b->phase,       &b->fill_ticks,  &b->drain_ticks,
+        &b->soap_ticks, &b->wash_ticks,  &b->rinse_ticks, &b->run_ticks,   &b->half_ticks,
+        &b->spin_ticks, &b->target_level, &b->wash_count, &b->rinse_count, &b->spin_enable,
+        &b->water_level, &b->drain_check, &b->out,
+    };
+
+    memset(b, 0, sizeof(*b));
+    b->n = n;
+    b->stride = (n + WM_BATCH_LANES - 1) / WM_BATCH_LANES * WM_BATCH_LANES;
+    b->mem = calloc(b->stride * BATCH_FIELDS, sizeof(uint32_t));
+    if (!b->mem)
+        return false;
+
+    for (int f = 0; f < BATCH_FIELDS; f++)
+        *fields[f] = (uint32_t *)b->mem + f * b->stride;
+    return true;
+}
+
+void wm_batch_free(wm_batch_t *b) {
+    free(b->mem);
+    memset(b, 0, sizeof(*b));
+}
+
+bool wm_batch_set(wm_batch_t *b, size_t i, const wm_controller_t *c) {
+    const wm_program_t *p = &c->program;
+    uint32_t tps = p->ticks_per_second;
+    uint32_t half = (uint32_t)p->agitate_cycle_ms * tps / 1000;
+
+    if (c->code_len || half == 0)
+        return false;
+
+    b->state[i] = c->state;
+    b->prev_state[i] = c->prev_state;
+    b->state_time[i] = c->state_time;
+    b->error[i] = c->error_code;
+    b->is_wash[i] = c->is_wash_phase;
+    b->wash_done[i] = c->wash_done;
+    b->rinse_done[i] = c->rinse_done;
+    b->phase[i] = c->state_time % (2 * half);
+
+    b->fill_ticks[i] = (uint32_t)p->water_fill_timeout_sec * tps;
+    b->drain_ticks[i] = (uint32_t)p->drain_timeout_sec * tps;
+    b->soap_ticks[i] = (uint32_t)p->soap_time_sec * tps;
+    b->wash_ticks[i] = (uint32_t)p->wash_agitate_time_sec * tps;
+    b->rinse_ticks[i] = (uint32_t)p->rinse_agitate_time_sec * tps;
+    b->run_ticks[i] = (uint32_t)p->agitate_run_ms * tps / 1000;
+    b->half_ticks[i] = half;
+    b->spin_ticks[i] = 7 * tps;
+    b->target_level[i] = p->target_water_level;
+    b->wash_count[i] = p->wash_count;
+    b->rinse_count[i] = p->rinse_count;
+    b->spin_enable[i] = p->spin_enable;
+    return true;
+}
+
+void wm_batch_get(const wm_batch_t *b, size_t i, wm_controller_t *c) {
+    c->state = (wm_state_t)b->state[i];
+    c->prev_state = (wm_state_t)b->prev_state[i];
+    c->state_time = (uint16_t)b->state_time[i];
+    c->error_code = (wm_error_t)b->error[i];
+    c->is_wash_phase = b->is_wash[i] != 0;
+    c->wash_done = (uint8_t)b->wash_done[i];
+    c->rinse_done = (uint8_t)b->rinse_done[i];
+}
+
+void wm_batch_actuators(uint32_t out, wm_actuators_t *a) {
+    a->inlet_valve = (out & WM_OUT_INLET) != 0;
+    a->soap_pump = (out & WM_OUT_SOAP) != 0;
+    a->drain_pump = (out & WM_OUT_DRAIN) != 0;
+    a->motor_dir = (out & WM_OUT_MOTOR_CW)    ? MOTOR_CW
+                   : (out & WM_OUT_MOTOR_CCW) ? MOTOR_CCW
+                                              : MOTOR_STOP;
+    a->buzzer = (wm_buzzer_mode_t)((out >> WM_OUT_BUZZER_SHIFT) & 0x03);
+}
+
+#define LOAD(v, arr)                                                                               \
+    lane_t v;                                                                                      \
+    memcpy(&v, (arr) + i, sizeof(v))
+#define STORE(arr, v) memcpy((arr) + i, &(v), sizeof(v))
+
+/*
+ * Mirrors the classic path of wm_tick; see there for the meaning of each rule. Every rule
+ * is computed for all lanes and applied under its state mask; 'reset' collects the lanes
+ * whose state_time restarts. state_time and the phase counters keep their uint16_t/uint8_t
+ * wrap-around so the results stay bit-identical.
+ */
+WM_BATCH_CLONES
+void wm_tick_batch(wm_batch_t *b) {
+    const lane_t zero = {0};
+    const lane_t one = zero + 1, u8 = zero + 0xFF, u16 = zero + 0xFFFF;
+    const lane_t buzz_start = zero + (BUZZER_START << WM_OUT_BUZZER_SHIFT);
+    const lane_t buzz_finish = zero + (BUZZER_FINISH << WM_OUT_BUZZER_SHIFT);
+    const lane_t buzz_error = zero + (BUZZER_ERROR << WM_OUT_BUZZER_SHIFT);
+    const lane_t o_inlet = zero + WM_OUT_INLET, o_soap = zero + WM_OUT_SOAP;
+    const lane_t o_drain = zero + WM_OUT_DRAIN, o_cw = zero + WM_OUT_MOTOR_CW;
+    const lane_t o_ccw = zero + WM_OUT_MOTOR_CCW;
+    const lane_t o_buzzer = zero + (0x03u << WM_OUT_BUZZER_SHIFT);
+    const lane_t s_start = zero + WM_START, s_fill = zero + WM_FILL, s_soap = zero + WM_SOAP;
+    const lane_t s_agitate = zero + WM_AGITATE, s_drain = zero + WM_DRAIN;
+    const lane_t s_spin = zero + WM_SPIN, s_paused = zero + WM_PAUSED;
+    const lane_t s_complete = zero + WM_COMPLETE, s_error = zero + WM_ERROR;
+    const lane_t e_fill = zero + WM_ERR_TIMEOUT_FILL, e_drain = zero + WM_ERR_TIMEOUT_DRAIN;
+
+    for (size_t i = 0; i < b->stride; i += WM_BATCH_LANES) {
+        LOAD(st, b->state);
+        LOAD(t, b->state_time);
+        LOAD(ph, b->phase);
+        LOAD(err, b->error);
+        LOAD(wash, b->is_wash);
+        LOAD(wd, b->wash_done);
+        LOAD(rd, b->rinse_done);
+        LOAD(level, b->water_level);
+        LOAD(drain_check, b->drain_check);
+
+        lane_t active = ~MASK(st == s_paused);
+        lane_t washing = MASK(wash != zero);
+        lane_t in_fill = MASK(st == s_fill), in_soap = MASK(st == s_soap);
+        lane_t in_agitate = MASK(st == s_agitate), in_drain = MASK(st == s_drain);
+        lane_t in_spin = MASK(st == s_spin), in_start = MASK(st == s_start);
+
+        lane_t t1 = (t + one) & u16;
+        LOAD(half, b->half_ticks);
+        lane_t full = half + half;
+        lane_t ph1 = ph + one;
+        ph1 = SEL(MASK(ph1 >= full), ph1 - full, ph1);
+        ph1 = SEL(MASK(t1 == zero), zero, ph1);
+
+        lane_t ns = st, reset = zero, out = zero;
+
+        /* START */
+        out |= in_start & buzz_start;
+        ns = SEL(in_start, s_fill, ns);
+        reset |= in_start;
+
+        /* FILL */
+        LOAD(target, b->target_level);
+        LOAD(fill_ticks, b->fill_ticks);
+        lane_t filled = in_fill & MASK(level >= target);
+        lane_t fill_timeout = in_fill & ~filled & MASK(t1 >= fill_ticks);
+        out |= in_fill & o_inlet;
+        ns = SEL(filled, SEL(washing, s_soap, s_agitate), ns);
+        ns = SEL(fill_timeout, s_error, ns);
+        err = SEL(fill_timeout, e_fill, err);
+        reset |= filled;
+
+        /* SOAP */
+        LOAD(soap_ticks, b->soap_ticks);
+        lane_t soaped = in_soap & MASK(t1 >= soap_ticks);
+        out |= in_soap & o_soap;
+        ns = SEL(soaped, s_agitate, ns);
+        reset |= soaped;
+
+        /* AGITATE */
+        LOAD(run, b->run_ticks);
+        LOAD(wash_ticks, b->wash_ticks);
+        LOAD(rinse_ticks, b->rinse_ticks);
+        lane_t first_half = MASK(ph1 < half);
+        lane_t cw = first_half & MASK(ph1 < run);
+        lane_t ccw = ~first_half & MASK(ph1 - half < run);
+        lane_t agitated = in_agitate & MASK(t1 >= SEL(washing, wash_ticks, rinse_ticks));
+        out |= in_agitate & ((cw & o_cw) | (ccw & o_ccw));
+        ns = SEL(agitated, s_drain, ns);
+        reset |= agitated;
+
+        /* DRAIN */
+        LOAD(wash_count, b->wash_count);
+        LOAD(rinse_count, b->rinse_count);
+        LOAD(spin_enable, b->spin_enable);
+        LOAD(drain_ticks, b->drain_ticks);
+        lane_t drained = in_drain & MASK(drain_check == zero);
+        lane_t wash_drained = drained & washing, rinse_drained = drained & ~washing;
+        lane_t wd1 = (wd + one) & u8, rd1 = (rd + one) & u8;
+        lane_t after_rinse = SEL(MASK(rd1 < rinse_count), s_fill,
+                                 SEL(MASK(spin_enable != zero), s_spin, s_complete));
+        lane_t drain_timeout = in_drain & ~drained & MASK(t1 >= drain_ticks);
+        out |= in_drain & o_drain;
+        wd = SEL(wash_drained, wd1, wd);
+        rd = SEL(rinse_drained, rd1, rd);
+        wash = SEL(wash_drained & MASK(wd1 >= wash_count), zero, wash);
+        ns = SEL(wash_drained, s_fill, SEL(rinse_drained, after_rinse, ns));
+        ns = SEL(drain_timeout, s_error, ns);
+        err = SEL(drain_timeout, e_drain, err);
+        reset |= drained;
+
+        /* SPIN (no state_time reset on the way to COMPLETE, as in wm_tick) */
+        LOAD(spin_ticks, b->spin_ticks);
+        out |= in_spin & o_cw;
+        ns = SEL(in_spin & MASK(t1 >= spin_ticks), s_complete, ns);
+
+        /* COMPLETE / ERROR */
+        out |= MASK(st == s_complete) & buzz_finish;
+        out |= MASK(st == s_error) & buzz_error;
+
+        /* Safety interlocks, against the new state */
+        lane_t spinning = MASK(ns == s_spin);
+        lane_t allowed = (MASK(ns == s_fill) & o_inlet) | (MASK(ns == s_soap) & o_soap) |
+                         ((MASK(ns == s_drain) | spinning) & o_drain) |
+                         ((MASK(ns == s_agitate) | spinning) & (o_cw | o_ccw)) | o_buzzer;
+        out &= allowed;
+        out &= ~(MASK((out & o_drain) != zero) & o_inlet);
+
+        /* Paused lanes keep everything and output nothing */
+        st = SEL(active, ns, st);
+        t = SEL(active, SEL(reset, zero, t1), t);
+        ph = SEL(active, SEL(reset, zero, ph1), ph);
+        out &= active;
+
+        STORE(b->state, st);
+        STORE(b->state_time, t);
+        STORE(b->phase, ph);
+        STORE(b->error, err);
+        STORE(b->is_wash, wash);
+        STORE(b->wash_done, wd);
+        STORE(b->rinse_done, rd);
+        STORE(b->out, out);
+    }
+}
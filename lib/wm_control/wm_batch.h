@@ -0,0 +1,84 @@
+#ifndef WM_BATCH_H
+#define WM_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wm_control.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Batched controller stepping for fleet simulation.
+ *
+ * N classic (wm_program_t driven) controllers are stored as one array per field, with the
+ * program pre-scaled to ticks. wm_tick_batch advances all of them by one tick with the same
+ * transitions and interlocks as wm_tick, but branch-free across lanes: every state's rule is
+ * evaluated as a mask and blended, so GCC vector code steps 8 machines per operation
+ * (SSE2, or AVX2 when the CPU has it). Other compilers and AVR get a one-lane scalar build
+ * of the same code (also forced with -DWM_BATCH_SCALAR).
+ *
+ * Sensors go in through water_level/drain_check and actuators come out as one bitmask per
+ * machine. Step programs (wm_load_code) are not supported, and neither are the usage
+ * counters (wm_usage_t); callers that need them can add up the bitmasks.
+ */
+
+/* Actuator bits in wm_batch_t.out */
+#define WM_OUT_INLET (1u << 0)
+#define WM_OUT_SOAP (1u << 1)
+#define WM_OUT_DRAIN (1u << 2)
+#define WM_OUT_MOTOR_CW (1u << 3)
+#define WM_OUT_MOTOR_CCW (1u << 4)
+#define WM_OUT_BUZZER_SHIFT 5 /* wm_buzzer_mode_t in bits 5-6 */
+
+typedef struct {
+    size_t n;      /* Machines in the batch */
+    size_t stride; /* Allocated lanes (n rounded up to the vector width) */
+
+    /* Controller state (wm_controller_t fields) */
+    uint32_t *state, *prev_state, *state_time, *error;
+    uint32_t *is_wash, *wash_done, *rinse_done;
+    uint32_t *phase; /* state_time % agitation cycle, kept incrementally */
+
+    /* Program, in ticks */
+    uint32_t *fill_ticks, *drain_ticks, *soap_ticks, *wash_ticks, *rinse_ticks;
+    uint32_t *run_ticks, *half_ticks, *spin_ticks;
+    uint32_t *target_level, *wash_count, *rinse_count, *spin_enable;
+
+    /* Inputs, set before each tick */
+    uint32_t *water_level, *drain_check;
+
+    /* Outputs of the last tick (WM_OUT_* bits) */
+    uint32_t *out;
+
+    void *mem;
+} wm_batch_t;
+
+/* Allocate a batch of n idle machines. Returns false if out of memory. */
+bool wm_batch_init(wm_batch_t *b, size_t n);
+void wm_batch_free(wm_batch_t *b);
+
+/**
+ * Copy a controller into lane i (program and state).
+ * Returns false for controllers wm_tick_batch cannot run: step programs, and agitation
+ * windows shorter than one tick (wm_tick would divide by zero).
+ */
+bool wm_batch_set(wm_batch_t *b, size_t i, const wm_controller_t *c);
+
+/* Copy lane i's state back into the controller it was set from */
+void wm_batch_get(const wm_batch_t *b, size_t i, wm_controller_t *c);
+
+/* Advance every machine by one tick */
+void wm_tick_batch(wm_batch_t *b);
+
+/* Expand an output bitmask into wm_actuators_t */
+void wm_batch_actuators(uint32_t out, wm_actuators_t *a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_BATCH_H
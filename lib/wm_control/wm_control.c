@@ -1,4 +1,32 @@
 #include "wm_control.h"
+#include "wm_coverage.h"
+
+#ifdef WM_COVERAGE
+static void cov_count(wm_controller_t *c, wm_state_t from, wm_cov_reason_t why) {
+    if (c->cov && c->cov->trans[from][c->state][why] != UINT32_MAX)
+        c->cov->trans[from][c->state][why]++;
+}
+
+static void cov_override(wm_controller_t *c, wm_cov_interlock_t lock) {
+    if (c->cov && c->cov->override[c->state][lock] != UINT32_MAX)
+        c->cov->override[c->state][lock]++;
+}
+
+/* Transition reason of a wm_tick, from where it went */
+static wm_cov_reason_t cov_tick_reason(wm_state_t from, wm_state_t to) {
+    if (to == WM_ERROR)
+        return WM_COV_TIMEOUT;
+    return from == WM_FILL ? WM_COV_LEVEL : from == WM_DRAIN ? WM_COV_DRAINED : WM_COV_TIMER;
+}
+
+#define COV_FROM(c) wm_state_t cov_from = (c)->state
+#define COV_COUNT(c, why) cov_count((c), cov_from, (why))
+#define COV_OVERRIDE(c, lock) cov_override((c), (lock))
+#else
+#define COV_FROM(c) ((void)0)
+#define COV_COUNT(c, why) ((void)0)
+#define COV_OVERRIDE(c, lock) ((void)0)
+#endif
 
 void wm_init(wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a, wm_program_t program) {
     *c = (wm_controller_t){0};
@@ -7,37 +35,324 @@ void wm_init(wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a, wm_program_
     c->state = WM_IDLE;
     c->program = program;
     c->error_code = WM_ERR_NONE;
+    WM_COV_ATTACH(c, wm_cov_default);
 
     /* Validation */
     if (program.water_fill_timeout_sec == 0 || program.drain_timeout_sec == 0 ||
         program.ticks_per_second == 0) {
+        COV_FROM(c);
         c->state = WM_ERROR;
         c->error_code = WM_ERR_INVALID_PROGRAM;
+        COV_COUNT(c, WM_COV_INVALID);
     }
 
     s->water_level = WATER_EMPTY;
     s->drain_check = false;
 }
 
+/* ---------- Step Programs ---------- */
+
+/* Operand bytes following each opcode */
+static const uint8_t op_operands[WM_OP_COUNT] = {
+    [WM_OP_END] = 0,  [WM_OP_FILL] = 1, [WM_OP_SOAP] = 2,  [WM_OP_AGITATE] = 4, [WM_OP_DRAIN] = 0,
+    [WM_OP_SPIN] = 2, [WM_OP_SOAK] = 2, [WM_OP_RINSE] = 0, [WM_OP_LOOP] = 2,
+};
+
+static uint16_t rd16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+bool wm_code_valid(const uint8_t *code, uint8_t len, uint8_t ticks_per_second) {
+    if (len > WM_CODE_MAX)
+        return false;
+
+    uint8_t last_loop_end = 0; /* Loop bodies may not contain another LOOP */
+    uint8_t pc = 0;
+    while (pc < len) {
+        uint8_t op = code[pc];
+        if (op >= WM_OP_COUNT || pc + 1 + op_operands[op] > len)
+            return false;
+
+        switch (op) {
+        case WM_OP_FILL:
+            if (code[pc + 1] > WATER_HIGH)
+                return false;
+            break;
+        case WM_OP_AGITATE:
+            /* Half cycle must last at least one tick */
+            if ((uint16_t)code[pc + 2] * ticks_per_second < 10)
+                return false;
+            break;
+        case WM_OP_LOOP: {
+            uint8_t back = code[pc + 2];
+            if (code[pc + 1] == 0 || back == 0 || back > pc || pc - back < last_loop_end)
+                return false;
+            /* The loop target must be an opcode boundary */
+            uint8_t q = 0;
+            while (q < pc - back)
+                q += 1 + op_operands[code[q]];
+            if (q != pc - back)
+                return false;
+            /* The body must hold a timed step, or one fetch would run every pass at once */
+            bool timed = false;
+            for (; q < pc; q += 1 + op_operands[code[q]])
+                timed |= code[q] >= WM_OP_FILL && code[q] <= WM_OP_SOAK;
+            if (!timed)
+                return false;
+            last_loop_end = (uint8_t)(pc + 3);
+            break;
+        }
+        default:
+            break;
+        }
+        pc += 1 + op_operands[op];
+    }
+    return true;
+}
+
+bool wm_load_code(wm_controller_t *c, const uint8_t *code, uint8_t len) {
+    if (len == 0 || !wm_code_valid(code, len, c->program.ticks_per_second)) {
+        COV_FROM(c);
+        c->state = WM_ERROR;
+        c->error_code = WM_ERR_INVALID_PROGRAM;
+        COV_COUNT(c, WM_COV_INVALID);
+        return false;
+    }
+    for (uint8_t i = 0; i < len; i++)
+        c->code[i] = code[i];
+    c->code_len = len;
+    c->pc = 0;
+    c->loop_iter = 0;
+    return true;
+}
+
+/*
+ * Fetch and enter the next timed step. RINSE and LOOP are consumed on the way. Loops do
+ * not nest and every loop body holds a timed step (wm_code_valid), so a fetch costs a
+ * bounded handful of iterations regardless of program length.
+ */
+static void wm_next_step(wm_controller_t *c) {
+    c->state_time = 0;
+
+    for (;;) {
+        if (c->pc >= c->code_len) {
+            c->state = WM_COMPLETE;
+            return;
+        }
+
+        const uint8_t *op = &c->code[c->pc];
+        c->pc += 1 + op_operands[op[0]];
+
+        switch (op[0]) {
+        case WM_OP_FILL:
+            c->program.target_water_level = (water_level_t)op[1];
+            c->state = WM_FILL;
+            return;
+        case WM_OP_SOAP:
+            c->program.soap_time_sec = rd16(op + 1);
+            c->state = WM_SOAP;
+            return;
+        case WM_OP_AGITATE:
+            c->program.agitate_run_ms = (uint16_t)op[1] * 100;
+            c->program.agitate_cycle_ms = (uint16_t)op[2] * 100;
+            if (c->is_wash_phase)
+                c->program.wash_agitate_time_sec = rd16(op + 3);
+            else
+                c->program.rinse_agitate_time_sec = rd16(op + 3);
+            c->state = WM_AGITATE;
+            return;
+        case WM_OP_DRAIN:
+            c->state = WM_DRAIN;
+            return;
+        case WM_OP_SPIN:
+            c->step_sec = rd16(op + 1);
+            c->state = WM_SPIN;
+            return;
+        case WM_OP_SOAK:
+            c->step_sec = rd16(op + 1);
+            c->state = WM_SOAK;
+            return;
+        case WM_OP_RINSE:
+            c->is_wash_phase = false;
+            break;
+        case WM_OP_LOOP:
+            if (++c->loop_iter < op[1]) {
+                c->pc = (uint8_t)(c->pc - 3 - op[2]);
+            } else {
+                c->loop_iter = 0;
+            }
+            break;
+        default: /* WM_OP_END */
+            c->pc = c->code_len;
+            c->state = WM_COMPLETE;
+            return;
+        }
+    }
+}
+
+/* Nominal duration of one step, using timeouts as estimates for FILL/DRAIN */
+static uint32_t wm_step_sec(const wm_controller_t *c, const uint8_t *op) {
+    switch (op[0]) {
+    case WM_OP_FILL:
+        return c->program.water_fill_timeout_sec;
+    case WM_OP_SOAP:
+    case WM_OP_SPIN:
+    case WM_OP_SOAK:
+        return rd16(op + 1);
+    case WM_OP_AGITATE:
+        return rd16(op + 3);
+    case WM_OP_DRAIN:
+        return c->program.drain_timeout_sec;
+    default:
+        return 0;
+    }
+}
+
+static uint32_t wm_code_span_sec(const wm_controller_t *c, uint8_t from, uint8_t to) {
+    uint32_t total = 0;
+    while (from < to) {
+        total += wm_step_sec(c, &c->code[from]);
+        from += 1 + op_operands[c->code[from]];
+    }
+    return total;
+}
+
+static uint16_t wm_code_time_remaining_sec(wm_controller_t *c) {
+    wm_state_t st = (c->state == WM_PAUSED) ? c->prev_state : c->state;
+    uint32_t target = 0;
+
+    switch (st) {
+    case WM_FILL:
+        target = c->program.water_fill_timeout_sec;
+        break;
+    case WM_SOAP:
+        target = c->program.soap_time_sec;
+        break;
+    case WM_AGITATE:
+        target =
+            c->is_wash_phase ? c->program.wash_agitate_time_sec : c->program.rinse_agitate_time_sec;
+        break;
+    case WM_DRAIN:
+        target = c->program.drain_timeout_sec;
+        break;
+    case WM_SPIN:
+    case WM_SOAK:
+        target = c->step_sec;
+        break;
+    default:
+        break;
+    }
+
+    uint32_t elapsed = c->state_time / c->program.ticks_per_second;
+    uint32_t total = (elapsed < target) ? target - elapsed : 0;
+
+    /* Remaining steps; a loop body adds one pass per remaining iteration */
+    uint8_t start = c->pc;
+    uint8_t pc = start;
+    while (pc < c->code_len && c->code[pc] != WM_OP_END) {
+        const uint8_t *op = &c->code[pc];
+        if (op[0] == WM_OP_LOOP) {
+            uint8_t body = (uint8_t)(pc - op[2]);
+            uint32_t passes = (start > body) ? (uint32_t)op[1] - 1 - c->loop_iter : op[1] - 1u;
+            total += passes * wm_code_span_sec(c, body, pc);
+        } else {
+            total += wm_step_sec(c, op);
+        }
+        pc += 1 + op_operands[op[0]];
+    }
+
+    return (uint16_t)total;
+}
+
+uint8_t wm_compile_program(const wm_program_t *p, uint8_t *code, uint8_t max) {
+    uint8_t buf[WM_CODE_MAX];
+    uint8_t n = 0;
+
+    if (p->agitate_run_ms % 100 || p->agitate_cycle_ms % 100 || p->agitate_run_ms / 100 > 255 ||
+        p->agitate_cycle_ms / 100 > 255)
+        return 0;
+    uint8_t run_ds = (uint8_t)(p->agitate_run_ms / 100);
+    uint8_t cycle_ds = (uint8_t)(p->agitate_cycle_ms / 100);
+
+    /* The classic cycle always runs at least one wash and one rinse */
+    uint8_t washes = p->wash_count ? p->wash_count : 1;
+    uint8_t rinses = p->rinse_count ? p->rinse_count : 1;
+
+    /* Wash: FILL, SOAP, AGITATE, DRAIN (x washes) */
+    uint8_t body = n;
+    buf[n++] = WM_OP_FILL;
+    buf[n++] = (uint8_t)p->target_water_level;
+    buf[n++] = WM_OP_SOAP;
+    buf[n++] = (uint8_t)p->soap_time_sec;
+    buf[n++] = (uint8_t)(p->soap_time_sec >> 8);
+    buf[n++] = WM_OP_AGITATE;
+    buf[n++] = run_ds;
+    buf[n++] = cycle_ds;
+    buf[n++] = (uint8_t)p->wash_agitate_time_sec;
+    buf[n++] = (uint8_t)(p->wash_agitate_time_sec >> 8);
+    buf[n++] = WM_OP_DRAIN;
+    if (washes > 1) {
+        buf[n] = WM_OP_LOOP;
+        buf[n + 1] = washes;
+        buf[n + 2] = (uint8_t)(n - body);
+        n += 3;
+    }
+
+    /* Rinse: FILL, AGITATE, DRAIN (x rinses) */
+    buf[n++] = WM_OP_RINSE;
+    body = n;
+    buf[n++] = WM_OP_FILL;
+    buf[n++] = (uint8_t)p->target_water_level;
+    buf[n++] = WM_OP_AGITATE;
+    buf[n++] = run_ds;
+    buf[n++] = cycle_ds;
+    buf[n++] = (uint8_t)p->rinse_agitate_time_sec;
+    buf[n++] = (uint8_t)(p->rinse_agitate_time_sec >> 8);
+    buf[n++] = WM_OP_DRAIN;
+    if (rinses > 1) {
+        buf[n] = WM_OP_LOOP;
+        buf[n + 1] = rinses;
+        buf[n + 2] = (uint8_t)(n - body);
+        n += 3;
+    }
+
+    if (p->spin_enable) {
+        buf[n++] = WM_OP_SPIN;
+        buf[n++] = 7; /* Fixed spin time of the classic cycle */
+        buf[n++] = 0;
+    }
+    buf[n++] = WM_OP_END;
+
+    if (n > max)
+        return 0;
+    for (uint8_t i = 0; i < n; i++)
+        code[i] = buf[i];
+    return n;
+}
+
 void wm_start(wm_controller_t *c) {
+    COV_FROM(c);
     if (c->state == WM_IDLE) {
         c->is_wash_phase = true;
         c->state = WM_START;
         c->state_time = 0;
     }
+    COV_COUNT(c, WM_COV_START);
 }
 
 void wm_pause(wm_controller_t *c) {
+    COV_FROM(c);
     if (c->state != WM_PAUSED && c->state != WM_COMPLETE) {
         c->prev_state = c->state;
         c->state = WM_PAUSED;
     }
+    COV_COUNT(c, WM_COV_PAUSE);
 }
 
 void wm_resume(wm_controller_t *c) {
+    COV_FROM(c);
     if (c->state == WM_PAUSED) {
         c->state = c->prev_state;
     }
+    COV_COUNT(c, WM_COV_RESUME);
 }
 
 void wm_abort(wm_controller_t *c) {
@@ -46,7 +361,9 @@ void wm_abort(wm_controller_t *c) {
      * If there is water (or we are in any active state), force a transition to DRAIN.
      * Configure the controller so that after DRAIN it goes to COMPLETE/IDLE.
      */
+    COV_FROM(c);
     if (c->state == WM_IDLE || c->state == WM_COMPLETE || c->state == WM_ERROR) {
+        COV_COUNT(c, WM_COV_ABORT);
         return;
     }
 
@@ -54,9 +371,11 @@ void wm_abort(wm_controller_t *c) {
     c->rinse_done = c->program.rinse_count;
     c->wash_done = c->program.wash_count;
     c->program.spin_enable = false; /* Don't spin after aborting */
+    c->pc = c->code_len;            /* Step programs: nothing left after the drain */
 
     c->state = WM_DRAIN;
     c->state_time = 0;
+    COV_COUNT(c, WM_COV_ABORT);
 }
 
 uint16_t wm_get_time_remaining_sec(wm_controller_t *c) {
@@ -64,6 +383,9 @@ uint16_t wm_get_time_remaining_sec(wm_controller_t *c) {
         return 0;
     }
 
+    if (c->code_len)
+        return wm_code_time_remaining_sec(c);
+
     uint32_t total_sec = 0;
     uint32_t current_state_target = 0;
 
@@ -142,13 +464,44 @@ uint16_t wm_get_time_remaining_sec(wm_controller_t *c) {
     return (uint16_t)total_sec;
 }
 
+/* Add one tick of the outputs being driven to the cycle's usage */
+static void wm_account(wm_controller_t *c, const wm_actuators_t *a) {
+    wm_usage_t *u = &c->usage;
+    uint8_t phase = c->is_wash_phase ? WM_PHASE_WASH : WM_PHASE_RINSE;
+    uint8_t relays = (uint8_t)((a->motor_dir != MOTOR_STOP) << WM_RELAY_MOTOR |
+                               (a->motor_dir == MOTOR_CCW) << WM_RELAY_DIR |
+                               a->inlet_valve << WM_RELAY_INLET | a->drain_pump << WM_RELAY_DRAIN |
+                               a->soap_pump << WM_RELAY_SOAP);
+
+    if (relays != u->relays) {
+        uint8_t changed = relays ^ u->relays;
+        for (uint8_t r = 0; r < WM_RELAYS; r++)
+            if (changed >> r & 1)
+                u->switches[r]++;
+        u->relays = relays;
+    }
+    if (!relays)
+        return;
+    if (a->motor_dir != MOTOR_STOP)
+        u->motor_ticks[phase][a->motor_dir == MOTOR_CCW]++;
+    if (a->inlet_valve)
+        u->inlet_ticks[phase]++;
+    if (a->drain_pump)
+        u->drain_ticks[phase]++;
+    if (a->soap_pump)
+        u->soap_ticks[phase]++;
+}
+
 void wm_tick(wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a) {
     /* Reset all outputs every tick */
     *a = (wm_actuators_t){0};
 
-    if (c->state == WM_PAUSED)
+    if (c->state == WM_PAUSED) {
+        wm_account(c, a);
         return;
+    }
 
+    COV_FROM(c);
     c->state_time++;
 
     /*
@@ -165,8 +518,12 @@ void wm_tick(wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a) {
 
     case WM_START:
         a->buzzer = BUZZER_START;
-        c->state = WM_FILL;
-        c->state_time = 0;
+        if (c->code_len) {
+            wm_next_step(c);
+        } else {
+            c->state = WM_FILL;
+            c->state_time = 0;
+        }
         break;
 
     case WM_FILL:
@@ -174,8 +531,12 @@ void wm_tick(wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a) {
 
         /* Exit FILL state once target water level is achieved */
         if (s->water_level >= c->program.target_water_level) {
-            c->state = c->is_wash_phase ? WM_SOAP : WM_AGITATE;
-            c->state_time = 0;
+            if (c->code_len) {
+                wm_next_step(c);
+            } else {
+                c->state = c->is_wash_phase ? WM_SOAP : WM_AGITATE;
+                c->state_time = 0;
+            }
         } else if (c->state_time >=
                    (uint32_t)c->program.water_fill_timeout_sec * c->program.ticks_per_second) {
             /* Error if filling takes too long */
@@ -188,8 +549,12 @@ void wm_tick(wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a) {
         a->soap_pump = true;
         /* Only inject soap during the soap phase of the wash */
         if (c->state_time >= (uint32_t)c->program.soap_time_sec * c->program.ticks_per_second) {
-            c->state = WM_AGITATE;
-            c->state_time = 0;
+            if (c->code_len) {
+                wm_next_step(c);
+            } else {
+                c->state = WM_AGITATE;
+                c->state_time = 0;
+            }
         }
         break;
 
@@ -222,16 +587,33 @@ void wm_tick(wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a) {
                                 c->program.ticks_per_second;
 
         if (c->state_time >= target_ticks) {
-            c->state = WM_DRAIN;
-            c->state_time = 0;
+            if (c->code_len) {
+                wm_next_step(c);
+            } else {
+                c->state = WM_DRAIN;
+                c->state_time = 0;
+            }
         }
         break;
     }
 
+    case WM_SOAK:
+        /* Water stays in the drum; all outputs off */
+        if (c->state_time >= (uint32_t)c->step_sec * c->program.ticks_per_second) {
+            wm_next_step(c);
+        }
+        break;
+
     case WM_DRAIN:
         a->drain_pump = true;
 
-        if (s->drain_check == false) {
+        if (s->drain_check == false && c->code_len) {
+            if (c->is_wash_phase)
+                c->wash_done++;
+            else
+                c->rinse_done++;
+            wm_next_step(c);
+        } else if (s->drain_check == false) {
 
             if (c->is_wash_phase && ++c->wash_done < c->program.wash_count) {
                 c->state = WM_FILL;
@@ -256,8 +638,11 @@ void wm_tick(wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a) {
 
     case WM_SPIN:
         a->motor_dir = MOTOR_CW;
-        /* Spin fixed duration: 7 seconds */
-        if (c->state_time >= (uint32_t)7 * c->program.ticks_per_second) {
+        if (c->code_len) {
+            if (c->state_time >= (uint32_t)c->step_sec * c->program.ticks_per_second)
+                wm_next_step(c);
+        } else if (c->state_time >= (uint32_t)7 * c->program.ticks_per_second) {
+            /* Spin fixed duration: 7 seconds */
             c->state = WM_COMPLETE;
         }
         break;
@@ -274,32 +659,47 @@ void wm_tick(wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a) {
         break;
     }
 
+#ifdef WM_COVERAGE
+    /* A transition resets state_time (a step may re-enter its state); IDLE, COMPLETE and
+     * ERROR never leave on a tick, so their state_time may wrap */
+    if (c->state != cov_from || (c->state_time == 0 && cov_from != WM_IDLE &&
+                                 cov_from != WM_COMPLETE && cov_from != WM_ERROR))
+        COV_COUNT(c, cov_tick_reason(cov_from, c->state));
+#endif
+
     /* Safety Interlocks (Robust Output Enforcement) */
 
     /* 1. Inlet Valve: Only allowed in FILL state */
     if (c->state != WM_FILL && a->inlet_valve) {
         a->inlet_valve = false;
+        COV_OVERRIDE(c, WM_COV_INLET);
     }
 
     /* 2. Soap Pump: Only allowed in SOAP state */
     if (c->state != WM_SOAP && a->soap_pump) {
         a->soap_pump = false;
+        COV_OVERRIDE(c, WM_COV_SOAP);
     }
 
     /* 3. Drain Pump: Allowed in DRAIN and SPIN states */
     if (c->state != WM_DRAIN && c->state != WM_SPIN && a->drain_pump) {
         a->drain_pump = false;
+        COV_OVERRIDE(c, WM_COV_DRAIN);
     }
 
     /* 4. Motor: Only allowed in AGITATE and SPIN states */
     if (c->state != WM_AGITATE && c->state != WM_SPIN && a->motor_dir != MOTOR_STOP) {
         a->motor_dir = MOTOR_STOP;
+        COV_OVERRIDE(c, WM_COV_MOTOR);
     }
 
     /* 5. Mutual Exclusion: Inlet and Drain cannot be on together */
     if (a->inlet_valve && a->drain_pump) {
         a->inlet_valve = false;
+        COV_OVERRIDE(c, WM_COV_INLET_DRAIN);
     }
+
+    wm_account(c, a);
 }
 
 const char *wm_state_str(wm_state_t s) {
@@ -314,6 +714,8 @@ const char *wm_state_str(wm_state_t s) {
         return "SOAP";
     case WM_AGITATE:
         return "AGITATE";
+    case WM_SOAK:
+        return "SOAK";
     case WM_DRAIN:
         return "DRAIN";
     case WM_SPIN:
@@ -46,6 +46,40 @@ typedef struct {
     uint8_t ticks_per_second;         /* Tick frequency (e.g., 10 for 100ms) */
 } wm_program_t;
 
+/* ---------- Step Programs (bytecode) ---------- */
+/*
+ * A program can instead be given as a list of steps, interpreted by wm_tick.
+ * Each step is an opcode byte followed by its operands (16-bit values little-endian):
+ *
+ *   FILL     level                     Fill to water_level_t 'level'
+ *   SOAP     sec16                     Inject soap
+ *   AGITATE  run_ds cycle_ds sec16     Agitate; run/half-cycle in deciseconds
+ *   DRAIN                              Drain until drain_check clears
+ *   SPIN     sec16                     Spin
+ *   SOAK     sec16                     Hold water with the motor off
+ *   RINSE                              Following steps belong to the rinse phase
+ *   LOOP     count back                Run the 'back' bytes before this op 'count' times
+ *   END                                Program finished (also implied past the last byte)
+ *
+ * Loops cannot be nested, and a loop body must contain a timed step (FILL to SOAK).
+ * wm_program_t still supplies the fill/drain timeouts and the tick rate; its step fields
+ * are overwritten as steps are fetched.
+ */
+typedef enum {
+    WM_OP_END = 0,
+    WM_OP_FILL,
+    WM_OP_SOAP,
+    WM_OP_AGITATE,
+    WM_OP_DRAIN,
+    WM_OP_SPIN,
+    WM_OP_SOAK,
+    WM_OP_RINSE,
+    WM_OP_LOOP,
+    WM_OP_COUNT
+} wm_op_t;
+
+#define WM_CODE_MAX 48 /* Largest step program in bytes */
+
 /* ---------- States ---------- */
 /* Main state machine stages */
 typedef enum {
@@ -54,6 +88,7 @@ typedef enum {
     WM_FILL,     /* Filling water until HIGH level reached */
     WM_SOAP,     /* Wash phase: injecting soap */
     WM_AGITATE,  /* Wash/Rinse phase: alternating motor rotation */
+    WM_SOAK,     /* Step programs: water held in the drum, motor off */
     WM_DRAIN,    /* Draining water until EMPTY level reached */
     WM_SPIN,     /* High speed rotation to dry clothes */
     WM_PAUSED,   /* User paused the timer */
@@ -68,6 +103,34 @@ typedef enum {
     WM_ERR_INVALID_PROGRAM
 } wm_error_t;
 
+/* ---------- Usage Accounting ---------- */
+/* Relays behind the outputs: the motor has a power relay and a direction relay (on: CCW) */
+typedef enum {
+    WM_RELAY_MOTOR,
+    WM_RELAY_DIR,
+    WM_RELAY_INLET,
+    WM_RELAY_DRAIN,
+    WM_RELAY_SOAP,
+    WM_RELAYS
+} wm_relay_t;
+
+/* Phase on-times are booked to, as is_wash_phase: rinse covers the spin and abort drains */
+typedef enum { WM_PHASE_WASH, WM_PHASE_RINSE, WM_PHASES } wm_phase_t;
+
+/*
+ * Output on-times in ticks and relay switch counts of the current cycle. wm_tick adds up
+ * the outputs it drives (after the interlocks), so the totals are final once the cycle
+ * reaches COMPLETE or ERROR. wm_init clears them.
+ */
+typedef struct {
+    uint32_t motor_ticks[WM_PHASES][2]; /* [phase][0: CW, 1: CCW] */
+    uint32_t inlet_ticks[WM_PHASES];
+    uint32_t drain_ticks[WM_PHASES];
+    uint32_t soap_ticks[WM_PHASES];
+    uint16_t switches[WM_RELAYS]; /* Off-to-on and on-to-off changes */
+    uint8_t relays;               /* Relay states after the last tick, bit per wm_relay_t */
+} wm_usage_t;
+
 /* ---------- Controller ---------- */
 typedef struct {
     wm_state_t state;
@@ -80,11 +143,40 @@ typedef struct {
 
     wm_program_t program;
     wm_error_t error_code;
+
+    /* Step program (code_len == 0: classic wm_program_t driven cycle) */
+    uint8_t code[WM_CODE_MAX];
+    uint8_t code_len;
+    uint8_t pc;         /* Offset of the next step to fetch */
+    uint8_t loop_iter;  /* Completed passes of the active LOOP */
+    uint16_t step_sec;  /* Duration of the current SPIN/SOAK step */
+
+    wm_usage_t usage; /* Output time and relay wear of the current cycle */
+
+#ifdef WM_COVERAGE
+    struct wm_cov *cov; /* Transition counters (wm_coverage.h); NULL: not counted */
+#endif
 } wm_controller_t;
 
 /* ---------- API ---------- */
 void wm_init(wm_controller_t *ctrl, wm_sensors_t *sens, wm_actuators_t *act, wm_program_t program);
 
+/**
+ * Load a step program (after wm_init, before wm_start).
+ * Returns false and enters WM_ERROR/WM_ERR_INVALID_PROGRAM if the code is malformed.
+ */
+bool wm_load_code(wm_controller_t *ctrl, const uint8_t *code, uint8_t len);
+
+/* Check a step program against the tick rate it will run at */
+bool wm_code_valid(const uint8_t *code, uint8_t len, uint8_t ticks_per_second);
+
+/**
+ * Translate a classic program into the equivalent step program.
+ * Returns the code length, or 0 if it does not fit in 'max' bytes or cannot be expressed
+ * (agitation times must be whole deciseconds).
+ */
+uint8_t wm_compile_program(const wm_program_t *program, uint8_t *code, uint8_t max);
+
 void wm_start(wm_controller_t *ctrl);
 void wm_pause(wm_controller_t *ctrl);
 void wm_resume(wm_controller_t *ctrl);
@@ -0,0 +1,170 @@
+#include "wm_coverage.h"
+
+#ifdef WM_COVERAGE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COV_DEFAULT_PATH "build/coverage.txt"
+
+wm_cov_t *wm_cov_default;
+
+static const char *const reason_names[WM_COV_REASONS] = {
+    "start", "pause", "resume", "abort", "level", "timer", "drained", "timeout", "invalid"};
+
+static const char *const interlock_names[WM_COV_INTERLOCKS] = {"inlet", "soap", "drain", "motor",
+                                                               "inlet+drain"};
+
+void wm_cov_reset(wm_cov_t *cov) { memset(cov, 0, sizeof(*cov)); }
+
+static void add_sat(uint32_t *dst, uint32_t v) {
+    *dst = (*dst > UINT32_MAX - v) ? UINT32_MAX : *dst + v;
+}
+
+void wm_cov_merge(wm_cov_t *dst, const wm_cov_t *src) {
+    for (int f = 0; f < WM_COV_STATES; f++) {
+        for (int t = 0; t < WM_COV_STATES; t++)
+            for (int r = 0; r < WM_COV_REASONS; r++)
+                add_sat(&dst->trans[f][t][r], src->trans[f][t][r]);
+        for (int i = 0; i < WM_COV_INTERLOCKS; i++)
+            add_sat(&dst->override[f][i], src->override[f][i]);
+    }
+}
+
+/* States a step fetch can enter */
+static bool step_target(wm_state_t s) {
+    return s == WM_FILL || s == WM_SOAP || s == WM_AGITATE || s == WM_SOAK || s == WM_DRAIN ||
+           s == WM_SPIN || s == WM_COMPLETE;
+}
+
+bool wm_cov_expected(wm_state_t from, wm_state_t to, wm_cov_reason_t why) {
+    bool pausable = from != WM_PAUSED && from != WM_COMPLETE;
+    bool active = from != WM_IDLE && from != WM_COMPLETE && from != WM_ERROR;
+
+    switch (why) {
+    case WM_COV_START:
+        return from == WM_IDLE ? to == WM_START : to == from;
+    case WM_COV_PAUSE:
+        return pausable ? to == WM_PAUSED : to == from;
+    case WM_COV_RESUME:
+        return from == WM_PAUSED ? to != WM_PAUSED && to != WM_COMPLETE : to == from;
+    case WM_COV_ABORT:
+        return active ? to == WM_DRAIN : to == from;
+    case WM_COV_LEVEL:
+        return from == WM_FILL && step_target(to);
+    case WM_COV_TIMER:
+        return (from == WM_START || from == WM_SOAP || from == WM_AGITATE || from == WM_SPIN ||
+                from == WM_SOAK) &&
+               step_target(to);
+    case WM_COV_DRAINED:
+        return from == WM_DRAIN && step_target(to);
+    case WM_COV_TIMEOUT:
+        return (from == WM_FILL || from == WM_DRAIN) && to == WM_ERROR;
+    case WM_COV_INVALID:
+        return from == WM_IDLE && to == WM_ERROR;
+    default:
+        return false;
+    }
+}
+
+const char *wm_cov_reason_str(wm_cov_reason_t why) {
+    return (unsigned)why < WM_COV_REASONS ? reason_names[why] : "?";
+}
+
+const char *wm_cov_interlock_str(wm_cov_interlock_t lock) {
+    return (unsigned)lock < WM_COV_INTERLOCKS ? interlock_names[lock] : "?";
+}
+
+/* --- Files --- */
+static int find_state(const char *name) {
+    for (int s = 0; s < WM_COV_STATES; s++)
+        if (strcmp(name, wm_state_str((wm_state_t)s)) == 0)
+            return s;
+    return -1;
+}
+
+static int find_name(const char *name, const char *const *names, int n) {
+    for (int i = 0; i < n; i++)
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    return -1;
+}
+
+static bool cov_read(FILE *f, wm_cov_t *cov) {
+    char line[128], a[32], b[32], c[32];
+    unsigned long n;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%31s %31s %31s %lu", a, b, c, &n) != 4)
+            return false;
+        int from = find_state(b);
+        if (strcmp(a, "override") == 0) {
+            int lock = find_name(c, interlock_names, WM_COV_INTERLOCKS);
+            if (from < 0 || lock < 0)
+                return false;
+            add_sat(&cov->override[from][lock], (uint32_t)n);
+            continue;
+        }
+        int to = from;
+        from = find_state(a);
+        int why = find_name(c, reason_names, WM_COV_REASONS);
+        if (from < 0 || to < 0 || why < 0)
+            return false;
+        add_sat(&cov->trans[from][to][why], (uint32_t)n);
+    }
+    return !ferror(f);
+}
+
+bool wm_cov_load(const char *path, wm_cov_t *cov) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    bool ok = cov_read(f, cov);
+    fclose(f);
+    return ok;
+}
+
+bool wm_cov_save(const char *path, const wm_cov_t *cov) {
+    wm_cov_t *sum = malloc(sizeof(*sum));
+    if (!sum)
+        return false;
+    *sum = *cov;
+    FILE *f = fopen(path, "r");
+    bool ok = f ? cov_read(f, sum) : errno == ENOENT;
+    if (f)
+        fclose(f);
+    if (!ok) {
+        free(sum);
+        return false;
+    }
+
+    f = fopen(path, "w");
+    ok = f != NULL;
+    if (f) {
+        fprintf(f, "# wm_control coverage: FROM TO reason count | override STATE output count\n");
+        for (int s = 0; s < WM_COV_STATES; s++) {
+            const char *from = wm_state_str((wm_state_t)s);
+            for (int t = 0; t < WM_COV_STATES; t++)
+                for (int r = 0; r < WM_COV_REASONS; r++)
+                    if (sum->trans[s][t][r])
+                        fprintf(f, "%s %s %s %lu\n", from, wm_state_str((wm_state_t)t),
+                                reason_names[r], (unsigned long)sum->trans[s][t][r]);
+            for (int i = 0; i < WM_COV_INTERLOCKS; i++)
+                if (sum->override[s][i])
+                    fprintf(f, "override %s %s %lu\n", from, interlock_names[i],
+                            (unsigned long)sum->override[s][i]);
+        }
+        ok = !ferror(f);
+        ok = fclose(f) == 0 && ok;
+    }
+    free(sum);
+    return ok;
+}
+
+const char *wm_cov_path(void) {
+    const char *path = getenv("WM_COV_FILE");
+    return path && *path ? path : COV_DEFAULT_PATH;
+}
+#endif
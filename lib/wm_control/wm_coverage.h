@@ -0,0 +1,88 @@
+#ifndef WM_COVERAGE_H
+#define WM_COVERAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wm_control.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Transition coverage counters for wm_control (host builds).
+ *
+ * Compiled in only with -DWM_COVERAGE; otherwise WM_COV_ATTACH expands to nothing and
+ * wm_controller_t has no counter pointer. A controller with a wm_cov_t attached counts every
+ * transition by (from, to, reason) and every output an interlock had to switch off, by
+ * state. Commands that leave the state alone count too (wm_abort in IDLE is IDLE -> IDLE
+ * "abort"), as do step fetches that re-enter the same state. Counters saturate.
+ *
+ * wm_init attaches wm_cov_default, so a single-threaded program sets that once. Threaded
+ * ones attach a matrix per thread after wm_init (for an App, by setting App.cov, which it
+ * attaches to every controller it starts) and merge them. Files are text, one
+ * "FROM TO reason count" or "override STATE output count" line per non-zero counter, and
+ * wm_cov_save adds to what the file already holds, so counts accumulate across runs.
+ */
+
+typedef enum {
+    WM_COV_START,   /* wm_start */
+    WM_COV_PAUSE,   /* wm_pause */
+    WM_COV_RESUME,  /* wm_resume */
+    WM_COV_ABORT,   /* wm_abort */
+    WM_COV_LEVEL,   /* FILL reached its level */
+    WM_COV_TIMER,   /* START's tick or the step's time ran out */
+    WM_COV_DRAINED, /* drain_check cleared */
+    WM_COV_TIMEOUT, /* Fill or drain timeout */
+    WM_COV_INVALID, /* wm_init or wm_load_code rejected the program */
+    WM_COV_REASONS
+} wm_cov_reason_t;
+
+typedef enum {
+    WM_COV_INLET,       /* Inlet outside FILL */
+    WM_COV_SOAP,        /* Soap pump outside SOAP */
+    WM_COV_DRAIN,       /* Drain pump outside DRAIN/SPIN */
+    WM_COV_MOTOR,       /* Motor outside AGITATE/SPIN */
+    WM_COV_INLET_DRAIN, /* Inlet together with the drain pump */
+    WM_COV_INTERLOCKS
+} wm_cov_interlock_t;
+
+#define WM_COV_STATES (WM_ERROR + 1)
+
+typedef struct wm_cov {
+    uint32_t trans[WM_COV_STATES][WM_COV_STATES][WM_COV_REASONS];
+    uint32_t override[WM_COV_STATES][WM_COV_INTERLOCKS];
+} wm_cov_t;
+
+#ifdef WM_COVERAGE
+extern wm_cov_t *wm_cov_default; /* Attached by wm_init (NULL: none) */
+
+#define WM_COV_ATTACH(ctrl, m) ((ctrl)->cov = (m))
+
+void wm_cov_reset(wm_cov_t *cov);
+void wm_cov_merge(wm_cov_t *dst, const wm_cov_t *src);
+
+/* Whether wm_control can take this transition with some program and inputs */
+bool wm_cov_expected(wm_state_t from, wm_state_t to, wm_cov_reason_t why);
+
+const char *wm_cov_reason_str(wm_cov_reason_t why);
+const char *wm_cov_interlock_str(wm_cov_interlock_t lock);
+
+/* Add the counts of a file to cov. False if it cannot be read or a line is malformed. */
+bool wm_cov_load(const char *path, wm_cov_t *cov);
+
+/* Add cov to the counts already in path (if any) and write the sum back */
+bool wm_cov_save(const char *path, const wm_cov_t *cov);
+
+/* $WM_COV_FILE, or build/coverage.txt */
+const char *wm_cov_path(void);
+#else
+#define WM_COV_ATTACH(ctrl, m) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_COVERAGE_H
@@ -1,6 +1,7 @@
 #include "app.h"
 #include "../include/utils.h"
 #include "hal.h"
+#include "wm_coverage.h"
 
 /*
  * Hardware Abstraction Layer (HAL) for Washing Machine
@@ -9,8 +10,6 @@
  * have been moved to hal.c / hal.h.
  */
 
-typedef enum { UI_STARTUP, UI_RUNNING, UI_ABORT, UI_SLEEP } ui_state_t;
-
 /* Program Parameters */
 static const struct {
     const char *name;
@@ -35,18 +34,19 @@ static const struct {
 } powers[] = {{"Normal", 1600, 5000}, {"Strong", 4000, 5000}};
 static const int num_powers = 2;
 
-/* Initialize all actuator pins via HAL */
-int wm_actuators_init(void) {
-    hal_init();
-    return 0;
-}
+#define APP_TICKS_PER_SECOND 10 /* 100ms resolution */
+
+/* Custom step program in storage: 'W' 'P' len checksum, then len bytes of code */
+#define CUSTOM_ADDR 0
+#define CUSTOM_HDR 4
 
 /* Bridges the logic state (struct) to the physical pins via HAL */
-static int wm_actuators(wm_actuators_t *act) {
+static int wm_actuators(App *app, const wm_actuators_t *act) {
+    hal_t *hal = app->hal;
     bool motor_on = (act->motor_dir != MOTOR_STOP);
 
     /* motorPin is Enable */
-    hal_actuator_write(HAL_ACT_MOTOR_POWER, motor_on);
+    hal_actuator_write(hal, HAL_ACT_MOTOR_POWER, motor_on);
 
     /* Direction Control: CCW if pin is HIGH, CW if pin is LOW (handled by HAL logic primarily,
        but here we pass boolean.
@@ -54,31 +54,30 @@ static int wm_actuators(wm_actuators_t *act) {
        HAL: true -> CCW (HIGH), false -> CW (LOW)
     */
     bool is_ccw = (act->motor_dir == MOTOR_CCW);
-    hal_actuator_write(HAL_ACT_MOTOR_DIR, is_ccw);
+    hal_actuator_write(hal, HAL_ACT_MOTOR_DIR, is_ccw);
 
     /* Actuators */
-    hal_actuator_write(HAL_ACT_INLET, act->inlet_valve);
-    hal_actuator_write(HAL_ACT_DRAIN, act->drain_pump);
-    hal_actuator_write(HAL_ACT_SOAP, act->soap_pump);
+    hal_actuator_write(hal, HAL_ACT_INLET, act->inlet_valve);
+    hal_actuator_write(hal, HAL_ACT_DRAIN, act->drain_pump);
+    hal_actuator_write(hal, HAL_ACT_SOAP, act->soap_pump);
 
     /* Buzzer Control via HAL */
-    static wm_buzzer_mode_t last_buzzer = BUZZER_OFF;
-    if (act->buzzer != BUZZER_OFF && act->buzzer != last_buzzer) {
+    if (act->buzzer != BUZZER_OFF && act->buzzer != app->last_buzzer) {
         switch (act->buzzer) {
         case BUZZER_START:
-            hal_sound_play(HAL_SONG_START);
+            hal_sound_play(hal, HAL_SONG_START);
             break;
         case BUZZER_FINISH:
-            hal_sound_play(HAL_SONG_FINISHED);
+            hal_sound_play(hal, HAL_SONG_FINISHED);
             break;
         case BUZZER_ERROR:
-            hal_sound_play(HAL_SONG_ERROR);
+            hal_sound_play(hal, HAL_SONG_ERROR);
             break;
         default:
             break;
         }
     }
-    last_buzzer = act->buzzer;
+    app->last_buzzer = act->buzzer;
 
     return 0;
 }
@@ -113,101 +112,250 @@ static const char *motor_str(wm_motor_dir_t d) {
     }
 }
 
-/* --- Main Washing Program --- */
+/* Console log, unless this machine's HAL is silenced (headless simulation). ISO C99 needs
+ * at least one argument after fmt. */
+#define APP_LOG(app, fmt, ...)                                                                     \
+    do {                                                                                           \
+        if (hal_log_enabled((app)->hal))                                                           \
+            LOG_PRINTF(fmt, __VA_ARGS__);                                                          \
+    } while (0)
+
+/* Report stack high-water mark and free RAM, if the backend can measure them */
+static void report_memory(App *app) {
+    hal_mem_stats_t mem;
+    if (hal_mem_stats(app->hal, &mem)) {
+        SERIAL_PRINTF("Mem: stack peak %u B | free RAM min %u B, now %u B\n", mem.stack_peak,
+                      mem.free_ram_min, mem.free_ram_now);
+    }
+}
+
+/* Whole seconds of a wash + rinse tick count */
+static unsigned long usage_sec(uint32_t wash, uint32_t rinse, uint32_t tps) {
+    return (unsigned long)((wash + rinse) / tps);
+}
+
+/* Report the finished cycle's output on-times and relay switches */
+static void report_usage(App *app) {
+    const wm_usage_t *u = &app->ctrl.usage;
+    uint32_t tps = app->ctrl.program.ticks_per_second;
+    unsigned switches = 0;
+    for (int r = 0; r < WM_RELAYS; r++)
+        switches += u->switches[r];
+    unsigned long cw =
+        usage_sec(u->motor_ticks[WM_PHASE_WASH][0], u->motor_ticks[WM_PHASE_RINSE][0], tps);
+    unsigned long ccw =
+        usage_sec(u->motor_ticks[WM_PHASE_WASH][1], u->motor_ticks[WM_PHASE_RINSE][1], tps);
+    SERIAL_PRINTF("Usage: motor CW %lu s, CCW %lu s | inlet %lu s | drain %lu s | soap %lu s | "
+                  "%u relay switches\n",
+                  cw, ccw,
+                  usage_sec(u->inlet_ticks[WM_PHASE_WASH], u->inlet_ticks[WM_PHASE_RINSE], tps),
+                  usage_sec(u->drain_ticks[WM_PHASE_WASH], u->drain_ticks[WM_PHASE_RINSE], tps),
+                  usage_sec(u->soap_ticks[WM_PHASE_WASH], u->soap_ticks[WM_PHASE_RINSE], tps),
+                  switches);
+}
 
 /* --- Main Washing Program --- */
 
 /* Helper for non-blocking button edge detection using HAL */
-static bool is_just_pressed(hal_button_t btn) {
+static bool is_just_pressed(App *app, hal_button_t btn) {
     // Map HAL button enum to a simple index for debounce array (0-2)
     int idx = (int)btn;
     if (idx < 0 || idx >= 3)
         return false;
 
-    static uint32_t last_time[3] = {0};
-    static bool last_state[3] = {false, false, false};
-
-    bool state = hal_button_read(btn);
-    uint32_t now = hal_millis();
+    bool state = hal_button_read(app->hal, btn);
+    uint32_t now = hal_millis(app->hal);
 
-    if (state != last_state[idx] && (now - last_time[idx] > 50)) {
-        last_time[idx] = now;
-        last_state[idx] = state;
+    if (state != app->btn_last_state[idx] && (now - app->btn_last_time[idx] > 50)) {
+        app->btn_last_time[idx] = now;
+        app->btn_last_state[idx] = state;
         if (state == true) // Pressed
             return true;
     }
     return false;
 }
 
+/* --- Custom Step Program --- */
+
+static uint8_t code_checksum(const uint8_t *code, uint8_t len) {
+    uint8_t sum = 0xA5;
+    for (uint8_t i = 0; i < len; i++)
+        sum = (uint8_t)((sum << 1 | sum >> 7) ^ code[i]);
+    return sum;
+}
+
+/* Read and verify the stored custom program. Returns its length, 0 if there is none. */
+static uint8_t custom_program_read(App *app, uint8_t *code) {
+    uint8_t hdr[CUSTOM_HDR];
+    hal_storage_read(app->hal, CUSTOM_ADDR, hdr, CUSTOM_HDR);
+    if (hdr[0] != 'W' || hdr[1] != 'P' || hdr[2] == 0 || hdr[2] > WM_CODE_MAX)
+        return 0;
+    hal_storage_read(app->hal, CUSTOM_ADDR + CUSTOM_HDR, code, hdr[2]);
+    if (hdr[3] != code_checksum(code, hdr[2]) ||
+        !wm_code_valid(code, hdr[2], APP_TICKS_PER_SECOND))
+        return 0;
+    return hdr[2];
+}
+
+static int program_count(const App *app) { return num_programs + (app->has_custom ? 1 : 0); }
+
+static const char *program_name(int idx) {
+    return idx < num_programs ? programs[idx].name : "Custom";
+}
+
+static void upload_begin(App *app) {
+    /* Invalidate the stored program first, so a partial upload is never run */
+    const uint8_t erased[2] = {0xFF, 0xFF};
+    hal_storage_write(app->hal, CUSTOM_ADDR, erased, sizeof(erased));
+    app->has_custom = false;
+    app->uploading = true;
+    app->upload_len = 0;
+    app->upload_hi = -1;
+    SERIAL_PRINTF("%s\n", "Upload: send hex bytes, end with '.' or newline");
+}
+
+static void upload_end(App *app) {
+    uint8_t code[WM_CODE_MAX];
+    uint8_t len = app->upload_len;
+    app->uploading = false;
+
+    bool ok = app->upload_hi < 0 && len > 0 && len <= WM_CODE_MAX;
+    if (ok) {
+        hal_storage_read(app->hal, CUSTOM_ADDR + CUSTOM_HDR, code, len);
+        ok = wm_code_valid(code, len, APP_TICKS_PER_SECOND);
+    }
+    if (ok) {
+        /* Header last: it is what marks the program as present */
+        uint8_t hdr[CUSTOM_HDR] = {'W', 'P', len, code_checksum(code, len)};
+        hal_storage_write(app->hal, CUSTOM_ADDR, hdr, CUSTOM_HDR);
+        app->has_custom = true;
+        SERIAL_PRINTF("Upload OK: %u bytes\n", len);
+    } else {
+        SERIAL_PRINTF("%s\n", "Upload FAILED: invalid step program");
+    }
+
+    if (app->sel_program >= program_count(app))
+        app->sel_program = 0;
+}
+
+static void upload_char(App *app, char ch) {
+    int8_t nibble = -1;
+    if (ch >= '0' && ch <= '9')
+        nibble = (int8_t)(ch - '0');
+    else if (ch >= 'a' && ch <= 'f')
+        nibble = (int8_t)(ch - 'a' + 10);
+    else if (ch >= 'A' && ch <= 'F')
+        nibble = (int8_t)(ch - 'A' + 10);
+
+    if (nibble < 0) {
+        /* Separators are ignored; the line ending that followed 'u' does not end it */
+        if (ch == '.' || ((ch == '\n' || ch == '\r') && app->upload_len > 0))
+            upload_end(app);
+        return;
+    }
+    if (app->upload_hi < 0) {
+        app->upload_hi = nibble;
+        return;
+    }
+
+    uint8_t byte = (uint8_t)(app->upload_hi << 4 | nibble);
+    app->upload_hi = -1;
+    if (app->upload_len < WM_CODE_MAX)
+        hal_storage_write(app->hal, CUSTOM_ADDR + CUSTOM_HDR + app->upload_len, &byte, 1);
+    if (app->upload_len <= WM_CODE_MAX)
+        app->upload_len++;
+}
+
 // Global App State
 
-void app_init(App *app) {
-    hal_init();
+void app_init(App *app, hal_t *hal) {
+    app->hal = hal;
+    hal_init(hal);
     app->ui_state = UI_STARTUP;
     app->menu_step = 0;
     app->sel_program = 0;
     app->sel_level = 0;
     app->sel_power = 0;
-    app->last_tick_time = hal_millis();
-
-    LOG_PRINTF("\n%s\n", "=== Washing Machine Menu ===");
-    LOG_PRINTF("Program: %s (B: Next, A: OK)\n", programs[app->sel_program].name);
+    app->last_tick_time = hal_millis(hal);
+    app->last_buzzer = BUZZER_OFF;
+    app->hold_timer = 0;
+    for (int i = 0; i < 3; i++) {
+        app->btn_last_time[i] = 0;
+        app->btn_last_state[i] = false;
+    }
+    fr_init(&app->recorder, 100);
+#ifdef WM_PROFILE
+    prof_reset(&app->prof);
+#endif
+#ifdef WM_COVERAGE
+    app->cov = wm_cov_default;
+#endif
+    uint8_t code[WM_CODE_MAX];
+    app->has_custom = custom_program_read(app, code) > 0;
+    app->uploading = false;
+
+    APP_LOG(app, "\n%s\n", "=== Washing Machine Menu ===");
+    APP_LOG(app, "Program: %s (B: Next, A: OK)\n", program_name(app->sel_program));
 }
 
-void app_loop(App *app) {
-    uint32_t now = hal_millis();
+static void app_loop_body(App *app) {
+    uint32_t now = hal_millis(app->hal);
 
     /* --- Input Handling --- */
-    bool btnA = is_just_pressed(HAL_BTN_A);
-    bool btnB = is_just_pressed(HAL_BTN_B);
-    bool btnC = is_just_pressed(HAL_BTN_C);
+    bool btnA = is_just_pressed(app, HAL_BTN_A);
+    bool btnB = is_just_pressed(app, HAL_BTN_B);
+    bool btnC = is_just_pressed(app, HAL_BTN_C);
+
+    /* Button edges are attached to the next recorded tick */
+    if (app->ui_state == UI_RUNNING || app->ui_state == UI_ABORT) {
+        fr_note_buttons(&app->recorder,
+                        (btnA ? FR_BTN_A : 0) | (btnB ? FR_BTN_B : 0) | (btnC ? FR_BTN_C : 0));
+    }
 
     switch (app->ui_state) {
     case UI_STARTUP:
         if (btnB) {
             if (app->menu_step == 0)
-                app->sel_program = (app->sel_program + 1) % num_programs;
+                app->sel_program = (app->sel_program + 1) % program_count(app);
             else if (app->menu_step == 1)
                 app->sel_level = (app->sel_level + 1) % num_levels;
             else if (app->menu_step == 2)
                 app->sel_power = (app->sel_power + 1) % num_powers;
 
             if (app->menu_step == 0)
-                LOG_PRINTF("Program: %s\n", programs[app->sel_program].name);
+                APP_LOG(app, "Program: %s\n", program_name(app->sel_program));
             else if (app->menu_step == 1)
-                LOG_PRINTF("Water Level: %s\n", levels[app->sel_level].name);
+                APP_LOG(app, "Water Level: %s\n", levels[app->sel_level].name);
             else if (app->menu_step == 2)
-                LOG_PRINTF("Power: %s\n", powers[app->sel_power].name);
+                APP_LOG(app, "Power: %s\n", powers[app->sel_power].name);
         }
         if (btnA) {
             app->menu_step++;
             if (app->menu_step == 1) {
-                LOG_PRINTF("Water Level: %s (B: Next, A: OK)\n", levels[app->sel_level].name);
+                APP_LOG(app, "Water Level: %s (B: Next, A: OK)\n", levels[app->sel_level].name);
             } else if (app->menu_step == 2) {
-                LOG_PRINTF("Power: %s (B: Next, A: OK)\n", powers[app->sel_power].name);
+                APP_LOG(app, "Power: %s (B: Next, A: OK)\n", powers[app->sel_power].name);
             } else {
                 /* All selections done, build program and start */
-                wm_program_t prog = {
-                    .wash_count = 1,
-                    .rinse_count = programs[app->sel_program].rinse_count,
-                    .spin_enable = true,
-                    .soap_time_sec = 20, /* Default soap for wash */
-                    .wash_agitate_time_sec = programs[app->sel_program].wash_min * 60,
-                    .rinse_agitate_time_sec = programs[app->sel_program].rinse_min * 60,
-                    .agitate_run_ms = powers[app->sel_power].run_ms,
-                    .agitate_cycle_ms = powers[app->sel_power].cycle_ms,
-                    .target_water_level = levels[app->sel_level].level,
-                    .water_fill_timeout_sec = 600, /* 10 mins */
-                    .drain_timeout_sec = 300,      /* 5 mins */
-                    .ticks_per_second = 10         /* 100ms resolution */
-                };
-
+                bool custom = app->sel_program >= num_programs;
+                wm_program_t prog =
+                    app_menu_program(app->sel_program, app->sel_level, app->sel_power);
+
+                /* Presets run as compiled step programs, the same as uploaded ones */
+                uint8_t code[WM_CODE_MAX];
+                uint8_t len = custom ? custom_program_read(app, code)
+                                     : wm_compile_program(&prog, code, sizeof(code));
                 wm_init(&app->ctrl, &app->sensors, &app->actuators, prog);
-                wm_start(&app->ctrl);
+                WM_COV_ATTACH(&app->ctrl, app->cov);
+                if (wm_load_code(&app->ctrl, code, len))
+                    wm_start(&app->ctrl);
+                app->recorder.tick_ms = 1000 / prog.ticks_per_second;
+                /* First tick is due immediately (not counted as late after idling in the menu) */
+                app->last_tick_time = now - app->recorder.tick_ms;
                 app->ui_state = UI_RUNNING;
-                LOG_PRINTF("\nStarting cycle: %s, %s Level, %s Power...\n",
-                           programs[app->sel_program].name, levels[app->sel_level].name,
-                           powers[app->sel_power].name);
+                APP_LOG(app, "\nStarting cycle: %s, %s Level, %s Power...\n",
+                        program_name(app->sel_program), levels[app->sel_level].name,
+                        powers[app->sel_power].name);
             }
         }
         break;
@@ -216,16 +364,16 @@ void app_loop(App *app) {
         if (btnA) {
             if (app->ctrl.state == WM_PAUSED) {
                 wm_resume(&app->ctrl);
-                LOG_PRINTF("\n%s\n", "Resumed.");
+                APP_LOG(app, "\n%s\n", "Resumed.");
             } else {
                 wm_pause(&app->ctrl);
-                LOG_PRINTF("\n%s\n", "Paused.");
+                APP_LOG(app, "\n%s\n", "Paused.");
             }
         }
         if (btnC) {
             wm_pause(&app->ctrl);
             app->ui_state = UI_ABORT;
-            LOG_PRINTF("\n%s\n", "Abort? (A: YES, C: NO/RESUME)");
+            APP_LOG(app, "\n%s\n", "Abort? (A: YES, C: NO/RESUME)");
         }
 
         /* Auto-transition to SLEEP if finished */
@@ -234,15 +382,21 @@ void app_loop(App *app) {
             // Since loop runs fast, we use a simple counter or timer?
             // Original code used counter with 50ms delay
             // Let's rely on time to avoid frame-rate dependency
-            static uint32_t hold_timer = 0;
-            if (hold_timer == 0)
-                hold_timer = now;
+            if (app->hold_timer == 0)
+                app->hold_timer = now;
 
-            if (now - hold_timer > 2000) { // 2 seconds hold
-                hold_timer = 0;
+            if (now - app->hold_timer > 2000) { // 2 seconds hold
+                app->hold_timer = 0;
                 app->ui_state = UI_SLEEP;
-                LOG_PRINTF("\n%s\n", "=== CYCLE ENDED ===");
-                LOG_PRINTF("Press A to WAKE UP\n");
+                APP_LOG(app, "\n%s\n", "=== CYCLE ENDED ===");
+                if (hal_log_enabled(app->hal)) {
+                    report_usage(app);
+                    report_memory(app);
+#ifdef WM_PROFILE
+                    prof_dump(&app->prof);
+#endif
+                }
+                APP_LOG(app, "%s\n", "Press A to WAKE UP");
             }
         }
         break;
@@ -251,12 +405,12 @@ void app_loop(App *app) {
         if (btnA) {
             wm_abort(&app->ctrl);
             app->ui_state = UI_RUNNING; // Let the state machine finish the drain
-            LOG_PRINTF("\n%s\n", "Aborting... Draining Water...");
+            APP_LOG(app, "\n%s\n", "Aborting... Draining Water...");
         }
         if (btnC) {
             wm_resume(&app->ctrl);
             app->ui_state = UI_RUNNING;
-            LOG_PRINTF("\n%s\n", "Aborted cancelled. Resuming...");
+            APP_LOG(app, "\n%s\n", "Aborted cancelled. Resuming...");
         }
         break;
 
@@ -264,8 +418,8 @@ void app_loop(App *app) {
         if (btnA) {
             app->ui_state = UI_STARTUP;
             app->menu_step = 0;
-            LOG_PRINTF("\n%s\n", "Waking up...");
-            LOG_PRINTF("Program: %s (B: Next, A: OK)\n", programs[app->sel_program].name);
+            APP_LOG(app, "\n%s\n", "Waking up...");
+            APP_LOG(app, "Program: %s (B: Next, A: OK)\n", program_name(app->sel_program));
         }
         break;
     }
@@ -279,6 +433,8 @@ void app_loop(App *app) {
     /* Run controller at ticks_per_second */
     uint32_t tick_period_ms = 1000 / app->ctrl.program.ticks_per_second;
     if (now - app->last_tick_time >= tick_period_ms) {
+        PROF_VALUE(&app->prof, PROF_TICK_LATE,
+                   (now - app->last_tick_time - tick_period_ms) * (uint32_t)1000);
         app->last_tick_time = now;
 
         /* READ PHYSICAL SENSORS (Abstracted by HAL) */
@@ -286,25 +442,144 @@ void app_loop(App *app) {
         /* On real hardware, hal_sensors_read would read actual pins */
         int water_raw = 0;
         bool drain_check = false;
-        hal_sensors_read(&drain_check, &water_raw);
+        hal_sensors_read(app->hal, &drain_check, &water_raw);
 
         app->sensors.water_level = (water_level_t)water_raw;
         app->sensors.drain_check = drain_check;
 
         /* Tick Controller */
+        PROF_START(app->hal, t_tick);
         wm_tick(&app->ctrl, &app->sensors, &app->actuators);
-        wm_actuators(&app->actuators);
+        PROF_STOP(app->hal, &app->prof, PROF_WM_TICK, t_tick);
+
+        PROF_START(app->hal, t_act);
+        wm_actuators(app, &app->actuators);
+        PROF_STOP(app->hal, &app->prof, PROF_ACTUATORS, t_act);
+        fr_record(&app->recorder, app->ctrl.state, &app->sensors, &app->actuators);
 
         if (app->ui_state == UI_RUNNING) {
             /* Display progress */
             uint16_t rem = wm_get_time_remaining_sec(&app->ctrl);
-            LOG_PRINTF("Phase: %-5s | Status: %-10s | Time Rem: %02d:%02d | Level: %-6s | "
-                       "Inlet:%d Soap:%d "
-                       "Drain:%d Motor:%s\n",
-                       app->ctrl.is_wash_phase ? "WASH" : "RINSE", wm_state_str(app->ctrl.state),
-                       rem / 60, rem % 60, water_str(app->sensors.water_level),
-                       app->actuators.inlet_valve, app->actuators.soap_pump,
-                       app->actuators.drain_pump, motor_str(app->actuators.motor_dir));
+            PROF_START(app->hal, t_log);
+            APP_LOG(app, "Phase: %-5s | Status: %-10s | Time Rem: %02d:%02d | Level: %-6s | "
+                    "Inlet:%d Soap:%d "
+                    "Drain:%d Motor:%s\n",
+                    app->ctrl.is_wash_phase ? "WASH" : "RINSE", wm_state_str(app->ctrl.state),
+                    rem / 60, rem % 60, water_str(app->sensors.water_level),
+                    app->actuators.inlet_valve, app->actuators.soap_pump,
+                    app->actuators.drain_pump, motor_str(app->actuators.motor_dir));
+            PROF_STOP(app->hal, &app->prof, PROF_LOG, t_log);
         }
     }
 }
+
+void app_loop(App *app) {
+    PROF_START(app->hal, t_loop);
+    app_loop_body(app);
+    PROF_STOP(app->hal, &app->prof, PROF_APP_LOOP, t_loop);
+}
+
+int app_menu_count(const App *app, app_menu_t step) {
+    switch (step) {
+    case APP_MENU_PROGRAM:
+        return program_count(app);
+    case APP_MENU_LEVEL:
+        return num_levels;
+    case APP_MENU_POWER:
+        return num_powers;
+    default:
+        return 0;
+    }
+}
+
+const char *app_menu_name(const App *app, app_menu_t step, int idx) {
+    if (idx < 0 || idx >= app_menu_count(app, step))
+        return "?";
+    switch (step) {
+    case APP_MENU_PROGRAM:
+        return program_name(idx);
+    case APP_MENU_LEVEL:
+        return levels[idx].name;
+    default:
+        return powers[idx].name;
+    }
+}
+
+wm_program_t app_menu_program(int program, int level, int power) {
+    int preset = (program < 0 || program >= num_programs) ? 0 : program;
+    if (level < 0 || level >= num_levels)
+        level = 0;
+    if (power < 0 || power >= num_powers)
+        power = 0;
+
+    wm_program_t prog = {
+        .wash_count = 1,
+        .rinse_count = programs[preset].rinse_count,
+        .spin_enable = true,
+        .soap_time_sec = 20, /* Default soap for wash */
+        .wash_agitate_time_sec = programs[preset].wash_min * 60,
+        .rinse_agitate_time_sec = programs[preset].rinse_min * 60,
+        .agitate_run_ms = powers[power].run_ms,
+        .agitate_cycle_ms = powers[power].cycle_ms,
+        .target_water_level = levels[level].level,
+        .water_fill_timeout_sec = 600, /* 10 mins */
+        .drain_timeout_sec = 300,      /* 5 mins */
+        .ticks_per_second = APP_TICKS_PER_SECOND};
+    return prog;
+}
+
+/* Print the flight recorder as hex lines for tools/flight_recorder/decoder.c */
+static void dump_recorder(App *app) {
+    flight_recorder_t *fr = &app->recorder;
+
+    SERIAL_PRINTF("FR BEGIN v%d tick_ms=%u ticks=%lu bytes=%u frozen=%d\n", FR_DUMP_VERSION,
+                  fr->tick_ms, (unsigned long)fr->ticks, fr->used, fr->frozen);
+    SERIAL_PRINTF("FR BASE %02X%02X%02X\n", fr->base[0], fr->base[1], fr->base[2]);
+    for (uint16_t i = 0; i < fr->used; i += 16) {
+        SERIAL_PRINTF("%s", "FR DATA ");
+        for (uint16_t j = i; j < fr->used && j < i + 16; j++)
+            SERIAL_PRINTF("%02X", fr_byte_at(fr, j));
+        SERIAL_PRINTF("%s", "\n");
+    }
+    SERIAL_PRINTF("%s\n", "FR END");
+
+    /* History has been read out; resume recording */
+    fr_thaw(fr);
+}
+
+/* One-shot status/telemetry report */
+static void report_status(App *app) {
+    uint16_t rem = wm_get_time_remaining_sec(&app->ctrl);
+    SERIAL_PRINTF("Status: %s | Error: %s | Time Rem: %02d:%02d\n",
+                  wm_state_str(app->ctrl.state), wm_error_str(app->ctrl.error_code), rem / 60,
+                  rem % 60);
+    report_memory(app);
+}
+
+void app_command(App *app, char cmd) {
+    if (app->uploading) {
+        upload_char(app, cmd);
+        return;
+    }
+
+    switch (cmd) {
+    case 'd':
+        dump_recorder(app);
+        break;
+    case 's':
+        report_status(app);
+        break;
+    case 'p':
+#ifdef WM_PROFILE
+        prof_dump(&app->prof);
+#else
+        SERIAL_PRINTF("%s\n", "Profiling disabled (build with -DWM_PROFILE)");
+#endif
+        break;
+    case 'u':
+        upload_begin(app);
+        break;
+    default:
+        break;
+    }
+}
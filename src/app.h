@@ -5,12 +5,23 @@
 extern "C" {
 #endif
 
+#include "flight_recorder.h"
+#include "hal.h"
+#include "prof.h"
 #include "wm_control.h"
 
+/* UI states (App.ui_state) */
+typedef enum { UI_STARTUP, UI_RUNNING, UI_ABORT, UI_SLEEP } ui_state_t;
+
+/* Menu steps, in the order the A button walks through them */
+typedef enum { APP_MENU_PROGRAM, APP_MENU_LEVEL, APP_MENU_POWER, APP_MENU_STEPS } app_menu_t;
+
 /**
  * @brief Application State Structure
  */
 typedef struct {
+    hal_t *hal; /* Machine this instance drives */
+
     int ui_state;
     int menu_step;
     int sel_program;
@@ -21,13 +32,35 @@ typedef struct {
     wm_sensors_t sensors;
     wm_actuators_t actuators;
     uint32_t last_tick_time;
+
+    /* Per-instance I/O state */
+    wm_buzzer_mode_t last_buzzer;
+    uint32_t hold_timer;
+    uint32_t btn_last_time[3];
+    bool btn_last_state[3];
+
+    flight_recorder_t recorder;
+
+    /* Custom step program (stored in non-volatile storage, uploaded with 'u') */
+    bool has_custom;
+    bool uploading;
+    uint8_t upload_len; /* Bytes received; WM_CODE_MAX + 1 once the upload overflowed */
+    int8_t upload_hi;   /* Pending high nibble, -1 if none */
+#ifdef WM_PROFILE
+    prof_t prof;
+#endif
+#ifdef WM_COVERAGE
+    struct wm_cov *cov; /* Attached to each controller the app starts (app_init: the default) */
+#endif
 } App;
 
 /**
  * @brief Initialize the application (HAL, State Machine, etc).
+ * Instances share no state, so any number can run side by side, each with its own HAL.
  * @param app Pointer to App structure
+ * @param hal HAL context the instance drives (must outlive it)
  */
-void app_init(App *app);
+void app_init(App *app, hal_t *hal);
 
 /**
  * @brief Main application loop.
@@ -36,6 +69,42 @@ void app_init(App *app);
  */
 void app_loop(App *app);
 
+/**
+ * @brief Handle a single-character command received over serial.
+ * 'd' dumps the flight recorder, 's' prints status and memory usage,
+ * 'p' dumps latency histograms (WM_PROFILE builds), 'u' starts a custom program upload:
+ * hex bytes follow and '.' or a newline ends it. While uploading every character
+ * received must be passed here.
+ * @param app Pointer to App structure
+ * @param cmd Command character
+ */
+void app_command(App *app, char cmd);
+
+/**
+ * @brief Number of options in a menu step, for tools that drive the menu with buttons.
+ * Pressing B n times at a step selects option n.
+ * @param app Pointer to App structure
+ * @param step Menu step
+ */
+int app_menu_count(const App *app, app_menu_t step);
+
+/**
+ * @brief Display name of a menu option.
+ * @param app Pointer to App structure
+ * @param step Menu step
+ * @param idx Option index (0 .. app_menu_count() - 1)
+ */
+const char *app_menu_name(const App *app, app_menu_t step, int idx);
+
+/**
+ * @brief The classic program the menu builds for a selection (the custom entry uses the
+ * first preset's timing, as when it runs).
+ * @param program Program option index
+ * @param level Water level option index
+ * @param power Power option index
+ */
+wm_program_t app_menu_program(int program, int level, int power);
+
 #ifdef __cplusplus
 }
 #endif
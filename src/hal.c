@@ -5,6 +5,7 @@
 #ifdef ARDUINO
 #include "../lib/buzzer/buzzer.h"
 #include <Arduino.h>
+#include <avr/eeprom.h>
 
 /* Pin Definitions */
 static const int PIN_MOTOR = 12;     /* RELAY: Controls motor POWER */
@@ -18,7 +19,36 @@ static const int PIN_BTN_A = 2; /* BUTTON: Start/Pause/OK */
 static const int PIN_BTN_B = 3; /* BUTTON: Next */
 static const int PIN_BTN_C = 4; /* BUTTON: ESC */
 
-void hal_init(void) {
+#ifdef __AVR__
+/* --- Stack Painting --- */
+#define HAL_STACK_CANARY 0xC5
+
+extern uint8_t _end;    /* End of .bss/.noinit, start of the heap */
+extern uint8_t __stack; /* RAMEND, top of the stack */
+extern char *__brkval;  /* Current heap top (0 until the first malloc) */
+
+/*
+ * Fill everything between the end of static data and RAMEND with the canary.
+ * Runs from .init1, before the C runtime sets up the stack, so it must not touch it.
+ */
+void hal_paint_ram(void) __attribute__((naked, used, section(".init1")));
+void hal_paint_ram(void) {
+    __asm volatile("    ldi r30, lo8(_end)\n"
+                   "    ldi r31, hi8(_end)\n"
+                   "    ldi r24, 0xC5\n"
+                   "    ldi r25, hi8(__stack)\n"
+                   "    rjmp 2f\n"
+                   "1:  st Z+, r24\n"
+                   "2:  cpi r30, lo8(__stack)\n"
+                   "    cpc r31, r25\n"
+                   "    brlo 1b\n"
+                   "    breq 1b\n" ::
+                       : "r24", "r25", "r30", "r31");
+}
+#endif
+
+void hal_init(hal_t *hal) {
+    (void)hal;
     pinMode(PIN_MOTOR, OUTPUT);
     pinMode(PIN_MOTOR_ROT, OUTPUT);
     pinMode(PIN_INLET, OUTPUT);
@@ -39,11 +69,23 @@ void hal_init(void) {
     digitalWrite(PIN_SOAP, HIGH);
 }
 
-uint32_t hal_millis(void) { return millis(); }
+uint32_t hal_millis(hal_t *hal) {
+    (void)hal;
+    return millis();
+}
 
-void hal_delay(uint32_t ms) { delay(ms); }
+uint32_t hal_micros(hal_t *hal) {
+    (void)hal;
+    return micros();
+}
 
-void hal_actuator_write(hal_actuator_t act, bool active) {
+void hal_delay(hal_t *hal, uint32_t ms) {
+    (void)hal;
+    delay(ms);
+}
+
+void hal_actuator_write(hal_t *hal, hal_actuator_t act, bool active) {
+    (void)hal;
     int pin = -1;
     // Logical 'active' means 'ON'.
     // Relays are Active-LOW: LOW -> ON, HIGH -> OFF.
@@ -83,7 +125,8 @@ void hal_actuator_write(hal_actuator_t act, bool active) {
     }
 }
 
-bool hal_button_read(hal_button_t btn) {
+bool hal_button_read(hal_t *hal, hal_button_t btn) {
+    (void)hal;
     int pin = -1;
     switch (btn) {
     case HAL_BTN_A:
@@ -106,7 +149,8 @@ bool hal_button_read(hal_button_t btn) {
     return false;
 }
 
-void hal_sound_play(hal_song_t song_id) {
+void hal_sound_play(hal_t *hal, hal_song_t song_id) {
+    (void)hal;
     switch (song_id) {
     case HAL_SONG_START:
         buzzer_play_song(SONG_START);
@@ -120,7 +164,8 @@ void hal_sound_play(hal_song_t song_id) {
     }
 }
 
-void hal_sensors_read(bool *drain_check, int *water_level_raw) {
+void hal_sensors_read(hal_t *hal, bool *drain_check, int *water_level_raw) {
+    (void)hal;
     // In a real Arduino scenario, this would read pins.
     // For now, if we don't have physical sensors wired, we might return defaults
     // or rely on a global variable if we are mocking it on hardware too.
@@ -133,6 +178,42 @@ void hal_sensors_read(bool *drain_check, int *water_level_raw) {
     // But request implies simulation is on PC.
 }
 
+void hal_storage_read(hal_t *hal, uint16_t addr, uint8_t *buf, uint16_t len) {
+    (void)hal;
+    eeprom_read_block(buf, (const void *)(uintptr_t)addr, len);
+}
+
+void hal_storage_write(hal_t *hal, uint16_t addr, const uint8_t *buf, uint16_t len) {
+    (void)hal;
+    eeprom_update_block(buf, (void *)(uintptr_t)addr, len);
+}
+
+bool hal_log_enabled(hal_t *hal) {
+    (void)hal;
+    return true;
+}
+
+bool hal_mem_stats(hal_t *hal, hal_mem_stats_t *stats) {
+    (void)hal;
+#ifdef __AVR__
+    uint8_t *heap_end = __brkval ? (uint8_t *)__brkval : &_end;
+    uint8_t *sp = (uint8_t *)SP;
+
+    /* The first non-canary byte above the heap is the deepest the stack has reached */
+    uint8_t *p = heap_end;
+    while (p <= &__stack && *p == HAL_STACK_CANARY)
+        p++;
+
+    stats->stack_peak = (uint16_t)(&__stack - p + 1);
+    stats->free_ram_min = (uint16_t)(p - heap_end);
+    stats->free_ram_now = (uint16_t)(sp - heap_end);
+    return true;
+#else
+    (void)stats;
+    return false;
+#endif
+}
+
 #else // LINUX / DUMMY
 
 #include <stddef.h> // for NULL
@@ -141,94 +222,162 @@ void hal_sensors_read(bool *drain_check, int *water_level_raw) {
 #include <time.h>
 #include <unistd.h> // for usleep
 
-// Simulation State
-static struct {
-    bool drain_check;
-    int water_level;
-    bool buttons[3]; // A, B, C
+/* Each hal_t is one simulated machine; there is no shared state here */
 
-    // Actuators
-    bool act_motor_pwr;
-    bool act_motor_ccw;
-    bool act_inlet;
-    bool act_drain;
-    bool act_soap;
-} sim_state = {0};
+static uint32_t tap_in(hal_t *hal, hal_sim_input_t what, uint32_t value) {
+    return hal->tap ? hal->tap->input(hal->tap_ctx, what, value) : value;
+}
 
-void hal_init(void) {
-    // Dummy init
-    // printf("[HAL] Init\n");
-    memset(&sim_state, 0, sizeof(sim_state));
+void hal_init(hal_t *hal) {
+    // Reset the I/O; storage persists like EEPROM (erased on first use)
+    hal->drain_check = false;
+    hal->water_level = 0;
+    memset(hal->buttons, 0, sizeof(hal->buttons));
+    hal->act_motor_pwr = false;
+    hal->act_motor_ccw = false;
+    hal->act_inlet = false;
+    hal->act_drain = false;
+    hal->act_soap = false;
+    if (!hal->storage_ready) {
+        memset(hal->storage, 0xFF, sizeof(hal->storage));
+        hal->storage_ready = true;
+    }
 }
 
-uint32_t hal_millis(void) {
+uint32_t hal_millis(hal_t *hal) {
+    if (hal->virtual_clock)
+        return tap_in(hal, HAL_SIM_IN_MILLIS, (uint32_t)(hal->virtual_us / 1000));
+
     // Monotonic clock for linux
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+    return tap_in(hal, HAL_SIM_IN_MILLIS, (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
 }
 
-void hal_delay(uint32_t ms) { usleep(ms * 1000); }
+uint32_t hal_micros(hal_t *hal) {
+    if (hal->virtual_clock)
+        return tap_in(hal, HAL_SIM_IN_MICROS, (uint32_t)hal->virtual_us);
 
-void hal_actuator_write(hal_actuator_t act, bool active) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return tap_in(hal, HAL_SIM_IN_MICROS,
+                  (uint32_t)((uint64_t)ts.tv_sec * 1000000 + (ts.tv_nsec / 1000)));
+}
+
+void hal_delay(hal_t *hal, uint32_t ms) {
+    if (hal->virtual_clock)
+        hal->virtual_us += (uint64_t)ms * 1000;
+    else
+        usleep(ms * 1000);
+}
+
+void hal_actuator_write(hal_t *hal, hal_actuator_t act, bool active) {
     switch (act) {
     case HAL_ACT_MOTOR_POWER:
-        sim_state.act_motor_pwr = active;
+        hal->act_motor_pwr = active;
         break;
     case HAL_ACT_MOTOR_DIR:
-        sim_state.act_motor_ccw = active;
+        hal->act_motor_ccw = active;
         break;
     case HAL_ACT_INLET:
-        sim_state.act_inlet = active;
+        hal->act_inlet = active;
         break;
     case HAL_ACT_DRAIN:
-        sim_state.act_drain = active;
+        hal->act_drain = active;
         break;
     case HAL_ACT_SOAP:
-        sim_state.act_soap = active;
+        hal->act_soap = active;
         break;
     }
+    if (hal->tap)
+        hal->tap->output(hal->tap_ctx, act, active);
 }
 
-bool hal_button_read(hal_button_t btn) {
+bool hal_button_read(hal_t *hal, hal_button_t btn) {
     if (btn >= 0 && btn < 3) {
-        return sim_state.buttons[btn];
+        uint32_t v = ((uint32_t)btn << 1) | hal->buttons[btn];
+        return tap_in(hal, HAL_SIM_IN_BUTTON, v) & 1;
     }
     return false;
 }
 
-void hal_sound_play(hal_song_t song_id) {
+void hal_sound_play(hal_t *hal, hal_song_t song_id) {
     // printf("[HAL] Play Song: %d\n", song_id);
+    (void)hal;
     (void)song_id;
 }
 
-void hal_sensors_read(bool *drain_check, int *water_level_raw) {
+void hal_sensors_read(hal_t *hal, bool *drain_check, int *water_level_raw) {
+    uint32_t v = ((uint32_t)hal->water_level << 1) | hal->drain_check;
+    v = tap_in(hal, HAL_SIM_IN_SENSORS, v);
     if (drain_check)
-        *drain_check = sim_state.drain_check;
+        *drain_check = v & 1;
     if (water_level_raw)
-        *water_level_raw = sim_state.water_level;
+        *water_level_raw = (int)(v >> 1);
+}
+
+void hal_storage_read(hal_t *hal, uint16_t addr, uint8_t *buf, uint16_t len) {
+    for (uint16_t i = 0; i < len; i++) {
+        bool valid = hal->storage_ready && addr + i < HAL_STORAGE_SIZE;
+        buf[i] = valid ? hal->storage[addr + i] : 0xFF;
+    }
+}
+
+void hal_storage_write(hal_t *hal, uint16_t addr, const uint8_t *buf, uint16_t len) {
+    if (!hal->storage_ready) {
+        memset(hal->storage, 0xFF, sizeof(hal->storage));
+        hal->storage_ready = true;
+    }
+    for (uint16_t i = 0; i < len && addr + i < HAL_STORAGE_SIZE; i++)
+        hal->storage[addr + i] = buf[i];
+}
+
+bool hal_log_enabled(hal_t *hal) { return !hal->quiet; }
+
+bool hal_mem_stats(hal_t *hal, hal_mem_stats_t *stats) {
+    // No painted RAM region on the host; tools/stack_depth measures call depth instead
+    (void)hal;
+    (void)stats;
+    return false;
 }
 
 /* --- Simulation Hooks --- */
-void hal_sim_set_sensors(bool drain_check, int water_level_raw) {
-    sim_state.drain_check = drain_check;
-    sim_state.water_level = water_level_raw;
+void hal_sim_set_sensors(hal_t *hal, bool drain_check, int water_level_raw) {
+    hal->drain_check = drain_check;
+    hal->water_level = water_level_raw;
 }
 
-void hal_sim_set_button(hal_button_t btn, bool pressed) {
+void hal_sim_set_button(hal_t *hal, hal_button_t btn, bool pressed) {
     if (btn >= 0 && btn < 3) {
-        sim_state.buttons[btn] = pressed;
+        hal->buttons[btn] = pressed;
     }
 }
 
-hal_sim_actuators_t hal_sim_get_actuators(void) {
+hal_sim_actuators_t hal_sim_get_actuators(const hal_t *hal) {
     hal_sim_actuators_t acts;
-    acts.motor_power = sim_state.act_motor_pwr;
-    acts.motor_ccw = sim_state.act_motor_ccw;
-    acts.inlet = sim_state.act_inlet;
-    acts.drain = sim_state.act_drain;
-    acts.soap = sim_state.act_soap;
+    acts.motor_power = hal->act_motor_pwr;
+    acts.motor_ccw = hal->act_motor_ccw;
+    acts.inlet = hal->act_inlet;
+    acts.drain = hal->act_drain;
+    acts.soap = hal->act_soap;
     return acts;
 }
 
+void hal_sim_set_quiet(hal_t *hal, bool quiet) { hal->quiet = quiet; }
+
+void hal_sim_use_virtual_clock(hal_t *hal) {
+    hal->virtual_clock = true;
+    hal->virtual_us = 0;
+}
+
+void hal_sim_advance(hal_t *hal, uint32_t ms) {
+    if (hal->virtual_clock)
+        hal->virtual_us += (uint64_t)ms * 1000;
+}
+
+void hal_sim_set_tap(hal_t *hal, const hal_sim_tap_t *tap, void *ctx) {
+    hal->tap = tap;
+    hal->tap_ctx = ctx;
+}
+
 #endif
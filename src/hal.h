@@ -27,55 +27,166 @@ typedef enum {
 // Song IDs
 typedef enum { HAL_SONG_START, HAL_SONG_FINISHED, HAL_SONG_ERROR } hal_song_t;
 
+#define HAL_STORAGE_SIZE 256 // Bytes of non-volatile storage available to the app
+
+/*
+ * HAL context, passed to every hal_* call so each App drives its own machine.
+ * On the MCU there is one board and the context carries no state. On the host it is a
+ * whole simulated machine: zero-initialize new contexts (static, calloc or {0}).
+ * hal_init() resets the I/O but keeps the storage, as EEPROM survives a reset, and the
+ * clock and console settings.
+ */
+#ifdef ARDUINO
+typedef struct {
+    uint8_t unused;
+} hal_t;
+#else
+/* Values the app reads through the HAL, as seen by a tap (see hal_sim_set_tap()) */
+typedef enum {
+    HAL_SIM_IN_MILLIS,
+    HAL_SIM_IN_MICROS,
+    HAL_SIM_IN_BUTTON,  // (btn << 1) | pressed
+    HAL_SIM_IN_SENSORS, // (water_level_raw << 1) | drain_check
+} hal_sim_input_t;
+
+typedef struct {
+    // Each value the app reads; returns the value the app gets instead
+    uint32_t (*input)(void *ctx, hal_sim_input_t what, uint32_t value);
+    // Each actuator write, after it took effect
+    void (*output)(void *ctx, hal_actuator_t act, bool active);
+} hal_sim_tap_t;
+
+typedef struct {
+    bool drain_check;
+    int water_level;
+    bool buttons[3]; // A, B, C
+
+    // Actuators
+    bool act_motor_pwr;
+    bool act_motor_ccw;
+    bool act_inlet;
+    bool act_drain;
+    bool act_soap;
+
+    // Non-volatile storage (EEPROM stand-in, erased = 0xFF)
+    uint8_t storage[HAL_STORAGE_SIZE];
+    bool storage_ready;
+
+    // Clock: CLOCK_MONOTONIC unless a virtual clock was selected
+    bool virtual_clock;
+    uint64_t virtual_us;
+
+    // Console output suppressed (headless runs)
+    bool quiet;
+
+    // Optional tap on the app's I/O (record/replay)
+    const hal_sim_tap_t *tap;
+    void *tap_ctx;
+} hal_t;
+#endif
+
 /**
  * @brief Initialize all hardware pins and peripherals.
+ * @param hal HAL context
  */
-void hal_init(void);
+void hal_init(hal_t *hal);
 
 /**
  * @brief Get system time in milliseconds.
  */
-uint32_t hal_millis(void);
+uint32_t hal_millis(hal_t *hal);
+
+/**
+ * @brief Get system time in microseconds (wraps after ~71 minutes).
+ */
+uint32_t hal_micros(hal_t *hal);
 
 /**
  * @brief Blocking delay.
+ * @param hal HAL context
  * @param ms Milliseconds to wait
  */
-void hal_delay(uint32_t ms);
+void hal_delay(hal_t *hal, uint32_t ms);
 
 /**
  * @brief Control an actuator (Relay).
+ * @param hal HAL context
  * @param act Actuator ID
  * @param active true = ON/ACTIVE, false = OFF/INACTIVE
  */
-void hal_actuator_write(hal_actuator_t act, bool active);
+void hal_actuator_write(hal_t *hal, hal_actuator_t act, bool active);
 
 /**
  * @brief Read button state.
+ * @param hal HAL context
  * @param btn Button ID
  * @return true if button is currently pressed (active), false otherwise.
  */
-bool hal_button_read(hal_button_t btn);
+bool hal_button_read(hal_t *hal, hal_button_t btn);
 
 /**
  * @brief Play a defined song/tune on the buzzer.
+ * @param hal HAL context
  * @param song_id Song ID to play
  */
-void hal_sound_play(hal_song_t song_id);
+void hal_sound_play(hal_t *hal, hal_song_t song_id);
 
 /**
  * @brief Read all sensors.
+ * @param hal HAL context
  * @param drain_check Output pointer for drain sensor state (true=water detected).
  * @param water_level_raw Output pointer for raw water level sensor value (0-100 or enum).
  */
-void hal_sensors_read(bool *drain_check, int *water_level_raw);
+void hal_sensors_read(hal_t *hal, bool *drain_check, int *water_level_raw);
+
+/**
+ * @brief Read from non-volatile storage (EEPROM on the MCU).
+ * @param hal HAL context
+ * @param addr Byte offset
+ * @param buf Destination
+ * @param len Number of bytes
+ */
+void hal_storage_read(hal_t *hal, uint16_t addr, uint8_t *buf, uint16_t len);
+
+/**
+ * @brief Write to non-volatile storage. Unchanged bytes are not rewritten.
+ * @param hal HAL context
+ * @param addr Byte offset
+ * @param buf Source
+ * @param len Number of bytes
+ */
+void hal_storage_write(hal_t *hal, uint16_t addr, const uint8_t *buf, uint16_t len);
+
+/**
+ * @brief Whether the app should write its console log.
+ * @param hal HAL context
+ * @return false when a simulation has silenced this machine.
+ */
+bool hal_log_enabled(hal_t *hal);
+
+// RAM usage figures, in bytes
+typedef struct {
+    uint16_t stack_peak;   // Deepest stack use since reset
+    uint16_t free_ram_min; // Smallest gap ever seen between heap and stack
+    uint16_t free_ram_now; // Current gap between heap and stack
+} hal_mem_stats_t;
+
+/**
+ * @brief Probe stack high-water mark and free RAM.
+ * On AVR the free region is painted with a canary at startup; the probe scans for the
+ * deepest overwritten byte.
+ * @param hal HAL context
+ * @param stats Output figures
+ * @return false if the backend cannot measure (Linux: use tools/stack_depth instead).
+ */
+bool hal_mem_stats(hal_t *hal, hal_mem_stats_t *stats);
 
 #ifndef ARDUINO
 /* --- Simulation Hooks --- */
 /* These allow the PC simulation to inject sensor state and read actuator state */
 
-void hal_sim_set_sensors(bool drain_check, int water_level_raw);
-void hal_sim_set_button(hal_button_t btn, bool pressed);
+void hal_sim_set_sensors(hal_t *hal, bool drain_check, int water_level_raw);
+void hal_sim_set_button(hal_t *hal, hal_button_t btn, bool pressed);
 
 typedef struct {
     bool motor_power;
@@ -85,7 +196,41 @@ typedef struct {
     bool soap;
 } hal_sim_actuators_t;
 
-hal_sim_actuators_t hal_sim_get_actuators(void);
+hal_sim_actuators_t hal_sim_get_actuators(const hal_t *hal);
+
+/**
+ * @brief Silence the app's console log for this context (see hal_log_enabled()).
+ * @param hal HAL context
+ * @param quiet true to suppress output
+ */
+void hal_sim_set_quiet(hal_t *hal, bool quiet);
+
+/**
+ * @brief Run this context on a virtual clock starting at 0 ms.
+ * Time then only moves through hal_sim_advance() and hal_delay(), which returns at once,
+ * so a simulation runs as fast as the host allows and independently of its load.
+ * Select it before app_init().
+ * @param hal HAL context
+ */
+void hal_sim_use_virtual_clock(hal_t *hal);
+
+/**
+ * @brief Advance a virtual clock (no effect on the real clock).
+ * @param hal HAL context
+ * @param ms Milliseconds to advance
+ */
+void hal_sim_advance(hal_t *hal, uint32_t ms);
+
+/**
+ * @brief Route the app's reads and actuator writes through a tap (NULL removes it).
+ * The tap sees every clock, button and sensor read and may replace the value, which is
+ * how a recorded session is replayed. Button values read (btn << 1) | pressed, and the
+ * tap returns the same form.
+ * @param hal HAL context
+ * @param tap Callbacks (must outlive their use)
+ * @param ctx Passed to the callbacks
+ */
+void hal_sim_set_tap(hal_t *hal, const hal_sim_tap_t *tap, void *ctx);
 
 #endif
 
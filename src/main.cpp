@@ -3,11 +3,34 @@
 #include <Arduino.h>
 
 /* --- Main Entry Point for MCU --- */
+static hal_t hal;
 static App app;
 
+/* Bridge C stdio to Arduino Serial (declared in utils.h) */
+static int serial_putchar(char c, FILE *f) {
+    (void)f;
+    if (c == '\n')
+        Serial.write('\r');
+    return Serial.write(c) == 1 ? 0 : 1;
+}
+
+void SerialPrintf(const char *fmt, ...) {
+    static FILE serial_out;
+    static bool initialized = false;
+    if (!initialized) {
+        fdev_setup_stream(&serial_out, serial_putchar, NULL, _FDEV_SETUP_WRITE);
+        initialized = true;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    vfprintf_P(&serial_out, fmt, args); // _P version reads fmt from Flash
+    va_end(args);
+}
+
 void setup() {
     /* Initialize App (HAL + Logic) */
-    app_init(&app);
+    app_init(&app, &hal);
 
     Serial.begin(115200);
     while (!Serial) {
@@ -17,6 +40,11 @@ void setup() {
 }
 
 void loop() {
+    /* Forward serial commands (e.g. 'd' = dump flight recorder) */
+    while (Serial.available() > 0) {
+        app_command(&app, (char)Serial.read());
+    }
+
     /* Run App Logic Loop */
     app_loop(&app);
 }
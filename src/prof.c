@@ -0,0 +1,39 @@
+#include "prof.h"
+
+#ifdef WM_PROFILE
+#include "../include/utils.h"
+
+static const char *const probe_names[PROF_COUNT] = {"app_loop", "wm_tick", "wm_actuators",
+                                                    "log", "tick_late"};
+
+void prof_reset(prof_t *prof) { *prof = (prof_t){0}; }
+
+void prof_record(prof_t *prof, prof_probe_t probe, uint32_t us) {
+    /* Bucket = index of the highest set bit */
+    uint8_t bucket = 0;
+    for (uint32_t v = us >> 1; v && bucket < PROF_BUCKETS - 1; v >>= 1)
+        bucket++;
+
+    if (prof->hist[probe][bucket] != UINT16_MAX)
+        prof->hist[probe][bucket]++;
+    if (us > prof->max_us[probe])
+        prof->max_us[probe] = us;
+}
+
+void prof_dump(const prof_t *prof) {
+    SERIAL_PRINTF("%s\n", "PROF probe          count     max_us  buckets (>=2^k us: count)");
+    for (uint8_t p = 0; p < PROF_COUNT; p++) {
+        uint32_t count = 0;
+        for (uint8_t b = 0; b < PROF_BUCKETS; b++)
+            count += prof->hist[p][b];
+
+        SERIAL_PRINTF("PROF %-12s %8lu %10lu ", probe_names[p], (unsigned long)count,
+                      (unsigned long)prof->max_us[p]);
+        for (uint8_t b = 0; b < PROF_BUCKETS; b++) {
+            if (prof->hist[p][b])
+                SERIAL_PRINTF(" %u:%u", b, prof->hist[p][b]);
+        }
+        SERIAL_PRINTF("%s", "\n");
+    }
+}
+#endif
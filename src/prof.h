@@ -0,0 +1,52 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hot-path latency instrumentation.
+ *
+ * Compiled in only with -DWM_PROFILE; otherwise the PROF_* macros expand to nothing and
+ * prof_t is not part of App. Each probe feeds a log2 histogram of microseconds
+ * (bucket k counts samples in [2^k, 2^(k+1)), bucket 0 also holds 0) plus a max counter.
+ */
+
+typedef enum {
+    PROF_APP_LOOP,  /* One app_loop call */
+    PROF_WM_TICK,   /* wm_tick */
+    PROF_ACTUATORS, /* wm_actuators (HAL writes + buzzer) */
+    PROF_LOG,       /* Per-tick status LOG_PRINTF (compiled out in C on the MCU) */
+    PROF_TICK_LATE, /* Controller tick start vs. its schedule */
+    PROF_COUNT
+} prof_probe_t;
+
+#define PROF_BUCKETS 22 /* Last bucket collects everything >= 2^21 us (~2 s) */
+
+typedef struct {
+    uint16_t hist[PROF_COUNT][PROF_BUCKETS]; /* Saturating counts */
+    uint32_t max_us[PROF_COUNT];
+} prof_t;
+
+#ifdef WM_PROFILE
+void prof_reset(prof_t *prof);
+void prof_record(prof_t *prof, prof_probe_t probe, uint32_t us);
+void prof_dump(const prof_t *prof);
+
+#define PROF_START(hal, var) uint32_t var = hal_micros(hal)
+#define PROF_STOP(hal, prof, probe, var) prof_record((prof), (probe), hal_micros(hal) - (var))
+#define PROF_VALUE(prof, probe, us) prof_record((prof), (probe), (us))
+#else
+#define PROF_START(hal, var) ((void)0)
+#define PROF_STOP(hal, prof, probe, var) ((void)0)
+#define PROF_VALUE(prof, probe, us) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROF_H
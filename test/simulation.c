@@ -1,110 +1,477 @@
 #define _DEFAULT_SOURCE
 #include "../lib/wm_control/wm_control.h" // For water_level_t enum
+#include "../lib/wm_control/wm_coverage.h"
 #include "../src/app.h"
 #include "../src/hal.h"
+#include "../tools/sim/dash.h"
+#include "../tools/sim/meter.h"
+#include "../tools/sim/physics.h"
+#include "../tools/sim/shm.h"
+#include "../tools/sim/trace.h"
+#include "../tools/sim/vcd.h"
+#include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
-#include <sys/select.h>
-#include <sys/time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <termios.h>
 #include <unistd.h>
 
 /* --- Utility for Non-blocking Keyboard Input --- */
+static struct termios orig_termios;
+
 static void set_conio_terminal_mode(void) {
     struct termios new_termios;
+    tcgetattr(0, &orig_termios);
     tcgetattr(0, &new_termios);
     new_termios.c_lflag &= ~ICANON;
     new_termios.c_lflag &= ~ECHO;
     tcsetattr(0, TCSANOW, &new_termios);
 }
 
-static int get_key(void) {
-    struct timeval tv = {0L, 0L};
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(0, &fds);
-    if (select(1, &fds, NULL, NULL, &tv)) {
-        return getchar();
+/* --- Physics Simulation --- */
+#define LOOP_MS 50 // Simulated time per step on a virtual clock
+
+static phys_t sim_phys;
+
+/* Integrate the water and motor model up to the HAL clock, then feed the sensors */
+static void run_physics(hal_t *hal) {
+    hal_sim_actuators_t acts = hal_sim_get_actuators(hal);
+    phys_sync(&sim_phys, &acts, hal_millis(hal));
+    phys_sense(&sim_phys, hal);
+}
+
+/* Anything still moving: an output on, or the drum not yet coasted to a stop */
+static bool physics_active(hal_t *hal) {
+    hal_sim_actuators_t a = hal_sim_get_actuators(hal);
+    return a.motor_power || a.inlet || a.drain || a.soap || sim_phys.rpm >= 1.0 ||
+           sim_phys.rpm <= -1.0;
+}
+
+/* --- Event Loop --- */
+/*
+ * On the wall clock nothing polls: the loop sleeps in epoll_wait until a key arrives or
+ * one of three timerfds expires. These are the controller's next tick (one-shot, re-armed
+ * from App.last_tick_time), the physics step (periodic, only while something moves), and
+ * the release of a simulated button. An idle menu therefore uses no CPU. On a virtual
+ * clock a pacing timerfd (or nothing, when unthrottled) drives fixed LOOP_MS steps instead.
+ */
+#define KEY_HOLD_MS 60 // A key holds its button this long, then releases it as long (debounce)
+#define KEY_QUEUE 4096
+
+typedef struct {
+    hal_t *hal;
+    App *app;
+    long speed;
+    int epfd, tick_fd, phys_fd, key_fd, pace_fd;
+    bool phys_armed;
+
+    unsigned char keys[KEY_QUEUE]; /* Typed but not yet delivered */
+    size_t key_head, key_len;
+    int held;         /* Button pressed by the current key, -1 if none */
+    uint32_t key_due; /* Release of the held button, else the earliest next press */
+
+    trace_t trace; /* Session recording (-R) */
+    vcd_t vcd;     /* Waveform dump (-V) */
+    shm_link_t *link; /* Shared-memory slot (-S), else NULL */
+    dash_t dash;      /* In-place panel (-D) instead of the scrolling log */
+    meter_rates_t rates; /* For the water and energy estimate of a finished cycle (-E) */
+    bool metered;        /* The finished cycle's estimate was printed */
+} sim_t;
+
+static volatile sig_atomic_t quit;
+
+static void on_signal(int sig) {
+    (void)sig;
+    quit = 1;
+}
+
+/* Arm a timerfd after first_us (0 disarms), then every period_us (0: once) */
+static void timer_arm(int fd, uint64_t first_us, uint64_t period_us) {
+    struct itimerspec its = {
+        .it_interval = {(time_t)(period_us / 1000000), (long)(period_us % 1000000) * 1000},
+        .it_value = {(time_t)(first_us / 1000000), (long)(first_us % 1000000) * 1000},
+    };
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+/* Microseconds until a HAL-clock deadline; at least 1 so that an overdue timer still fires */
+static uint64_t until_us(hal_t *hal, uint32_t due_ms) {
+    int32_t rem = (int32_t)(due_ms - hal_millis(hal));
+    return rem > 0 ? (uint64_t)rem * 1000 : 1;
+}
+
+static void read_keys(sim_t *s) {
+    unsigned char buf[256];
+    ssize_t n = read(0, buf, sizeof(buf));
+    if (n <= 0) {
+        /* EOF: stop watching stdin, or epoll would report it forever */
+        epoll_ctl(s->epfd, EPOLL_CTL_DEL, 0, NULL);
+        return;
     }
-    return -1;
+    for (ssize_t i = 0; i < n && s->key_len < KEY_QUEUE; i++)
+        s->keys[(s->key_head + s->key_len++) % KEY_QUEUE] = buf[i];
 }
 
-/* --- Physics Simulation --- */
-static int sim_water_level = 0; // 0=EMPTY, 1=LOW, 2=MED, 3=HIGH
-static uint64_t last_physics_tick = 0;
+/* Deliver queued keys. Button keys press for KEY_HOLD_MS, so one waits for the previous. */
+static void service_keys(sim_t *s) {
+    uint32_t now = hal_millis(s->hal);
+
+    if (s->held >= 0) {
+        if ((int32_t)(now - s->key_due) < 0)
+            return;
+        hal_sim_set_button(s->hal, (hal_button_t)s->held, false);
+        trace_app_loop(&s->trace, s->app);
+        s->held = -1;
+        s->key_due = now + KEY_HOLD_MS;
+    }
+
+    while (s->key_len) {
+        int key = s->keys[s->key_head];
+        bool button = !s->app->uploading && (key == 'a' || key == 'b' || key == 'c');
+        if (button && (int32_t)(now - s->key_due) < 0)
+            return;
+        s->key_head = (s->key_head + 1) % KEY_QUEUE;
+        s->key_len--;
 
-static uint64_t get_now_ms(void) {
-    struct timeval now_tv;
-    gettimeofday(&now_tv, NULL);
-    return (uint64_t)now_tv.tv_sec * 1000 + (now_tv.tv_usec / 1000);
+        if (s->app->uploading) {
+            /* Hex digits of an upload are not button presses */
+            trace_app_command(&s->trace, s->app, (char)key);
+            dash_invalidate(&s->dash);
+        } else if (button) {
+            s->held = HAL_BTN_A + (key - 'a');
+            hal_sim_set_button(s->hal, (hal_button_t)s->held, true);
+            run_physics(s->hal);
+            trace_app_loop(&s->trace, s->app);
+            s->key_due = now + KEY_HOLD_MS;
+            return;
+        } else if (key == 'd' || key == 's' || key == 'p' || key == 'u') {
+            trace_app_command(&s->trace, s->app, (char)key);
+            dash_invalidate(&s->dash);
+        } else if (key == 'w') {
+            printf("Water: %.1f L, drum: %.0f rpm\n", sim_phys.litres, sim_phys.rpm);
+            dash_invalidate(&s->dash);
+        }
+    }
 }
 
-static void run_physics(void) {
-    // Read actuators from HAL
-    hal_sim_actuators_t acts = hal_sim_get_actuators();
+/* Re-arm the wall-clock timers for whatever is due next */
+static void update_timers(sim_t *s) {
+    App *app = s->app;
 
-    // Simple timing for water fill/drain simulation
-    uint64_t now = get_now_ms();
+    if (app->ui_state == UI_RUNNING || app->ui_state == UI_ABORT) {
+        uint32_t period = 1000 / app->ctrl.program.ticks_per_second;
+        timer_arm(s->tick_fd, until_us(s->hal, app->last_tick_time + period), 0);
+    } else {
+        timer_arm(s->tick_fd, 0, 0);
+    }
 
-    // Fill/Drain every 2000ms ?? Actually app presets ticks_per_sec is variable.
-    // Let's make it relatively fast for simulation comfort.
-    // App ticks are driven by actual time in app_loop (1s, 0.5s).
-    // Let's make water move every 500ms for responsiveness.
-    if (now - last_physics_tick > 500) {
-        last_physics_tick = now;
+    /* Remote inputs raise no event here, so a shared-memory link polls at the physics rate */
+    bool active = physics_active(s->hal) || s->link;
+    if (active != s->phys_armed) {
+        timer_arm(s->phys_fd, active ? PHYS_DT_MS * 1000 : 0, PHYS_DT_MS * 1000);
+        s->phys_armed = active;
+    }
 
-        if (acts.inlet) {
-            if (sim_water_level < WATER_HIGH) {
-                sim_water_level++;
-            }
+    if (s->held >= 0 || s->key_len)
+        timer_arm(s->key_fd, until_us(s->hal, s->key_due), 0);
+    else
+        timer_arm(s->key_fd, 0, 0);
+}
+
+/* Water and energy of the cycle that just finished, from the controller's usage counters */
+static void print_meter(sim_t *s) {
+    meter_t m;
+    meter_read(&s->app->ctrl.usage, s->app->ctrl.program.ticks_per_second, &s->rates, &m);
+    printf("Cycle: %.1f L water (wash %.1f, rinse %.1f), %.3f kWh, %u relay switches\n",
+           meter_litres(&m), m.litres[WM_PHASE_WASH], m.litres[WM_PHASE_RINSE], meter_kwh(&m),
+           (unsigned)m.switches);
+    dash_invalidate(&s->dash);
+}
+
+/* Hand the machine's state to the waveform, the shared-memory slot and the dashboard */
+static void observe(sim_t *s) {
+    bool done = s->app->ctrl.state == WM_COMPLETE || s->app->ctrl.state == WM_ERROR;
+    if (done && !s->metered)
+        print_meter(s);
+    s->metered = done;
+    if (s->vcd.out)
+        vcd_sample(&s->vcd, s->hal, s->app);
+    if (s->link)
+        shm_link_publish(s->link, s->app);
+    if (s->dash.out)
+        dash_sample(&s->dash, s->hal, s->app, &sim_phys);
+}
+
+/* One LOOP_MS step on the virtual clock */
+static void virtual_step(sim_t *s) {
+    hal_sim_advance(s->hal, LOOP_MS);
+    run_physics(s->hal);
+    service_keys(s);
+    trace_app_loop(&s->trace, s->app);
+    observe(s);
+}
+
+static int watch(int epfd, int fd) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void run(sim_t *s) {
+    while (!quit) {
+        struct epoll_event ev[5];
+        int timeout = s->speed == 0 ? 0 : -1;
+        int due = s->dash.out ? dash_due_ms(&s->dash) : -1;
+        if (due >= 0 && (timeout < 0 || due < timeout))
+            timeout = due; /* Draw the last changes once the frame cap allows */
+        int n = epoll_wait(s->epfd, ev, 5, timeout);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            return;
         }
-        if (acts.drain) {
-            if (sim_water_level > WATER_EMPTY) {
-                sim_water_level--;
+
+        uint64_t steps = 0;
+        bool tick = false;
+        for (int i = 0; i < n; i++) {
+            int fd = ev[i].data.fd;
+            uint64_t expired = 0;
+            if (fd == 0) {
+                read_keys(s);
+                continue;
             }
+            if (read(fd, &expired, sizeof(expired)) != sizeof(expired))
+                continue;
+            if (fd == s->pace_fd)
+                steps = expired < 100 ? expired : 100; /* Do not spiral after a stall */
+            tick |= fd == s->tick_fd;
+        }
+
+        if (s->speed != 1) {
+            if (s->speed == 0)
+                steps = 1;
+            service_keys(s);
+            while (steps--)
+                virtual_step(s);
+            continue;
         }
+
+        run_physics(s->hal);
+        service_keys(s);
+        if (tick || s->link)
+            trace_app_loop(&s->trace, s->app);
+        observe(s);
+        update_timers(s);
     }
+}
 
-    // Update HAL Sensors
-    bool drain_check = (sim_water_level > WATER_EMPTY);
-    hal_sim_set_sensors(drain_check, sim_water_level);
+/* Replay a recorded session as fast as possible and check every actuator write */
+static int replay(const char *path) {
+    static hal_t hal;
+    static App app;
+    static trace_t trace;
+    if (!trace_open_replay(&trace, &hal, path)) {
+        fprintf(stderr, "%s\n", trace.why);
+        return 1;
+    }
+    bool same = trace_replay_run(&trace, &app);
+    fflush(stdout);
+    if (same)
+        fprintf(stderr, "Replay OK: %llu app_loop calls, %llu output changes identical\n",
+                (unsigned long long)trace.loops, (unsigned long long)trace.outputs);
+    else
+        fprintf(stderr, "Replay DIVERGED at %s\n", trace.why);
+    trace_close(&trace);
+    return same ? 0 : 1;
 }
 
-int main(void) {
+/*
+ * Usage: simulation [-x speed] [-R trace | -S name:slot] [-V waves.vcd] [-D fps] [-E rates]
+ *                   | -P trace
+ *   speed 1 (default) runs on the wall clock. Larger values run on a virtual clock
+ *   advanced LOOP_MS per step, 'speed' times faster than real time; 0 runs unthrottled.
+ *   -R records the session to a trace, -P replays one and checks the outputs match.
+ *   -V writes the outputs, sensors and controller state as a VCD waveform.
+ *   -S attaches to slot 'slot' of a shared-memory region (see tools/shmtool): outputs and
+ *   state are published there, sensors and remote presses read from it. Not with -R.
+ *   -D replaces the per-tick log with a panel redrawn in place, at most fps times a second.
+ *   -E sets the rates of the water and energy estimate printed when a cycle ends (meter.h).
+ */
+int main(int argc, char **argv) {
+    long speed = 1, fps = 0;
+    meter_rates_t rates = meter_default_rates();
+    const char *record = NULL, *vcd = NULL, *shm = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "x:R:P:V:S:D:E:")) != -1) {
+        switch (opt) {
+        case 'x':
+            speed = strtol(optarg, NULL, 10);
+            break;
+        case 'R':
+            record = optarg;
+            break;
+        case 'P':
+            return replay(optarg);
+        case 'V':
+            vcd = optarg;
+            break;
+        case 'S':
+            shm = optarg;
+            break;
+        case 'D':
+            fps = strtol(optarg, NULL, 10);
+            fps = fps > 0 ? fps : 1;
+            break;
+        case 'E':
+            if (meter_parse(optarg, &rates))
+                break;
+            /* fall through */
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-x speed] [-R trace | -S name:slot] [-V waves.vcd] [-D fps] "
+                    "[-E rates] | -P trace\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (record && shm) {
+        fprintf(stderr, "simulation: -R and -S cannot be combined (both use the HAL tap)\n");
+        return 1;
+    }
+
     set_conio_terminal_mode();
 
     printf("\n=== Washing Machine Simulation ===\n");
     printf("Controls: 'a' = Start/Pause/OK, 'b' = Next, 'c' = ESC/Abort\n");
+    printf("Commands: 'd' = Dump flight recorder, 's' = Status, 'p' = Latency histograms\n");
+    printf("          'u' = Upload custom step program (hex bytes, end with '.')\n");
+    printf("          'w' = Water volume and drum speed\n");
 
-    // Initialize Application
-    App app;
-    app_init(&app);
-
-    while (1) {
-        // 1. Input Handling -> Simulate Buttons
-        int key = get_key();
+#ifdef WM_COVERAGE
+    static wm_cov_t cov;
+    wm_cov_default = &cov;
+#endif
 
-        // Reset all buttons first
-        hal_sim_set_button(HAL_BTN_A, false);
-        hal_sim_set_button(HAL_BTN_B, false);
-        hal_sim_set_button(HAL_BTN_C, false);
-
-        if (key == 'a')
-            hal_sim_set_button(HAL_BTN_A, true);
-        if (key == 'b')
-            hal_sim_set_button(HAL_BTN_B, true);
-        if (key == 'c')
-            hal_sim_set_button(HAL_BTN_C, true);
+    // Initialize Application
+    static hal_t hal;
+    if (speed != 1) {
+        hal_sim_use_virtual_clock(&hal);
+        printf("Virtual clock: %s\n", speed > 0 ? "accelerated" : "unthrottled");
+    }
+    /* On the dashboard, the menu and status lines of the app's log are all on the panel */
+    hal_sim_set_quiet(&hal, fps != 0);
+    static App app;
+    static sim_t sim;
+    if (record && !trace_record(&sim.trace, &hal, record)) {
+        perror(record);
+        return 1;
+    }
+    if (vcd && !vcd_open(&sim.vcd, vcd)) {
+        perror(vcd);
+        return 1;
+    }
+    trace_app_init(&sim.trace, &app, &hal);
+    static shm_link_t link;
+    shm_region_t *region = NULL;
+    if (shm) {
+        char name[128], why[256];
+        const char *colon = strrchr(shm, ':');
+        unsigned long slot = colon ? strtoul(colon + 1, NULL, 10) : 0;
+        snprintf(name, sizeof(name), "%.*s", colon ? (int)(colon - shm) : (int)strlen(shm), shm);
+        region = shm_attach(name, why, sizeof(why));
+        if (!region) {
+            fprintf(stderr, "%s\n", why);
+            return 1;
+        }
+        if (slot >= region->slots) {
+            fprintf(stderr, "%s has %u slots\n", name, region->slots);
+            return 1;
+        }
+        shm_link_attach(&link, &hal, &region->slot[slot]);
+        sim.link = &link;
+        printf("Shared memory: %s slot %lu\n", name, slot);
+    }
+    phys_params_t params = phys_default_params();
+    phys_init(&sim_phys, &params, rng_for_run(1, 0));
+    run_physics(&hal);
 
-        // 2. Run Physics (Water Level)
-        run_physics();
+    sim.hal = &hal;
+    sim.app = &app;
+    sim.speed = speed;
+    sim.rates = rates;
+    sim.held = -1;
+    sim.key_due = hal_millis(&hal) + KEY_HOLD_MS;
+    sim.pace_fd = -1;
+    sim.epfd = epoll_create1(EPOLL_CLOEXEC);
+    sim.tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    sim.phys_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    sim.key_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (sim.epfd < 0 || sim.tick_fd < 0 || sim.phys_fd < 0 || sim.key_fd < 0 ||
+        watch(sim.epfd, sim.tick_fd) || watch(sim.epfd, sim.phys_fd) ||
+        watch(sim.epfd, sim.key_fd)) {
+        perror("simulation");
+        return 1;
+    }
+    if (speed > 1) {
+        uint64_t pace_us = (uint64_t)LOOP_MS * 1000 / (uint64_t)speed;
+        pace_us = pace_us ? pace_us : 1;
+        sim.pace_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (sim.pace_fd < 0 || watch(sim.epfd, sim.pace_fd)) {
+            perror("simulation");
+            return 1;
+        }
+        timer_arm(sim.pace_fd, pace_us, pace_us);
+    }
+    if (watch(sim.epfd, 0) && errno == EPERM) {
+        /* Regular file on stdin: epoll cannot watch it, so take what fits now */
+        read_keys(&sim);
+    }
 
-        // 3. Run Application Loop
-        app_loop(&app);
+    /* Ctrl-C ends the session cleanly, so a recording is complete */
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
 
-        // 4. Sleep to spare CPU
-        usleep(50000); // 50ms
+    if (fps) {
+        printf("\n");
+        dash_open(&sim.dash, stdout, (unsigned)fps);
     }
+    trace_app_loop(&sim.trace, &app);
+    if (speed == 1)
+        update_timers(&sim);
+    observe(&sim);
+    run(&sim);
+    tcsetattr(0, TCSANOW, &orig_termios);
+    if (fps) {
+        dash_close(&sim.dash, &hal, &app, &sim_phys);
+        fprintf(stderr, "\nDashboard: %llu frames for %llu samples (%llu unchanged, not drawn)\n",
+                (unsigned long long)sim.dash.frames, (unsigned long long)sim.dash.samples,
+                (unsigned long long)sim.dash.skipped);
+    }
+    if (region) {
+        shm_link_detach(&link);
+        shm_detach(region);
+    }
+    if (vcd) {
+        unsigned long long changes = (unsigned long long)sim.vcd.changes;
+        bool ok = vcd_close(&sim.vcd);
+        fprintf(stderr, "\n%s %s: %llu value changes\n", ok ? "Wrote" : "Failed to write", vcd,
+                changes);
+    }
+#ifdef WM_COVERAGE
+    if (!wm_cov_save(wm_cov_path(), &cov))
+        perror(wm_cov_path());
+#endif
 
+    if (record) {
+        bool ok = trace_close(&sim.trace);
+        fprintf(stderr, "\n%s %s: %llu events, %llu app_loop calls\n",
+                ok ? "Recorded" : "Failed to write", record,
+                (unsigned long long)sim.trace.events, (unsigned long long)sim.trace.loops);
+        return ok ? 0 : 1;
+    }
     return 0;
 }
@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include "../lib/flight_recorder/flight_recorder.h"
+
+/* ============================================================
+ * Helpers
+ * ============================================================ */
+
+#define MAX_TICKS 20000
+
+typedef struct {
+    fr_sample_t samples[MAX_TICKS];
+    uint32_t count;
+} capture_t;
+
+static void capture_visit(void *user, const fr_sample_t *s, uint16_t repeat) {
+    capture_t *cap = (capture_t *)user;
+    for (uint16_t i = 0; i < repeat && cap->count < MAX_TICKS; i++)
+        cap->samples[cap->count++] = *s;
+}
+
+static uint32_t decode_all(const flight_recorder_t *fr, capture_t *cap) {
+    uint8_t data[FR_BUF_SIZE];
+    for (uint16_t i = 0; i < fr->used; i++)
+        data[i] = fr_byte_at(fr, i);
+    cap->count = 0;
+    int32_t ticks = fr_decode(data, fr->used, fr->base, capture_visit, cap);
+    assert(ticks >= 0);
+    return (uint32_t)ticks;
+}
+
+/* Deterministic pseudo-cycle: agitation-like motor pattern with occasional level changes */
+static void make_tick(uint32_t t, wm_state_t *state, wm_sensors_t *s, wm_actuators_t *a) {
+    *a = (wm_actuators_t){0};
+    *state = (t / 700) % 2 ? WM_AGITATE : WM_FILL;
+    s->water_level = (water_level_t)((t / 150) % 4);
+    s->drain_check = s->water_level != WATER_EMPTY;
+    a->inlet_valve = *state == WM_FILL;
+    a->motor_dir = *state == WM_AGITATE ? ((t % 50) < 16 ? MOTOR_CW : MOTOR_STOP) : MOTOR_STOP;
+}
+
+static int same(const fr_sample_t *x, wm_state_t st, const wm_sensors_t *s,
+                const wm_actuators_t *a) {
+    return x->state == st && x->water_level == s->water_level &&
+           x->drain_check == s->drain_check && x->inlet_valve == a->inlet_valve &&
+           x->soap_pump == a->soap_pump && x->drain_pump == a->drain_pump &&
+           x->motor_dir == a->motor_dir && x->buzzer == a->buzzer;
+}
+
+/* ============================================================
+ * Tests
+ * ============================================================ */
+
+static void test_roundtrip_without_wrap(void) {
+    static flight_recorder_t fr;
+    static capture_t cap;
+    fr_init(&fr, 100);
+
+    wm_state_t st;
+    wm_sensors_t s = {0};
+    wm_actuators_t a;
+    for (uint32_t t = 0; t < 40; t++) {
+        make_tick(t, &st, &s, &a);
+        fr_record(&fr, st, &s, &a);
+    }
+
+    assert(fr.ticks == 40);
+    assert(decode_all(&fr, &cap) == 40);
+    for (uint32_t t = 0; t < 40; t++) {
+        make_tick(t, &st, &s, &a);
+        assert(same(&cap.samples[t], st, &s, &a));
+    }
+
+    printf("✓ test_roundtrip_without_wrap\n");
+}
+
+static void test_wrap_keeps_latest_history(void) {
+    static flight_recorder_t fr;
+    static capture_t cap;
+    fr_init(&fr, 100);
+
+    const uint32_t total = 15000;
+    wm_state_t st;
+    wm_sensors_t s = {0};
+    wm_actuators_t a;
+    for (uint32_t t = 0; t < total; t++) {
+        make_tick(t, &st, &s, &a);
+        fr_record(&fr, st, &s, &a);
+    }
+
+    assert(fr.used <= FR_BUF_SIZE);
+    uint32_t ticks = decode_all(&fr, &cap);
+    assert(ticks == fr.ticks);
+    assert(ticks < total);
+    /* Delta + RLE should hold well over a minute of 10 Hz ticks */
+    assert(ticks > 600);
+
+    for (uint32_t i = 0; i < ticks; i++) {
+        make_tick(total - ticks + i, &st, &s, &a);
+        assert(same(&cap.samples[i], st, &s, &a));
+    }
+
+    printf("✓ test_wrap_keeps_latest_history\n");
+}
+
+static void test_freeze_on_error(void) {
+    static flight_recorder_t fr;
+    static capture_t cap;
+    fr_init(&fr, 100);
+
+    wm_sensors_t s = {.water_level = WATER_LOW, .drain_check = true};
+    wm_actuators_t a = {.inlet_valve = true};
+    for (int i = 0; i < 10; i++)
+        fr_record(&fr, WM_FILL, &s, &a);
+
+    a = (wm_actuators_t){.buzzer = BUZZER_ERROR};
+    fr_record(&fr, WM_ERROR, &s, &a);
+    assert(fr.frozen);
+
+    /* Nothing is appended while frozen */
+    uint32_t ticks = fr.ticks;
+    for (int i = 0; i < 100; i++)
+        fr_record(&fr, WM_IDLE, &s, &a);
+    assert(fr.ticks == ticks);
+
+    decode_all(&fr, &cap);
+    assert(cap.samples[cap.count - 1].state == WM_ERROR);
+    assert(cap.samples[cap.count - 2].state == WM_FILL);
+    assert(cap.samples[cap.count - 2].inlet_valve == true);
+
+    fr_thaw(&fr);
+    fr_record(&fr, WM_IDLE, &s, &a);
+    assert(fr.ticks == ticks + 1);
+
+    printf("✓ test_freeze_on_error\n");
+}
+
+static void test_button_edges(void) {
+    static flight_recorder_t fr;
+    static capture_t cap;
+    fr_init(&fr, 100);
+
+    wm_sensors_t s = {0};
+    wm_actuators_t a = {0};
+    fr_record(&fr, WM_AGITATE, &s, &a);
+    fr_note_buttons(&fr, FR_BTN_A);
+    fr_note_buttons(&fr, FR_BTN_C);
+    fr_record(&fr, WM_AGITATE, &s, &a);
+    fr_record(&fr, WM_AGITATE, &s, &a);
+
+    decode_all(&fr, &cap);
+    assert(cap.count == 3);
+    assert(cap.samples[0].buttons == 0);
+    assert(cap.samples[1].buttons == (FR_BTN_A | FR_BTN_C));
+    assert(cap.samples[2].buttons == 0);
+
+    printf("✓ test_button_edges\n");
+}
+
+/* ============================================================
+ * Main
+ * ============================================================ */
+
+int main(void) {
+    printf("Running flight recorder unit tests...\n\n");
+
+    test_roundtrip_without_wrap();
+    test_wrap_keeps_latest_history();
+    test_freeze_on_error();
+    test_button_edges();
+
+    printf("\nAll tests PASSED ✅\n");
+    return 0;
+}
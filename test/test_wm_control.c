@@ -1,7 +1,10 @@
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "../lib/wm_control/wm_batch.h"
 #include "../lib/wm_control/wm_control.h"
+#include "../lib/wm_control/wm_coverage.h"
 
 /* ============================================================
  * Test Macros
@@ -30,6 +33,54 @@
  * Helpers
  * ============================================================ */
 
+/* Crude drum: one level step every 3 ticks while filling or draining */
+static void step_water(const wm_actuators_t *a, wm_sensors_t *s, int tick) {
+    if (tick % 3 == 0) {
+        if (a->inlet_valve && s->water_level < WATER_HIGH)
+            s->water_level++;
+        if (a->drain_pump && s->water_level > WATER_EMPTY)
+            s->water_level--;
+    }
+    s->drain_check = s->water_level != WATER_EMPTY;
+}
+
+/* Run a classic controller and its compiled twin side by side; abort_at < 0 = never */
+static void run_twins(wm_program_t program, int abort_at) {
+    wm_controller_t c1, c2;
+    wm_sensors_t s1, s2;
+    wm_actuators_t a1, a2;
+    uint8_t code[WM_CODE_MAX];
+
+    uint8_t len = wm_compile_program(&program, code, sizeof(code));
+    assert(len > 0);
+
+    wm_init(&c1, &s1, &a1, program);
+    wm_init(&c2, &s2, &a2, program);
+    assert(wm_load_code(&c2, code, len));
+    wm_start(&c1);
+    wm_start(&c2);
+
+    for (int t = 0; t < 100000 && c1.state != WM_COMPLETE; t++) {
+        if (t == abort_at) {
+            wm_abort(&c1);
+            wm_abort(&c2);
+        }
+        wm_tick(&c1, &s1, &a1);
+        wm_tick(&c2, &s2, &a2);
+
+        assert(c1.state == c2.state);
+        assert(c1.is_wash_phase == c2.is_wash_phase);
+        assert(a1.inlet_valve == a2.inlet_valve && a1.drain_pump == a2.drain_pump);
+        assert(a1.soap_pump == a2.soap_pump && a1.motor_dir == a2.motor_dir);
+        assert(a1.buzzer == a2.buzzer);
+
+        step_water(&a1, &s1, t);
+        step_water(&a2, &s2, t);
+    }
+    assert(c1.state == WM_COMPLETE && c2.state == WM_COMPLETE);
+    assert(memcmp(&c1.usage, &c2.usage, sizeof(c1.usage)) == 0);
+}
+
 /* ============================================================
  * Tests
  * ============================================================ */
@@ -526,8 +577,403 @@ static void test_spin_logic(void) {
     printf("✓ test_spin_logic\n");
 }
 
+static void test_usage_accounting(void) {
+    wm_controller_t c;
+    wm_sensors_t s;
+    wm_actuators_t a;
+    wm_program_t program = {
+        .wash_count = 2,
+        .rinse_count = 1,
+        .spin_enable = true,
+        .soap_time_sec = 2,
+        .wash_agitate_time_sec = 8,
+        .rinse_agitate_time_sec = 6,
+        .agitate_run_ms = 1500,
+        .agitate_cycle_ms = 4000,
+        .target_water_level = WATER_MED,
+        .water_fill_timeout_sec = 60,
+        .drain_timeout_sec = 60,
+        .ticks_per_second = 10,
+    };
+    uint32_t motor[WM_PHASES][2] = {{0}}, inlet[WM_PHASES] = {0}, drain[WM_PHASES] = {0};
+    uint32_t soap[WM_PHASES] = {0};
+    uint16_t switches = 0;
+    bool was[WM_RELAYS] = {false};
+    int paused_at = -1;
+
+    wm_init(&c, &s, &a, program);
+    wm_start(&c);
+    for (int t = 0; t < 100000 && c.state != WM_COMPLETE; t++) {
+        /* Pause once with the motor running: the paused ticks count nothing */
+        if (paused_at < 0 && c.state == WM_AGITATE && a.motor_dir != MOTOR_STOP) {
+            wm_pause(&c);
+            paused_at = t;
+        } else if (c.state == WM_PAUSED && t == paused_at + 5) {
+            wm_resume(&c);
+        }
+        wm_tick(&c, &s, &a);
+
+        int ph = c.is_wash_phase ? WM_PHASE_WASH : WM_PHASE_RINSE;
+        bool now[WM_RELAYS] = {a.motor_dir != MOTOR_STOP, a.motor_dir == MOTOR_CCW,
+                               a.inlet_valve, a.drain_pump, a.soap_pump};
+        for (int r = 0; r < WM_RELAYS; r++) {
+            switches += now[r] != was[r];
+            was[r] = now[r];
+        }
+        if (a.motor_dir != MOTOR_STOP)
+            motor[ph][a.motor_dir == MOTOR_CCW]++;
+        inlet[ph] += a.inlet_valve;
+        drain[ph] += a.drain_pump;
+        soap[ph] += a.soap_pump;
+        step_water(&a, &s, t);
+    }
+    assert(c.state == WM_COMPLETE);
+    assert(paused_at >= 0);
+
+    uint16_t counted = 0;
+    for (int r = 0; r < WM_RELAYS; r++)
+        counted += c.usage.switches[r];
+    assert(counted == switches);
+    assert(memcmp(c.usage.motor_ticks, motor, sizeof(motor)) == 0);
+    assert(memcmp(c.usage.inlet_ticks, inlet, sizeof(inlet)) == 0);
+    assert(memcmp(c.usage.drain_ticks, drain, sizeof(drain)) == 0);
+    assert(memcmp(c.usage.soap_ticks, soap, sizeof(soap)) == 0);
+    /* Soap is dosed in the wash only; both phases fill, drain and agitate both ways */
+    assert(soap[WM_PHASE_WASH] > 0 && soap[WM_PHASE_RINSE] == 0);
+    for (int ph = 0; ph < WM_PHASES; ph++)
+        assert(inlet[ph] > 0 && drain[ph] > 0 && motor[ph][0] > 0 && motor[ph][1] > 0);
+
+    /* A new cycle starts from zero */
+    wm_init(&c, &s, &a, program);
+    assert(c.usage.relays == 0 && c.usage.switches[WM_RELAY_MOTOR] == 0);
+    assert(c.usage.motor_ticks[WM_PHASE_WASH][0] == 0);
+
+    printf("✓ test_usage_accounting\n");
+}
+
+static void test_compiled_program_matches_classic(void) {
+    wm_program_t program = {
+        .wash_count = 2,
+        .rinse_count = 2,
+        .spin_enable = true,
+        .soap_time_sec = 3,
+        .wash_agitate_time_sec = 12,
+        .rinse_agitate_time_sec = 9,
+        .agitate_run_ms = 1600,
+        .agitate_cycle_ms = 5000,
+        .target_water_level = WATER_MED,
+        .water_fill_timeout_sec = 60,
+        .drain_timeout_sec = 60,
+        .ticks_per_second = 10,
+    };
+
+    run_twins(program, -1);
+
+    /* Single rinse, no spin */
+    program.rinse_count = 1;
+    program.wash_count = 1;
+    program.spin_enable = false;
+    run_twins(program, -1);
+
+    /* Abort mid-wash and mid-rinse */
+    program.rinse_count = 2;
+    program.spin_enable = true;
+    run_twins(program, 100);
+    run_twins(program, 400);
+
+    printf("✓ test_compiled_program_matches_classic\n");
+}
+
+static void test_compiled_preset_size(void) {
+    /* The app's Normal preset: 1 wash, 2 rinses, 15 min each, spin */
+    wm_program_t program = {
+        .wash_count = 1,
+        .rinse_count = 2,
+        .spin_enable = true,
+        .soap_time_sec = 20,
+        .wash_agitate_time_sec = 900,
+        .rinse_agitate_time_sec = 900,
+        .agitate_run_ms = 1600,
+        .agitate_cycle_ms = 5000,
+        .target_water_level = WATER_HIGH,
+        .water_fill_timeout_sec = 600,
+        .drain_timeout_sec = 300,
+        .ticks_per_second = 10,
+    };
+    uint8_t code[WM_CODE_MAX];
+
+    uint8_t len = wm_compile_program(&program, code, sizeof(code));
+    assert(len > 0 && len <= 32);
+    assert(wm_code_valid(code, len, program.ticks_per_second));
+
+    /* Agitation that is not a whole number of deciseconds cannot be expressed */
+    program.agitate_run_ms = 1650;
+    assert(wm_compile_program(&program, code, sizeof(code)) == 0);
+
+    printf("✓ test_compiled_preset_size\n");
+}
+
+static void test_step_program_soak_and_loop(void) {
+    wm_controller_t c;
+    wm_sensors_t s;
+    wm_actuators_t a;
+    wm_program_t program = {
+        .water_fill_timeout_sec = 10,
+        .drain_timeout_sec = 10,
+        .ticks_per_second = 1,
+    };
+
+    /* Pre-wash, soak, then two rinses with a short intermediate spin */
+    const uint8_t code[] = {
+        WM_OP_FILL,  WATER_LOW, WM_OP_AGITATE, 20, 50, 4, 0, WM_OP_DRAIN,
+        WM_OP_FILL,  WATER_MED, WM_OP_SOAK,    5,  0,  WM_OP_DRAIN, WM_OP_RINSE,
+        WM_OP_FILL,  WATER_MED, WM_OP_AGITATE, 20, 50, 3, 0, WM_OP_DRAIN, WM_OP_SPIN, 2, 0,
+        WM_OP_LOOP,  2,         11,            WM_OP_END,
+    };
+
+    wm_init(&c, &s, &a, program);
+    assert(wm_load_code(&c, code, sizeof(code)));
+    wm_start(&c);
+
+    wm_state_t seen[64];
+    int n = 0;
+    wm_state_t last = c.state;
+    for (int t = 0; t < 1000 && c.state != WM_COMPLETE; t++) {
+        wm_tick(&c, &s, &a);
+        if (c.state == WM_SOAK)
+            assert(a.motor_dir == MOTOR_STOP && !a.inlet_valve && !a.drain_pump);
+        if (c.state != last && n < 64)
+            seen[n++] = c.state;
+        last = c.state;
+        step_water(&a, &s, 0);
+    }
+
+    const wm_state_t expected[] = {WM_FILL, WM_AGITATE, WM_DRAIN, WM_FILL, WM_SOAK,
+                                   WM_DRAIN, WM_FILL, WM_AGITATE, WM_DRAIN, WM_SPIN,
+                                   WM_FILL, WM_AGITATE, WM_DRAIN, WM_SPIN, WM_COMPLETE};
+    assert(n == (int)(sizeof(expected) / sizeof(expected[0])));
+    for (int i = 0; i < n; i++)
+        assert(seen[i] == expected[i]);
+    assert(c.is_wash_phase == false);
+    assert(c.rinse_done == 2);
+
+    printf("✓ test_step_program_soak_and_loop\n");
+}
+
+static void test_invalid_step_program(void) {
+    wm_controller_t c;
+    wm_sensors_t s;
+    wm_actuators_t a;
+    wm_program_t program = {.water_fill_timeout_sec = 1, .drain_timeout_sec = 1,
+                            .ticks_per_second = 1};
+
+    const uint8_t bad_opcode[] = {WM_OP_FILL, WATER_LOW, 0x7F};
+    const uint8_t truncated[] = {WM_OP_SOAP, 5};
+    const uint8_t nested_loop[] = {WM_OP_DRAIN, WM_OP_LOOP, 2, 1, WM_OP_LOOP, 2, 4};
+    const uint8_t short_cycle[] = {WM_OP_AGITATE, 2, 5, 10, 0}; /* 0.5 s half cycle at 1 Hz */
+    const uint8_t untimed_loop[] = {WM_OP_DRAIN, WM_OP_RINSE, WM_OP_LOOP, 255, 1};
+    const uint8_t timed_loop[] = {WM_OP_RINSE, WM_OP_DRAIN, WM_OP_LOOP, 255, 2};
+
+    assert(!wm_code_valid(bad_opcode, sizeof(bad_opcode), 1));
+    assert(!wm_code_valid(truncated, sizeof(truncated), 1));
+    assert(!wm_code_valid(nested_loop, sizeof(nested_loop), 1));
+    assert(!wm_code_valid(short_cycle, sizeof(short_cycle), 1));
+    assert(wm_code_valid(short_cycle, sizeof(short_cycle), 10));
+    assert(!wm_code_valid(untimed_loop, sizeof(untimed_loop), 1));
+    assert(wm_code_valid(timed_loop, sizeof(timed_loop), 1));
+
+    wm_init(&c, &s, &a, program);
+    assert(!wm_load_code(&c, truncated, sizeof(truncated)));
+    assert(c.state == WM_ERROR);
+    assert(c.error_code == WM_ERR_INVALID_PROGRAM);
+
+    printf("✓ test_invalid_step_program\n");
+}
+
+/* ============================================================
+ * Batched stepping (wm_tick_batch)
+ * ============================================================ */
+
+static uint32_t test_rand(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+static wm_program_t random_program(uint32_t *seed) {
+    wm_program_t p = {
+        .wash_count = (uint8_t)(test_rand(seed) % 4),
+        .rinse_count = (uint8_t)(test_rand(seed) % 4),
+        .spin_enable = test_rand(seed) & 1,
+        .soap_time_sec = (uint16_t)(test_rand(seed) % 6),
+        .wash_agitate_time_sec = (uint16_t)(1 + test_rand(seed) % 30),
+        .rinse_agitate_time_sec = (uint16_t)(1 + test_rand(seed) % 20),
+        .agitate_run_ms = (uint16_t)(100 + test_rand(seed) % 3000),
+        .agitate_cycle_ms = (uint16_t)(1000 + test_rand(seed) % 4000),
+        .target_water_level = (water_level_t)(1 + test_rand(seed) % 3),
+        .water_fill_timeout_sec = (uint16_t)(1 + test_rand(seed) % 30),
+        .drain_timeout_sec = (uint16_t)(1 + test_rand(seed) % 30),
+        .ticks_per_second = (uint8_t)(1 + test_rand(seed) % 20),
+    };
+    return p;
+}
+
+#define BATCH_N 37 /* Not a multiple of the vector width */
+
+/* Reference controllers and a batch driven with the same random sensors and commands */
+static void test_batch_matches_wm_tick(void) {
+    wm_controller_t ref[BATCH_N];
+    wm_sensors_t sens[BATCH_N];
+    wm_actuators_t act[BATCH_N];
+    wm_batch_t b;
+    uint32_t seed = 12345;
+
+    assert(wm_batch_init(&b, BATCH_N));
+    for (int i = 0; i < BATCH_N; i++) {
+        wm_init(&ref[i], &sens[i], &act[i], random_program(&seed));
+        wm_start(&ref[i]);
+        assert(wm_batch_set(&b, i, &ref[i]));
+    }
+
+    for (int t = 0; t < 200000; t++) {
+        for (int i = 0; i < BATCH_N; i++) {
+            /* Crude drum with glitches: random level readings 2% of the time */
+            step_water(&act[i], &sens[i], t);
+            if (test_rand(&seed) % 50 == 0) {
+                sens[i].water_level = (water_level_t)(test_rand(&seed) % 4);
+                sens[i].drain_check = test_rand(&seed) & 1;
+            }
+            b.water_level[i] = sens[i].water_level;
+            b.drain_check[i] = sens[i].drain_check;
+
+            /* Occasional user commands; lane 0 never restarts, so its state_time wraps */
+            uint32_t r = test_rand(&seed) % 4000;
+            if (r < 4) {
+                wm_controller_t *c = &ref[i];
+                if (r == 0)
+                    wm_pause(c);
+                else if (r == 1)
+                    wm_resume(c);
+                else if (r == 2)
+                    wm_abort(c);
+                else if (i != 0 && (c->state == WM_COMPLETE || c->state == WM_ERROR)) {
+                    wm_init(c, &sens[i], &act[i], random_program(&seed));
+                    wm_start(c);
+                }
+                assert(wm_batch_set(&b, i, c));
+            }
+        }
+
+        wm_tick_batch(&b);
+        for (int i = 0; i < BATCH_N; i++) {
+            wm_controller_t got = ref[i];
+            wm_actuators_t a;
+
+            wm_tick(&ref[i], &sens[i], &act[i]);
+            wm_batch_get(&b, i, &got);
+            wm_batch_actuators(b.out[i], &a);
+
+            assert(got.state == ref[i].state && got.state_time == ref[i].state_time);
+            assert(got.error_code == ref[i].error_code);
+            assert(got.is_wash_phase == ref[i].is_wash_phase);
+            assert(got.wash_done == ref[i].wash_done && got.rinse_done == ref[i].rinse_done);
+            assert(a.inlet_valve == act[i].inlet_valve && a.drain_pump == act[i].drain_pump);
+            assert(a.soap_pump == act[i].soap_pump && a.motor_dir == act[i].motor_dir);
+            assert(a.buzzer == act[i].buzzer);
+        }
+    }
+
+    wm_batch_free(&b);
+    printf("✓ test_batch_matches_wm_tick\n");
+}
+
+/* Agitation longer than 65535 ticks: state_time wraps and the cycle phase must follow */
+static void test_batch_agitate_wrap(void) {
+    wm_controller_t ref;
+    wm_sensors_t s;
+    wm_actuators_t a, got_a;
+    wm_batch_t b;
+
+    wm_program_t program = {
+        .wash_count = 1,
+        .rinse_count = 1,
+        .soap_time_sec = 0,
+        .wash_agitate_time_sec = 7000,
+        .rinse_agitate_time_sec = 5,
+        .agitate_run_ms = 1300,
+        .agitate_cycle_ms = 1700,
+        .target_water_level = WATER_LOW,
+        .water_fill_timeout_sec = 10,
+        .drain_timeout_sec = 10,
+        .ticks_per_second = 10,
+    };
+
+    wm_init(&ref, &s, &a, program);
+    wm_start(&ref);
+    s.water_level = WATER_LOW;
+    s.drain_check = true;
+
+    assert(wm_batch_init(&b, 1));
+    assert(wm_batch_set(&b, 0, &ref));
+    b.water_level[0] = s.water_level;
+    b.drain_check[0] = s.drain_check;
+
+    for (int t = 0; t < 70000; t++) {
+        wm_tick(&ref, &s, &a);
+        wm_tick_batch(&b);
+        wm_batch_actuators(b.out[0], &got_a);
+        assert(b.state[0] == (uint32_t)ref.state && b.state_time[0] == ref.state_time);
+        assert(got_a.motor_dir == a.motor_dir);
+    }
+    assert(ref.state == WM_AGITATE);
+
+    wm_batch_free(&b);
+    printf("✓ test_batch_agitate_wrap\n");
+}
+
+static void test_batch_rejects_unsupported(void) {
+    wm_controller_t c;
+    wm_sensors_t s;
+    wm_actuators_t a;
+    wm_batch_t b;
+    uint8_t code[WM_CODE_MAX];
+
+    wm_program_t program = {
+        .wash_count = 1,
+        .rinse_count = 1,
+        .soap_time_sec = 2,
+        .wash_agitate_time_sec = 5,
+        .rinse_agitate_time_sec = 5,
+        .agitate_run_ms = 1600,
+        .agitate_cycle_ms = 5000,
+        .target_water_level = WATER_MED,
+        .water_fill_timeout_sec = 10,
+        .drain_timeout_sec = 10,
+        .ticks_per_second = 10,
+    };
+    assert(wm_batch_init(&b, 1));
+
+    /* Step programs */
+    wm_init(&c, &s, &a, program);
+    uint8_t len = wm_compile_program(&program, code, sizeof(code));
+    assert(len > 0 && wm_load_code(&c, code, len));
+    assert(!wm_batch_set(&b, 0, &c));
+
+    /* Agitation window below one tick */
+    program.agitate_cycle_ms = 50;
+    program.ticks_per_second = 10;
+    wm_init(&c, &s, &a, program);
+    assert(!wm_batch_set(&b, 0, &c));
+
+    wm_batch_free(&b);
+    printf("✓ test_batch_rejects_unsupported\n");
+}
+
 int main(void) {
     printf("Running washing machine unit tests...\n\n");
+#ifdef WM_COVERAGE
+    static wm_cov_t cov;
+    wm_cov_default = &cov;
+#endif
 
     test_init_state();
     test_start_to_fill();
@@ -543,7 +989,23 @@ int main(void) {
     /* New Tests */
     test_full_standard_cycle();
     test_spin_logic();
+    test_usage_accounting();
+
+    /* Step programs */
+    test_compiled_program_matches_classic();
+    test_compiled_preset_size();
+    test_step_program_soak_and_loop();
+    test_invalid_step_program();
+
+    /* Batched stepping */
+    test_batch_matches_wm_tick();
+    test_batch_agitate_wrap();
+    test_batch_rejects_unsupported();
 
     printf("\nAll tests PASSED ✅\n");
+#ifdef WM_COVERAGE
+    if (!wm_cov_save(wm_cov_path(), &cov))
+        perror(wm_cov_path());
+#endif
     return 0;
 }
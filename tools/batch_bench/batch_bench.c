@@ -0,0 +1,183 @@
+/*
+ * Batched stepping benchmark.
+ *
+ * Steps the same fleet of controllers with wm_tick (one wm_controller_t after another) and
+ * with wm_tick_batch, and reports machine-ticks per second on one core for each. Machines
+ * start at staggered points of a cycle so every state is represented, and a small integer
+ * drum model feeds the sensors between ticks (not timed). The final states of both fleets
+ * must match.
+ *
+ * Usage: batch_bench [-n machines] [-t ticks] [-s seed]
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wm_batch.h"
+#include "wm_control.h"
+
+#define WATER_MAX 60 /* Drum capacity in model units */
+#define WATER_PER_LEVEL 15
+
+typedef struct {
+    size_t n;
+    wm_controller_t *ctrl;
+    wm_sensors_t *sens;
+    wm_actuators_t *act;
+    int *water;
+} fleet_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Inlet adds one unit per tick, the drain pump removes two */
+static int drum_step(int water, int inlet, int drain, water_level_t *level, bool *wet) {
+    water += inlet - 2 * drain;
+    water = water < 0 ? 0 : water > WATER_MAX ? WATER_MAX : water;
+    *level = (water_level_t)(water / WATER_PER_LEVEL > WATER_HIGH ? WATER_HIGH
+                                                                  : water / WATER_PER_LEVEL);
+    *wet = water > 0;
+    return water;
+}
+
+static void fleet_drum(fleet_t *f, size_t i) {
+    f->water[i] = drum_step(f->water[i], f->act[i].inlet_valve, f->act[i].drain_pump,
+                            &f->sens[i].water_level, &f->sens[i].drain_check);
+}
+
+static wm_program_t bench_program(unsigned r) {
+    wm_program_t p = {
+        .wash_count = (uint8_t)(1 + r % 2),
+        .rinse_count = (uint8_t)(1 + r % 3),
+        .spin_enable = (r & 1) != 0,
+        .soap_time_sec = 10,
+        .wash_agitate_time_sec = (uint16_t)(300 + r % 600),
+        .rinse_agitate_time_sec = (uint16_t)(120 + r % 240),
+        .agitate_run_ms = (r & 2) ? 1600 : 4000,
+        .agitate_cycle_ms = 5000,
+        .target_water_level = (water_level_t)(WATER_LOW + r % 3),
+        .water_fill_timeout_sec = 600,
+        .drain_timeout_sec = 300,
+        .ticks_per_second = 10,
+    };
+    return p;
+}
+
+static const char *batch_isa(void) {
+#if defined(WM_BATCH_SCALAR)
+    return "scalar";
+#elif defined(__x86_64__) && defined(__linux__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? "AVX2" : "SSE2";
+#else
+    return "generic vectors";
+#endif
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-n machines] [-t ticks] [-s seed]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    size_t n = 4096;
+    long ticks = 2000;
+    unsigned seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            ticks = atol(optarg);
+            break;
+        case 's':
+            seed = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (n == 0 || ticks <= 0)
+        usage(argv[0]);
+
+    fleet_t f = {n, calloc(n, sizeof(wm_controller_t)), calloc(n, sizeof(wm_sensors_t)),
+                 calloc(n, sizeof(wm_actuators_t)), calloc(n, sizeof(int))};
+    int *batch_water = calloc(n, sizeof(int));
+    wm_batch_t b;
+    if (!f.ctrl || !f.sens || !f.act || !f.water || !batch_water || !wm_batch_init(&b, n)) {
+        fprintf(stderr, "batch_bench: out of memory\n");
+        return 1;
+    }
+
+    /* Start every machine somewhere in its first hour */
+    srand(seed);
+    for (size_t i = 0; i < n; i++) {
+        wm_init(&f.ctrl[i], &f.sens[i], &f.act[i], bench_program((unsigned)rand()));
+        wm_start(&f.ctrl[i]);
+        for (long t = rand() % 36000; t > 0; t--) {
+            wm_tick(&f.ctrl[i], &f.sens[i], &f.act[i]);
+            fleet_drum(&f, i);
+        }
+        wm_batch_set(&b, i, &f.ctrl[i]);
+        b.water_level[i] = f.sens[i].water_level;
+        b.drain_check[i] = f.sens[i].drain_check;
+        batch_water[i] = f.water[i];
+    }
+
+    double t_tick = 0.0, t_batch = 0.0;
+    for (long t = 0; t < ticks; t++) {
+        double t0 = now_sec();
+        for (size_t i = 0; i < n; i++)
+            wm_tick(&f.ctrl[i], &f.sens[i], &f.act[i]);
+        t_tick += now_sec() - t0;
+        for (size_t i = 0; i < n; i++)
+            fleet_drum(&f, i);
+
+        t0 = now_sec();
+        wm_tick_batch(&b);
+        t_batch += now_sec() - t0;
+        for (size_t i = 0; i < n; i++) {
+            water_level_t level;
+            bool wet;
+            uint32_t out = b.out[i];
+            batch_water[i] = drum_step(batch_water[i], (out & WM_OUT_INLET) != 0,
+                                       (out & WM_OUT_DRAIN) != 0, &level, &wet);
+            b.water_level[i] = level;
+            b.drain_check[i] = wet;
+        }
+    }
+
+    size_t mismatched = 0;
+    for (size_t i = 0; i < n; i++) {
+        wm_controller_t c = f.ctrl[i];
+        wm_batch_get(&b, i, &c);
+        mismatched += c.state != f.ctrl[i].state || c.state_time != f.ctrl[i].state_time;
+    }
+
+    double mt = (double)n * ticks;
+    printf("%zu machines x %ld ticks, batch kernel: %s\n", n, ticks, batch_isa());
+    printf("wm_tick       : %8.1f M machine-ticks/s per core\n", mt / t_tick / 1e6);
+    printf("wm_tick_batch : %8.1f M machine-ticks/s per core (%.1fx)\n", mt / t_batch / 1e6,
+           t_tick / t_batch);
+    if (mismatched) {
+        printf("FAIL: %zu machines diverged from wm_tick\n", mismatched);
+        return 1;
+    }
+
+    wm_batch_free(&b);
+    free(batch_water);
+    free(f.ctrl);
+    free(f.sens);
+    free(f.act);
+    free(f.water);
+    return 0;
+}
@@ -0,0 +1,564 @@
+/*
+ * Microbenchmark suite.
+ *
+ * Times the host-side hot paths, each as the cost of one operation:
+ *
+ *   tick/<state>      one wm_tick in each controller state (the controller is copied from a
+ *                     snapshot before every tick, so it stays in that state)
+ *   eta/<case>        wm_get_time_remaining_sec, classic and step programs
+ *   app_loop/<case>   one app_loop on a silenced HAL with a virtual clock: in the menu, while
+ *                     running with no tick due, and while running with a controller tick due
+ *   pcm/<song>        the buzzer's PCM synthesis of a whole song (written to /dev/null)
+ *   midi/parse        the MIDI generator parsing a generated two-track file (about 500
+ *                     notes with running status, tempo and program changes)
+ *   cycle/<program>   a whole headless cycle: menu, App, HAL and water model
+ *
+ * An operation is repeated until one sample takes at least -m ms, after a first round that
+ * also warms caches. Each benchmark takes -n samples; the report gives the minimum, the
+ * 10th, 50th, 90th and 99th percentiles and the maximum of the per-operation time.
+ *
+ * -o writes the results as JSON, one benchmark per line. -b compares the medians with a
+ * baseline written earlier by -o: a benchmark more than -t (a fraction) slower than its
+ * baseline is a regression and the exit status is 1. Benchmarks missing from the baseline
+ * are reported but never fail.
+ *
+ * Usage: bench [-o results.json] [-b baseline.json] [-t tolerance] [-f filter]
+ *              [-n samples] [-m min_sample_ms]
+ */
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../lib/buzzer/buzzer.h"
+#include "../../lib/buzzer/generator.h"
+#include "app.h"
+#include "hal.h"
+#include "headless.h"
+#include "wm_control.h"
+
+#define MAX_SAMPLES 1001
+#define MAX_BENCH 64
+#define MIDI_NOTES 500
+
+typedef void (*bench_fn)(void *ctx, uint64_t reps);
+
+typedef struct {
+    char name[48];
+    uint64_t ops; /* Operations timed, all samples */
+    double min, p10, median, p90, p99, max; /* ns per operation */
+} result_t;
+
+typedef struct {
+    char name[48];
+    double median;
+} baseline_t;
+
+static FILE *report;
+static const char *filter;
+static unsigned samples = 31;
+static double min_sample_ns = 2e6;
+static result_t results[MAX_BENCH];
+static unsigned result_count;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted v */
+static double percentile(const double *v, unsigned n, double p) {
+    return v[(unsigned)(p * (n - 1) + 0.5)];
+}
+
+static void run(const char *name, bench_fn fn, void *ctx) {
+    if (filter && !strstr(name, filter))
+        return;
+    if (result_count == MAX_BENCH) {
+        fprintf(stderr, "Too many benchmarks, %s skipped\n", name);
+        return;
+    }
+
+    /* Double the repetitions until a sample is long enough to time */
+    uint64_t reps = 1;
+    for (;;) {
+        uint64_t t0 = now_ns();
+        fn(ctx, reps);
+        if ((double)(now_ns() - t0) >= min_sample_ns || reps >= (1ull << 40))
+            break;
+        reps *= 2;
+    }
+
+    double per_op[MAX_SAMPLES];
+    for (unsigned i = 0; i < samples; i++) {
+        uint64_t t0 = now_ns();
+        fn(ctx, reps);
+        per_op[i] = (double)(now_ns() - t0) / (double)reps;
+    }
+    qsort(per_op, samples, sizeof(double), cmp_double);
+
+    result_t *r = &results[result_count++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->ops = reps * samples;
+    r->min = per_op[0];
+    r->p10 = percentile(per_op, samples, 0.10);
+    r->median = percentile(per_op, samples, 0.50);
+    r->p90 = percentile(per_op, samples, 0.90);
+    r->p99 = percentile(per_op, samples, 0.99);
+    r->max = per_op[samples - 1];
+}
+
+/* --- wm_tick and ETA --- */
+static const wm_program_t program = {
+    .wash_count = 2,
+    .rinse_count = 2,
+    .spin_enable = true,
+    .soap_time_sec = 2,
+    .wash_agitate_time_sec = 10,
+    .rinse_agitate_time_sec = 10,
+    .agitate_run_ms = 1600,
+    .agitate_cycle_ms = 5000,
+    .target_water_level = WATER_MED,
+    .water_fill_timeout_sec = 20,
+    .drain_timeout_sec = 20,
+    .ticks_per_second = 10,
+};
+
+typedef struct {
+    const char *name;
+    wm_state_t state;
+    uint16_t state_time;
+    bool is_wash_phase;
+    water_level_t level;
+    bool drain_check;
+    bool pause; /* Paused from that state */
+} tick_case_t;
+
+/* One case per state, away from its transitions. START moves to FILL on every tick. */
+/* clang-format off */
+static const tick_case_t tick_cases[] = {
+    /* name        state        time wash level         chk    pause */
+    {"idle",       WM_IDLE,      0,  1,   WATER_EMPTY, false, false},
+    {"start",      WM_START,     0,  1,   WATER_EMPTY, false, false},
+    {"fill",       WM_FILL,      5,  1,   WATER_LOW,   true,  false},
+    {"soap",       WM_SOAP,      3,  1,   WATER_MED,   true,  false},
+    {"agitate",    WM_AGITATE,   3,  1,   WATER_MED,   true,  false},
+    {"drain",      WM_DRAIN,     5,  1,   WATER_LOW,   true,  false},
+    {"spin",       WM_SPIN,     10,  0,   WATER_EMPTY, false, false},
+    {"paused",     WM_AGITATE,   3,  1,   WATER_MED,   true,  true},
+    {"complete",   WM_COMPLETE,  0,  0,   WATER_EMPTY, false, false},
+    {"error",      WM_ERROR,     0,  1,   WATER_LOW,   true,  false},
+};
+/* clang-format on */
+#define NUM_TICK_CASES (sizeof(tick_cases) / sizeof(tick_cases[0]))
+
+typedef struct {
+    wm_controller_t proto, c;
+    wm_sensors_t s;
+    wm_actuators_t a;
+} tick_ctx_t;
+
+static void tick_setup(tick_ctx_t *t, const tick_case_t *k) {
+    wm_init(&t->proto, &t->s, &t->a, program);
+    t->proto.state = k->state;
+    t->proto.state_time = k->state_time;
+    t->proto.is_wash_phase = k->is_wash_phase;
+    t->proto.rinse_done = k->is_wash_phase ? 0 : 2;
+    t->proto.wash_done = k->is_wash_phase ? 0 : 2;
+    if (k->pause)
+        wm_pause(&t->proto);
+    t->s.water_level = k->level;
+    t->s.drain_check = k->drain_check;
+}
+
+static void bench_tick(void *ctx, uint64_t reps) {
+    tick_ctx_t *t = ctx;
+    for (uint64_t i = 0; i < reps; i++) {
+        t->c = t->proto;
+        wm_tick(&t->c, &t->s, &t->a);
+    }
+}
+
+static volatile uint32_t sink;
+
+static void bench_eta(void *ctx, uint64_t reps) {
+    tick_ctx_t *t = ctx;
+    uint32_t sum = 0;
+    for (uint64_t i = 0; i < reps; i++)
+        sum += wm_get_time_remaining_sec(&t->proto);
+    sink = sum;
+}
+
+static void eta_benches(void) {
+    static tick_ctx_t t;
+
+    wm_init(&t.proto, &t.s, &t.a, program);
+    t.proto.state = WM_FILL;
+    t.proto.state_time = 5;
+    run("eta/wash_fill", bench_eta, &t);
+
+    t.proto.state = WM_AGITATE;
+    t.proto.is_wash_phase = false;
+    t.proto.wash_done = 2;
+    t.proto.rinse_done = 1;
+    run("eta/rinse_agitate", bench_eta, &t);
+
+    /* The same program as steps, at its first step: the whole program is ahead */
+    uint8_t code[WM_CODE_MAX];
+    uint8_t len = wm_compile_program(&program, code, sizeof(code));
+    wm_init(&t.proto, &t.s, &t.a, program);
+    if (!len || !wm_load_code(&t.proto, code, len)) {
+        fprintf(stderr, "Benchmark program does not compile\n");
+        exit(1);
+    }
+    wm_start(&t.proto);
+    wm_tick(&t.proto, &t.s, &t.a);
+    run("eta/steps", bench_eta, &t);
+}
+
+/* --- app_loop on a silenced HAL --- */
+typedef enum { LOOP_MENU, LOOP_POLL, LOOP_TICK } loop_case_t;
+
+typedef struct {
+    hal_t hal;
+    App app;
+    wm_controller_t proto;
+    loop_case_t what;
+} loop_ctx_t;
+
+static void bench_loop(void *ctx, uint64_t reps) {
+    loop_ctx_t *l = ctx;
+    App *app = &l->app;
+    for (uint64_t i = 0; i < reps; i++) {
+        if (l->what != LOOP_MENU) {
+            app->ctrl = l->proto;
+            app->ui_state = UI_RUNNING;
+            app->last_tick_time = hal_millis(&l->hal) - (l->what == LOOP_TICK ? 1000 : 0);
+        }
+        app_loop(app);
+    }
+}
+
+static void loop_benches(void) {
+    static loop_ctx_t l;
+    static const char *const names[] = {"app_loop/menu", "app_loop/poll", "app_loop/tick"};
+
+    hal_sim_use_virtual_clock(&l.hal);
+    hal_sim_set_quiet(&l.hal, true);
+    app_init(&l.app, &l.hal);
+    hal_sim_set_sensors(&l.hal, true, WATER_MED);
+
+    wm_sensors_t s;
+    wm_actuators_t a;
+    wm_init(&l.proto, &s, &a, program);
+    l.proto.state = WM_AGITATE;
+    l.proto.state_time = 3;
+
+    for (int w = LOOP_MENU; w <= LOOP_TICK; w++) {
+        l.what = (loop_case_t)w;
+        run(names[w], bench_loop, &l);
+    }
+}
+
+/* --- Buzzer PCM synthesis --- */
+static void bench_pcm(void *ctx, uint64_t reps) {
+    song_id_t song = *(const song_id_t *)ctx;
+    for (uint64_t i = 0; i < reps; i++)
+        buzzer_play_song(song);
+}
+
+/* --- MIDI parsing --- */
+typedef struct {
+    char path[64];
+    FILE *out;
+} midi_ctx_t;
+
+static size_t put_be(uint8_t *p, uint32_t v, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        p[i] = (uint8_t)(v >> (8 * (bytes - 1 - i)));
+    return (size_t)bytes;
+}
+
+static size_t put_varlen(uint8_t *p, uint32_t v) {
+    uint8_t tmp[4];
+    size_t n = 0;
+    do {
+        tmp[n++] = v & 0x7F;
+        v >>= 7;
+    } while (v);
+    for (size_t i = 0; i < n; i++)
+        p[i] = (uint8_t)(tmp[n - 1 - i] | (i + 1 < n ? 0x80 : 0));
+    return n;
+}
+
+static size_t put_track(uint8_t *p, const uint8_t *body, size_t len) {
+    size_t n = put_be(p, 0x4D54726B, 4);
+    n += put_be(p + n, (uint32_t)len, 4);
+    memcpy(p + n, body, len);
+    return n + len;
+}
+
+/* A format 1 file: a conductor track (name, tempo) and a melody with running status */
+static size_t make_midi(uint8_t *buf) {
+    static uint8_t body[MIDI_NOTES * 8 + 64];
+    size_t n = put_be(buf, 0x4D546864, 4);
+    n += put_be(buf + n, 6, 4);
+    n += put_be(buf + n, 1, 2);   /* Format */
+    n += put_be(buf + n, 2, 2);   /* Tracks */
+    n += put_be(buf + n, 480, 2); /* Ticks per quarter note */
+
+    size_t b = 0;
+    static const uint8_t conductor[] = {0x00, 0xFF, 0x03, 0x04, 'b', 'e', 'n', 'c',
+                                        0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20,
+                                        0x00, 0xFF, 0x2F, 0x00};
+    n += put_track(buf + n, conductor, sizeof(conductor));
+
+    body[b++] = 0x00;
+    body[b++] = 0xC0; /* Program change */
+    body[b++] = 0x50;
+    for (unsigned i = 0; i < MIDI_NOTES; i++) {
+        uint8_t note = (uint8_t)(60 + (i * 7) % 24);
+        b += put_varlen(body + b, i % 8 == 7 ? 240 : 0);
+        if (i == 0)
+            body[b++] = 0x90;
+        body[b++] = note; /* Running status: note on */
+        body[b++] = 0x64;
+        b += put_varlen(body + b, 200 + (i % 3) * 40);
+        body[b++] = note; /* Note on with velocity 0: note off */
+        body[b++] = 0x00;
+    }
+    body[b++] = 0x00;
+    body[b++] = 0xFF;
+    body[b++] = 0x2F;
+    body[b++] = 0x00;
+    return n + put_track(buf + n, body, b);
+}
+
+static void bench_midi(void *ctx, uint64_t reps) {
+    midi_ctx_t *m = ctx;
+    for (uint64_t i = 0; i < reps; i++) {
+        rewind(m->out);
+        if (process_midi(m->path, "bench", m->out) != 0) {
+            fprintf(stderr, "%s: not parsed\n", m->path);
+            exit(1);
+        }
+    }
+}
+
+static void midi_benches(void) {
+    static uint8_t buf[MIDI_NOTES * 8 + 256];
+    static midi_ctx_t m;
+    snprintf(m.path, sizeof(m.path), "/tmp/wm_bench_XXXXXX");
+    int fd = mkstemp(m.path);
+    size_t len = make_midi(buf);
+    if (fd < 0 || write(fd, buf, len) != (ssize_t)len) {
+        perror(m.path);
+        exit(1);
+    }
+    close(fd);
+    m.out = fopen("/dev/null", "w");
+    if (!m.out) {
+        perror("/dev/null");
+        exit(1);
+    }
+    run("midi/parse", bench_midi, &m);
+    fclose(m.out);
+    unlink(m.path);
+}
+
+/* --- Whole cycles --- */
+static void bench_cycle(void *ctx, uint64_t reps) {
+    const hl_config_t *cfg = ctx;
+    hl_result_t res;
+    for (uint64_t i = 0; i < reps; i++) {
+        hl_run(cfg, &res);
+        if (res.final_state != WM_COMPLETE) {
+            fprintf(stderr, "Benchmark cycle ended in %s\n", wm_state_str(res.final_state));
+            exit(1);
+        }
+    }
+}
+
+static void cycle_benches(void) {
+    static const char *const names[] = {"cycle/normal", "cycle/short", "cycle/express"};
+    for (int p = 0; p < 3; p++) {
+        hl_config_t cfg = {0};
+        cfg.program = p;
+        cfg.level = 1;
+        cfg.power = 0;
+        cfg.phys = phys_default_params();
+        cfg.rng = rng_for_run(1, (uint64_t)p);
+        run(names[p], bench_cycle, &cfg);
+    }
+}
+
+/* --- Results --- */
+static bool write_json(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    fprintf(f, "{\n  \"unit\": \"ns\",\n  \"samples\": %u,\n  \"benchmarks\": [\n", samples);
+    for (unsigned i = 0; i < result_count; i++) {
+        const result_t *r = &results[i];
+        fprintf(f,
+                "    {\"name\": \"%s\", \"ops\": %llu, \"min\": %.2f, \"p10\": %.2f, "
+                "\"median\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f}%s\n",
+                r->name, (unsigned long long)r->ops, r->min, r->p10, r->median, r->p90, r->p99,
+                r->max, i + 1 < result_count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+/* Read the name and median of each benchmark line of a file written by write_json */
+static int read_baseline(const char *path, baseline_t *out, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[512];
+    int n = 0;
+    while (n < max && fgets(line, sizeof(line), f)) {
+        const char *name = strstr(line, "\"name\": \"");
+        const char *median = strstr(line, "\"median\": ");
+        if (!name || !median)
+            continue;
+        if (sscanf(name, "\"name\": \"%47[^\"]\"", out[n].name) != 1)
+            continue;
+        out[n].median = strtod(median + 10, NULL);
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+/* ns with a unit that keeps 3-4 digits */
+static void fmt_ns(char *buf, size_t len, double ns) {
+    if (ns < 1e3)
+        snprintf(buf, len, "%.1f ns", ns);
+    else if (ns < 1e6)
+        snprintf(buf, len, "%.2f us", ns / 1e3);
+    else
+        snprintf(buf, len, "%.2f ms", ns / 1e6);
+}
+
+static int print_report(const baseline_t *base, int base_count, double tolerance) {
+    int regressions = 0;
+    fprintf(report, "%-20s %10s %10s %10s %10s %10s%s\n", "benchmark", "min", "median", "p90",
+            "p99", "baseline", base ? "  change" : "");
+    for (unsigned i = 0; i < result_count; i++) {
+        const result_t *r = &results[i];
+        char mn[16], med[16], p90[16], p99[16], ref[16] = "-", change[40] = "";
+        fmt_ns(mn, sizeof(mn), r->min);
+        fmt_ns(med, sizeof(med), r->median);
+        fmt_ns(p90, sizeof(p90), r->p90);
+        fmt_ns(p99, sizeof(p99), r->p99);
+        for (int b = 0; base && b < base_count; b++) {
+            if (strcmp(base[b].name, r->name) != 0)
+                continue;
+            double ratio = r->median / base[b].median;
+            bool slow = ratio > 1 + tolerance;
+            fmt_ns(ref, sizeof(ref), base[b].median);
+            snprintf(change, sizeof(change), "%+6.1f%%%s", (ratio - 1) * 100,
+                     slow ? "  <-- REGRESSION" : "");
+            regressions += slow;
+        }
+        if (base && !strcmp(ref, "-"))
+            snprintf(change, sizeof(change), "new");
+        fprintf(report, "%-20s %10s %10s %10s %10s %10s%s%s\n", r->name, mn, med, p90, p99, ref,
+                *change ? "  " : "", change);
+    }
+    if (base)
+        fprintf(report, "\n%d regression(s) beyond %.0f%% of the baseline -> %s\n", regressions,
+                tolerance * 100, regressions ? "FAIL" : "PASS");
+    return regressions;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-o results.json] [-b baseline.json] [-t tolerance] [-f filter]\n"
+            "          [-n samples] [-m min_sample_ms]\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *out_path = NULL, *base_path = NULL;
+    double tolerance = 0.25;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:b:t:f:n:m:")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'b':
+            base_path = optarg;
+            break;
+        case 't':
+            tolerance = atof(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'n':
+            samples = (unsigned)atoi(optarg);
+            break;
+        case 'm':
+            min_sample_ns = atof(optarg) * 1e6;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || samples < 1 || samples > MAX_SAMPLES || tolerance < 0 ||
+        min_sample_ns <= 0)
+        usage(argv[0]);
+
+    static baseline_t base[MAX_BENCH * 2];
+    int base_count = 0;
+    if (base_path && (base_count = read_baseline(base_path, base, MAX_BENCH * 2)) < 0)
+        return 1;
+
+    /* The PCM goes to stdout; so would any log line */
+    report = fdopen(dup(1), "w");
+    if (!report || !freopen("/dev/null", "w", stdout)) {
+        perror("stdout redirect");
+        return 1;
+    }
+
+    for (size_t i = 0; i < NUM_TICK_CASES; i++) {
+        static tick_ctx_t t;
+        char name[48];
+        tick_setup(&t, &tick_cases[i]);
+        snprintf(name, sizeof(name), "tick/%s", tick_cases[i].name);
+        run(name, bench_tick, &t);
+    }
+    eta_benches();
+    loop_benches();
+
+    static const song_id_t songs[] = {SONG_START, SONG_FINISHED, SONG_ERROR};
+    static const char *const song_names[] = {"pcm/start", "pcm/finished", "pcm/error"};
+    for (int i = 0; i < 3; i++)
+        run(song_names[i], bench_pcm, (void *)&songs[i]);
+    midi_benches();
+    cycle_benches();
+
+    int regressions = print_report(base_path ? base : NULL, base_count, tolerance);
+    if (out_path && !write_json(out_path))
+        return 1;
+    fclose(report);
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * Coverage report for wm_control.
+ *
+ * Merges coverage files written by WM_COVERAGE builds (unit tests, scenarios, fuzzer,
+ * simulator) and lists, per reason, how many of the transitions wm_control can take were
+ * seen, then every one that never was: e.g. "abort SOAP -> DRAIN" if nothing ever aborted
+ * during SOAP. Transitions that were counted but are not in wm_cov_expected are listed as
+ * unexpected (wm_cov_expected needs updating, or the controller took a path it should not).
+ * Interlock overrides follow by state; most come from the tick a state is left, when the
+ * outputs set for the old state are switched off.
+ *
+ * Usage: covreport [-a] [-o merged.txt] <coverage.txt>...
+ *   -a lists the covered transitions with their counts too; -o writes the merged counts.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "wm_coverage.h"
+
+static const char *state(int s) { return wm_state_str((wm_state_t)s); }
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-a] [-o merged.txt] <coverage.txt>...\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    bool all = false;
+    const char *out = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "ao:")) != -1) {
+        switch (opt) {
+        case 'a':
+            all = true;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+
+    static wm_cov_t cov;
+    for (int i = optind; i < argc; i++) {
+        if (!wm_cov_load(argv[i], &cov)) {
+            fprintf(stderr, "covreport: cannot read %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (out) {
+        remove(out);
+        if (!wm_cov_save(out, &cov)) {
+            perror(out);
+            return 1;
+        }
+    }
+
+    unsigned total = 0, total_seen = 0, unexpected = 0, overrides = 0;
+    printf("%-8s %8s  %s\n", "reason", "covered", "never covered");
+    for (int r = 0; r < WM_COV_REASONS; r++) {
+        unsigned expected = 0, seen = 0;
+        for (int f = 0; f < WM_COV_STATES; f++) {
+            for (int t = 0; t < WM_COV_STATES; t++) {
+                if (!wm_cov_expected((wm_state_t)f, (wm_state_t)t, (wm_cov_reason_t)r)) {
+                    unexpected += cov.trans[f][t][r] != 0;
+                    continue;
+                }
+                expected++;
+                seen += cov.trans[f][t][r] != 0;
+            }
+        }
+        printf("%-8s %3u/%-4u", wm_cov_reason_str((wm_cov_reason_t)r), seen, expected);
+        unsigned col = 0;
+        for (int f = 0; f < WM_COV_STATES; f++) {
+            for (int t = 0; t < WM_COV_STATES; t++) {
+                if (!wm_cov_expected((wm_state_t)f, (wm_state_t)t, (wm_cov_reason_t)r) ||
+                    cov.trans[f][t][r])
+                    continue;
+                if (col++ % 4 == 0)
+                    printf("\n        ");
+                printf("  %-9s -> %-9s", state(f), state(t));
+            }
+        }
+        printf("\n");
+        total += expected;
+        total_seen += seen;
+    }
+    printf("\n%u of %u transitions covered (%.0f%%)\n", total_seen, total,
+           total ? 100.0 * total_seen / total : 0.0);
+
+    if (all) {
+        printf("\ncovered:\n");
+        for (int r = 0; r < WM_COV_REASONS; r++)
+            for (int f = 0; f < WM_COV_STATES; f++)
+                for (int t = 0; t < WM_COV_STATES; t++)
+                    if (cov.trans[f][t][r])
+                        printf("  %-8s %-9s -> %-9s %10lu\n",
+                               wm_cov_reason_str((wm_cov_reason_t)r), state(f), state(t),
+                               (unsigned long)cov.trans[f][t][r]);
+    }
+    if (unexpected) {
+        printf("\nunexpected transitions (not in wm_cov_expected):\n");
+        for (int r = 0; r < WM_COV_REASONS; r++)
+            for (int f = 0; f < WM_COV_STATES; f++)
+                for (int t = 0; t < WM_COV_STATES; t++)
+                    if (cov.trans[f][t][r] &&
+                        !wm_cov_expected((wm_state_t)f, (wm_state_t)t, (wm_cov_reason_t)r))
+                        printf("  %-8s %-9s -> %-9s %10lu\n",
+                               wm_cov_reason_str((wm_cov_reason_t)r), state(f), state(t),
+                               (unsigned long)cov.trans[f][t][r]);
+    }
+    for (int s = 0; s < WM_COV_STATES; s++) {
+        for (int i = 0; i < WM_COV_INTERLOCKS; i++) {
+            if (!cov.override[s][i])
+                continue;
+            if (overrides++ == 0)
+                printf("\ninterlock overrides:\n");
+            printf("  %-9s %-12s %10lu\n", state(s), wm_cov_interlock_str((wm_cov_interlock_t)i),
+                   (unsigned long)cov.override[s][i]);
+        }
+    }
+    if (!overrides)
+        printf("no interlock overrides\n");
+    return 0;
+}
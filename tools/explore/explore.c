@@ -0,0 +1,357 @@
+/*
+ * Branch explorer: what happens if the user acts at every possible second of a cycle?
+ *
+ * One trunk run goes through the selected cycle and snapshots the whole machine (App, HAL
+ * and water model, tools/sim/snapshot.h) every -s seconds of the chosen phase. Each
+ * snapshot is then forked into a branch that takes the action and runs to the end:
+ *
+ *   abort   C, then A at the prompt: the drum must drain and the cycle end without a spin
+ *   pause   A, wait -d seconds, A again: all outputs must stay off while paused
+ *
+ * The trunk costs one cycle however many branch points there are; re-running from
+ * power-on for every branch would cost one cycle prefix per branch. -S does that as well,
+ * times it and checks that every branch ends the same way both times.
+ *
+ * -o saves the trunk's snapshots and -i loads them instead of running the trunk (the
+ * program comes from the snapshots), so a long exploration can be checkpointed and resumed,
+ * or run again with other actions.
+ *
+ * Usage: explore [-m program,level,power] [-p wash|rinse|all] [-a abort|pause] [-s sec]
+ *                [-d pause_sec] [-j threads] [-S] [-o trunk.snap] [-i trunk.snap]
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "app.h"
+#include "pool.h"
+#include "snapshot.h"
+
+#define MAX_BRANCH_MS (4u * 3600 * 1000)
+#define MAX_TRUNK_MS (6u * 3600 * 1000)
+
+typedef enum { PHASE_WASH, PHASE_RINSE, PHASE_ALL } phase_t;
+typedef enum { ACT_ABORT, ACT_PAUSE } action_t;
+
+typedef struct {
+    uint8_t state; /* Final controller state */
+    uint8_t error;
+    bool bad;           /* Spun after an abort, or an output was on while paused */
+    uint32_t finish_ms; /* From the action to COMPLETE/ERROR */
+    double litres;      /* Water left at the end */
+} outcome_t;
+
+typedef struct {
+    int sel[3];
+    action_t action;
+    uint32_t pause_ms;
+    const snap_t *snaps;
+    outcome_t *out;
+    outcome_t *scratch;
+} explore_t;
+
+static const char *const phase_names[] = {"wash", "rinse", "all"};
+static const char *const action_names[] = {"abort", "pause"};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool finished(const snap_machine_t *m) {
+    return m->app.ctrl.state == WM_COMPLETE || m->app.ctrl.state == WM_ERROR;
+}
+
+static bool in_phase(const wm_controller_t *c, phase_t phase) {
+    if (c->state < WM_START || c->state > WM_SPIN)
+        return false;
+    if (phase == PHASE_ALL)
+        return true;
+    return c->state != WM_SPIN && c->is_wash_phase == (phase == PHASE_WASH);
+}
+
+static bool any_output(const snap_machine_t *m) {
+    hal_sim_actuators_t a = hal_sim_get_actuators(&m->hal);
+    return a.motor_power || a.inlet || a.drain || a.soap;
+}
+
+/* Take the action on m and run it to the end */
+static void branch(const explore_t *ex, snap_machine_t *m, outcome_t *o) {
+    uint32_t t0 = m->now_ms;
+    memset(o, 0, sizeof(*o));
+
+    snap_machine_press(m, ex->action == ACT_ABORT ? HAL_BTN_C : HAL_BTN_A);
+    if (ex->action == ACT_ABORT) {
+        snap_machine_press(m, HAL_BTN_A);
+    } else {
+        for (uint32_t t = 0; t < ex->pause_ms && !finished(m); t += 1000) {
+            o->bad |= m->app.ctrl.state != WM_PAUSED || any_output(m);
+            snap_machine_run(m, 1000);
+        }
+        snap_machine_press(m, HAL_BTN_A);
+    }
+
+    while (!finished(m) && m->now_ms - t0 < MAX_BRANCH_MS) {
+        snap_machine_run(m, 1000);
+        o->bad |= ex->action == ACT_ABORT && m->app.ctrl.state == WM_SPIN;
+    }
+    o->state = (uint8_t)m->app.ctrl.state;
+    o->error = (uint8_t)m->app.ctrl.error_code;
+    o->finish_ms = m->now_ms - t0;
+    o->litres = m->phys.litres;
+}
+
+static bool same_outcome(const outcome_t *a, const outcome_t *b) {
+    return a->state == b->state && a->error == b->error && a->bad == b->bad &&
+           a->finish_ms == b->finish_ms && a->litres == b->litres;
+}
+
+static void fork_branch(void *ctx, size_t index, snap_machine_t *m) {
+    const explore_t *ex = (const explore_t *)ctx;
+    branch(ex, m, &ex->out[index]);
+}
+
+/* The same branch, re-simulated from power-on */
+static void scratch_branch(void *ctx, size_t index, unsigned worker) {
+    const explore_t *ex = (const explore_t *)ctx;
+    snap_machine_t *m = malloc(sizeof(*m));
+    (void)worker;
+    if (!m) {
+        perror("explore");
+        exit(1);
+    }
+    snap_machine_init(m, &ex->snaps[index].m.phys.p, rng_for_run(1, 0));
+    snap_machine_start(m, ex->sel[0], ex->sel[1], ex->sel[2]);
+    snap_machine_run(m, ex->snaps[index].m.now_ms - m->now_ms);
+    branch(ex, m, &ex->scratch[index]);
+    free(m);
+}
+
+/* Run the cycle once, snapshotting every step_ms of the phase */
+static snap_t *run_trunk(const int sel[3], phase_t phase, uint32_t step_ms, size_t *n) {
+    size_t cap = 256;
+    snap_t *snaps = malloc(cap * sizeof(*snaps));
+    snap_machine_t *m = malloc(sizeof(*m));
+    if (!snaps || !m) {
+        perror("explore");
+        exit(1);
+    }
+
+    phys_params_t p = phys_default_params();
+    snap_machine_init(m, &p, rng_for_run(1, 0));
+    snap_machine_start(m, sel[0], sel[1], sel[2]);
+    *n = 0;
+    while (!finished(m) && m->now_ms < MAX_TRUNK_MS) {
+        if (in_phase(&m->app.ctrl, phase)) {
+            if (*n == cap) {
+                cap *= 2;
+                snap_t *grown = realloc(snaps, cap * sizeof(*snaps));
+                if (!grown) {
+                    perror("explore");
+                    exit(1);
+                }
+                snaps = grown;
+            }
+            snap_take(&snaps[(*n)++], m);
+        }
+        snap_machine_run(m, step_ms);
+    }
+    free(m);
+    return snaps;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_clock(const char *label, uint32_t ms) {
+    unsigned s = ms / 1000;
+    printf("%s %u:%02u:%02u", label, s / 3600, s / 60 % 60, s % 60);
+}
+
+static void report(const explore_t *ex, size_t n) {
+    size_t states[WM_ERROR + 1] = {0}, errors[WM_ERR_INVALID_PROGRAM + 1] = {0}, bad = 0;
+    double wet = 0.0;
+    uint32_t *finish = malloc(n * sizeof(*finish));
+    if (!finish) {
+        perror("explore");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        const outcome_t *o = &ex->out[i];
+        states[o->state]++;
+        if (o->state == WM_ERROR)
+            errors[o->error]++;
+        bad += o->bad;
+        if (o->litres > wet)
+            wet = o->litres;
+        finish[i] = o->finish_ms;
+    }
+    qsort(finish, n, sizeof(*finish), cmp_u32);
+
+    printf("outcome   COMPLETE %zu", states[WM_COMPLETE]);
+    for (int e = WM_ERR_TIMEOUT_FILL; e <= WM_ERR_INVALID_PROGRAM; e++) {
+        if (errors[e])
+            printf(" | %s %zu", wm_error_str((wm_error_t)e), errors[e]);
+    }
+    printf(" | unfinished %zu\n", n - states[WM_COMPLETE] - states[WM_ERROR]);
+    print_clock("to end    min", finish[0]);
+    print_clock(" | median", finish[n / 2]);
+    print_clock(" | max", finish[n - 1]);
+    printf(" after the %s\n", action_names[ex->action]);
+    printf("checks    %zu %s | water left at most %.1f L\n", bad,
+           ex->action == ACT_ABORT ? "spun after the abort" : "had an output on while paused",
+           wet);
+    free(finish);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-m program,level,power] [-p wash|rinse|all] [-a abort|pause] [-s sec]\n"
+            "          [-d pause_sec] [-j threads] [-S] [-o trunk.snap] [-i trunk.snap]\n",
+            argv0);
+    exit(2);
+}
+
+static int word_index(const char *word, const char *const *names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(word, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    explore_t ex = {.sel = {0, 1, 0}, .action = ACT_ABORT, .pause_ms = 60000};
+    int phase = PHASE_RINSE;
+    uint32_t step_ms = 1000;
+    unsigned threads = 0;
+    bool scratch = false;
+    const char *save_path = NULL, *load_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:p:a:s:d:j:So:i:")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (sscanf(optarg, "%d,%d,%d", &ex.sel[0], &ex.sel[1], &ex.sel[2]) != 3)
+                usage(argv[0]);
+            break;
+        case 'p':
+            if ((phase = word_index(optarg, phase_names, 3)) < 0)
+                usage(argv[0]);
+            break;
+        case 'a':
+            if ((opt = word_index(optarg, action_names, 2)) < 0)
+                usage(argv[0]);
+            ex.action = (action_t)opt;
+            break;
+        case 's':
+            step_ms = (uint32_t)(strtod(optarg, NULL) * 1000.0);
+            break;
+        case 'd':
+            ex.pause_ms = (uint32_t)(strtod(optarg, NULL) * 1000.0);
+            break;
+        case 'j':
+            threads = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 'S':
+            scratch = true;
+            break;
+        case 'o':
+            save_path = optarg;
+            break;
+        case 'i':
+            load_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || step_ms < SNAP_STEP_MS)
+        usage(argv[0]);
+
+    static hal_t menu_hal;
+    static App menu;
+    hal_sim_set_quiet(&menu_hal, true);
+    app_init(&menu, &menu_hal);
+    for (int i = 0; i < APP_MENU_STEPS; i++) {
+        if (ex.sel[i] < 0 || ex.sel[i] >= app_menu_count(&menu, (app_menu_t)i))
+            usage(argv[0]);
+    }
+    if (threads == 0)
+        threads = pool_cpu_count();
+
+    size_t n = 0;
+    snap_t *snaps;
+    double t0 = now_sec();
+    if (load_path) {
+        char why[256];
+        snaps = snap_load(load_path, &n, why, sizeof(why));
+        if (!snaps) {
+            fprintf(stderr, "explore: %s\n", why);
+            return 1;
+        }
+    } else {
+        snaps = run_trunk(ex.sel, (phase_t)phase, step_ms, &n);
+    }
+    double trunk_s = now_sec() - t0;
+    if (n == 0) {
+        fprintf(stderr, "explore: the cycle has no %s phase\n", phase_names[phase]);
+        return 1;
+    }
+    if (load_path) {
+        /* The menu selection is part of the saved App */
+        const App *saved = &snaps[0].m.app;
+        ex.sel[0] = saved->sel_program;
+        ex.sel[1] = saved->sel_level;
+        ex.sel[2] = saved->sel_power;
+    }
+    if (save_path && !snap_save(save_path, snaps, n)) {
+        perror(save_path);
+        return 1;
+    }
+
+    ex.snaps = snaps;
+    ex.out = calloc(n, sizeof(*ex.out));
+    ex.scratch = calloc(n, sizeof(*ex.scratch));
+    if (!ex.out || !ex.scratch) {
+        perror("explore");
+        return 1;
+    }
+
+    printf("%s/%s/%s, %s at %zu points", app_menu_name(&menu, APP_MENU_PROGRAM, ex.sel[0]),
+           app_menu_name(&menu, APP_MENU_LEVEL, ex.sel[1]),
+           app_menu_name(&menu, APP_MENU_POWER, ex.sel[2]), action_names[ex.action], n);
+    print_clock(",", snaps[0].m.now_ms);
+    print_clock(" ..", snaps[n - 1].m.now_ms);
+    printf("\n%-9s %7.3f s  (%zu snapshots, %.1f MB)\n", load_path ? "loaded" : "trunk", trunk_s,
+           n, n * sizeof(*snaps) / 1e6);
+
+    t0 = now_sec();
+    snap_fork(snaps, n, 1, threads, fork_branch, &ex);
+    double fork_s = now_sec() - t0;
+    printf("%-9s %7.3f s  (%u threads)\n", "branches", fork_s, threads);
+
+    if (scratch) {
+        t0 = now_sec();
+        pool_run(n, threads, scratch_branch, &ex);
+        double scratch_s = now_sec() - t0;
+        size_t differ = 0;
+        for (size_t i = 0; i < n; i++)
+            differ += !same_outcome(&ex.out[i], &ex.scratch[i]);
+        printf("%-9s %7.3f s  (from power-on, %.1fx trunk + branches), %zu of %zu outcomes "
+               "differ\n",
+               "scratch", scratch_s, scratch_s / (trunk_s + fork_s), differ, n);
+    }
+
+    report(&ex, n);
+    free(snaps);
+    free(ex.out);
+    free(ex.scratch);
+    return 0;
+}
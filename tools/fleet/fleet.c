@@ -0,0 +1,494 @@
+/*
+ * Laundromat fleet simulator.
+ *
+ * N headless machines (tools/sim/headless.c, each a full App on its own HAL) run loads back
+ * to back: a random program, level and power per load, with a random idle gap between
+ * loads. The machines share two resources:
+ *
+ *   Water supply  The open inlets share the supply flow (-Q); each gets at most the
+ *                 model's inlet flow, so many simultaneous fills slow every fill down.
+ *   Power budget  Every machine draws standby, valve and pump power, 400 W while the
+ *                 motor runs and 1200 W for the first 0.5 s after a motor start. Steps
+ *                 above the budget (-P) count as overload; a breaker would trip there.
+ *
+ * In "coord" mode a coordinator admits every FILL start (inlet opening) and motor start.
+ * A FILL is admitted while fewer fills are open than the supply can feed at full flow.
+ * A motor start is admitted if its start current fits in the budget. A refused machine
+ * is paused (wm_pause, so its timeouts stop) and queued. Queued machines are resumed in
+ * FIFO order once there is room. In "free" mode nothing is coordinated.
+ *
+ * Each fleet size x mode is one job on the work-stealing pool; machine streams derive from
+ * (seed, machine index), so results depend only on the seed.
+ *
+ * A second table adds up the water and energy of the completed loads, as estimated from
+ * each controller's usage counters at the rates of -E (tools/sim/meter.h).
+ *
+ * Usage: fleet [-n machines,...] [-H hours] [-Q supply_lpm] [-P budget_w] [-g max_gap_min]
+ *              [-m free,coord] [-j threads] [-s seed] [-E rates]
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "headless.h"
+#include "meter.h"
+#include "pool.h"
+
+#define MAX_SIZES 16
+#define STEP_MS 100
+
+/* Power model (W) */
+#define W_STANDBY 3
+#define W_INLET 6
+#define W_SOAP 15
+#define W_DRAIN 40
+#define W_MOTOR 400
+#define W_INRUSH 1200
+#define INRUSH_STEPS 5
+
+/* Defaults per machine when -Q / -P are not given */
+#define SUPPLY_LPM_PER_MACHINE 6.0
+#define BUDGET_W_PER_MACHINE 250.0
+
+enum { MODE_FREE, MODE_COORD, MODES };
+static const char *const mode_names[MODES] = {"free", "coord"};
+
+typedef struct {
+    hl_machine_t m;
+    rng_t rng;
+    bool loaded;
+    uint32_t idle_steps; /* Until the next load */
+    bool inlet, motor;   /* Outputs of the previous step */
+    uint8_t inrush;      /* Steps of start current left */
+    uint32_t grant_step; /* Step whose inlet/motor start was pre-admitted */
+    uint32_t held_since; /* Step the machine was queued at */
+} fleet_machine_t;
+
+/* FIFO of machine indices waiting for admission */
+typedef struct {
+    uint32_t *q;
+    uint32_t cap, head, len;
+} queue_t;
+
+typedef struct {
+    uint32_t machines;
+    int mode;
+
+    uint64_t loads, errors[WM_ERR_INVALID_PROGRAM + 1];
+    double peak_w;
+    uint32_t over_steps, over_events;
+    uint64_t admissions, wait_steps;
+    uint32_t max_wait_steps;
+    double app_ns, coord_ns; /* Per machine-step */
+    meter_t meter;           /* Completed loads */
+} fleet_result_t;
+
+typedef struct {
+    uint32_t sizes[MAX_SIZES];
+    int nsizes;
+    bool modes[MODES];
+    double hours, supply_lpm, budget_w, gap_min;
+    uint64_t seed;
+    meter_rates_t rates;
+    int programs, levels, powers;
+    fleet_result_t *results;
+} fleet_cfg_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void queue_push(queue_t *q, uint32_t i) {
+    q->q[(q->head + q->len++) % q->cap] = i;
+}
+
+static uint32_t queue_pop(queue_t *q) {
+    uint32_t i = q->q[q->head];
+    q->head = (q->head + 1) % q->cap;
+    q->len--;
+    return i;
+}
+
+static uint32_t gap_steps(const fleet_cfg_t *cfg, rng_t *r) {
+    return (uint32_t)(rng_uniform(r) * cfg->gap_min * 60000.0 / STEP_MS);
+}
+
+static void load_start(const fleet_cfg_t *cfg, fleet_machine_t *fm, uint32_t hours) {
+    hl_config_t hc = {0};
+    hc.program = (int)(rng_next(&fm->rng) % cfg->programs);
+    hc.level = (int)(rng_next(&fm->rng) % cfg->levels);
+    hc.power = (int)(rng_next(&fm->rng) % cfg->powers);
+    hc.phys = phys_default_params();
+    hc.rng = fm->rng;
+    rng_next(&fm->rng);
+    hc.step_ms = STEP_MS;
+    hc.max_sec = hours * 3600 + 3600;
+    hl_machine_init(&fm->m, &hc);
+    fm->loaded = true;
+}
+
+static void load_finish(const fleet_cfg_t *cfg, fleet_machine_t *fm, fleet_result_t *res) {
+    hl_result_t r;
+    hl_machine_finish(&fm->m, &r);
+    if (r.final_state == WM_COMPLETE) {
+        meter_t m;
+        meter_read(&r.usage, r.ticks_per_second, &cfg->rates, &m);
+        meter_add(&res->meter, &m);
+        res->loads++;
+    } else if (r.final_state == WM_ERROR)
+        res->errors[r.error <= WM_ERR_INVALID_PROGRAM ? r.error : WM_ERR_INVALID_PROGRAM]++;
+
+    fm->loaded = false;
+    fm->idle_steps = gap_steps(cfg, &fm->rng);
+    fm->inlet = fm->motor = false;
+    fm->inrush = 0;
+}
+
+/* Refuse this step's start: force the output off, pause the cycle and queue it */
+static void hold(fleet_machine_t *fm, hal_actuator_t act, queue_t *q, uint32_t index,
+                 uint32_t step) {
+    hal_actuator_write(&fm->m.hal, act, false);
+    if (act == HAL_ACT_MOTOR_POWER)
+        hal_actuator_write(&fm->m.hal, HAL_ACT_MOTOR_DIR, false);
+    wm_pause(&fm->m.app.ctrl);
+    fm->held_since = step;
+    queue_push(q, index);
+}
+
+static void admit(fleet_machine_t *fm, fleet_result_t *res, uint32_t step) {
+    uint32_t waited = step - fm->held_since;
+    wm_resume(&fm->m.app.ctrl);
+    fm->grant_step = step;
+    res->admissions++;
+    res->wait_steps += waited;
+    if (waited > res->max_wait_steps)
+        res->max_wait_steps = waited;
+}
+
+static double machine_draw(const hal_sim_actuators_t *a, bool inrush) {
+    double w = W_STANDBY;
+    w += a->inlet ? W_INLET : 0;
+    w += a->soap ? W_SOAP : 0;
+    w += a->drain ? W_DRAIN : 0;
+    if (a->motor_power)
+        w += inrush ? W_INRUSH : W_MOTOR;
+    return w;
+}
+
+static void run_fleet(void *ctx, size_t job, unsigned worker) {
+    fleet_cfg_t *cfg = (fleet_cfg_t *)ctx;
+    fleet_result_t *res = &cfg->results[job];
+    uint32_t n = res->machines;
+    bool coord = res->mode == MODE_COORD;
+    (void)worker;
+
+    double supply = cfg->supply_lpm > 0 ? cfg->supply_lpm : SUPPLY_LPM_PER_MACHINE * n;
+    double budget = cfg->budget_w > 0 ? cfg->budget_w : BUDGET_W_PER_MACHINE * n;
+    double inlet_lpm = phys_default_params().inlet_lpm;
+    uint32_t max_fills = supply / inlet_lpm >= 1.0 ? (uint32_t)(supply / inlet_lpm) : 1;
+    uint32_t steps = (uint32_t)(cfg->hours * 3600000.0 / STEP_MS);
+
+    fleet_machine_t *fleet = calloc(n, sizeof(*fleet));
+    queue_t fill_q = {calloc(n, sizeof(uint32_t)), n, 0, 0};
+    queue_t motor_q = {calloc(n, sizeof(uint32_t)), n, 0, 0};
+    if (!fleet || !fill_q.q || !motor_q.q) {
+        perror("fleet");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        fleet[i].rng = rng_for_run(cfg->seed, i);
+        fleet[i].idle_steps = gap_steps(cfg, &fleet[i].rng);
+        fleet[i].grant_step = UINT32_MAX;
+    }
+
+    double t_app = 0.0, t_coord = 0.0, prev_draw = 0.0;
+    uint32_t prev_fills = 0;
+    bool over = false;
+
+    for (uint32_t step = 0; step < steps; step++) {
+        double t0 = now_sec();
+
+        /* Admit queued machines while there is room; their starts are reserved for this step */
+        uint32_t granted_fills = 0;
+        double granted_w = 0.0;
+        if (coord) {
+            while (fill_q.len && prev_fills + granted_fills < max_fills) {
+                admit(&fleet[queue_pop(&fill_q)], res, step);
+                granted_fills++;
+            }
+            while (motor_q.len && prev_draw + granted_w + W_INRUSH <= budget) {
+                admit(&fleet[queue_pop(&motor_q)], res, step);
+                granted_w += W_INRUSH;
+            }
+        }
+        double t1 = now_sec();
+
+        for (uint32_t i = 0; i < n; i++) {
+            fleet_machine_t *fm = &fleet[i];
+            if (!fm->loaded) {
+                if (fm->idle_steps-- == 0)
+                    load_start(cfg, fm, (uint32_t)cfg->hours);
+                continue;
+            }
+            if (!hl_machine_control(&fm->m))
+                load_finish(cfg, fm, res);
+        }
+        double t2 = now_sec();
+
+        /* Outputs that stay on are already admitted; starts are checked in rotating order */
+        uint32_t fills = granted_fills;
+        double draw = granted_w;
+        for (uint32_t i = 0; i < n; i++) {
+            fleet_machine_t *fm = &fleet[i];
+            if (!fm->loaded) {
+                draw += W_STANDBY;
+                continue;
+            }
+            hal_sim_actuators_t a = hal_sim_get_actuators(&fm->m.hal);
+            a.inlet = a.inlet && fm->inlet;
+            a.motor_power = a.motor_power && fm->motor;
+            fills += a.inlet;
+            draw += machine_draw(&a, fm->inrush > 0);
+        }
+        for (uint32_t k = 0; k < n; k++) {
+            uint32_t i = (step + k) % n;
+            fleet_machine_t *fm = &fleet[i];
+            if (!fm->loaded)
+                continue;
+            hal_sim_actuators_t a = hal_sim_get_actuators(&fm->m.hal);
+            bool granted = fm->grant_step == step;
+
+            if (a.inlet && !fm->inlet) {
+                if (coord && !granted && fills >= max_fills) {
+                    hold(fm, HAL_ACT_INLET, &fill_q, i, step);
+                    a.inlet = false;
+                } else if (!granted) {
+                    fills++;
+                }
+            }
+            if (a.motor_power && !fm->motor) {
+                if (coord && !granted && draw + W_INRUSH > budget) {
+                    hold(fm, HAL_ACT_MOTOR_POWER, &motor_q, i, step);
+                    a.motor_power = false;
+                } else {
+                    fm->inrush = INRUSH_STEPS;
+                    draw += granted ? 0.0 : W_INRUSH;
+                }
+            }
+            if (a.inlet && !fm->inlet)
+                draw += W_INLET;
+            fm->inlet = a.inlet;
+            fm->motor = a.motor_power;
+        }
+
+        /* Exact draw and the water supply split between the open inlets */
+        draw = 0.0;
+        double flow = fills ? supply / fills : inlet_lpm;
+        if (flow > inlet_lpm)
+            flow = inlet_lpm;
+        for (uint32_t i = 0; i < n; i++) {
+            fleet_machine_t *fm = &fleet[i];
+            if (!fm->loaded) {
+                draw += W_STANDBY;
+                continue;
+            }
+            hal_sim_actuators_t a = hal_sim_get_actuators(&fm->m.hal);
+            draw += machine_draw(&a, fm->inrush > 0);
+            if (fm->inrush)
+                fm->inrush = a.motor_power ? fm->inrush - 1 : 0;
+            fm->m.phys.p.inlet_lpm = flow;
+        }
+        double t3 = now_sec();
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (fleet[i].loaded && !hl_machine_advance(&fleet[i].m))
+                load_finish(cfg, &fleet[i], res);
+        }
+
+        if (draw > res->peak_w)
+            res->peak_w = draw;
+        if (draw > budget) {
+            res->over_steps++;
+            res->over_events += !over;
+        }
+        over = draw > budget;
+        prev_draw = draw;
+        prev_fills = fills;
+
+        t_app += t2 - t1;
+        t_coord += (t1 - t0) + (t3 - t2);
+    }
+
+    res->app_ns = t_app * 1e9 / ((double)steps * n);
+    res->coord_ns = t_coord * 1e9 / ((double)steps * n);
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (fleet[i].loaded) {
+            hl_result_t r;
+            hl_machine_finish(&fleet[i].m, &r); /* Cut off by the horizon; not counted */
+        }
+    }
+    free(fill_q.q);
+    free(motor_q.q);
+    free(fleet);
+}
+
+static int parse_sizes(const char *arg, fleet_cfg_t *cfg) {
+    cfg->nsizes = 0;
+    for (const char *p = arg; *p && cfg->nsizes < MAX_SIZES;) {
+        char *end;
+        unsigned long v = strtoul(p, &end, 10);
+        if (end == p || v == 0)
+            return 0;
+        cfg->sizes[cfg->nsizes++] = (uint32_t)v;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end && *end != ',')
+            return 0;
+    }
+    return cfg->nsizes > 0;
+}
+
+static int parse_modes(const char *arg, fleet_cfg_t *cfg) {
+    memset(cfg->modes, 0, sizeof(cfg->modes));
+    for (int m = 0; m < MODES; m++)
+        cfg->modes[m] = strstr(arg, mode_names[m]) != NULL;
+    return cfg->modes[MODE_FREE] || cfg->modes[MODE_COORD];
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-n machines,...] [-H hours] [-Q supply_lpm] [-P budget_w]\n"
+            "          [-g max_gap_min] [-m free,coord] [-j threads] [-s seed] [-E rates]\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    fleet_cfg_t cfg = {0};
+    unsigned threads = 0;
+    parse_sizes("25,100,400", &cfg);
+    parse_modes("free,coord", &cfg);
+    cfg.hours = 4.0;
+    cfg.gap_min = 10.0;
+    cfg.seed = 1;
+    cfg.rates = meter_default_rates();
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:H:Q:P:g:m:j:s:E:")) != -1) {
+        switch (opt) {
+        case 'n':
+            if (!parse_sizes(optarg, &cfg))
+                usage(argv[0]);
+            break;
+        case 'H':
+            cfg.hours = strtod(optarg, NULL);
+            break;
+        case 'Q':
+            cfg.supply_lpm = strtod(optarg, NULL);
+            break;
+        case 'P':
+            cfg.budget_w = strtod(optarg, NULL);
+            break;
+        case 'g':
+            cfg.gap_min = strtod(optarg, NULL);
+            break;
+        case 'm':
+            if (!parse_modes(optarg, &cfg))
+                usage(argv[0]);
+            break;
+        case 'j':
+            threads = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            cfg.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'E':
+            if (!meter_parse(optarg, &cfg.rates))
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (cfg.hours <= 0.0 || cfg.gap_min < 0.0)
+        usage(argv[0]);
+
+    static hal_t menu_hal;
+    static App menu;
+    hal_sim_set_quiet(&menu_hal, true);
+    app_init(&menu, &menu_hal);
+    cfg.programs = app_menu_count(&menu, APP_MENU_PROGRAM);
+    cfg.levels = app_menu_count(&menu, APP_MENU_LEVEL);
+    cfg.powers = app_menu_count(&menu, APP_MENU_POWER);
+
+    size_t jobs = 0;
+    cfg.results = calloc((size_t)cfg.nsizes * MODES, sizeof(*cfg.results));
+    if (!cfg.results) {
+        perror("fleet");
+        return 1;
+    }
+    for (int s = 0; s < cfg.nsizes; s++) {
+        for (int m = 0; m < MODES; m++) {
+            if (cfg.modes[m]) {
+                cfg.results[jobs].machines = cfg.sizes[s];
+                cfg.results[jobs++].mode = m;
+            }
+        }
+    }
+    if (threads == 0)
+        threads = pool_cpu_count();
+
+    double t0 = now_sec();
+    pool_run(jobs, threads, run_fleet, &cfg);
+    double wall = now_sec() - t0;
+
+    printf("Fleet: %.1f h per run, idle gap up to %.0f min, supply ", cfg.hours, cfg.gap_min);
+    if (cfg.supply_lpm > 0)
+        printf("%.0f L/min, ", cfg.supply_lpm);
+    else
+        printf("%.1f L/min per machine, ", SUPPLY_LPM_PER_MACHINE);
+    if (cfg.budget_w > 0)
+        printf("budget %.0f W, seed %llu\n\n", cfg.budget_w, (unsigned long long)cfg.seed);
+    else
+        printf("budget %.0f W per machine, seed %llu\n\n", BUDGET_W_PER_MACHINE,
+               (unsigned long long)cfg.seed);
+
+    printf("%8s %-5s %8s %8s %8s %8s %7s %7s %7s %7s %8s %8s %7s %7s\n", "machines", "mode",
+           "loads/h", "per_mach", "peak_kW", "budg_kW", "over_s", "over_n", "fill_to", "drain_to",
+           "wait_s", "maxwait", "app_ns", "crd_ns");
+    for (size_t j = 0; j < jobs; j++) {
+        const fleet_result_t *r = &cfg.results[j];
+        double budget = cfg.budget_w > 0 ? cfg.budget_w : BUDGET_W_PER_MACHINE * r->machines;
+        double per_h = r->loads / cfg.hours;
+        printf("%8u %-5s %8.1f %8.2f %8.1f %8.1f %7.1f %7u %7llu %7llu %8.1f %8.1f %7.0f %7.0f\n",
+               r->machines, mode_names[r->mode], per_h, per_h / r->machines, r->peak_w / 1000.0,
+               budget / 1000.0, r->over_steps * STEP_MS / 1000.0, r->over_events,
+               (unsigned long long)r->errors[WM_ERR_TIMEOUT_FILL],
+               (unsigned long long)r->errors[WM_ERR_TIMEOUT_DRAIN],
+               r->admissions ? r->wait_steps * STEP_MS / 1000.0 / r->admissions : 0.0,
+               r->max_wait_steps * STEP_MS / 1000.0, r->app_ns, r->coord_ns);
+    }
+
+    char rates[128];
+    meter_format(&cfg.rates, rates, sizeof(rates));
+    printf("\nWater and energy of completed loads (rates %s)\n", rates);
+    printf("%8s %-5s %8s %8s %8s %8s %9s %9s\n", "machines", "mode", "loads", "L/load",
+           "kWh/load", "sw/load", "water_m3", "kWh");
+    for (size_t j = 0; j < jobs; j++) {
+        const fleet_result_t *r = &cfg.results[j];
+        double k = r->loads ? 1.0 / r->loads : 0.0;
+        printf("%8u %-5s %8llu %8.1f %8.3f %8.0f %9.2f %9.1f\n", r->machines,
+               mode_names[r->mode], (unsigned long long)r->loads, meter_litres(&r->meter) * k,
+               meter_kwh(&r->meter) * k, r->meter.switches * k,
+               meter_litres(&r->meter) / 1000.0, meter_kwh(&r->meter));
+    }
+    fprintf(stderr, "%zu fleet runs on %u threads in %.2f s\n", jobs, threads, wall);
+
+    free(cfg.results);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Flight recorder decoder.
+ *
+ * Reads a serial capture containing an "FR BEGIN ... FR END" dump (produced by the 'd'
+ * command) and prints a timeline of every change, with times relative to the last
+ * recorded tick.
+ *
+ * Usage: fr_decode [capture.txt]   (stdin if omitted)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flight_recorder.h"
+
+#define MAX_DUMP_BYTES 65535
+
+typedef struct {
+    uint32_t tick;     /* Current tick index since the start of the dump */
+    uint32_t total;    /* Ticks in the dump */
+    uint16_t tick_ms;  /* Tick period */
+    fr_sample_t prev;  /* Last printed sample */
+    int have_prev;
+} timeline_t;
+
+static const char *water_names[] = {"EMPTY", "LOW", "MED", "HIGH"};
+static const char *motor_names[] = {"STOP", "CW", "CCW", "?"};
+static const char *buzzer_names[] = {"-", "START", "FINISH", "ERROR"};
+
+static double rel_sec(const timeline_t *t, uint32_t tick) {
+    return -((double)t->total - (double)tick) * t->tick_ms / 1000.0;
+}
+
+static void print_sample(const timeline_t *t, const fr_sample_t *s, uint32_t at) {
+    printf("%9.1fs  %-8s water=%-5s chk=%d | inlet=%d soap=%d drain=%d motor=%-4s buzzer=%-6s",
+           rel_sec(t, at), wm_state_str(s->state), water_names[s->water_level & 3],
+           s->drain_check, s->inlet_valve, s->soap_pump, s->drain_pump,
+           motor_names[s->motor_dir & 3], buzzer_names[s->buzzer & 3]);
+    if (s->buttons) {
+        printf(" | btn=%s%s%s", (s->buttons & FR_BTN_A) ? "A" : "",
+               (s->buttons & FR_BTN_B) ? "B" : "", (s->buttons & FR_BTN_C) ? "C" : "");
+    }
+    printf("\n");
+}
+
+static int same_sample(const fr_sample_t *a, const fr_sample_t *b) {
+    return a->state == b->state && a->water_level == b->water_level &&
+           a->drain_check == b->drain_check && a->inlet_valve == b->inlet_valve &&
+           a->soap_pump == b->soap_pump && a->drain_pump == b->drain_pump &&
+           a->motor_dir == b->motor_dir && a->buzzer == b->buzzer && a->buttons == b->buttons;
+}
+
+static void visit(void *user, const fr_sample_t *s, uint16_t repeat) {
+    timeline_t *t = (timeline_t *)user;
+
+    if (!t->have_prev || !same_sample(s, &t->prev)) {
+        print_sample(t, s, t->tick);
+        t->prev = *s;
+        t->have_prev = 1;
+    }
+    t->tick += repeat;
+}
+
+static int hex_byte(const char *p, uint8_t *out) {
+    unsigned v;
+    if (sscanf(p, "%2x", &v) != 1)
+        return 0;
+    *out = (uint8_t)v;
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    FILE *in = stdin;
+    if (argc > 1) {
+        in = fopen(argv[1], "r");
+        if (!in) {
+            perror("Failed to open capture");
+            return 1;
+        }
+    }
+
+    static uint8_t data[MAX_DUMP_BYTES];
+    uint8_t base[FR_SAMPLE_BYTES] = {0};
+    uint16_t len = 0;
+    unsigned version = 0, tick_ms = 100, bytes = 0;
+    unsigned long ticks = 0;
+    int frozen = 0, in_dump = 0, complete = 0;
+    char line[512];
+
+    while (fgets(line, sizeof(line), in)) {
+        char *p = strstr(line, "FR ");
+        if (!p)
+            continue;
+
+        if (sscanf(p, "FR BEGIN v%u tick_ms=%u ticks=%lu bytes=%u frozen=%d", &version, &tick_ms,
+                   &ticks, &bytes, &frozen) == 5) {
+            /* State numbers differ between versions, so an old dump would decode wrongly */
+            if (version != FR_DUMP_VERSION) {
+                fprintf(stderr, "FR dump is v%u, this decoder reads v%d\n", version,
+                        FR_DUMP_VERSION);
+                return 1;
+            }
+            /* A later dump supersedes earlier ones in the same capture */
+            in_dump = 1;
+            complete = 0;
+            len = 0;
+        } else if (in_dump && strncmp(p, "FR BASE ", 8) == 0) {
+            for (int b = 0; b < FR_SAMPLE_BYTES; b++) {
+                if (!hex_byte(p + 8 + 2 * b, &base[b])) {
+                    fprintf(stderr, "Malformed FR BASE line\n");
+                    return 1;
+                }
+            }
+        } else if (in_dump && strncmp(p, "FR DATA ", 8) == 0) {
+            for (char *h = p + 8; h[0] && h[1] && h[0] != '\r' && h[0] != '\n'; h += 2) {
+                if (len >= MAX_DUMP_BYTES || !hex_byte(h, &data[len])) {
+                    fprintf(stderr, "Malformed FR DATA line\n");
+                    return 1;
+                }
+                len++;
+            }
+        } else if (in_dump && strncmp(p, "FR END", 6) == 0) {
+            in_dump = 0;
+            complete = 1;
+        }
+    }
+    if (in != stdin)
+        fclose(in);
+
+    if (!complete) {
+        fprintf(stderr, "No complete FR dump found\n");
+        return 1;
+    }
+    if (len != bytes)
+        fprintf(stderr, "Warning: header says %u bytes, got %u\n", bytes, len);
+
+    timeline_t t = {0};
+    t.total = (uint32_t)ticks;
+    t.tick_ms = (uint16_t)tick_ms;
+
+    printf("Flight recorder: %lu ticks (%.1f s) in %u bytes%s\n", ticks,
+           ticks * tick_ms / 1000.0, len, frozen ? ", frozen on error" : "");
+
+    int32_t decoded = fr_decode(data, len, base, visit, &t);
+    if (decoded < 0) {
+        fprintf(stderr, "Truncated record stream\n");
+        return 1;
+    }
+    if ((unsigned long)decoded != ticks)
+        fprintf(stderr, "Warning: decoded %ld ticks, header says %lu\n", (long)decoded, ticks);
+
+    return 0;
+}
@@ -0,0 +1,732 @@
+/*
+ * Randomized tester for wm_control.
+ *
+ * Each case is a random program and a random input stream, both drawn from the case's own
+ * stream of the seed, so any case can be re-run alone (-r). Programs are realistic:
+ * classic ones in the ranges of the presets, the same compiled to step programs, or
+ * random step programs that pass wm_code_valid. Each tick reads sensors from one of
+ * three models and may be preceded by a random wm_start, wm_pause, wm_resume or wm_abort:
+ *
+ *   noise      any level and drain_check, new every tick
+ *   sticky     readings that change now and then
+ *   water      a water volume that follows the inlet and drain, with random glitches
+ *
+ * After every wm_tick the checker verifies the interlocks (inlet never with drain, motor
+ * only in AGITATE/SPIN, inlet only in FILL, soap only in SOAP, drain only in DRAIN/SPIN,
+ * nothing while paused) and the state invariants: the error code matches the state,
+ * FILL and DRAIN never outlast their timeouts, counters and the step pointer stay in
+ * range, a finished cycle stays finished, and wm_start outside IDLE changes nothing.
+ *
+ * Cases run on all cores until the time budget is spent or a case fails. A failing case
+ * is shrunk to a minimal reproducer: ticks are cut from the end and removed in chunks,
+ * commands dropped, sensor readings merged into runs and, for classic programs, the
+ * program's counts and times lowered, as long as the same check still fails.
+ *
+ * Usage: fuzz [-T seconds] [-j threads] [-s seed] [-r case] [-n max_ticks]
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "rng.h"
+#include "wm_control.h"
+#include "wm_coverage.h"
+
+#define DEFAULT_MAX_TICKS (1u << 20)
+#define SETTLE_TICKS 16      /* Ticks to keep going after the cycle finished */
+#define SHRINK_SECONDS 20.0  /* Time cap for shrinking */
+#define NO_CASE UINT64_MAX
+
+typedef enum { SENSE_NOISE, SENSE_STICKY, SENSE_WATER, SENSE_MODES } sense_mode_t;
+
+/* Input byte of a recorded tick: sensors in bits 0-2 (level << 1 | drain), command above */
+typedef enum { CMD_NONE, CMD_START, CMD_PAUSE, CMD_RESUME, CMD_ABORT, CMD_COUNT } cmd_t;
+
+typedef enum {
+    OK,
+    V_INLET_DRAIN,
+    V_MOTOR,
+    V_INLET,
+    V_SOAP,
+    V_DRAIN,
+    V_PAUSED_OUTPUT,
+    V_ERROR_CODE,
+    V_FILL_TIMEOUT,
+    V_DRAIN_TIMEOUT,
+    V_COUNTERS,
+    V_PC,
+    V_REOPENED,
+    V_START,
+    V_COUNT
+} check_t;
+
+static const char *const check_names[V_COUNT] = {
+    "ok",
+    "inlet and drain pump on together",
+    "motor on outside AGITATE/SPIN",
+    "inlet on outside FILL",
+    "soap pump on outside SOAP",
+    "drain pump on outside DRAIN/SPIN",
+    "output on while paused",
+    "error code does not match the state",
+    "FILL outlasted its timeout",
+    "DRAIN outlasted its timeout",
+    "more fills or washes than the program has",
+    "step pointer past the program",
+    "finished cycle became active again",
+    "wm_start outside IDLE changed the controller",
+};
+
+static const char *const cmd_names[CMD_COUNT] = {"", "start", "pause", "resume", "abort"};
+static const char *const sense_names[SENSE_MODES] = {"noise", "sticky", "water"};
+static const char *const level_names[] = {"EMPTY", "LOW", "MED", "HIGH"};
+
+typedef struct {
+    wm_program_t prog;
+    uint8_t code[WM_CODE_MAX];
+    uint8_t code_len; /* 0: classic program */
+    bool compiled;    /* code is wm_compile_program(prog) (recompiled when prog shrinks) */
+
+    sense_mode_t mode;
+    uint32_t change_p; /* Sticky: chance per tick of a new reading (of 2^32) */
+    uint32_t glitch_p; /* Water: chance per tick of a wrong reading */
+    uint32_t cmd_p;    /* Chance per tick of a command */
+    uint32_t flow;     /* Water: volume units per tick through the inlet; the drain is twice */
+    uint32_t max_ticks;
+    rng_t rng; /* Input stream */
+#ifdef WM_COVERAGE
+    wm_cov_t *cov; /* Counts of the worker (NULL while shrinking) */
+#endif
+} case_t;
+
+typedef struct {
+    check_t check;
+    uint32_t tick; /* 0-based tick whose check failed */
+} fail_t;
+
+typedef struct {
+    uint8_t *v;
+    size_t n, cap;
+} bytes_t;
+
+typedef struct {
+    uint64_t seed;
+    uint32_t max_ticks;
+    double deadline;
+    volatile int stop;
+    unsigned threads;
+    /* Per worker */
+    uint64_t *ticks, *cases;
+    uint64_t (*ends)[3]; /* Cases that completed, ended in ERROR, hit max_ticks */
+    uint64_t (*state_ticks)[WM_ERROR + 1];
+    uint64_t *failed_case;
+    fail_t *fails;
+#ifdef WM_COVERAGE
+    wm_cov_t *cov;
+#endif
+} run_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t below(rng_t *r, uint32_t n) { return (uint32_t)((rng_next(r) >> 32) * n >> 32); }
+
+static uint32_t range(rng_t *r, uint32_t lo, uint32_t hi) { return lo + below(r, hi - lo + 1); }
+
+/* 2^32 * 10^-e for e drawn from [lo, hi] */
+static uint32_t chance(rng_t *r, int lo, int hi) {
+    double p = 1.0;
+    for (int e = range(r, (uint32_t)lo, (uint32_t)hi); e > 0; e--)
+        p /= 10.0;
+    return (uint32_t)(p * 4294967295.0);
+}
+
+/* --- Case generation --- */
+static void random_classic(rng_t *r, wm_program_t *p) {
+    static const uint8_t rates[] = {1, 2, 5, 10, 10, 10, 20};
+    memset(p, 0, sizeof(*p));
+    p->ticks_per_second = rates[below(r, sizeof(rates))];
+    p->wash_count = (uint8_t)range(r, 1, 3);
+    p->rinse_count = (uint8_t)range(r, 1, 3); /* A rinse count of 0 still runs one rinse */
+    p->spin_enable = below(r, 2);
+    p->soap_time_sec = (uint16_t)range(r, 0, 60);
+    p->wash_agitate_time_sec = (uint16_t)range(r, 30, 900);
+    p->rinse_agitate_time_sec = (uint16_t)range(r, 30, 600);
+    /* Half cycle of at least one tick, as wm_code_valid requires of step programs */
+    uint32_t min_ds = (10 + p->ticks_per_second - 1) / p->ticks_per_second;
+    p->agitate_cycle_ms = (uint16_t)(range(r, min_ds > 10 ? min_ds : 10, 60) * 100);
+    p->agitate_run_ms = (uint16_t)(range(r, 1, p->agitate_cycle_ms / 100) * 100);
+    p->target_water_level = (water_level_t)range(r, WATER_LOW, WATER_HIGH);
+    p->water_fill_timeout_sec = (uint16_t)range(r, 10, 600);
+    p->drain_timeout_sec = (uint16_t)range(r, 10, 300);
+}
+
+static uint8_t random_steps(rng_t *r, uint8_t tps, uint8_t *code) {
+    uint32_t min_ds = (10 + tps - 1) / tps;
+    for (;;) {
+        uint8_t n = 0;
+        int ops = (int)range(r, 1, 10);
+        for (int i = 0; i < ops && n + 5 <= WM_CODE_MAX - 4; i++) {
+            uint8_t op = (uint8_t)range(r, WM_OP_FILL, WM_OP_RINSE);
+            uint16_t sec = (uint16_t)range(r, 1, 600);
+            code[n++] = op;
+            switch (op) {
+            case WM_OP_FILL:
+                code[n++] = (uint8_t)range(r, WATER_EMPTY, WATER_HIGH);
+                break;
+            case WM_OP_AGITATE:
+                code[n + 1] = (uint8_t)range(r, min_ds, 60);
+                code[n] = (uint8_t)range(r, 1, code[n + 1]);
+                n += 2;
+                /* fall through */
+            case WM_OP_SOAP:
+            case WM_OP_SPIN:
+            case WM_OP_SOAK:
+                code[n++] = (uint8_t)sec;
+                code[n++] = (uint8_t)(sec >> 8);
+                break;
+            default:
+                break;
+            }
+        }
+        if (below(r, 3) == 0 && n > 0) {
+            code[n] = WM_OP_LOOP;
+            code[n + 1] = (uint8_t)range(r, 1, 3);
+            code[n + 2] = (uint8_t)range(r, 1, n);
+            n += 3;
+        }
+        if (below(r, 2))
+            code[n++] = WM_OP_END;
+        if (wm_code_valid(code, n, tps))
+            return n;
+    }
+}
+
+static void make_case(case_t *k, uint64_t seed, uint64_t index, uint32_t max_ticks) {
+    rng_t r = rng_for_run(seed, index);
+    memset(k, 0, sizeof(*k));
+    random_classic(&r, &k->prog);
+    switch (below(&r, 3)) {
+    case 0:
+        break;
+    case 1:
+        k->compiled = true;
+        k->code_len = wm_compile_program(&k->prog, k->code, sizeof(k->code));
+        k->compiled = k->code_len != 0;
+        break;
+    default:
+        k->code_len = random_steps(&r, k->prog.ticks_per_second, k->code);
+        break;
+    }
+    k->mode = (sense_mode_t)below(&r, SENSE_MODES);
+    k->change_p = chance(&r, 0, 4);
+    k->glitch_p = chance(&r, 2, 6);
+    k->cmd_p = below(&r, 4) == 0 ? 0 : chance(&r, 2, 5);
+    k->flow = range(&r, 1, 400);
+    k->max_ticks = max_ticks;
+    k->rng = r;
+}
+
+/* --- Checks --- */
+static bool finished(wm_state_t s) { return s == WM_COMPLETE || s == WM_ERROR; }
+
+/* What the checker remembers between ticks */
+typedef struct {
+    wm_state_t last; /* State before this tick, paused or not */
+    uint32_t fills;  /* Times FILL was entered */
+    bool done;       /* The cycle finished */
+} track_t;
+
+static check_t check_tick(const wm_controller_t *c, const wm_actuators_t *a, track_t *tr) {
+    wm_state_t st = c->state;
+    wm_state_t real = st == WM_PAUSED ? c->prev_state : st;
+    uint32_t tps = c->program.ticks_per_second;
+    bool was_done = tr->done;
+
+    tr->fills += real == WM_FILL && tr->last != WM_FILL;
+    tr->last = real;
+    tr->done |= finished(real);
+
+    if (a->inlet_valve && a->drain_pump)
+        return V_INLET_DRAIN;
+    if (a->motor_dir != MOTOR_STOP && st != WM_AGITATE && st != WM_SPIN)
+        return V_MOTOR;
+    if (a->inlet_valve && st != WM_FILL)
+        return V_INLET;
+    if (a->soap_pump && st != WM_SOAP)
+        return V_SOAP;
+    if (a->drain_pump && st != WM_DRAIN && st != WM_SPIN)
+        return V_DRAIN;
+    if (st == WM_PAUSED && (a->inlet_valve || a->soap_pump || a->drain_pump || a->motor_dir))
+        return V_PAUSED_OUTPUT;
+    if ((real == WM_ERROR) != (c->error_code != WM_ERR_NONE))
+        return V_ERROR_CODE;
+    if (st == WM_FILL && c->state_time >= (uint32_t)c->program.water_fill_timeout_sec * tps)
+        return V_FILL_TIMEOUT;
+    if (st == WM_DRAIN && c->state_time >= (uint32_t)c->program.drain_timeout_sec * tps)
+        return V_DRAIN_TIMEOUT;
+    if (!c->code_len && (c->wash_done > c->program.wash_count ||
+                         tr->fills > (uint32_t)c->program.wash_count + c->program.rinse_count))
+        return V_COUNTERS;
+    if (c->pc > c->code_len)
+        return V_PC;
+    if (was_done && !finished(real))
+        return V_REOPENED;
+    return OK;
+}
+
+static void apply(wm_controller_t *c, cmd_t cmd, fail_t *f) {
+    wm_controller_t before;
+    switch (cmd) {
+    case CMD_START:
+        before = *c;
+        wm_start(c);
+        if (before.state != WM_IDLE && memcmp(&before, c, sizeof(before)) != 0)
+            f->check = V_START;
+        break;
+    case CMD_PAUSE:
+        wm_pause(c);
+        break;
+    case CMD_RESUME:
+        wm_resume(c);
+        break;
+    case CMD_ABORT:
+        wm_abort(c);
+        break;
+    default:
+        break;
+    }
+}
+
+/* --- Running --- */
+static bool setup(const case_t *k, wm_controller_t *c, wm_sensors_t *s, wm_actuators_t *a) {
+    wm_init(c, s, a, k->prog);
+    WM_COV_ATTACH(c, k->cov);
+    if (k->code_len && !wm_load_code(c, k->code, k->code_len))
+        return false;
+    wm_start(c);
+    return true;
+}
+
+/*
+ * Run a case. With 'inputs' the ticks replay them, else they are drawn from the case's
+ * stream (and appended to 'rec' if given). Returns false with f set at the first failed
+ * check. state_ticks and end (the last state) may be NULL.
+ */
+static bool run_case(case_t *k, const uint8_t *inputs, size_t n_inputs, bytes_t *rec,
+                     uint64_t *ticks, uint64_t *state_ticks, wm_state_t *end, fail_t *f) {
+    wm_controller_t c;
+    wm_sensors_t s;
+    wm_actuators_t a;
+    rng_t r = k->rng;
+    uint32_t water = 0, full = 3 * 4096, settle = SETTLE_TICKS;
+    uint8_t sensors = 0;
+    track_t tr = {WM_IDLE, 0, false};
+
+    f->check = OK;
+    if (!setup(k, &c, &s, &a))
+        return true;
+    uint32_t limit = inputs ? (uint32_t)n_inputs : k->max_ticks;
+    for (uint32_t t = 0; t < limit; t++) {
+        uint8_t in;
+        if (inputs) {
+            in = inputs[t];
+        } else {
+            uint64_t x = rng_next(&r);
+            switch (k->mode) {
+            case SENSE_NOISE:
+                sensors = (uint8_t)(x & 7);
+                break;
+            case SENSE_STICKY:
+                if ((uint32_t)x < k->change_p)
+                    sensors = (uint8_t)(x >> 61);
+                break;
+            default:
+                if (a.inlet_valve && water < full + 4096)
+                    water += k->flow;
+                if (a.drain_pump)
+                    water = water > 2 * k->flow ? water - 2 * k->flow : 0;
+                sensors = (uint8_t)((water >= full ? 3 : water / 4096) << 1 | (water > 0));
+                if ((uint32_t)x < k->glitch_p)
+                    sensors = (uint8_t)(x >> 61);
+                break;
+            }
+            in = sensors;
+            if ((uint32_t)(x >> 32) < k->cmd_p)
+                in |= (uint8_t)((1 + (x >> 40) % (CMD_COUNT - 1)) << 3);
+            if (rec) {
+                if (rec->n == rec->cap) {
+                    rec->cap = rec->cap ? rec->cap * 2 : 4096;
+                    rec->v = realloc(rec->v, rec->cap);
+                    if (!rec->v) {
+                        perror("fuzz");
+                        exit(1);
+                    }
+                }
+                rec->v[rec->n++] = in;
+            }
+        }
+
+        if (in >> 3) {
+            apply(&c, (cmd_t)(in >> 3), f);
+            if (f->check) {
+                f->tick = t;
+                return false;
+            }
+        }
+        s.water_level = (water_level_t)(in >> 1 & 3);
+        s.drain_check = in & 1;
+        wm_tick(&c, &s, &a);
+        (*ticks)++;
+        if (state_ticks)
+            state_ticks[c.state]++;
+
+        if ((f->check = check_tick(&c, &a, &tr)) != OK) {
+            f->tick = t;
+            return false;
+        }
+        if (tr.done && !inputs && --settle == 0)
+            break;
+    }
+    if (end)
+        *end = c.state;
+    return true;
+}
+
+static void worker(void *ctx, size_t index, unsigned w) {
+    run_t *run = (run_t *)ctx;
+    (void)w;
+    for (uint64_t i = index; !run->stop; i += run->threads) {
+        case_t k;
+        fail_t f;
+        wm_state_t end;
+        make_case(&k, run->seed, i, run->max_ticks);
+#ifdef WM_COVERAGE
+        k.cov = &run->cov[index];
+#endif
+        run->cases[index]++;
+        if (!run_case(&k, NULL, 0, NULL, &run->ticks[index], run->state_ticks[index], &end,
+                      &f)) {
+            run->failed_case[index] = i;
+            run->fails[index] = f;
+            run->stop = 1;
+        } else {
+            run->ends[index][end == WM_COMPLETE ? 0 : end == WM_ERROR ? 1 : 2]++;
+        }
+        if (now_sec() >= run->deadline)
+            break;
+    }
+}
+
+/* --- Shrinking --- */
+typedef struct {
+    case_t k;
+    bytes_t in;
+    check_t check;
+    uint64_t replays;
+} shrink_t;
+
+/* Still fails the same way? Then cut the inputs after the failing tick. */
+static bool still_fails(shrink_t *sh, case_t *k, bytes_t *in) {
+    uint64_t ticks = 0;
+    fail_t f;
+    sh->replays++;
+    if (k->compiled) {
+        k->code_len = wm_compile_program(&k->prog, k->code, sizeof(k->code));
+        if (!k->code_len)
+            return false;
+    }
+    if (run_case(k, in->v, in->n, NULL, &ticks, NULL, NULL, &f) || f.check != sh->check)
+        return false;
+    in->n = f.tick + 1;
+    return true;
+}
+
+/* Try an edited copy of the inputs; keep it if the case still fails */
+static bool try_inputs(shrink_t *sh, bytes_t *cand) {
+    case_t k = sh->k;
+    if (!still_fails(sh, &k, cand))
+        return false;
+    memcpy(sh->in.v, cand->v, cand->n);
+    sh->in.n = cand->n;
+    return true;
+}
+
+static bool shrink_inputs(shrink_t *sh, bytes_t *cand, double stop_at) {
+    bool progress = false;
+    /* Remove chunks of ticks, halving the chunk size */
+    for (size_t chunk = sh->in.n / 2; chunk >= 1 && now_sec() < stop_at; chunk /= 2) {
+        for (size_t i = 0; i + chunk <= sh->in.n && now_sec() < stop_at;) {
+            memcpy(cand->v, sh->in.v, i);
+            memcpy(cand->v + i, sh->in.v + i + chunk, sh->in.n - i - chunk);
+            cand->n = sh->in.n - chunk;
+            if (try_inputs(sh, cand))
+                progress = true;
+            else
+                i += chunk;
+        }
+    }
+    /* Drop commands, then repeat the previous reading over chunks of ticks */
+    for (size_t i = 0; i < sh->in.n && now_sec() < stop_at; i++) {
+        if (!(sh->in.v[i] >> 3))
+            continue;
+        memcpy(cand->v, sh->in.v, sh->in.n);
+        cand->n = sh->in.n;
+        cand->v[i] &= 7;
+        progress |= try_inputs(sh, cand);
+    }
+    for (size_t chunk = sh->in.n / 2; chunk >= 1 && now_sec() < stop_at; chunk /= 2) {
+        for (size_t i = 1; i < sh->in.n && now_sec() < stop_at; i += chunk) {
+            uint8_t prev = sh->in.v[i - 1] & 7;
+            bool same = true;
+            memcpy(cand->v, sh->in.v, sh->in.n);
+            cand->n = sh->in.n;
+            for (size_t j = i; j < i + chunk && j < cand->n; j++) {
+                same &= (cand->v[j] & 7) == prev;
+                cand->v[j] = (uint8_t)((cand->v[j] & ~7) | prev);
+            }
+            if (!same)
+                progress |= try_inputs(sh, cand);
+        }
+    }
+    return progress;
+}
+
+/* Lower a classic program's counts and times while the case still fails */
+static bool shrink_program(shrink_t *sh) {
+    bool progress = false;
+    if (sh->k.code_len && !sh->k.compiled)
+        return false;
+    for (int field = 0; field < 8; field++) {
+        case_t k = sh->k;
+        wm_program_t *p = &k.prog;
+        switch (field) {
+        case 0:
+            p->wash_count = 1;
+            break;
+        case 1:
+            p->rinse_count = 1;
+            break;
+        case 2:
+            p->spin_enable = false;
+            break;
+        case 3:
+            p->soap_time_sec = 1;
+            break;
+        case 4:
+            p->wash_agitate_time_sec = 1;
+            break;
+        case 5:
+            p->rinse_agitate_time_sec = 1;
+            break;
+        case 6:
+            p->water_fill_timeout_sec = 1;
+            break;
+        default:
+            p->drain_timeout_sec = 1;
+            break;
+        }
+        if (memcmp(&k.prog, &sh->k.prog, sizeof(k.prog)) == 0)
+            continue;
+        bytes_t copy = sh->in;
+        if (still_fails(sh, &k, &copy)) {
+            sh->k = k;
+            sh->in.n = copy.n;
+            progress = true;
+        }
+    }
+    return progress;
+}
+
+static void print_program(const case_t *k) {
+    const wm_program_t *p = &k->prog;
+    printf("  wm_program_t program = {.wash_count = %u, .rinse_count = %u, .spin_enable = %s,\n"
+           "      .soap_time_sec = %u, .wash_agitate_time_sec = %u, .rinse_agitate_time_sec = %u,\n"
+           "      .agitate_run_ms = %u, .agitate_cycle_ms = %u, .target_water_level = %s,\n"
+           "      .water_fill_timeout_sec = %u, .drain_timeout_sec = %u,\n"
+           "      .ticks_per_second = %u};\n",
+           p->wash_count, p->rinse_count, p->spin_enable ? "true" : "false", p->soap_time_sec,
+           p->wash_agitate_time_sec, p->rinse_agitate_time_sec, p->agitate_run_ms,
+           p->agitate_cycle_ms, level_names[p->target_water_level], p->water_fill_timeout_sec,
+           p->drain_timeout_sec, p->ticks_per_second);
+    if (k->code_len) {
+        printf("  uint8_t code[] = {");
+        for (uint8_t i = 0; i < k->code_len; i++)
+            printf("%s%u", i ? ", " : "", k->code[i]);
+        printf("}; /* %s */\n", k->compiled ? "wm_compile_program(&program)" : "step program");
+    }
+}
+
+/* The inputs as runs of equal ticks */
+static void print_inputs(const bytes_t *in) {
+    printf("  tick(s)        level drain  command\n");
+    for (size_t i = 0; i < in->n;) {
+        size_t j = i + 1;
+        while (j < in->n && in->v[j] == in->v[i] && !(in->v[i] >> 3))
+            j++;
+        char span[48];
+        if (j - i > 1)
+            snprintf(span, sizeof(span), "%zu-%zu", i + 1, j);
+        else
+            snprintf(span, sizeof(span), "%zu", i + 1);
+        printf("  %-14s %-5s %-5s  %s\n", span, level_names[in->v[i] >> 1 & 3],
+               in->v[i] & 1 ? "wet" : "dry", cmd_names[in->v[i] >> 3]);
+        i = j;
+    }
+}
+
+/* Shrink and print case 'index' if it fails; returns whether it did */
+static bool shrink_and_report(uint64_t seed, uint64_t index, uint32_t max_ticks) {
+    shrink_t sh;
+    uint64_t ticks = 0;
+    fail_t f;
+    memset(&sh, 0, sizeof(sh));
+    make_case(&sh.k, seed, index, max_ticks);
+    if (run_case(&sh.k, NULL, 0, &sh.in, &ticks, NULL, NULL, &f)) {
+        printf("case %llu passes\n", (unsigned long long)index);
+        free(sh.in.v);
+        return false;
+    }
+    sh.check = f.check;
+    sh.in.n = f.tick + 1;
+    size_t original = sh.in.n;
+
+    bytes_t cand = {malloc(sh.in.n ? sh.in.n : 1), 0, sh.in.n};
+    if (!cand.v) {
+        perror("fuzz");
+        exit(1);
+    }
+    double stop_at = now_sec() + SHRINK_SECONDS;
+    while (now_sec() < stop_at) {
+        bool p = shrink_program(&sh);
+        if (!shrink_inputs(&sh, &cand, stop_at) && !p)
+            break;
+    }
+
+    printf("FAIL case %llu (-s %llu -r %llu): %s\n", (unsigned long long)index,
+           (unsigned long long)seed, (unsigned long long)index, check_names[sh.check]);
+    printf("shrunk %zu ticks to %zu in %llu replays; %s sensors, command chance %.2g/tick\n",
+           original, sh.in.n, (unsigned long long)sh.replays, sense_names[sh.k.mode],
+           sh.k.cmd_p / 4294967296.0);
+    print_program(&sh.k);
+    print_inputs(&sh.in);
+    free(cand.v);
+    free(sh.in.v);
+    return true;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-T seconds] [-j threads] [-s seed] [-r case] [-n max_ticks]\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    double seconds = 10.0;
+    unsigned threads = 0;
+    uint64_t seed = 1, replay = NO_CASE;
+    uint32_t max_ticks = DEFAULT_MAX_TICKS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "T:j:s:r:n:")) != -1) {
+        switch (opt) {
+        case 'T':
+            seconds = strtod(optarg, NULL);
+            break;
+        case 'j':
+            threads = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'r':
+            replay = strtoull(optarg, NULL, 10);
+            break;
+        case 'n':
+            max_ticks = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || seconds <= 0 || max_ticks == 0)
+        usage(argv[0]);
+    if (replay != NO_CASE)
+        return shrink_and_report(seed, replay, max_ticks) ? 1 : 0;
+    if (threads == 0)
+        threads = pool_cpu_count();
+
+    run_t run = {.seed = seed, .max_ticks = max_ticks, .threads = threads};
+    run.ticks = calloc(threads, sizeof(*run.ticks));
+    run.cases = calloc(threads, sizeof(*run.cases));
+    run.ends = calloc(threads, sizeof(*run.ends));
+    run.state_ticks = calloc(threads, sizeof(*run.state_ticks));
+    run.failed_case = malloc(threads * sizeof(*run.failed_case));
+    run.fails = calloc(threads, sizeof(*run.fails));
+    if (!run.ticks || !run.cases || !run.ends || !run.state_ticks || !run.failed_case ||
+        !run.fails) {
+        perror("fuzz");
+        return 1;
+    }
+    for (unsigned i = 0; i < threads; i++)
+        run.failed_case[i] = NO_CASE;
+#ifdef WM_COVERAGE
+    run.cov = calloc(threads, sizeof(*run.cov));
+    if (!run.cov) {
+        perror("fuzz");
+        return 1;
+    }
+#endif
+
+    double t0 = now_sec();
+    run.deadline = t0 + seconds;
+    pool_run(threads, threads, worker, &run);
+    double wall = now_sec() - t0;
+    unsigned cores = threads < pool_cpu_count() ? threads : pool_cpu_count();
+
+    uint64_t ticks = 0, cases = 0, failed = NO_CASE, states[WM_ERROR + 1] = {0}, ends[3] = {0};
+    for (unsigned i = 0; i < threads; i++) {
+        ticks += run.ticks[i];
+        cases += run.cases[i];
+        for (int e = 0; e < 3; e++)
+            ends[e] += run.ends[i][e];
+        for (int s = 0; s <= WM_ERROR; s++)
+            states[s] += run.state_ticks[i][s];
+        if (run.failed_case[i] < failed)
+            failed = run.failed_case[i];
+    }
+    printf("%llu cases, %.3g ticks in %.1f s on %u threads: %.1f M ticks/s per core\n",
+           (unsigned long long)cases, (double)ticks, wall, threads, ticks / wall / cores / 1e6);
+    printf("cases ending COMPLETE %llu, ERROR %llu, at the tick limit %llu\n",
+           (unsigned long long)ends[0], (unsigned long long)ends[1], (unsigned long long)ends[2]);
+    printf("ticks per state:");
+    for (int s = WM_IDLE; s <= WM_ERROR; s++)
+        printf(" %s %.1f%%", wm_state_str((wm_state_t)s), ticks ? 100.0 * states[s] / ticks : 0.0);
+    printf("\n");
+#ifdef WM_COVERAGE
+    for (unsigned i = 1; i < threads; i++)
+        wm_cov_merge(&run.cov[0], &run.cov[i]);
+    if (!wm_cov_save(wm_cov_path(), &run.cov[0]))
+        perror(wm_cov_path());
+    free(run.cov);
+#endif
+
+    if (failed != NO_CASE)
+        shrink_and_report(seed, failed, max_ticks);
+    else
+        printf("no failures\n");
+    free(run.ticks);
+    free(run.cases);
+    free(run.ends);
+    free(run.state_ticks);
+    free(run.failed_case);
+    free(run.fails);
+    return failed == NO_CASE ? 0 : 1;
+}
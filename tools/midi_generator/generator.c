@@ -5,6 +5,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../../lib/buzzer/generator.h"
+
 #define MAX_EVENTS 20000
 #define MIDI_MAGIC 0x4D546864
 #define TRACK_MAGIC 0x4D54726B
@@ -208,6 +210,7 @@ int process_midi(const char *path, const char *song_name, FILE *out) {
     return 0;
 }
 
+#ifdef STANDALONE_GENERATOR
 int main(int argc, char **argv) {
     if (argc < 4) {
         printf("Usage: %s <output.h> <name1:in1.mid> [name2:in2.mid] ...\n", argv[0]);
@@ -237,3 +240,4 @@ int main(int argc, char **argv) {
     fclose(out);
     return 0;
 }
+#endif
@@ -0,0 +1,755 @@
+/*
+ * Exhaustive model checker for the wm_control state machine.
+ *
+ * Explores every wm_controller_t state reachable from wm_start under all inputs: on each
+ * tick any water level and drain_check reading, optionally preceded by wm_pause,
+ * wm_resume or wm_abort. Programs are the small bounded ones of the unit tests, run
+ * at 1 tick per second; -t raises the tick rate, and the state count grows with it.
+ *
+ * The search is breadth-first and level-synchronous. States are packed into 128 bits
+ * (only the fields the controller changes; the rest must stay as wm_init left them) and
+ * hashed into 64 shards, each an open-addressing table of indices into its state array.
+ * Each level has two parallel phases on the work-stealing pool:
+ *   expand  every shard's new states are stepped under every input; the successors go
+ *           into per (source, destination) shard buckets
+ *   insert  every shard adds the successors bucketed for it, with no locks
+ * Every state keeps its parent and input, so a failure is reported with the shortest
+ * sequence of ticks that reaches it.
+ *
+ * Properties:
+ *   interlocks   after every wm_tick: inlet never on with the drain pump, motor only in
+ *                AGITATE/SPIN, inlet only in FILL, soap only in SOAP, drain only in
+ *                DRAIN/SPIN
+ *   termination  once the user stops pausing and aborting (and resumes a pause), every
+ *                run reaches COMPLETE or ERROR whatever the sensors read: the graph of
+ *                command-free ticks over the non-final states has no cycle. The longest
+ *                such path bounds how long any state takes to finish.
+ *
+ * Usage: modelcheck [-p program] [-t ticks_per_second] [-j threads] [-l]
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "wm_control.h"
+
+#define SHARDS 64
+#define SENSOR_INPUTS 8 /* water_level (4) x drain_check (2) */
+#define INPUTS (4 * SENSOR_INPUTS)
+#define NO_PARENT UINT64_MAX
+
+typedef enum { CMD_NONE, CMD_PAUSE, CMD_RESUME, CMD_ABORT } cmd_t;
+
+static const char *const cmd_names[] = {"", "pause", "resume", "abort"};
+static const char *const level_names[] = {"EMPTY", "LOW", "MED", "HIGH"};
+
+typedef struct {
+    uint64_t w[2];
+} mkey_t;
+
+typedef struct {
+    mkey_t key;
+    uint64_t from; /* (parent id << 5) | input, NO_PARENT for the start state */
+} entry_t;
+
+typedef struct {
+    entry_t *states;
+    size_t count, cap;
+    uint32_t *table; /* State index + 1, 0 = empty */
+    size_t mask;
+    size_t level_start; /* States added by the last insert phase */
+    uint32_t *indeg;    /* Termination: command-free predecessors not yet ordered */
+    uint32_t *longest;  /* Termination: longest command-free path into the state */
+} shard_t;
+
+typedef struct {
+    entry_t *items;
+    size_t count, cap;
+} bucket_t;
+
+typedef struct {
+    uint64_t state; /* Id of the state whose tick failed */
+    int input;
+    char what[96];
+} violation_t;
+
+typedef struct {
+    const char *name;
+    wm_program_t program;
+    const uint8_t *code; /* Step program, or NULL for a classic one */
+    uint8_t code_len;
+    bool compile; /* Run the classic program as wm_compile_program's step program */
+} model_t;
+
+typedef struct {
+    wm_controller_t base; /* Start state; fields outside the key always equal it */
+    shard_t shards[SHARDS];
+    bucket_t buckets[SHARDS][SHARDS]; /* [source][destination] */
+    violation_t found[SHARDS];        /* First violation per source shard, state = NO_PARENT */
+    bool overflow;                    /* A state did not fit the key */
+} checker_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *xrealloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        perror("modelcheck");
+        exit(1);
+    }
+    return p;
+}
+
+/* --- Packing --- */
+/*
+ * Every field wm_control changes after wm_init, with its width in the key (128 bits). The
+ * usage counters are left out: nothing reads them, and they would make every tick new.
+ * step() puts them back to the base's after each tick.
+ */
+#define KEY_FIELDS(X)                                                                              \
+    X(state, 4)                                                                                    \
+    X(prev_state, 4)                                                                               \
+    X(is_wash_phase, 1)                                                                            \
+    X(wash_done, 4)                                                                                \
+    X(rinse_done, 4)                                                                               \
+    X(state_time, 16)                                                                              \
+    X(error_code, 2)                                                                               \
+    X(pc, 6)                                                                                       \
+    X(loop_iter, 4)                                                                                \
+    X(step_sec, 12)                                                                                \
+    X(program.spin_enable, 1)                                                                      \
+    X(program.target_water_level, 2)                                                               \
+    X(program.soap_time_sec, 12)                                                                   \
+    X(program.wash_agitate_time_sec, 12)                                                           \
+    X(program.rinse_agitate_time_sec, 12)                                                          \
+    X(program.agitate_run_ms, 16)                                                                  \
+    X(program.agitate_cycle_ms, 16)
+
+static void put_bits(mkey_t *k, int *bit, uint32_t v, int width, bool *ok) {
+    if (v >> (width - 1) >> 1)
+        *ok = false;
+    for (int i = 0; i < width; i++, (*bit)++) {
+        if (v >> i & 1)
+            k->w[*bit / 64] |= 1ull << (*bit % 64);
+    }
+}
+
+static uint32_t get_bits(const mkey_t *k, int *bit, int width) {
+    uint32_t v = 0;
+    for (int i = 0; i < width; i++, (*bit)++)
+        v |= (uint32_t)(k->w[*bit / 64] >> (*bit % 64) & 1) << i;
+    return v;
+}
+
+static bool pack(const wm_controller_t *c, mkey_t *k) {
+    int bit = 0;
+    bool ok = true;
+    k->w[0] = k->w[1] = 0;
+#define PACK(f, width) put_bits(k, &bit, (uint32_t)c->f, width, &ok);
+    KEY_FIELDS(PACK)
+#undef PACK
+    return ok;
+}
+
+static void unpack(const mkey_t *k, const wm_controller_t *base, wm_controller_t *c) {
+    int bit = 0;
+    *c = *base;
+#define UNPACK(f, width) c->f = get_bits(k, &bit, width);
+    KEY_FIELDS(UNPACK)
+#undef UNPACK
+}
+
+static uint64_t key_hash(const mkey_t *k) {
+    uint64_t z = k->w[0] ^ (k->w[1] * 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static bool key_eq(const mkey_t *a, const mkey_t *b) {
+    return a->w[0] == b->w[0] && a->w[1] == b->w[1];
+}
+
+static unsigned shard_of(uint64_t h) { return (unsigned)(h >> 58); }
+
+static uint64_t make_id(unsigned shard, size_t index) { return (uint64_t)shard << 32 | index; }
+
+static const entry_t *entry(const checker_t *ck, uint64_t id) {
+    return &ck->shards[id >> 32].states[id & 0xFFFFFFFFu];
+}
+
+/* --- Hash set --- */
+static size_t slot_of(const shard_t *s, const mkey_t *k, uint64_t h) {
+    size_t i = (size_t)h & s->mask;
+    while (s->table[i] && !key_eq(&s->states[s->table[i] - 1].key, k))
+        i = (i + 1) & s->mask;
+    return i;
+}
+
+static void shard_grow(shard_t *s) {
+    size_t size = s->mask ? (s->mask + 1) * 2 : 1024;
+    free(s->table);
+    s->table = calloc(size, sizeof(*s->table));
+    if (!s->table) {
+        perror("modelcheck");
+        exit(1);
+    }
+    s->mask = size - 1;
+    for (size_t n = 0; n < s->count; n++)
+        s->table[slot_of(s, &s->states[n].key, key_hash(&s->states[n].key))] = (uint32_t)n + 1;
+}
+
+/* Add a state unless present */
+static void shard_insert(shard_t *s, const entry_t *e) {
+    if ((s->count + 1) * 2 > s->mask + 1)
+        shard_grow(s);
+    size_t slot = slot_of(s, &e->key, key_hash(&e->key));
+    if (s->table[slot])
+        return;
+    if (s->count == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 1024;
+        s->states = xrealloc(s->states, s->cap * sizeof(*s->states));
+    }
+    s->states[s->count] = *e;
+    s->table[slot] = (uint32_t)++s->count;
+}
+
+static uint64_t lookup(const checker_t *ck, const mkey_t *k) {
+    uint64_t h = key_hash(k);
+    const shard_t *s = &ck->shards[shard_of(h)];
+    uint32_t at = s->table[slot_of(s, k, h)];
+    return at ? make_id(shard_of(h), at - 1) : NO_PARENT;
+}
+
+/* --- Transitions --- */
+static bool final(wm_state_t s) { return s == WM_COMPLETE || s == WM_ERROR; }
+
+/* Apply the command, then tick with the sensor reading. False if the command did nothing. */
+static bool step(wm_controller_t *c, int input, wm_actuators_t *a) {
+    wm_controller_t before = *c;
+    switch ((cmd_t)(input / SENSOR_INPUTS)) {
+    case CMD_NONE:
+        break;
+    case CMD_PAUSE:
+        wm_pause(c);
+        break;
+    case CMD_RESUME:
+        wm_resume(c);
+        break;
+    case CMD_ABORT:
+        wm_abort(c);
+        break;
+    }
+    if (input >= SENSOR_INPUTS && memcmp(&before, c, sizeof(before)) == 0)
+        return false;
+
+    wm_sensors_t s = {(water_level_t)(input % SENSOR_INPUTS / 2), input % 2 != 0};
+    wm_tick(c, &s, a);
+    c->usage = before.usage; /* Not in the key: keep the base's, so states still round-trip */
+    return true;
+}
+
+/* Command-free ticks (and resuming a pause): the moves left once the user stops */
+static bool fair(const wm_controller_t *c, int input) {
+    cmd_t cmd = (cmd_t)(input / SENSOR_INPUTS);
+    return c->state == WM_PAUSED ? cmd == CMD_RESUME : cmd == CMD_NONE;
+}
+
+/* The interlocks wm_tick promises; false with a description */
+static bool interlocks_hold(const wm_controller_t *c, const wm_actuators_t *a, char *what,
+                            size_t len) {
+    const char *st = wm_state_str(c->state);
+    if (a->inlet_valve && a->drain_pump)
+        snprintf(what, len, "inlet and drain pump on together in %s", st);
+    else if (a->motor_dir != MOTOR_STOP && c->state != WM_AGITATE && c->state != WM_SPIN)
+        snprintf(what, len, "motor on in %s", st);
+    else if (a->inlet_valve && c->state != WM_FILL)
+        snprintf(what, len, "inlet on in %s", st);
+    else if (a->soap_pump && c->state != WM_SOAP)
+        snprintf(what, len, "soap pump on in %s", st);
+    else if (a->drain_pump && c->state != WM_DRAIN && c->state != WM_SPIN)
+        snprintf(what, len, "drain pump on in %s", st);
+    else
+        return true;
+    return false;
+}
+
+/* --- Breadth-first search --- */
+static void expand_shard(void *ctx, size_t index, unsigned worker) {
+    checker_t *ck = (checker_t *)ctx;
+    shard_t *s = &ck->shards[index];
+    violation_t *v = &ck->found[index];
+    (void)worker;
+
+    for (size_t n = s->level_start; n < s->count; n++) {
+        wm_controller_t from;
+        unpack(&s->states[n].key, &ck->base, &from);
+        if (final(from.state))
+            continue;
+        for (int input = 0; input < INPUTS; input++) {
+            wm_controller_t c = from;
+            wm_actuators_t a;
+            if (!step(&c, input, &a))
+                continue;
+            uint64_t id = make_id((unsigned)index, n);
+            if (v->state == NO_PARENT && !interlocks_hold(&c, &a, v->what, sizeof(v->what))) {
+                v->state = id;
+                v->input = input;
+            }
+            entry_t e = {{{0, 0}}, id << 5 | (uint64_t)input};
+            wm_controller_t back;
+            bool fits = pack(&c, &e.key);
+            unpack(&e.key, &ck->base, &back);
+            if (!fits || memcmp(&back, &c, sizeof(c)) != 0) {
+                ck->overflow = true;
+                continue;
+            }
+            bucket_t *b = &ck->buckets[index][shard_of(key_hash(&e.key))];
+            if (b->count == b->cap) {
+                b->cap = b->cap ? b->cap * 2 : 256;
+                b->items = xrealloc(b->items, b->cap * sizeof(*b->items));
+            }
+            b->items[b->count++] = e;
+        }
+    }
+}
+
+static void insert_shard(void *ctx, size_t index, unsigned worker) {
+    checker_t *ck = (checker_t *)ctx;
+    shard_t *s = &ck->shards[index];
+    (void)worker;
+
+    s->level_start = s->count;
+    for (unsigned src = 0; src < SHARDS; src++) {
+        bucket_t *b = &ck->buckets[src][index];
+        for (size_t i = 0; i < b->count; i++)
+            shard_insert(s, &b->items[i]);
+        b->count = 0;
+    }
+}
+
+/* --- Termination --- */
+static void count_indeg(void *ctx, size_t index, unsigned worker) {
+    checker_t *ck = (checker_t *)ctx;
+    const shard_t *s = &ck->shards[index];
+    (void)worker;
+
+    for (size_t n = 0; n < s->count; n++) {
+        wm_controller_t from;
+        unpack(&s->states[n].key, &ck->base, &from);
+        if (final(from.state))
+            continue;
+        for (int input = 0; input < INPUTS; input++) {
+            wm_controller_t c = from;
+            wm_actuators_t a;
+            mkey_t k;
+            if (!fair(&from, input) || !step(&c, input, &a) || final(c.state) || !pack(&c, &k))
+                continue;
+            uint64_t id = lookup(ck, &k);
+            __atomic_add_fetch(&ck->shards[id >> 32].indeg[id & 0xFFFFFFFFu], 1,
+                               __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Successor ids of a non-final state over command-free moves, final ones excluded */
+static int fair_successors(const checker_t *ck, uint64_t id, uint64_t *out) {
+    wm_controller_t from;
+    int n = 0;
+    unpack(&entry(ck, id)->key, &ck->base, &from);
+    for (int input = 0; input < INPUTS; input++) {
+        wm_controller_t c = from;
+        wm_actuators_t a;
+        mkey_t k;
+        if (fair(&from, input) && step(&c, input, &a) && !final(c.state) && pack(&c, &k))
+            out[n++] = lookup(ck, &k);
+    }
+    return n;
+}
+
+/*
+ * Kahn's algorithm over the command-free graph. Returns the number of non-final states it
+ * could order; all of them means no cycle. *longest gets the longest path in ticks.
+ */
+static size_t topo_order(checker_t *ck, uint32_t *longest) {
+    size_t cap = 1024, top = 0, ordered = 0;
+    uint64_t *stack = xrealloc(NULL, cap * sizeof(*stack));
+    *longest = 0;
+
+    for (unsigned sh = 0; sh < SHARDS; sh++) {
+        shard_t *s = &ck->shards[sh];
+        for (size_t n = 0; n < s->count; n++) {
+            if (s->indeg[n] == 0 && !final((wm_state_t)(s->states[n].key.w[0] & 0xF))) {
+                if (top == cap)
+                    stack = xrealloc(stack, (cap *= 2) * sizeof(*stack));
+                stack[top++] = make_id(sh, n);
+            }
+        }
+    }
+    while (top) {
+        uint64_t id = stack[--top];
+        uint32_t len = ck->shards[id >> 32].longest[id & 0xFFFFFFFFu] + 1;
+        uint64_t next[INPUTS];
+        int n = fair_successors(ck, id, next);
+        ordered++;
+        if (len > *longest)
+            *longest = len; /* At worst the next tick is the final one */
+        for (int i = 0; i < n; i++) {
+            shard_t *s = &ck->shards[next[i] >> 32];
+            size_t at = next[i] & 0xFFFFFFFFu;
+            if (len > s->longest[at])
+                s->longest[at] = len;
+            if (--s->indeg[at] == 0) {
+                if (top == cap)
+                    stack = xrealloc(stack, (cap *= 2) * sizeof(*stack));
+                stack[top++] = next[i];
+            }
+        }
+    }
+    free(stack);
+    return ordered;
+}
+
+/* --- Reporting --- */
+static void describe_outputs(const wm_actuators_t *a, char *buf, size_t len) {
+    static const char *const dirs[] = {"", " motor CW", " motor CCW"};
+    snprintf(buf, len, "%s%s%s%s", a->inlet_valve ? " inlet" : "", a->soap_pump ? " soap" : "",
+             a->drain_pump ? " drain" : "", dirs[a->motor_dir]);
+}
+
+/* Print one tick of a trace and apply it to c */
+static void print_tick(wm_controller_t *c, int tick, int input) {
+    wm_actuators_t a;
+    char outs[64];
+    int cmd = input / SENSOR_INPUTS;
+    step(c, input, &a);
+    describe_outputs(&a, outs, sizeof(outs));
+    printf("    %4d  %-6s %-5s %-3s -> %-8s%s\n", tick, cmd_names[cmd],
+           level_names[input % SENSOR_INPUTS / 2], input % 2 ? "wet" : "dry",
+           wm_state_str(c->state), outs);
+}
+
+/* Print the path from the start state to id, then take 'input'; returns the path length */
+static int print_path(const checker_t *ck, uint64_t id, wm_controller_t *c) {
+    size_t cap = 256, n = 0;
+    int *inputs = xrealloc(NULL, cap * sizeof(*inputs));
+    for (uint64_t at = id; entry(ck, at)->from != NO_PARENT; at = entry(ck, at)->from >> 5) {
+        if (n == cap)
+            inputs = xrealloc(inputs, (cap *= 2) * sizeof(*inputs));
+        inputs[n++] = (int)(entry(ck, at)->from & 31);
+    }
+    *c = ck->base;
+    printf("    tick  cmd    level drain   state / outputs\n");
+    printf("       0  start              -> %s\n", wm_state_str(c->state));
+    for (size_t i = 0; i < n; i++)
+        print_tick(c, (int)i + 1, inputs[n - 1 - i]);
+    free(inputs);
+    return (int)n;
+}
+
+static void print_violation(const checker_t *ck, const violation_t *v) {
+    wm_controller_t c;
+    printf("  FAIL interlocks: %s\n", v->what);
+    int n = print_path(ck, v->state, &c);
+    print_tick(&c, n + 1, v->input);
+}
+
+/* A state on a command-free cycle, the path to it and the cycle */
+static void print_lasso(checker_t *ck) {
+    /* Drop the leftover states with no leftover successor until all are on or before a cycle */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned sh = 0; sh < SHARDS; sh++) {
+            shard_t *s = &ck->shards[sh];
+            for (size_t n = 0; n < s->count; n++) {
+                if (s->indeg[n] == 0)
+                    continue;
+                uint64_t next[INPUTS];
+                int k = fair_successors(ck, make_id(sh, n), next), live = 0;
+                for (int i = 0; i < k; i++)
+                    live += ck->shards[next[i] >> 32].indeg[next[i] & 0xFFFFFFFFu] != 0;
+                if (!live) {
+                    s->indeg[n] = 0;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    /* The shallowest leftover state, then leftover successors until one repeats */
+    uint64_t best = NO_PARENT;
+    int best_depth = 0;
+    for (unsigned sh = 0; sh < SHARDS; sh++) {
+        for (size_t n = 0; n < ck->shards[sh].count; n++) {
+            if (!ck->shards[sh].indeg[n])
+                continue;
+            int depth = 0;
+            for (uint64_t at = make_id(sh, n); entry(ck, at)->from != NO_PARENT;
+                 at = entry(ck, at)->from >> 5)
+                depth++;
+            if (best == NO_PARENT || depth < best_depth) {
+                best = make_id(sh, n);
+                best_depth = depth;
+            }
+        }
+    }
+    if (best == NO_PARENT)
+        return;
+
+    /* Walk leftover successors from there until a state repeats: that closes the cycle */
+    size_t cap = 256, n = 0, loop_at = 0;
+    uint64_t *ids = xrealloc(NULL, cap * sizeof(*ids));
+    int *inputs = xrealloc(NULL, cap * sizeof(*inputs));
+    for (uint64_t at = best;;) {
+        wm_controller_t from;
+        unpack(&entry(ck, at)->key, &ck->base, &from);
+        if (n == cap) {
+            cap *= 2;
+            ids = xrealloc(ids, cap * sizeof(*ids));
+            inputs = xrealloc(inputs, cap * sizeof(*inputs));
+        }
+        ids[n] = at;
+        for (int input = 0; input < INPUTS; input++) {
+            wm_controller_t t = from;
+            wm_actuators_t a;
+            mkey_t k;
+            if (!fair(&from, input) || !step(&t, input, &a) || final(t.state) || !pack(&t, &k))
+                continue;
+            uint64_t id = lookup(ck, &k);
+            if (ck->shards[id >> 32].indeg[id & 0xFFFFFFFFu]) {
+                inputs[n] = input;
+                at = id;
+                break;
+            }
+        }
+        n++;
+        for (loop_at = 0; loop_at < n && ids[loop_at] != at; loop_at++)
+            ;
+        if (loop_at < n)
+            break;
+    }
+
+    wm_controller_t c;
+    int tick = print_path(ck, ids[loop_at], &c);
+    printf("    ---- repeats forever from here ----\n");
+    for (size_t i = loop_at; i < n; i++)
+        print_tick(&c, ++tick, inputs[i]);
+    free(ids);
+    free(inputs);
+}
+
+/* --- Driver --- */
+static void checker_free(checker_t *ck) {
+    for (unsigned i = 0; i < SHARDS; i++) {
+        free(ck->shards[i].states);
+        free(ck->shards[i].table);
+        free(ck->shards[i].indeg);
+        free(ck->shards[i].longest);
+        for (unsigned j = 0; j < SHARDS; j++)
+            free(ck->buckets[i][j].items);
+    }
+    free(ck);
+}
+
+static bool check_model(const model_t *m, unsigned threads, bool show_levels) {
+    checker_t *ck = calloc(1, sizeof(*ck));
+    if (!ck) {
+        perror("modelcheck");
+        exit(1);
+    }
+    double t0 = now_sec();
+
+    wm_sensors_t s;
+    wm_actuators_t a;
+    uint8_t code[WM_CODE_MAX];
+    const uint8_t *load = m->code;
+    uint8_t len = m->code_len;
+    if (m->compile) {
+        len = wm_compile_program(&m->program, code, sizeof(code));
+        load = code;
+    }
+    wm_init(&ck->base, &s, &a, m->program);
+    if (load && !wm_load_code(&ck->base, load, len)) {
+        printf("%-10s invalid step program\n", m->name);
+        checker_free(ck);
+        return false;
+    }
+    wm_start(&ck->base);
+
+    entry_t root = {{{0, 0}}, NO_PARENT};
+    pack(&ck->base, &root.key);
+    shard_insert(&ck->shards[shard_of(key_hash(&root.key))], &root);
+
+    bool ok = true;
+    int depth = 0;
+    size_t total = 1;
+    for (;;) {
+        for (unsigned i = 0; i < SHARDS; i++)
+            ck->found[i].state = NO_PARENT;
+        pool_run(SHARDS, threads, expand_shard, ck);
+        for (unsigned i = 0; i < SHARDS; i++) {
+            if (ck->found[i].state != NO_PARENT) {
+                print_violation(ck, &ck->found[i]);
+                ok = false;
+                break;
+            }
+        }
+        if (!ok || ck->overflow)
+            break;
+
+        pool_run(SHARDS, threads, insert_shard, ck);
+        size_t now = 0;
+        for (unsigned i = 0; i < SHARDS; i++)
+            now += ck->shards[i].count;
+        if (now == total)
+            break;
+        depth++;
+        if (show_levels)
+            printf("  depth %4d: %zu new states\n", depth, now - total);
+        total = now;
+    }
+    if (ck->overflow) {
+        printf("%-10s a state does not fit the packed key (a field outgrew its width or one\n"
+               "           outside the key changed); use a smaller program\n",
+               m->name);
+        checker_free(ck);
+        return false;
+    }
+
+    size_t live = 0;
+    uint32_t longest = 0;
+    if (ok) {
+        for (unsigned i = 0; i < SHARDS; i++) {
+            shard_t *sh = &ck->shards[i];
+            sh->indeg = calloc(sh->count + 1, sizeof(*sh->indeg));
+            sh->longest = calloc(sh->count + 1, sizeof(*sh->longest));
+            if (!sh->indeg || !sh->longest) {
+                perror("modelcheck");
+                exit(1);
+            }
+            for (size_t n = 0; n < sh->count; n++)
+                live += !final((wm_state_t)(sh->states[n].key.w[0] & 0xF));
+        }
+        pool_run(SHARDS, threads, count_indeg, ck);
+        if (topo_order(ck, &longest) != live) {
+            printf("  FAIL termination: a run can go on forever without a command\n");
+            print_lasso(ck);
+            ok = false;
+        }
+    }
+
+    printf("%-10s %s  %9zu states (%zu MB)  depth %3d", m->name, ok ? "ok  " : "FAIL", total,
+           total * (sizeof(entry_t) + 2 * sizeof(uint32_t)) >> 20, depth);
+    if (ok)
+        printf("  finishes within %u ticks of the last command", longest);
+    printf("  %.2f s\n", now_sec() - t0);
+    checker_free(ck);
+    return ok;
+}
+
+/* The bounded programs of test/test_wm_control.c, at 1 tick per second */
+static const uint8_t loop_code[] = {
+    WM_OP_FILL,    WATER_LOW, WM_OP_AGITATE, 20,          50,        4, 0,    WM_OP_DRAIN,
+    WM_OP_FILL,    WATER_MED, WM_OP_SOAK,    5,           0,         WM_OP_DRAIN, WM_OP_RINSE,
+    WM_OP_FILL,    WATER_MED, WM_OP_AGITATE, 20,          50,        3, 0,    WM_OP_DRAIN,
+    WM_OP_SPIN,    2,         0,             WM_OP_LOOP,  2,         11,      WM_OP_END,
+};
+
+static const wm_program_t standard = {
+    .wash_count = 1,
+    .rinse_count = 1,
+    .spin_enable = true,
+    .soap_time_sec = 1,
+    .wash_agitate_time_sec = 2,
+    .rinse_agitate_time_sec = 2,
+    .water_fill_timeout_sec = 10,
+    .drain_timeout_sec = 10,
+    .agitate_run_ms = 2000,
+    .agitate_cycle_ms = 4000,
+    .target_water_level = WATER_HIGH,
+    .ticks_per_second = 1,
+};
+
+static const wm_program_t double_wash = {
+    .wash_count = 2,
+    .rinse_count = 2,
+    .spin_enable = false,
+    .soap_time_sec = 2,
+    .wash_agitate_time_sec = 3,
+    .rinse_agitate_time_sec = 3,
+    .water_fill_timeout_sec = 10,
+    .drain_timeout_sec = 10,
+    .agitate_run_ms = 1000,
+    .agitate_cycle_ms = 2000,
+    .target_water_level = WATER_MED,
+    .ticks_per_second = 1,
+};
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-p program] [-t ticks_per_second] [-j threads] [-l]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    model_t models[] = {
+        {"standard", standard, NULL, 0, false},
+        {"compiled", standard, NULL, 0, true},
+        {"double", double_wash, NULL, 0, false},
+        {"steps", {.water_fill_timeout_sec = 10, .drain_timeout_sec = 10, .ticks_per_second = 1},
+         loop_code, sizeof(loop_code), false},
+    };
+    const size_t n_models = sizeof(models) / sizeof(models[0]);
+    const char *only = NULL;
+    unsigned threads = 0;
+    int tps = 0;
+    bool show_levels = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:j:l")) != -1) {
+        switch (opt) {
+        case 'p':
+            only = optarg;
+            break;
+        case 't':
+            tps = atoi(optarg);
+            break;
+        case 'j':
+            threads = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            show_levels = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || tps < 0 || tps > 255)
+        usage(argv[0]);
+    if (threads == 0)
+        threads = pool_cpu_count();
+
+    size_t checked = 0, passed = 0;
+    for (size_t i = 0; i < n_models; i++) {
+        if (only && strcmp(only, models[i].name) != 0)
+            continue;
+        if (tps)
+            models[i].program.ticks_per_second = (uint8_t)tps;
+        checked++;
+        passed += check_model(&models[i], threads, show_levels);
+    }
+    if (checked == 0) {
+        fprintf(stderr, "modelcheck: no program '%s'\n", only);
+        return 2;
+    }
+    printf("\n%zu/%zu programs verified on %u threads\n", passed, checked, threads);
+    return passed == checked ? 0 : 1;
+}
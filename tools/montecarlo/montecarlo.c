@@ -0,0 +1,441 @@
+/*
+ * Monte Carlo reliability estimator.
+ *
+ * Runs many complete cycles of one menu selection. Each cycle draws its own inlet flow,
+ * drain flow and level-sensor glitch rate from the given distributions and runs the
+ * controller against the water model (tools/sim/physics.c). The tool reports how likely
+ * each wm_error_t is and how long cycles take, with 95% confidence intervals. It also
+ * gives the longest FILL and DRAIN of each cycle, which shows how close the timeouts are
+ * to the tail.
+ *
+ * Cycles are stepped 64 at a time with wm_tick_batch and spread over all cores in blocks.
+ * Each cycle draws from its own random stream (seed, cycle index), so results depend only
+ * on the seed.
+ *
+ * Usage: montecarlo [-N cycles] [-j threads] [-s seed] [-m program,level,power]
+ *                   [-F fill_timeout_s] [-D drain_timeout_s] [-f inlet_dist]
+ *                   [-d drain_dist] [-g glitch_dist] [-o hist.csv]
+ */
+#define _DEFAULT_SOURCE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "app.h"
+#include "dist.h"
+#include "physics.h"
+#include "pool.h"
+#include "wm_batch.h"
+
+#define MC_JOB_CYCLES 1024 /* Cycles per pool job */
+#define MC_LANES 64        /* Cycles stepped together */
+#define MC_MAX_SEC (6 * 3600) /* Histogram range; longer cycles count as not finished */
+#define MC_ERRORS (WM_ERR_INVALID_PROGRAM + 1)
+#define MC_Z 1.959964 /* 95% two-sided */
+
+typedef struct {
+    uint64_t outcome[MC_ERRORS]; /* By error code; WM_ERR_NONE is COMPLETE */
+    uint64_t unfinished;
+    uint64_t sim_ticks;             /* Over all cycles */
+    uint64_t sum_ticks, sum_ticks2; /* Over COMPLETE cycles */
+    uint32_t *cycle_hist;           /* COMPLETE cycle time, 1 s bins */
+    uint32_t *fill_hist;            /* Longest FILL of each cycle, 1 s bins */
+    uint32_t *drain_hist;           /* Longest DRAIN of each cycle, 1 s bins */
+} mc_stats_t;
+
+typedef struct {
+    wm_batch_t batch;
+    phys_t phys[MC_LANES];
+    bool active[MC_LANES];
+    uint8_t prev[MC_LANES];      /* State before the tick */
+    uint32_t ticks[MC_LANES];    /* Since the cycle started */
+    uint32_t fill_run[MC_LANES]; /* Ticks in the current FILL / DRAIN */
+    uint32_t drain_run[MC_LANES];
+    uint32_t fill_max[MC_LANES];
+    uint32_t drain_max[MC_LANES];
+    mc_stats_t stats;
+} mc_worker_t;
+
+typedef struct {
+    size_t cycles;
+    uint64_t seed;
+    wm_program_t program;
+    dist_t inlet, drain, glitch;
+    mc_worker_t *workers;
+} mc_t;
+
+static void *xcalloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+    if (!p) {
+        perror("montecarlo");
+        exit(1);
+    }
+    return p;
+}
+
+static double clamp(double v, double lo, double hi) { return v < lo ? lo : v > hi ? hi : v; }
+
+static void hist_add(uint32_t *hist, uint32_t ticks, uint32_t tps) {
+    uint32_t sec = ticks / tps;
+    hist[sec < MC_MAX_SEC ? sec : MC_MAX_SEC - 1]++;
+}
+
+static void lane_start(const mc_t *mc, mc_worker_t *w, int lane, size_t cycle) {
+    rng_t rng = rng_for_run(mc->seed, cycle);
+    phys_params_t p = phys_default_params();
+    p.inlet_lpm = clamp(dist_sample(&mc->inlet, &rng), 0.0, 1e9);
+    p.drain_lpm = clamp(dist_sample(&mc->drain, &rng), 0.0, 1e9);
+    p.sensor_noise = clamp(dist_sample(&mc->glitch, &rng), 0.0, 1.0);
+    phys_init(&w->phys[lane], &p, rng);
+
+    wm_controller_t c;
+    wm_sensors_t s;
+    wm_actuators_t a;
+    wm_init(&c, &s, &a, mc->program);
+    wm_start(&c);
+    wm_batch_set(&w->batch, lane, &c);
+
+    phys_read(&w->phys[lane], &s);
+    w->batch.water_level[lane] = s.water_level;
+    w->batch.drain_check[lane] = s.drain_check;
+
+    w->active[lane] = true;
+    w->prev[lane] = WM_START;
+    w->ticks[lane] = 0;
+    w->fill_run[lane] = w->drain_run[lane] = 0;
+    w->fill_max[lane] = w->drain_max[lane] = 0;
+}
+
+static void lane_finish(mc_worker_t *w, int lane, uint32_t tps, bool finished) {
+    mc_stats_t *st = &w->stats;
+    uint32_t ticks = w->ticks[lane];
+
+    st->sim_ticks += ticks;
+    if (!finished) {
+        st->unfinished++;
+    } else {
+        wm_error_t err = (wm_error_t)w->batch.error[lane];
+        st->outcome[err < MC_ERRORS ? err : WM_ERR_INVALID_PROGRAM]++;
+        if (w->batch.state[lane] == WM_COMPLETE) {
+            st->sum_ticks += ticks;
+            st->sum_ticks2 += (uint64_t)ticks * ticks;
+            hist_add(st->cycle_hist, ticks, tps);
+        }
+    }
+    hist_add(st->fill_hist, w->fill_max[lane], tps);
+    hist_add(st->drain_hist, w->drain_max[lane], tps);
+
+    w->active[lane] = false;
+    w->batch.state[lane] = WM_IDLE;
+}
+
+/* Run the cycles of block 'job' on this worker's lanes */
+static void run_job(void *ctx, size_t job, unsigned worker) {
+    mc_t *mc = (mc_t *)ctx;
+    mc_worker_t *w = &mc->workers[worker];
+    wm_batch_t *b = &w->batch;
+    uint32_t tps = mc->program.ticks_per_second;
+    uint32_t dt_ms = 1000 / tps;
+    uint32_t max_ticks = MC_MAX_SEC * tps;
+
+    size_t next = job * MC_JOB_CYCLES;
+    size_t end = next + MC_JOB_CYCLES < mc->cycles ? next + MC_JOB_CYCLES : mc->cycles;
+    int running = 0;
+    for (int l = 0; l < MC_LANES && next < end; l++, running++)
+        lane_start(mc, w, l, next++);
+
+    while (running) {
+        wm_tick_batch(b);
+
+        for (int l = 0; l < MC_LANES; l++) {
+            if (!w->active[l])
+                continue;
+
+            uint8_t state = (uint8_t)b->state[l];
+            w->ticks[l]++;
+            w->fill_run[l] = w->prev[l] == WM_FILL ? w->fill_run[l] + 1 : 0;
+            w->drain_run[l] = w->prev[l] == WM_DRAIN ? w->drain_run[l] + 1 : 0;
+            if (w->fill_run[l] > w->fill_max[l])
+                w->fill_max[l] = w->fill_run[l];
+            if (w->drain_run[l] > w->drain_max[l])
+                w->drain_max[l] = w->drain_run[l];
+            w->prev[l] = state;
+
+            bool done = state == WM_COMPLETE || state == WM_ERROR;
+            if (done || w->ticks[l] >= max_ticks) {
+                lane_finish(w, l, tps, done);
+                if (next < end)
+                    lane_start(mc, w, l, next++);
+                else
+                    running--;
+                continue;
+            }
+
+            uint32_t out = b->out[l];
+            hal_sim_actuators_t acts = {.inlet = (out & WM_OUT_INLET) != 0,
+                                        .drain = (out & WM_OUT_DRAIN) != 0};
+            wm_sensors_t s;
+            phys_step(&w->phys[l], &acts, dt_ms);
+            phys_read(&w->phys[l], &s);
+            b->water_level[l] = s.water_level;
+            b->drain_check[l] = s.drain_check;
+        }
+    }
+}
+
+/* ---------- Statistics ---------- */
+
+/* Wilson score interval for k successes in n trials */
+static void wilson(uint64_t k, uint64_t n, double *lo, double *hi) {
+    double p = (double)k / n, z2 = MC_Z * MC_Z;
+    double denom = 1.0 + z2 / n;
+    double centre = (p + z2 / (2.0 * n)) / denom;
+    double half = MC_Z * sqrt(p * (1.0 - p) / n + z2 / (4.0 * n * (double)n)) / denom;
+    *lo = centre - half > 0.0 ? centre - half : 0.0;
+    *hi = centre + half < 1.0 ? centre + half : 1.0;
+}
+
+/* Value (bin) holding the sample of the given rank (0-based) */
+static uint32_t hist_rank(const uint64_t *hist, double rank) {
+    uint64_t cum = 0;
+    for (uint32_t s = 0; s < MC_MAX_SEC; s++) {
+        cum += hist[s];
+        if (cum > rank)
+            return s;
+    }
+    return MC_MAX_SEC - 1;
+}
+
+/* Quantile q with a distribution-free 95% interval from the binomial order statistics */
+static void print_quantile(const char *name, const uint64_t *hist, uint64_t n, double q,
+                           double scale) {
+    double spread = MC_Z * sqrt(n * q * (1.0 - q));
+    double rank = floor(q * (n - 1));
+    double lo = rank - spread < 0 ? 0 : floor(rank - spread);
+    double hi = rank + spread > n - 1 ? n - 1 : ceil(rank + spread);
+    printf("  %-6s %9.1f  [%.1f, %.1f]\n", name, hist_rank(hist, rank) / scale,
+           hist_rank(hist, lo) / scale, hist_rank(hist, hi) / scale);
+}
+
+static void print_tail(const char *title, const uint64_t *hist, uint64_t n, uint16_t timeout) {
+    static const double qs[] = {0.5, 0.99, 0.999};
+    static const char *const names[] = {"p50", "p99", "p99.9"};
+
+    printf("\n%s (s, timeout %u):\n", title, timeout);
+    for (int i = 0; i < 3; i++)
+        print_quantile(names[i], hist, n, qs[i], 1.0);
+    printf("  %-6s %9u\n", "max", hist_rank(hist, n - 1));
+}
+
+static void report(const mc_t *mc, uint64_t *cycle_hist, uint64_t *fill_hist,
+                   uint64_t *drain_hist, const mc_stats_t *total) {
+    uint64_t n = mc->cycles;
+    uint32_t tps = mc->program.ticks_per_second;
+    double lo, hi;
+
+    printf("\n%-16s %10s %12s  %s\n", "Outcome", "Cycles", "Probability", "95% CI (Wilson)");
+    for (int e = 0; e < MC_ERRORS; e++) {
+        wilson(total->outcome[e], n, &lo, &hi);
+        printf("%-16s %10llu %12.4g  [%.4g, %.4g]\n",
+               e == WM_ERR_NONE ? "COMPLETE" : wm_error_str((wm_error_t)e),
+               (unsigned long long)total->outcome[e], (double)total->outcome[e] / n, lo, hi);
+    }
+    if (total->unfinished)
+        printf("%-16s %10llu (ran past %d h)\n", "Unfinished",
+               (unsigned long long)total->unfinished, MC_MAX_SEC / 3600);
+
+    uint64_t k = total->outcome[WM_ERR_NONE];
+    if (k) {
+        double mean = (double)total->sum_ticks / k;
+        double var = k > 1 ? ((double)total->sum_ticks2 - mean * total->sum_ticks) / (k - 1) : 0;
+        double half = MC_Z * sqrt(var > 0 ? var / k : 0);
+        printf("\nCycle time of COMPLETE cycles (min):\n");
+        printf("  %-6s %9.2f  [%.2f, %.2f]\n", "mean", mean / tps / 60, (mean - half) / tps / 60,
+               (mean + half) / tps / 60);
+        static const double qs[] = {0.01, 0.05, 0.5, 0.95, 0.99};
+        static const char *const names[] = {"p1", "p5", "p50", "p95", "p99"};
+        for (int i = 0; i < 5; i++)
+            print_quantile(names[i], cycle_hist, k, qs[i], 60.0);
+    }
+
+    print_tail("Longest FILL per cycle", fill_hist, n, mc->program.water_fill_timeout_sec);
+    print_tail("Longest DRAIN per cycle", drain_hist, n, mc->program.drain_timeout_sec);
+}
+
+static void write_csv(const char *path, const uint64_t *cycle_hist, const uint64_t *fill_hist,
+                      const uint64_t *drain_hist) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror("Failed to open output");
+        exit(1);
+    }
+    fprintf(out, "seconds,complete_cycles,longest_fill,longest_drain\n");
+    for (uint32_t s = 0; s < MC_MAX_SEC; s++) {
+        if (cycle_hist[s] || fill_hist[s] || drain_hist[s])
+            fprintf(out, "%u,%llu,%llu,%llu\n", s, (unsigned long long)cycle_hist[s],
+                    (unsigned long long)fill_hist[s], (unsigned long long)drain_hist[s]);
+    }
+    fclose(out);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-N cycles] [-j threads] [-s seed] [-m program,level,power]\n"
+            "          [-F fill_timeout_s] [-D drain_timeout_s] [-f inlet_dist]\n"
+            "          [-d drain_dist] [-g glitch_dist] [-o hist.csv]\n"
+            "Distributions: 12 | uniform:lo,hi | normal:mean,sd | lognormal:median,sigma\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    mc_t mc = {0};
+    unsigned threads = 0;
+    int sel[3] = {0, 0, 0};
+    long fill_timeout = -1, drain_timeout = -1;
+    const char *csv_path = NULL;
+    mc.cycles = 100000;
+    mc.seed = 1;
+    dist_parse("normal:12,2", &mc.inlet);
+    dist_parse("normal:25,3", &mc.drain);
+    dist_parse("0", &mc.glitch);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "N:j:s:m:F:D:f:d:g:o:")) != -1) {
+        switch (opt) {
+        case 'N':
+            mc.cycles = (size_t)strtod(optarg, NULL); /* Accepts 1e6 */
+            break;
+        case 'j':
+            threads = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            mc.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%d,%d,%d", &sel[0], &sel[1], &sel[2]) != 3)
+                usage(argv[0]);
+            break;
+        case 'F':
+            fill_timeout = strtol(optarg, NULL, 10);
+            break;
+        case 'D':
+            drain_timeout = strtol(optarg, NULL, 10);
+            break;
+        case 'f':
+            if (!dist_parse(optarg, &mc.inlet))
+                usage(argv[0]);
+            break;
+        case 'd':
+            if (!dist_parse(optarg, &mc.drain))
+                usage(argv[0]);
+            break;
+        case 'g':
+            if (!dist_parse(optarg, &mc.glitch))
+                usage(argv[0]);
+            break;
+        case 'o':
+            csv_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (mc.cycles == 0 || fill_timeout == 0 || drain_timeout == 0 || fill_timeout > 65535 ||
+        drain_timeout > 65535)
+        usage(argv[0]);
+
+    static hal_t menu_hal;
+    static App menu;
+    hal_sim_set_quiet(&menu_hal, true);
+    app_init(&menu, &menu_hal);
+    for (int i = 0; i < 3; i++) {
+        if (sel[i] < 0 || sel[i] >= app_menu_count(&menu, (app_menu_t)i))
+            usage(argv[0]);
+    }
+    mc.program = app_menu_program(sel[0], sel[1], sel[2]);
+    if (fill_timeout > 0)
+        mc.program.water_fill_timeout_sec = (uint16_t)fill_timeout;
+    if (drain_timeout > 0)
+        mc.program.drain_timeout_sec = (uint16_t)drain_timeout;
+
+    if (threads == 0)
+        threads = pool_cpu_count();
+    mc.workers = xcalloc(threads, sizeof(*mc.workers));
+    for (unsigned t = 0; t < threads; t++) {
+        mc_stats_t *st = &mc.workers[t].stats;
+        if (!wm_batch_init(&mc.workers[t].batch, MC_LANES)) {
+            fprintf(stderr, "montecarlo: out of memory\n");
+            return 1;
+        }
+        st->cycle_hist = xcalloc(MC_MAX_SEC, sizeof(uint32_t));
+        st->fill_hist = xcalloc(MC_MAX_SEC, sizeof(uint32_t));
+        st->drain_hist = xcalloc(MC_MAX_SEC, sizeof(uint32_t));
+    }
+
+    char inlet[64], drain[64], glitch[64];
+    dist_format(&mc.inlet, inlet, sizeof(inlet));
+    dist_format(&mc.drain, drain, sizeof(drain));
+    dist_format(&mc.glitch, glitch, sizeof(glitch));
+    printf("Monte Carlo: %zu cycles of %s / %s / %s, seed %llu\n", mc.cycles,
+           app_menu_name(&menu, APP_MENU_PROGRAM, sel[0]),
+           app_menu_name(&menu, APP_MENU_LEVEL, sel[1]),
+           app_menu_name(&menu, APP_MENU_POWER, sel[2]), (unsigned long long)mc.seed);
+    printf("Timeouts: fill %u s, drain %u s\n", mc.program.water_fill_timeout_sec,
+           mc.program.drain_timeout_sec);
+    printf("Per cycle: inlet %s L/min, drain %s L/min, level glitch probability %s\n", inlet,
+           drain, glitch);
+    fflush(stdout);
+
+    double t0 = now_sec();
+    pool_run((mc.cycles + MC_JOB_CYCLES - 1) / MC_JOB_CYCLES, threads, run_job, &mc);
+    double wall = now_sec() - t0;
+
+    /* Merge (integer sums, so the totals do not depend on which worker ran what) */
+    mc_stats_t total = {0};
+    uint64_t *cycle_hist = xcalloc(MC_MAX_SEC, sizeof(uint64_t));
+    uint64_t *fill_hist = xcalloc(MC_MAX_SEC, sizeof(uint64_t));
+    uint64_t *drain_hist = xcalloc(MC_MAX_SEC, sizeof(uint64_t));
+    for (unsigned t = 0; t < threads; t++) {
+        mc_stats_t *st = &mc.workers[t].stats;
+        for (int e = 0; e < MC_ERRORS; e++)
+            total.outcome[e] += st->outcome[e];
+        total.unfinished += st->unfinished;
+        total.sim_ticks += st->sim_ticks;
+        total.sum_ticks += st->sum_ticks;
+        total.sum_ticks2 += st->sum_ticks2;
+        for (uint32_t s = 0; s < MC_MAX_SEC; s++) {
+            cycle_hist[s] += st->cycle_hist[s];
+            fill_hist[s] += st->fill_hist[s];
+            drain_hist[s] += st->drain_hist[s];
+        }
+    }
+
+    report(&mc, cycle_hist, fill_hist, drain_hist, &total);
+    if (csv_path)
+        write_csv(csv_path, cycle_hist, fill_hist, drain_hist);
+
+    fprintf(stderr, "%zu cycles on %u threads in %.2f s: %.0f cycles/s, %.1f M ticks/s per thread\n",
+            mc.cycles, threads, wall, mc.cycles / wall, total.sim_ticks / wall / threads / 1e6);
+
+    for (unsigned t = 0; t < threads; t++) {
+        wm_batch_free(&mc.workers[t].batch);
+        free(mc.workers[t].stats.cycle_hist);
+        free(mc.workers[t].stats.fill_hist);
+        free(mc.workers[t].stats.drain_hist);
+    }
+    free(mc.workers);
+    free(cycle_hist);
+    free(fill_hist);
+    free(drain_hist);
+    return 0;
+}
@@ -0,0 +1,505 @@
+/*
+ * Program parameter optimizer.
+ *
+ * Searches the preset parameters of src/app.c (wash/rinse minutes, rinse count, agitation
+ * run/cycle ms) for programs that are fast, use little motor time and switch the relays
+ * rarely, while still agitating the laundry at least as much as the baseline preset.
+ *
+ * Each generation evaluates a batch of candidates: random ones first, then mutations of
+ * the current Pareto front. Every candidate runs one whole cycle of the controller against
+ * the water model, 64 candidates at a time through wm_tick_batch, spread over all cores.
+ * Candidates come from per-index random streams, so the result depends only on the seed.
+ *
+ * Objectives (all minimized): cycle time, motor on-time, relay switch count.
+ * Constraints: wash and rinse agitation (motor on-time while agitating) and rinse count at
+ * least the baseline's (-R overrides the rinse count), a motor rest of at least -r ms
+ * before each reversal, and optionally a maximum cycle time.
+ *
+ * Output: the baseline, the Pareto front, and the best picks as program/power table
+ * rows in the format of src/app.c.
+ *
+ * Usage: optimize [-n candidates] [-g generations] [-j threads] [-s seed]
+ *                 [-m program,level,power] [-w time,motor,switch] [-r rest_ms]
+ *                 [-R min_rinses] [-T max_cycle_min] [-o front.csv]
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "app.h"
+#include "physics.h"
+#include "pool.h"
+#include "wm_batch.h"
+
+#define OPT_LANES 64 /* Candidates per pool job, stepped together */
+#define OPT_MAX_TICKS (6u * 3600 * 10)
+
+/* Search space (app.c stores minutes and milliseconds; step programs need whole 100 ms) */
+#define WASH_MIN_MAX 30
+#define RINSE_MIN_MAX 20
+#define RINSE_COUNT_MAX 3
+#define RUN_MS_MIN 400
+#define CYCLE_MS_MAX 8000
+#define MS_STEP 100
+
+/* Relay bits for switch counting, as app.c drives them (power + direction for the motor) */
+#define RELAY_MOTOR_POWER (1u << 5)
+#define RELAY_MOTOR_DIR (1u << 6)
+
+typedef struct {
+    uint8_t wash_min, rinse_min, rinse_count;
+    uint16_t run_ms, cycle_ms;
+} params_t;
+
+typedef struct {
+    params_t p;
+    bool finished; /* Reached COMPLETE */
+    uint32_t cycle_ticks, motor_ticks, switches;
+    uint32_t wash_action, rinse_action; /* Motor-on ticks while agitating */
+    bool feasible, front;
+    double score;
+} cand_t;
+
+typedef struct {
+    wm_program_t base;
+    phys_params_t phys;
+    cand_t *cands;
+    size_t count;
+} eval_t;
+
+static uint32_t relays(uint32_t out) {
+    uint32_t r = out & (WM_OUT_INLET | WM_OUT_SOAP | WM_OUT_DRAIN);
+    if (out & (WM_OUT_MOTOR_CW | WM_OUT_MOTOR_CCW))
+        r |= RELAY_MOTOR_POWER;
+    if (out & WM_OUT_MOTOR_CCW)
+        r |= RELAY_MOTOR_DIR;
+    return r;
+}
+
+static unsigned popcount(uint32_t v) {
+    unsigned n = 0;
+    for (; v; v &= v - 1)
+        n++;
+    return n;
+}
+
+static wm_program_t candidate_program(const wm_program_t *base, const params_t *p) {
+    wm_program_t prog = *base;
+    prog.wash_agitate_time_sec = (uint16_t)(p->wash_min * 60);
+    prog.rinse_agitate_time_sec = (uint16_t)(p->rinse_min * 60);
+    prog.rinse_count = p->rinse_count;
+    prog.agitate_run_ms = p->run_ms;
+    prog.agitate_cycle_ms = p->cycle_ms;
+    return prog;
+}
+
+/* Run one cycle for each of up to OPT_LANES candidates starting at job * OPT_LANES */
+static void eval_job(void *ctx, size_t job, unsigned worker) {
+    eval_t *ev = (eval_t *)ctx;
+    size_t first = job * OPT_LANES;
+    int lanes = (int)(ev->count - first < OPT_LANES ? ev->count - first : OPT_LANES);
+    wm_batch_t b;
+    phys_t phys[OPT_LANES];
+    uint32_t prev_relays[OPT_LANES] = {0};
+    bool active[OPT_LANES];
+    (void)worker;
+
+    if (!wm_batch_init(&b, OPT_LANES)) {
+        fprintf(stderr, "optimize: out of memory\n");
+        exit(1);
+    }
+    uint32_t dt_ms = 1000 / ev->base.ticks_per_second;
+    for (int l = 0; l < lanes; l++) {
+        cand_t *c = &ev->cands[first + l];
+        wm_program_t prog = candidate_program(&ev->base, &c->p);
+        wm_controller_t ctrl;
+        wm_sensors_t s;
+        wm_actuators_t a;
+
+        wm_init(&ctrl, &s, &a, prog);
+        wm_start(&ctrl);
+        active[l] = wm_batch_set(&b, l, &ctrl); /* Rejected ones stay unfinished */
+        phys_init(&phys[l], &ev->phys, (rng_t){0});
+    }
+
+    int running = 0;
+    for (int l = 0; l < lanes; l++)
+        running += active[l];
+    while (running) {
+        wm_tick_batch(&b);
+        for (int l = 0; l < lanes; l++) {
+            if (!active[l])
+                continue;
+            cand_t *c = &ev->cands[first + l];
+            uint32_t out = b.out[l], r = relays(out);
+            bool motor = (r & RELAY_MOTOR_POWER) != 0;
+
+            c->cycle_ticks++;
+            c->motor_ticks += motor;
+            c->switches += popcount(r ^ prev_relays[l]);
+            prev_relays[l] = r;
+            if (b.state[l] == WM_AGITATE && motor) {
+                if (b.is_wash[l])
+                    c->wash_action++;
+                else
+                    c->rinse_action++;
+            }
+
+            if (b.state[l] == WM_COMPLETE || b.state[l] == WM_ERROR ||
+                c->cycle_ticks >= OPT_MAX_TICKS) {
+                c->finished = b.state[l] == WM_COMPLETE;
+                active[l] = false;
+                b.state[l] = WM_IDLE;
+                running--;
+                continue;
+            }
+
+            hal_sim_actuators_t acts = {.inlet = (out & WM_OUT_INLET) != 0,
+                                        .drain = (out & WM_OUT_DRAIN) != 0};
+            wm_sensors_t s;
+            phys_step(&phys[l], &acts, dt_ms);
+            phys_read(&phys[l], &s);
+            b.water_level[l] = s.water_level;
+            b.drain_check[l] = s.drain_check;
+        }
+    }
+    wm_batch_free(&b);
+}
+
+static void evaluate(eval_t *ev, cand_t *cands, size_t count, unsigned threads) {
+    ev->cands = cands;
+    ev->count = count;
+    pool_run((count + OPT_LANES - 1) / OPT_LANES, threads, eval_job, ev);
+}
+
+/* ---------- Search ---------- */
+
+static int rand_range(rng_t *r, int lo, int hi) {
+    return lo + (int)(rng_next(r) % (uint64_t)(hi - lo + 1));
+}
+
+static int clampi(int v, int lo, int hi) { return v < lo ? lo : v > hi ? hi : v; }
+
+static params_t random_params(rng_t *r) {
+    params_t p;
+    p.wash_min = (uint8_t)rand_range(r, 1, WASH_MIN_MAX);
+    p.rinse_min = (uint8_t)rand_range(r, 1, RINSE_MIN_MAX);
+    p.rinse_count = (uint8_t)rand_range(r, 1, RINSE_COUNT_MAX);
+    p.cycle_ms = (uint16_t)(MS_STEP * rand_range(r, (RUN_MS_MIN + MS_STEP) / MS_STEP,
+                                                 CYCLE_MS_MAX / MS_STEP));
+    p.run_ms = (uint16_t)(MS_STEP * rand_range(r, RUN_MS_MIN / MS_STEP, p.cycle_ms / MS_STEP));
+    return p;
+}
+
+/* Small random step in every parameter */
+static params_t mutate(const params_t *parent, rng_t *r) {
+    params_t p = *parent;
+    p.wash_min = (uint8_t)clampi(p.wash_min + rand_range(r, -2, 2), 1, WASH_MIN_MAX);
+    p.rinse_min = (uint8_t)clampi(p.rinse_min + rand_range(r, -2, 2), 1, RINSE_MIN_MAX);
+    if (rand_range(r, 0, 3) == 0) {
+        p.rinse_count =
+            (uint8_t)clampi(p.rinse_count + rand_range(r, -1, 1), 1, RINSE_COUNT_MAX);
+    }
+    p.cycle_ms = (uint16_t)clampi(p.cycle_ms + rand_range(r, -5, 5) * MS_STEP,
+                                  RUN_MS_MIN + MS_STEP, CYCLE_MS_MAX);
+    p.run_ms =
+        (uint16_t)clampi(p.run_ms + rand_range(r, -5, 5) * MS_STEP, RUN_MS_MIN, p.cycle_ms);
+    return p;
+}
+
+typedef struct {
+    uint32_t wash_action, rinse_action; /* Minimum motor-on ticks while agitating */
+    uint32_t rest_ms;                   /* Minimum cycle_ms - run_ms */
+    uint8_t rinses;                     /* Minimum rinse count (dilutes the detergent) */
+    uint32_t max_ticks;                 /* 0: no limit */
+    double w_time, w_motor, w_switch;   /* Score weights, relative to the baseline */
+} limits_t;
+
+static void judge(cand_t *c, const limits_t *lim, const cand_t *base) {
+    c->feasible = c->finished && c->wash_action >= lim->wash_action &&
+                  c->rinse_action >= lim->rinse_action && c->p.rinse_count >= lim->rinses &&
+                  (uint32_t)(c->p.cycle_ms - c->p.run_ms) >= lim->rest_ms &&
+                  (!lim->max_ticks || c->cycle_ticks <= lim->max_ticks);
+    c->score = lim->w_time * c->cycle_ticks / base->cycle_ticks +
+               lim->w_motor * c->motor_ticks / base->motor_ticks +
+               lim->w_switch * c->switches / base->switches;
+}
+
+static bool dominates(const cand_t *a, const cand_t *b) {
+    bool le = a->cycle_ticks <= b->cycle_ticks && a->motor_ticks <= b->motor_ticks &&
+              a->switches <= b->switches;
+    bool lt = a->cycle_ticks < b->cycle_ticks || a->motor_ticks < b->motor_ticks ||
+              a->switches < b->switches;
+    return le && lt;
+}
+
+static bool same_params(const params_t *a, const params_t *b) {
+    return a->wash_min == b->wash_min && a->rinse_min == b->rinse_min &&
+           a->rinse_count == b->rinse_count && a->run_ms == b->run_ms &&
+           a->cycle_ms == b->cycle_ms;
+}
+
+/* Mark the non-dominated feasible candidates (first of any duplicates); returns the count */
+static size_t mark_front(cand_t *c, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        c[i].front = c[i].feasible;
+        for (size_t j = 0; j < n && c[i].front; j++) {
+            if (j != i && c[j].feasible &&
+                (dominates(&c[j], &c[i]) || (j < i && same_params(&c[j].p, &c[i].p))))
+                c[i].front = false;
+        }
+        count += c[i].front;
+    }
+    return count;
+}
+
+static int cmp_time(const void *a, const void *b) {
+    const cand_t *x = a, *y = b;
+    if (x->cycle_ticks != y->cycle_ticks)
+        return x->cycle_ticks < y->cycle_ticks ? -1 : 1;
+    if (x->motor_ticks != y->motor_ticks)
+        return x->motor_ticks < y->motor_ticks ? -1 : 1;
+    return x->switches < y->switches ? -1 : x->switches > y->switches;
+}
+
+/* ---------- Output ---------- */
+
+static void print_row(const char *label, const cand_t *c, uint32_t tps) {
+    printf("%-10s %4u %5u %5u %6u %6u %8.1f %8.1f %7u %8.1f %8.1f %6.3f\n", label,
+           c->p.wash_min, c->p.rinse_min, c->p.rinse_count, c->p.run_ms, c->p.cycle_ms,
+           c->cycle_ticks / (60.0 * tps), c->motor_ticks / (60.0 * tps), c->switches,
+           c->wash_action / (60.0 * tps), c->rinse_action / (60.0 * tps), c->score);
+}
+
+static void print_header(void) {
+    printf("%-10s %4s %5s %5s %6s %6s %8s %8s %7s %8s %8s %6s\n", "", "wash", "rinse", "count",
+           "run", "cycle", "time", "motor", "relay", "wash_ag", "rinse_ag", "score");
+    printf("%-10s %4s %5s %5s %6s %6s %8s %8s %7s %8s %8s %6s\n", "", "min", "min", "", "ms",
+           "ms", "min", "min", "sw", "min", "min", "");
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-n candidates] [-g generations] [-j threads] [-s seed]\n"
+            "          [-m program,level,power] [-w time,motor,switch] [-r rest_ms]\n"
+            "          [-R min_rinses] [-T max_cycle_min] [-o front.csv]\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    size_t per_gen = 2048;
+    int generations = 4;
+    unsigned threads = 0;
+    uint64_t seed = 1;
+    int sel[3] = {0, 1, 0};
+    limits_t lim = {.rest_ms = 1000, .w_time = 1.0, .w_motor = 1.0, .w_switch = 1.0};
+    double max_min = 0.0;
+    int rinses = -1;
+    const char *csv_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:g:j:s:m:w:r:R:T:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            per_gen = strtoul(optarg, NULL, 10);
+            break;
+        case 'g':
+            generations = atoi(optarg);
+            break;
+        case 'j':
+            threads = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%d,%d,%d", &sel[0], &sel[1], &sel[2]) != 3)
+                usage(argv[0]);
+            break;
+        case 'w':
+            if (sscanf(optarg, "%lf,%lf,%lf", &lim.w_time, &lim.w_motor, &lim.w_switch) != 3)
+                usage(argv[0]);
+            break;
+        case 'r':
+            lim.rest_ms = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'R':
+            rinses = atoi(optarg);
+            break;
+        case 'T':
+            max_min = strtod(optarg, NULL);
+            break;
+        case 'o':
+            csv_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (per_gen == 0 || generations < 1)
+        usage(argv[0]);
+
+    static hal_t menu_hal;
+    static App menu;
+    hal_sim_set_quiet(&menu_hal, true);
+    app_init(&menu, &menu_hal);
+    for (int i = 0; i < 3; i++) {
+        if (sel[i] < 0 || sel[i] >= app_menu_count(&menu, (app_menu_t)i))
+            usage(argv[0]);
+    }
+    if (threads == 0)
+        threads = pool_cpu_count();
+
+    eval_t ev = {.base = app_menu_program(sel[0], sel[1], sel[2]), .phys = phys_default_params()};
+    uint32_t tps = ev.base.ticks_per_second;
+
+    /* Baseline: the selected preset as shipped */
+    cand_t base = {.p = {(uint8_t)(ev.base.wash_agitate_time_sec / 60),
+                         (uint8_t)(ev.base.rinse_agitate_time_sec / 60), ev.base.rinse_count,
+                         ev.base.agitate_run_ms, ev.base.agitate_cycle_ms}};
+    evaluate(&ev, &base, 1, 1);
+    if (!base.finished) {
+        fprintf(stderr, "optimize: baseline cycle did not complete\n");
+        return 1;
+    }
+    lim.wash_action = base.wash_action;
+    lim.rinse_action = base.rinse_action;
+    lim.rinses = (uint8_t)(rinses >= 0 ? rinses : ev.base.rinse_count);
+    lim.max_ticks = (uint32_t)(max_min * 60 * tps);
+    judge(&base, &lim, &base);
+
+    size_t cap = per_gen * generations;
+    cand_t *all = calloc(cap, sizeof(*all));
+    if (!all) {
+        perror("optimize");
+        return 1;
+    }
+
+    size_t n = 0, front = 0;
+    for (int g = 0; g < generations; g++) {
+        /* Parents: the current front, in index order */
+        size_t *parents = malloc((front ? front : 1) * sizeof(size_t)), np = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (all[i].front)
+                parents[np++] = i;
+        }
+        for (size_t i = 0; i < per_gen; i++) {
+            rng_t r = rng_for_run(seed, n + i);
+            all[n + i] = (cand_t){0};
+            all[n + i].p = np ? mutate(&all[parents[rng_next(&r) % np]].p, &r) : random_params(&r);
+        }
+        free(parents);
+
+        evaluate(&ev, all + n, per_gen, threads);
+        n += per_gen;
+        for (size_t i = n - per_gen; i < n; i++)
+            judge(&all[i], &lim, &base);
+        front = mark_front(all, n);
+        fprintf(stderr, "generation %d: %zu candidates, %zu on the front\n", g + 1, n, front);
+    }
+
+    /* Front, fastest first */
+    cand_t *fr = malloc((front ? front : 1) * sizeof(*fr));
+    size_t nf = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (all[i].front)
+            fr[nf++] = all[i];
+    }
+    qsort(fr, nf, sizeof(*fr), cmp_time);
+
+    printf("Baseline %s / %s / %s: wash agitation >= %.1f min, rinse agitation >= %.1f min, "
+           "%u+ rinses, rest >= %u ms",
+           app_menu_name(&menu, APP_MENU_PROGRAM, sel[0]),
+           app_menu_name(&menu, APP_MENU_LEVEL, sel[1]),
+           app_menu_name(&menu, APP_MENU_POWER, sel[2]), lim.wash_action / (60.0 * tps),
+           lim.rinse_action / (60.0 * tps), lim.rinses, lim.rest_ms);
+    if (lim.max_ticks)
+        printf(", cycle <= %.1f min", max_min);
+    printf("\nScore = %.2g x time + %.2g x motor + %.2g x relay switches, each relative to the "
+           "baseline\n\n",
+           lim.w_time, lim.w_motor, lim.w_switch);
+
+    print_header();
+    print_row("baseline", &base, tps);
+    printf("\nPareto front (%zu of %zu candidates):\n", nf, n);
+    for (size_t i = 0; i < nf; i++)
+        print_row("", &fr[i], tps);
+
+    if (nf == 0) {
+        printf("No candidate meets the constraints.\n");
+    } else {
+        /* Picks: best score, then the extreme of each objective */
+        size_t pick[4] = {0, 0, 0, 0};
+        for (size_t i = 1; i < nf; i++) {
+            if (fr[i].score < fr[pick[0]].score)
+                pick[0] = i;
+            if (fr[i].motor_ticks < fr[pick[2]].motor_ticks)
+                pick[2] = i;
+            if (fr[i].switches < fr[pick[3]].switches)
+                pick[3] = i;
+        }
+        static const char *const names[] = {"Balanced", "Fast", "Eco", "Gentle"};
+
+        /* Drop picks that repeat an earlier one */
+        int np = 0;
+        const char *pick_names[4];
+        for (int k = 0; k < 4; k++) {
+            bool dup = false;
+            for (int j = 0; j < np; j++)
+                dup |= pick[j] == pick[k];
+            if (!dup) {
+                pick[np] = pick[k];
+                pick_names[np++] = names[k];
+            }
+        }
+
+        printf("\nPicks:\n");
+        print_header();
+        for (int k = 0; k < np; k++)
+            print_row(pick_names[k], &fr[pick[k]], tps);
+
+        printf("\n/* Ready to paste into src/app.c (optimize -s %llu -m %d,%d,%d).\n"
+               " * Each program row was evaluated with the power row of the same name only. */\n",
+               (unsigned long long)seed, sel[0], sel[1], sel[2]);
+        printf("} programs[] = {");
+        for (int k = 0; k < np; k++) {
+            const params_t *p = &fr[pick[k]].p;
+            printf("%s{\"%s\", %u, %u, %u}", k ? ", " : "", pick_names[k], p->wash_min,
+                   p->rinse_min, p->rinse_count);
+        }
+        printf("};\nstatic const int num_programs = %d;\n\n", np);
+        printf("} powers[] = {");
+        for (int k = 0; k < np; k++) {
+            const params_t *p = &fr[pick[k]].p;
+            printf("%s{\"%s\", %u, %u}", k ? ", " : "", pick_names[k], p->run_ms, p->cycle_ms);
+        }
+        printf("};\nstatic const int num_powers = %d;\n", np);
+    }
+
+    if (csv_path) {
+        FILE *out = fopen(csv_path, "w");
+        if (!out) {
+            perror("Failed to open output");
+            return 1;
+        }
+        fprintf(out, "wash_min,rinse_min,rinse_count,run_ms,cycle_ms,cycle_s,motor_on_s,"
+                     "relay_switches,wash_agitation_s,rinse_agitation_s,score\n");
+        for (size_t i = 0; i < nf; i++) {
+            const cand_t *c = &fr[i];
+            fprintf(out, "%u,%u,%u,%u,%u,%.1f,%.1f,%u,%.1f,%.1f,%.4f\n", c->p.wash_min,
+                    c->p.rinse_min, c->p.rinse_count, c->p.run_ms, c->p.cycle_ms,
+                    (double)c->cycle_ticks / tps, (double)c->motor_ticks / tps, c->switches,
+                    (double)c->wash_action / tps, (double)c->rinse_action / tps, c->score);
+        }
+        fclose(out);
+    }
+
+    free(fr);
+    free(all);
+    return 0;
+}
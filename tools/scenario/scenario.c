@@ -0,0 +1,602 @@
+/*
+ * Scenario runner: scripted acceptance tests against the real app in virtual time.
+ *
+ * A scenario is a text file with one command per line; '#' starts a comment. Each runs
+ * one App on its own HAL with the water model (tools/sim/physics.h), stepping 10 ms of
+ * virtual time at a time. Commands run in order:
+ *
+ *   start <program> <level> <power>   Walk the menu (names or indices) and start
+ *   press <A|B|C> [count]             Press and release a button (60 ms each way)
+ *   wait <time>                       Let time pass
+ *   at <time> <command>               Wait until <time> after power-on, then run <command>
+ *   fault drain_check high|low|off    Stick the drain sensor, or release it
+ *   fault level <EMPTY..HIGH>|off     Stick the level sensor, or release it
+ *   fault noise <p>                   Level readings off by one level with probability p
+ *   fault inlet_flow <lpm>|x<factor>  Set or scale the inlet flow (also drain_flow)
+ *   expect <STATE> [within <time>]    The controller is (or gets) in STATE
+ *   expect error <ERROR> [within <time>]
+ *   expect <motor|inlet|drain|soap> on|off [within <time>]
+ *   expect never <STATE> for <time>   Let time pass; fail if STATE shows up meanwhile
+ *
+ * Times are like 250ms, 40s, 5m, 1h30m, or a plain number of seconds. A scenario passes
+ * when every command succeeded. Scenarios run in parallel on the work-stealing pool.
+ *
+ * Usage: scenario [-j threads] [-v] <file.scn | directory>...
+ */
+#define _DEFAULT_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "app.h"
+#include "wm_coverage.h"
+#include "physics.h"
+#include "pool.h"
+
+#define STEP_MS 10
+#define PRESS_MS 60 /* Longer than the app's 50 ms debounce */
+#define MAX_CMDS 256
+#define MAX_FILES 1024
+
+typedef enum {
+    CMD_START,
+    CMD_PRESS,
+    CMD_WAIT,
+    CMD_UNTIL,
+    CMD_FAULT_DRAIN,
+    CMD_FAULT_LEVEL,
+    CMD_FAULT_NOISE,
+    CMD_FAULT_INLET,
+    CMD_FAULT_OUTLET,
+    CMD_EXPECT_STATE,
+    CMD_EXPECT_ERROR,
+    CMD_EXPECT_OUTPUT,
+    CMD_NEVER,
+} cmd_kind_t;
+
+typedef struct {
+    cmd_kind_t kind;
+    int line;
+    char text[80]; /* Source, for messages */
+    uint32_t ms;   /* WAIT/UNTIL/NEVER time, or the 'within' limit of an expectation */
+    int a, b, c;   /* Button and count, menu selection, state/error/output and value */
+    double x;
+    bool scale;
+} cmd_t;
+
+typedef struct {
+    hal_t hal;
+    App app;
+    phys_t phys;
+    uint32_t now_ms;
+    int stuck_drain, stuck_level; /* -1 when the sensor works */
+} machine_t;
+
+typedef struct {
+    const char *path;
+    bool pass;
+    char msg[384];
+    uint32_t virtual_ms;
+    double wall_s;
+} result_t;
+
+typedef struct {
+    char **paths;
+    result_t *results;
+    bool verbose;
+#ifdef WM_COVERAGE
+    wm_cov_t *cov; /* One matrix per worker */
+#endif
+} run_ctx_t;
+
+static const char *const outputs[] = {"motor", "inlet", "drain", "soap"};
+static const char *const levels[] = {"EMPTY", "LOW", "MED", "HIGH"};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* --- Parsing --- */
+/* "250ms", "40s", "5m", "1h30m" or plain seconds */
+static bool parse_time(const char *s, uint32_t *out) {
+    double total = 0.0;
+    if (!*s)
+        return false;
+    while (*s) {
+        char *end;
+        double v = strtod(s, &end);
+        if (end == s || v < 0)
+            return false;
+        s = end;
+        if (strncmp(s, "ms", 2) == 0) {
+            total += v / 1000.0;
+            s += 2;
+        } else if (*s == 'h') {
+            total += v * 3600.0;
+            s++;
+        } else if (*s == 'm') {
+            total += v * 60.0;
+            s++;
+        } else {
+            total += v;
+            s += *s == 's';
+        }
+    }
+    *out = (uint32_t)(total * 1000.0 + 0.5);
+    return true;
+}
+
+static int lookup(const char *word, const char *const *names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcasecmp(word, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int state_index(const char *word) {
+    for (int s = WM_IDLE; s <= WM_ERROR; s++) {
+        if (strcasecmp(word, wm_state_str((wm_state_t)s)) == 0)
+            return s;
+    }
+    return -1;
+}
+
+static int error_index(const char *word) {
+    for (int e = WM_ERR_NONE; e <= WM_ERR_INVALID_PROGRAM; e++) {
+        if (strcasecmp(word, wm_error_str((wm_error_t)e)) == 0)
+            return e;
+    }
+    return -1;
+}
+
+/* Menu option by name or index */
+static int menu_index(const App *app, app_menu_t step, const char *word) {
+    char *end;
+    long v = strtol(word, &end, 10);
+    int n = app_menu_count(app, step);
+    if (*end == '\0')
+        return v >= 0 && v < n ? (int)v : -1;
+    for (int i = 0; i < n; i++) {
+        if (strcasecmp(word, app_menu_name(app, step, i)) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* Optional "within <time>" */
+static bool parse_within(char **w, int n, int at, uint32_t *ms) {
+    *ms = 0;
+    if (n == at)
+        return true;
+    return n == at + 2 && strcmp(w[at], "within") == 0 && parse_time(w[at + 1], ms);
+}
+
+/* One command from words; false on a syntax error */
+static bool parse_cmd(const App *menu, char **w, int n, cmd_t *c) {
+    if (n == 4 && strcmp(w[0], "start") == 0) {
+        c->kind = CMD_START;
+        c->a = menu_index(menu, APP_MENU_PROGRAM, w[1]);
+        c->b = menu_index(menu, APP_MENU_LEVEL, w[2]);
+        c->c = menu_index(menu, APP_MENU_POWER, w[3]);
+        return c->a >= 0 && c->b >= 0 && c->c >= 0;
+    }
+    if ((n == 2 || n == 3) && strcmp(w[0], "press") == 0) {
+        c->kind = CMD_PRESS;
+        c->a = (strlen(w[1]) == 1) ? toupper((unsigned char)w[1][0]) - 'A' : -1;
+        c->b = n == 3 ? atoi(w[2]) : 1;
+        return c->a >= HAL_BTN_A && c->a <= HAL_BTN_C && c->b > 0;
+    }
+    if (n == 2 && strcmp(w[0], "wait") == 0) {
+        c->kind = CMD_WAIT;
+        return parse_time(w[1], &c->ms);
+    }
+    if (n == 3 && strcmp(w[0], "fault") == 0) {
+        if (strcmp(w[1], "drain_check") == 0) {
+            c->kind = CMD_FAULT_DRAIN;
+            c->a = strcmp(w[2], "high") == 0 ? 1 : strcmp(w[2], "low") == 0 ? 0 : -1;
+            return c->a >= 0 || strcmp(w[2], "off") == 0;
+        }
+        if (strcmp(w[1], "level") == 0) {
+            c->kind = CMD_FAULT_LEVEL;
+            c->a = lookup(w[2], levels, 4);
+            return c->a >= 0 || strcmp(w[2], "off") == 0;
+        }
+        char *end;
+        c->scale = w[2][0] == 'x';
+        c->x = strtod(w[2] + c->scale, &end);
+        if (*end || c->x < 0)
+            return false;
+        if (strcmp(w[1], "noise") == 0) {
+            c->kind = CMD_FAULT_NOISE;
+            return !c->scale && c->x <= 1.0;
+        }
+        c->kind = strcmp(w[1], "inlet_flow") == 0 ? CMD_FAULT_INLET : CMD_FAULT_OUTLET;
+        return c->kind == CMD_FAULT_INLET || strcmp(w[1], "drain_flow") == 0;
+    }
+    if (n >= 2 && strcmp(w[0], "expect") == 0) {
+        if (n == 5 && strcmp(w[1], "never") == 0 && strcmp(w[3], "for") == 0) {
+            c->kind = CMD_NEVER;
+            c->a = state_index(w[2]);
+            return c->a >= 0 && parse_time(w[4], &c->ms);
+        }
+        if (strcmp(w[1], "error") == 0 && n >= 3) {
+            c->kind = CMD_EXPECT_ERROR;
+            c->a = error_index(w[2]);
+            return c->a >= 0 && parse_within(w, n, 3, &c->ms);
+        }
+        /* "drain" is both a state and an output; outputs take on/off */
+        int out = lookup(w[1], outputs, 4);
+        if (out >= 0 && n >= 3 && strcmp(w[2], "within") != 0) {
+            c->kind = CMD_EXPECT_OUTPUT;
+            c->a = out;
+            c->b = strcmp(w[2], "on") == 0 ? 1 : strcmp(w[2], "off") == 0 ? 0 : -1;
+            return c->b >= 0 && parse_within(w, n, 3, &c->ms);
+        }
+        c->kind = CMD_EXPECT_STATE;
+        c->a = state_index(w[1]);
+        return c->a >= 0 && parse_within(w, n, 2, &c->ms);
+    }
+    return false;
+}
+
+/* Parse a whole file; returns the number of commands or -1 with a message */
+static int parse_file(const char *path, const App *menu, cmd_t *cmds, char *msg,
+                      size_t msg_len) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        snprintf(msg, msg_len, "cannot open");
+        return -1;
+    }
+
+    char line[256];
+    int n = 0, lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char *w[12], *save;
+        int nw = 0;
+        for (char *tok = strtok_r(line, " \t\r\n", &save); tok && nw < 12;
+             tok = strtok_r(NULL, " \t\r\n", &save))
+            w[nw++] = tok;
+        if (nw == 0)
+            continue;
+        if (n + 2 > MAX_CMDS) {
+            snprintf(msg, msg_len, "line %d: too many commands", lineno);
+            fclose(f);
+            return -1;
+        }
+
+        char text[80];
+        size_t len = 0;
+        text[0] = '\0';
+        for (int i = 0; i < nw && len < sizeof(text); i++)
+            len += (size_t)snprintf(text + len, sizeof(text) - len, i ? " %s" : "%s", w[i]);
+
+        char **rest = w;
+        int nrest = nw;
+        if (strcmp(w[0], "at") == 0) {
+            cmd_t *c = &cmds[n++];
+            memset(c, 0, sizeof(*c));
+            c->kind = CMD_UNTIL;
+            c->line = lineno;
+            snprintf(c->text, sizeof(c->text), "%s", text);
+            if (nw < 3 || !parse_time(w[1], &c->ms)) {
+                snprintf(msg, msg_len, "line %d: bad time in '%s'", lineno, text);
+                fclose(f);
+                return -1;
+            }
+            rest = w + 2;
+            nrest = nw - 2;
+        }
+        cmd_t *c = &cmds[n++];
+        memset(c, 0, sizeof(*c));
+        c->line = lineno;
+        snprintf(c->text, sizeof(c->text), "%s", text);
+        if (!parse_cmd(menu, rest, nrest, c)) {
+            snprintf(msg, msg_len, "line %d: cannot parse '%s'", lineno, text);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+/* --- Running --- */
+static void machine_step(machine_t *m) {
+    wm_sensors_t s;
+    phys_read(&m->phys, &s);
+    if (m->stuck_drain >= 0)
+        s.drain_check = m->stuck_drain;
+    if (m->stuck_level >= 0)
+        s.water_level = (water_level_t)m->stuck_level;
+    hal_sim_set_sensors(&m->hal, s.drain_check, s.water_level);
+
+    app_loop(&m->app);
+
+    hal_sim_actuators_t acts = hal_sim_get_actuators(&m->hal);
+    hal_sim_advance(&m->hal, STEP_MS);
+    phys_step(&m->phys, &acts, STEP_MS);
+    m->now_ms += STEP_MS;
+}
+
+static void machine_run(machine_t *m, uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t += STEP_MS)
+        machine_step(m);
+}
+
+static void machine_init(machine_t *m, bool verbose) {
+    memset(m, 0, sizeof(*m));
+    hal_sim_use_virtual_clock(&m->hal);
+    hal_sim_set_quiet(&m->hal, !verbose);
+    app_init(&m->app, &m->hal);
+    phys_params_t p = phys_default_params();
+    phys_init(&m->phys, &p, rng_for_run(1, 0));
+    m->stuck_drain = m->stuck_level = -1;
+    /* Presses within 50 ms of power-on are debounced away; wait one press length first */
+    machine_run(m, PRESS_MS);
+}
+
+static void press(machine_t *m, hal_button_t btn) {
+    hal_sim_set_button(&m->hal, btn, true);
+    machine_run(m, PRESS_MS);
+    hal_sim_set_button(&m->hal, btn, false);
+    machine_run(m, PRESS_MS);
+}
+
+static bool output_on(machine_t *m, int out) {
+    hal_sim_actuators_t a = hal_sim_get_actuators(&m->hal);
+    const bool on[] = {a.motor_power, a.inlet, a.drain, a.soap};
+    return on[out];
+}
+
+static bool holds(machine_t *m, const cmd_t *c) {
+    const wm_controller_t *ctrl = &m->app.ctrl;
+    switch (c->kind) {
+    case CMD_EXPECT_STATE:
+        return (int)ctrl->state == c->a;
+    case CMD_EXPECT_ERROR:
+        return ctrl->state == WM_ERROR && (int)ctrl->error_code == c->a;
+    case CMD_EXPECT_OUTPUT:
+        return output_on(m, c->a) == (c->b != 0);
+    default:
+        return true;
+    }
+}
+
+static void describe(machine_t *m, char *buf, size_t len) {
+    const wm_controller_t *ctrl = &m->app.ctrl;
+    int n = snprintf(buf, len, "%s", wm_state_str(ctrl->state));
+    if (ctrl->state == WM_ERROR && n > 0 && (size_t)n < len)
+        n += snprintf(buf + n, len - (size_t)n, " %s", wm_error_str(ctrl->error_code));
+    for (int i = 0; i < 4 && n > 0 && (size_t)n < len; i++) {
+        if (output_on(m, i))
+            n += snprintf(buf + n, len - (size_t)n, " %s", outputs[i]);
+    }
+}
+
+/* Run one command; false (with msg) if it failed */
+static bool run_cmd(machine_t *m, const cmd_t *c, char *msg, size_t len) {
+    double scale;
+    switch (c->kind) {
+    case CMD_START:
+        for (int step = 0; step < APP_MENU_STEPS; step++) {
+            int times = step == 0 ? c->a : step == 1 ? c->b : c->c;
+            for (int i = 0; i < times; i++)
+                press(m, HAL_BTN_B);
+            press(m, HAL_BTN_A);
+        }
+        return true;
+    case CMD_PRESS:
+        for (int i = 0; i < c->b; i++)
+            press(m, (hal_button_t)c->a);
+        return true;
+    case CMD_WAIT:
+        machine_run(m, c->ms);
+        return true;
+    case CMD_UNTIL:
+        if (m->now_ms > c->ms) {
+            snprintf(msg, len, "already at %u ms", m->now_ms);
+            return false;
+        }
+        machine_run(m, c->ms - m->now_ms);
+        return true;
+    case CMD_FAULT_DRAIN:
+        m->stuck_drain = c->a;
+        return true;
+    case CMD_FAULT_LEVEL:
+        m->stuck_level = c->a;
+        return true;
+    case CMD_FAULT_NOISE:
+        m->phys.p.sensor_noise = c->x;
+        return true;
+    case CMD_FAULT_INLET:
+    case CMD_FAULT_OUTLET:
+        scale = c->kind == CMD_FAULT_INLET ? phys_default_params().inlet_lpm
+                                           : phys_default_params().drain_lpm;
+        *(c->kind == CMD_FAULT_INLET ? &m->phys.p.inlet_lpm : &m->phys.p.drain_lpm) =
+            c->scale ? scale * c->x : c->x;
+        return true;
+    case CMD_NEVER:
+        for (uint32_t t = 0; t < c->ms; t += STEP_MS) {
+            if ((int)m->app.ctrl.state == c->a) {
+                snprintf(msg, len, "entered %s after %u ms", wm_state_str(m->app.ctrl.state), t);
+                return false;
+            }
+            machine_step(m);
+        }
+        return true;
+    case CMD_EXPECT_STATE:
+    case CMD_EXPECT_ERROR:
+    case CMD_EXPECT_OUTPUT:
+        for (uint32_t t = 0;; t += STEP_MS) {
+            if (holds(m, c))
+                return true;
+            if (t >= c->ms)
+                break;
+            machine_step(m);
+        }
+        char got[96];
+        describe(m, got, sizeof(got));
+        snprintf(msg, len, "got %s", got);
+        return false;
+    }
+    return false;
+}
+
+static void run_scenario(void *ctx, size_t index, unsigned worker) {
+    run_ctx_t *rc = (run_ctx_t *)ctx;
+    result_t *r = &rc->results[index];
+    (void)worker;
+
+    double t0 = now_sec();
+    r->path = rc->paths[index];
+    r->pass = false;
+
+    cmd_t *cmds = malloc(MAX_CMDS * sizeof(*cmds));
+    machine_t *m = malloc(sizeof(*m));
+    if (!cmds || !m) {
+        snprintf(r->msg, sizeof(r->msg), "out of memory");
+        free(cmds);
+        free(m);
+        return;
+    }
+
+    machine_init(m, rc->verbose);
+#ifdef WM_COVERAGE
+    m->app.cov = &rc->cov[worker];
+#endif
+    int n = parse_file(r->path, &m->app, cmds, r->msg, sizeof(r->msg));
+    if (n >= 0) {
+        r->pass = true;
+        for (int i = 0; i < n; i++) {
+            char why[160];
+            if (!run_cmd(m, &cmds[i], why, sizeof(why))) {
+                unsigned s = m->now_ms / 1000;
+                snprintf(r->msg, sizeof(r->msg), "line %d '%s': %s (t=%u:%02u:%02u)",
+                         cmds[i].line, cmds[i].text, why, s / 3600, s / 60 % 60, s % 60);
+                r->pass = false;
+                break;
+            }
+        }
+        r->virtual_ms = m->now_ms;
+    }
+    r->wall_s = now_sec() - t0;
+    free(cmds);
+    free(m);
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Add a file, or every *.scn of a directory in name order */
+static void add_path(const char *path, char **paths, size_t *n) {
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR *d = opendir(path);
+        size_t first = *n;
+        for (struct dirent *e; d && (e = readdir(d)) != NULL && *n < MAX_FILES;) {
+            size_t len = strlen(e->d_name);
+            if (len > 4 && strcmp(e->d_name + len - 4, ".scn") == 0) {
+                paths[*n] = malloc(strlen(path) + len + 2);
+                sprintf(paths[(*n)++], "%s/%s", path, e->d_name);
+            }
+        }
+        if (d)
+            closedir(d);
+        qsort(paths + first, *n - first, sizeof(*paths), cmp_str);
+    } else if (*n < MAX_FILES) {
+        paths[(*n)++] = strdup(path);
+    }
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-j threads] [-v] <file.scn | directory>...\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    unsigned threads = 0;
+    bool verbose = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:v")) != -1) {
+        switch (opt) {
+        case 'j':
+            threads = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+
+    static char *paths[MAX_FILES];
+    size_t n = 0;
+    for (int i = optind; i < argc; i++)
+        add_path(argv[i], paths, &n);
+    if (n == 0) {
+        fprintf(stderr, "scenario: no .scn files found\n");
+        return 1;
+    }
+
+    result_t *results = calloc(n, sizeof(*results));
+    if (!results) {
+        perror("scenario");
+        return 1;
+    }
+    if (threads == 0)
+        threads = pool_cpu_count();
+
+    run_ctx_t ctx = {.paths = paths, .results = results, .verbose = verbose};
+#ifdef WM_COVERAGE
+    ctx.cov = calloc(threads, sizeof(*ctx.cov));
+    if (!ctx.cov) {
+        perror("scenario");
+        return 1;
+    }
+#endif
+    double t0 = now_sec();
+    pool_run(n, threads, run_scenario, &ctx);
+    double wall = now_sec() - t0;
+
+    size_t passed = 0;
+    for (size_t i = 0; i < n; i++) {
+        const result_t *r = &results[i];
+        unsigned s = r->virtual_ms / 1000;
+        printf("%s  %-40s %2u:%02u:%02u virtual %8.1f ms\n", r->pass ? "PASS" : "FAIL", r->path,
+               s / 3600, s / 60 % 60, s % 60, r->wall_s * 1000.0);
+        if (!r->pass)
+            printf("      %s\n", r->msg);
+        passed += r->pass;
+    }
+    printf("\n%zu/%zu scenarios passed on %u threads in %.2f s\n", passed, n, threads, wall);
+#ifdef WM_COVERAGE
+    for (unsigned i = 1; i < threads; i++)
+        wm_cov_merge(&ctx.cov[0], &ctx.cov[i]);
+    if (!wm_cov_save(wm_cov_path(), &ctx.cov[0]))
+        perror(wm_cov_path());
+    free(ctx.cov);
+#endif
+
+    for (size_t i = 0; i < n; i++)
+        free(paths[i]);
+    free(results);
+    return passed == n ? 0 : 1;
+}
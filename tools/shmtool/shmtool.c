@@ -0,0 +1,387 @@
+/*
+ * Processes around the shared-memory machine region (tools/sim/shm.h).
+ *
+ *   physics  Create the region and run the water model for every slot a controller has
+ *            written, on the slot's own HAL clock. Lines like "0a" on stdin press button
+ *            A of slot 0 for BUTTON_HOLD_MS.
+ *   watch    Print every active slot (state, ETA, outputs, sensors, update rate) a few
+ *            times per second. Read-only: any number of viewers can attach.
+ *   bench    Measure the seqlock between two processes on a private region: one writer
+ *            storing as fast as it can while the other reads (updates/s, torn-read
+ *            retries, and a check that no read is ever inconsistent), then a ping-pong
+ *            that bounces a counter through both images (round trips/s and latency).
+ *
+ * Controllers are simulators started with -S name:slot, in any order; a slot's sensors
+ * come from its own model until the physics process has written them.
+ *
+ * Usage: shmtool [-n name] [-s slots] [-T seconds] physics|watch|bench
+ */
+#define _DEFAULT_SOURCE
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "physics.h"
+#include "pool.h"
+#include "shm.h"
+
+#define DEFAULT_NAME "washer"
+#define DEFAULT_SLOTS 64
+#define BUTTON_HOLD_MS 100 /* Wall-clock press length; longer than the app's debounce */
+#define WATCH_PERIOD_MS 250
+#define BENCH_SAMPLES (1u << 20) /* Round trips timed individually */
+
+static volatile sig_atomic_t quit;
+
+static void on_signal(int sig) {
+    (void)sig;
+    quit = 1;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static hal_sim_actuators_t acts_from_bits(uint32_t bits) {
+    hal_sim_actuators_t a = {
+        .motor_power = bits >> HAL_ACT_MOTOR_POWER & 1,
+        .motor_ccw = bits >> HAL_ACT_MOTOR_DIR & 1,
+        .inlet = bits >> HAL_ACT_INLET & 1,
+        .drain = bits >> HAL_ACT_DRAIN & 1,
+        .soap = bits >> HAL_ACT_SOAP & 1,
+    };
+    return a;
+}
+
+/* --- physics --- */
+typedef struct {
+    bool live;
+    phys_t ph;
+    uint32_t updates; /* SHM_OUT_UPDATES last seen; a drop means the controller restarted */
+    uint32_t in[SHM_IN_BUTTONS + 1];
+    bool written;
+    uint32_t buttons;
+    double release_at;
+} phys_slot_t;
+
+/* "<slot><a|b|c>" presses a button */
+static void read_presses(phys_slot_t *ps, uint32_t slots) {
+    char line[64];
+    if (!fgets(line, sizeof(line), stdin) || line[0] == '\n')
+        return;
+    char *end;
+    unsigned long slot = strtoul(line, &end, 10);
+    if (end == line || slot >= slots || *end < 'a' || *end > 'c') {
+        fprintf(stderr, "shmtool: expected <slot><a|b|c>, e.g. 0a\n");
+        return;
+    }
+    ps[slot].buttons |= 1u << (HAL_BTN_A + (*end - 'a'));
+    ps[slot].release_at = now_sec() + BUTTON_HOLD_MS / 1000.0;
+}
+
+static int run_physics(const char *name, uint32_t slots) {
+    shm_region_t *r = shm_create(name, slots);
+    if (!r) {
+        perror("shmtool");
+        return 1;
+    }
+    phys_slot_t *ps = calloc(slots, sizeof(*ps));
+    if (!ps) {
+        perror("shmtool");
+        return 1;
+    }
+    phys_params_t params = phys_default_params();
+    printf("/dev/shm/%s: %u slots; attach simulators with -S %s:<slot>\n", name, slots, name);
+    fflush(stdout);
+
+    bool keys = true;
+    uint64_t sweeps = 0, writes = 0;
+    while (!quit) {
+        double now = now_sec();
+        for (uint32_t i = 0; i < slots; i++) {
+            phys_slot_t *p = &ps[i];
+            uint32_t out[SHM_OUT_UPDATES + 1];
+            if (!shm_read(&r->slot[i].out, out, SHM_OUT_UPDATES + 1, NULL))
+                continue;
+            if (!p->live || out[SHM_OUT_UPDATES] < p->updates) {
+                phys_init(&p->ph, &params, rng_for_run(1, i));
+                p->live = true;
+            }
+            p->updates = out[SHM_OUT_UPDATES];
+            if (p->buttons && now >= p->release_at)
+                p->buttons = 0;
+
+            hal_sim_actuators_t acts = acts_from_bits(out[SHM_OUT_ACTS]);
+            phys_sync(&p->ph, &acts, out[SHM_OUT_TIME]);
+            wm_sensors_t s;
+            phys_read(&p->ph, &s);
+            uint32_t in[SHM_IN_BUTTONS + 1] = {
+                [SHM_IN_TIME] = p->ph.now_ms,
+                [SHM_IN_SENSORS] = (uint32_t)s.water_level << 1 | s.drain_check,
+                [SHM_IN_BUTTONS] = p->buttons,
+            };
+            if (p->written && !memcmp(in, p->in, sizeof(in)))
+                continue;
+            shm_write(&r->slot[i].in, in, SHM_IN_BUTTONS + 1);
+            memcpy(p->in, in, sizeof(in));
+            p->written = true;
+            writes++;
+        }
+        sweeps++;
+
+        /* Sleep a millisecond between sweeps, or until a press arrives */
+        struct pollfd pfd = {.fd = 0, .events = POLLIN};
+        if (poll(&pfd, keys ? 1 : 0, 1) > 0) {
+            read_presses(ps, slots);
+            keys = !feof(stdin) && !ferror(stdin);
+        }
+    }
+
+    fprintf(stderr, "\nshmtool: %llu sweeps, %llu sensor updates\n", (unsigned long long)sweeps,
+            (unsigned long long)writes);
+    free(ps);
+    shm_detach(r);
+    shm_remove(name);
+    return 0;
+}
+
+/* --- watch --- */
+static const char *const level_names[4] = {"none", "low", "med", "high"};
+
+static int run_watch(const char *name) {
+    char why[256];
+    shm_region_t *r = shm_attach(name, why, sizeof(why));
+    if (!r) {
+        fprintf(stderr, "shmtool: %s\n", why);
+        return 1;
+    }
+    uint32_t *last = calloc(r->slots, sizeof(*last));
+    if (!last) {
+        perror("shmtool");
+        return 1;
+    }
+
+    double t_last = now_sec();
+    while (!quit) {
+        usleep(WATCH_PERIOD_MS * 1000);
+        double t = now_sec(), dt = t - t_last;
+        t_last = t;
+        printf("%-4s %-9s %8s %-22s %5s %5s %9s\n", "slot", "state", "ETA", "outputs", "level",
+               "drain", "updates/s");
+        for (uint32_t i = 0; i < r->slots; i++) {
+            uint32_t out[SHM_OUT_UPDATES + 1], in[SHM_IN_BUTTONS + 1];
+            if (!shm_read(&r->slot[i].out, out, SHM_OUT_UPDATES + 1, NULL))
+                continue;
+            bool sensed = shm_read(&r->slot[i].in, in, SHM_IN_BUTTONS + 1, NULL) != 0;
+            hal_sim_actuators_t a = acts_from_bits(out[SHM_OUT_ACTS]);
+            char outputs[32];
+            snprintf(outputs, sizeof(outputs), "%s%s%s%s", a.motor_power ? "motor " : "",
+                     a.motor_power ? (a.motor_ccw ? "ccw " : "cw ") : "", a.inlet ? "inlet " : "",
+                     a.drain ? "drain " : "");
+            if (a.soap)
+                strncat(outputs, "soap", sizeof(outputs) - strlen(outputs) - 1);
+            uint32_t eta = out[SHM_OUT_ETA];
+            char eta_s[16];
+            snprintf(eta_s, sizeof(eta_s), "%u:%02u:%02u", eta / 3600 % 100, eta / 60 % 60,
+                     eta % 60);
+            printf("%-4u %-9s %8s %-22s %5s %5s %9.0f\n", i,
+                   wm_state_str((wm_state_t)out[SHM_OUT_STATE]), eta_s, outputs,
+                   sensed ? level_names[in[SHM_IN_SENSORS] >> 1 & 3] : "-",
+                   sensed ? (in[SHM_IN_SENSORS] & 1 ? "wet" : "dry") : "-",
+                   (out[SHM_OUT_UPDATES] - last[i]) / dt);
+            last[i] = out[SHM_OUT_UPDATES];
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    free(last);
+    shm_detach(r);
+    return 0;
+}
+
+/* --- bench --- */
+typedef struct {
+    volatile uint32_t stop;
+    uint64_t writes;
+} bench_ctl_t;
+
+/* Wait for a new sequence number on img, yielding when the other side needs the CPU */
+static uint32_t wait_seq(const shm_image_t *img, uint32_t seen, const bench_ctl_t *ctl) {
+    for (unsigned spins = 1;; spins++) {
+        uint32_t seq = __atomic_load_n(&img->seq, __ATOMIC_ACQUIRE);
+        if ((seq != seen && !(seq & 1)) || ctl->stop)
+            return seq;
+        if (spins % SHM_SPIN_TRIES == 0 || pool_cpu_count() == 1)
+            sched_yield();
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int run_bench(const char *name, double seconds) {
+    char bench_name[128];
+    snprintf(bench_name, sizeof(bench_name), "%s-bench-%d", name, (int)getpid());
+    shm_region_t *r = shm_create(bench_name, 1);
+    bench_ctl_t *ctl = mmap(NULL, sizeof(*ctl), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    uint64_t *lat = malloc(BENCH_SAMPLES * sizeof(*lat));
+    if (!r || ctl == MAP_FAILED || !lat) {
+        perror("shmtool");
+        return 1;
+    }
+    shm_remove(bench_name); /* The mapping lives on; nothing is left behind in /dev/shm */
+    shm_image_t *out = &r->slot[0].out, *in = &r->slot[0].in;
+    printf("seqlock of %d words between two processes, %u CPU(s), %.1f s per test\n",
+           SHM_WORDS, pool_cpu_count(), seconds / 2);
+
+    /* Streaming: the child writes a counter to every word, the parent reads */
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("shmtool");
+        return 1;
+    }
+    if (pid == 0) {
+        uint32_t w[SHM_WORDS];
+        uint64_t n = 0;
+        while (!ctl->stop) {
+            n++;
+            for (int i = 0; i < SHM_WORDS; i++)
+                w[i] = (uint32_t)n;
+            shm_write(out, w, SHM_WORDS);
+        }
+        ctl->writes = n;
+        _exit(0);
+    }
+    uint64_t reads = 0, retries = 0, torn = 0, changes = 0, failed = 0;
+    uint32_t prev = 0;
+    double t0 = now_sec(), t1;
+    while ((t1 = now_sec()) - t0 < seconds / 2) {
+        uint32_t w[SHM_WORDS];
+        if (!shm_read(out, w, SHM_WORDS, &retries)) {
+            failed += __atomic_load_n(&out->seq, __ATOMIC_RELAXED) != 0;
+            continue;
+        }
+        reads++;
+        for (int i = 1; i < SHM_WORDS; i++)
+            torn += w[i] != w[0];
+        changes += w[0] != prev;
+        prev = w[0];
+    }
+    ctl->stop = 1;
+    waitpid(pid, NULL, 0);
+    double dt = t1 - t0;
+    printf("streaming  %10.0f writes/s %10.0f reads/s  %.0f distinct updates/s seen\n",
+           ctl->writes / dt, reads / dt, changes / dt);
+    printf("           %.3f torn attempts per read, %llu inconsistent reads, %llu gave up\n",
+           reads ? (double)retries / reads : 0.0, (unsigned long long)torn,
+           (unsigned long long)failed);
+
+    /* Ping-pong: the parent publishes k on out, the child echoes it on in */
+    ctl->stop = 0;
+    uint32_t out_seq = __atomic_load_n(&out->seq, __ATOMIC_RELAXED);
+    pid = fork();
+    if (pid < 0) {
+        perror("shmtool");
+        return 1;
+    }
+    if (pid == 0) {
+        uint32_t seen = out_seq, w;
+        while (!ctl->stop) {
+            seen = wait_seq(out, seen, ctl);
+            if (ctl->stop || !shm_read(out, &w, 1, NULL))
+                break;
+            shm_write(in, &w, 1);
+        }
+        _exit(0);
+    }
+    uint32_t in_seq = __atomic_load_n(&in->seq, __ATOMIC_RELAXED);
+    uint64_t trips = 0, samples = 0, lost = 0;
+    t0 = now_sec();
+    while ((t1 = now_sec()) - t0 < seconds / 2) {
+        uint32_t k = (uint32_t)(trips + 1), w = 0;
+        uint64_t start = now_ns();
+        shm_write(out, &k, 1);
+        in_seq = wait_seq(in, in_seq, ctl);
+        shm_read(in, &w, 1, NULL);
+        uint64_t ns = now_ns() - start;
+        lost += w != k;
+        trips++;
+        if (samples < BENCH_SAMPLES)
+            lat[samples++] = ns;
+    }
+    ctl->stop = 1;
+    waitpid(pid, NULL, 0);
+    dt = t1 - t0;
+    qsort(lat, samples, sizeof(*lat), cmp_u64);
+    printf("ping-pong  %10.0f round trips/s  latency p50 %.2f us, p99 %.2f us, max %.2f us",
+           trips / dt, samples ? lat[samples / 2] / 1e3 : 0.0,
+           samples ? lat[samples * 99 / 100] / 1e3 : 0.0,
+           samples ? lat[samples - 1] / 1e3 : 0.0);
+    printf("%s\n", lost ? "  (echo MISMATCH)" : "");
+
+    free(lat);
+    munmap(ctl, sizeof(*ctl));
+    shm_detach(r);
+    return torn || lost ? 1 : 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-n name] [-s slots] [-T seconds] physics|watch|bench\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *name = DEFAULT_NAME;
+    unsigned long slots = DEFAULT_SLOTS;
+    double seconds = 4.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:T:")) != -1) {
+        switch (opt) {
+        case 'n':
+            name = optarg;
+            break;
+        case 's':
+            slots = strtoul(optarg, NULL, 10);
+            break;
+        case 'T':
+            seconds = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || slots == 0 || slots > SHM_MAX_SLOTS || seconds <= 0)
+        usage(argv[0]);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    const char *mode = argv[optind];
+    if (!strcmp(mode, "physics"))
+        return run_physics(name, (uint32_t)slots);
+    if (!strcmp(mode, "watch"))
+        return run_watch(name);
+    if (!strcmp(mode, "bench"))
+        return run_bench(name, seconds);
+    usage(argv[0]);
+    return 2;
+}
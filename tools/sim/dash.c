@@ -0,0 +1,176 @@
+#define _DEFAULT_SOURCE
+#include "dash.h"
+
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+static const char *const water_names[] = {"EMPTY", "LOW", "MED", "HIGH"};
+static const char *const buzzer_names[] = {"off", "START", "FINISH", "ERROR"};
+static const char *const menu_titles[APP_MENU_STEPS] = {"Program", "Level", "Power"};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* HAL time as h:mm:ss */
+static void clock_str(char *buf, size_t len, uint32_t ms) {
+    uint32_t s = ms / 1000;
+    snprintf(buf, len, "%u:%02u:%02u", s / 3600, s / 60 % 60, s % 60);
+}
+
+/* Append one panel line, cut or padded to DASH_WIDTH */
+static void line(char *frame, unsigned *n, const char *fmt, ...) {
+    char text[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    *n += (unsigned)sprintf(frame + *n, "%-*.*s\n", DASH_WIDTH, DASH_WIDTH, text);
+}
+
+static void render(const dash_t *d, hal_t *hal, const App *app, const phys_t *ph, char *frame) {
+    const wm_controller_t *c = &app->ctrl;
+    const wm_actuators_t *a = &app->actuators;
+    unsigned n = 0;
+    char clk[16];
+    clock_str(clk, sizeof(clk), hal_millis(hal));
+
+    static const char *const ui_names[] = {"menu", "running", "abort? A: yes, C: no",
+                                           "asleep, A wakes"};
+    line(frame, &n, "Washing machine   clock %s   %s", clk,
+         app->ui_state >= 0 && app->ui_state <= UI_SLEEP ? ui_names[app->ui_state] : "?");
+
+    char sel[APP_MENU_STEPS][24];
+    int idx[APP_MENU_STEPS] = {app->sel_program, app->sel_level, app->sel_power};
+    for (int i = 0; i < APP_MENU_STEPS; i++) {
+        bool cur = app->ui_state == UI_STARTUP && app->menu_step == i;
+        snprintf(sel[i], sizeof(sel[i]), "%s%s%s", cur ? "[" : "",
+                 app_menu_name(app, (app_menu_t)i, idx[i]), cur ? "]" : "");
+    }
+    line(frame, &n, "%s: %-12s %s: %-8s %s: %s", menu_titles[0], sel[0], menu_titles[1], sel[1],
+         menu_titles[2], sel[2]);
+
+    uint16_t eta = wm_get_time_remaining_sec((wm_controller_t *)c);
+    if (c->state == WM_ERROR)
+        line(frame, &n, "State:   %-9s %s", wm_state_str(c->state), wm_error_str(c->error_code));
+    else
+        line(frame, &n, "State:   %-9s %-5s  wash %u/%u  rinse %u/%u  ETA %02u:%02u",
+             wm_state_str(c->state), c->is_wash_phase ? "wash" : "rinse", c->wash_done,
+             c->program.wash_count, c->rinse_done, c->program.rinse_count, eta / 60, eta % 60);
+
+    double fill = ph ? ph->litres / ph->p.capacity_l : app->sensors.water_level / 3.0;
+    int bars = (int)(fill * 20 + 0.5);
+    bars = bars < 0 ? 0 : bars > 20 ? 20 : bars;
+    char bar[21];
+    memset(bar, '#', (size_t)bars);
+    memset(bar + bars, '-', (size_t)(20 - bars));
+    bar[20] = '\0';
+    char volume[24] = "";
+    if (ph)
+        snprintf(volume, sizeof(volume), "%5.1f L", ph->litres);
+    line(frame, &n, "Water:   [%s] %-5s %s  drain_check %s", bar,
+         water_names[app->sensors.water_level & 3], volume,
+         app->sensors.drain_check ? "wet" : "dry");
+
+    char motor[24];
+    if (a->motor_dir == MOTOR_STOP)
+        snprintf(motor, sizeof(motor), "off");
+    else
+        snprintf(motor, sizeof(motor), "%s", a->motor_dir == MOTOR_CW ? "CW" : "CCW");
+    if (ph)
+        snprintf(motor + strlen(motor), sizeof(motor) - strlen(motor), " %4.0f rpm",
+                 ph->rpm < 0 ? -ph->rpm : ph->rpm);
+    line(frame, &n, "Outputs: motor %-12s inlet %-3s drain %-3s soap %-3s buzzer %s", motor,
+         a->inlet_valve ? "ON" : "off", a->drain_pump ? "ON" : "off", a->soap_pump ? "ON" : "off",
+         buzzer_names[a->buzzer & 3]);
+
+    for (unsigned i = 0; i < DASH_RECENT; i++) {
+        const char *label = i == 0 ? "Recent:" : "";
+        if (i >= d->count) {
+            line(frame, &n, "%s", label);
+            continue;
+        }
+        const dash_transition_t *t = &d->recent[(d->head + DASH_RECENT - 1 - i) % DASH_RECENT];
+        clock_str(clk, sizeof(clk), t->ms);
+        line(frame, &n, "%-8s %s  %s -> %s", label, clk, wm_state_str(t->from),
+             wm_state_str(t->to));
+    }
+}
+
+static void draw(dash_t *d, hal_t *hal, const App *app, const phys_t *ph) {
+    char frame[sizeof(d->frame)];
+    render(d, hal, app, ph, frame);
+    d->pending = false;
+    if (d->drawn && !strcmp(frame, d->frame)) {
+        d->skipped++;
+        return;
+    }
+    char out[sizeof(frame) + DASH_LINES * 8 + 16];
+    unsigned n = 0;
+    if (d->drawn)
+        n += (unsigned)sprintf(out, "\x1b[%dA", DASH_LINES);
+    /* Clear each line as it is rewritten, so nothing flickers */
+    for (const char *p = frame; *p;) {
+        const char *eol = strchr(p, '\n');
+        n += (unsigned)sprintf(out + n, "\r\x1b[2K%.*s", (int)(eol - p + 1), p);
+        p = eol + 1;
+    }
+    fwrite(out, 1, n, d->out);
+    fflush(d->out);
+    memcpy(d->frame, frame, sizeof(frame));
+    d->drawn = true;
+    d->frames++;
+}
+
+void dash_open(dash_t *d, FILE *out, unsigned fps) {
+    memset(d, 0, sizeof(*d));
+    d->out = out;
+    d->period_s = 1.0 / (fps ? fps : 1);
+    d->state = WM_IDLE;
+    fputs("\x1b[?25l", out); /* Hide the cursor while the panel is up */
+}
+
+void dash_sample(dash_t *d, hal_t *hal, const App *app, const phys_t *ph) {
+    d->samples++;
+    wm_state_t s = app->ctrl.state;
+    uint32_t ms = hal_millis(hal);
+    if (s != d->state) {
+        d->recent[d->head] = (dash_transition_t){ms, d->state, s};
+        d->head = (d->head + 1) % DASH_RECENT;
+        d->count += d->count < DASH_RECENT;
+        d->state = s;
+    }
+
+    /* Within a frame period only remember that the panel may be stale */
+    double now = now_sec();
+    if (now < d->next_s) {
+        d->pending = true;
+        return;
+    }
+    d->next_s = now + d->period_s;
+    draw(d, hal, app, ph);
+}
+
+int dash_due_ms(const dash_t *d) {
+    if (!d->pending)
+        return -1;
+    double wait = d->next_s - now_sec();
+    return wait > 0 ? (int)(wait * 1000) + 1 : 0;
+}
+
+void dash_invalidate(dash_t *d) {
+    d->drawn = false;
+    d->pending = true;
+}
+
+void dash_close(dash_t *d, hal_t *hal, const App *app, const phys_t *ph) {
+    if (!d->out)
+        return;
+    draw(d, hal, app, ph);
+    fputs("\x1b[?25h", d->out);
+    fflush(d->out);
+    d->out = NULL;
+}
@@ -0,0 +1,64 @@
+#ifndef SIM_DASH_H
+#define SIM_DASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "app.h"
+#include "hal.h"
+#include "physics.h"
+
+/*
+ * In-place terminal dashboard of a simulated machine.
+ *
+ * A panel of DASH_LINES lines is redrawn in place with ANSI cursor movement. It shows the
+ * menu or the running cycle (state, phase, ETA), the water level and the model's volume,
+ * the outputs, and the last few state transitions with their HAL times. Every sample
+ * records transitions, but frames are drawn at most 'fps' times per second of wall time.
+ * A frame identical to the one on screen is not written at all, so the speed of an
+ * accelerated simulation no longer depends on the terminal.
+ *
+ * The app's own console log should be silenced (hal_sim_set_quiet) while the panel is up.
+ * Anything else printed in between must be followed by dash_invalidate(), so the next
+ * frame starts below it instead of overwriting it.
+ */
+
+#define DASH_LINES 9
+#define DASH_WIDTH 80
+#define DASH_RECENT 4 /* Transitions listed */
+
+typedef struct {
+    uint32_t ms; /* HAL time */
+    wm_state_t from, to;
+} dash_transition_t;
+
+typedef struct {
+    FILE *out;
+    double period_s;  /* Minimum wall time between frames */
+    double next_s;    /* Earliest wall time of the next frame */
+    bool drawn;       /* A panel is on screen to redraw in place */
+    bool pending;     /* Sampled since the last frame */
+    wm_state_t state; /* State at the last sample */
+    dash_transition_t recent[DASH_RECENT]; /* Ring, newest at (head - 1) */
+    unsigned head, count;
+    char frame[DASH_LINES * (DASH_WIDTH + 8)]; /* Text of the panel on screen */
+    uint64_t samples, frames, skipped;         /* Skipped: due frames identical to the last */
+} dash_t;
+
+/* Start a dashboard on out, drawing at most fps frames per second (fps > 0) */
+void dash_open(dash_t *d, FILE *out, unsigned fps);
+
+/* Record the machine's state; draw a frame if one is due. ph (optional) adds volume/rpm. */
+void dash_sample(dash_t *d, hal_t *hal, const App *app, const phys_t *ph);
+
+/* Milliseconds until a pending frame is due, or -1 if nothing is pending (for poll waits) */
+int dash_due_ms(const dash_t *d);
+
+/* Other output was printed: draw the next frame below it */
+void dash_invalidate(dash_t *d);
+
+/* Draw the final state and leave the cursor below the panel */
+void dash_close(dash_t *d, hal_t *hal, const App *app, const phys_t *ph);
+
+#endif // SIM_DASH_H
@@ -0,0 +1,72 @@
+#define _DEFAULT_SOURCE
+#include "dist.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const kind_names[] = {"const", "uniform", "normal", "lognormal"};
+
+bool dist_parse(const char *spec, dist_t *out) {
+    const char *colon = strchr(spec, ':');
+    const char *args = spec;
+    int nargs = 1;
+
+    out->kind = DIST_CONST;
+    if (colon) {
+        size_t len = (size_t)(colon - spec);
+        int k;
+        for (k = 0; k <= DIST_LOGNORMAL; k++) {
+            if (strlen(kind_names[k]) == len && strncmp(spec, kind_names[k], len) == 0)
+                break;
+        }
+        if (k > DIST_LOGNORMAL)
+            return false;
+        out->kind = (dist_kind_t)k;
+        args = colon + 1;
+        nargs = out->kind == DIST_CONST ? 1 : 2;
+    }
+
+    char *end;
+    out->a = strtod(args, &end);
+    if (end == args)
+        return false;
+    out->b = 0.0;
+    if (nargs == 2) {
+        if (*end != ',')
+            return false;
+        args = end + 1;
+        out->b = strtod(args, &end);
+        if (end == args)
+            return false;
+    }
+    return *end == '\0';
+}
+
+/* Standard normal (Box-Muller, one value per call) */
+static double normal(rng_t *r) {
+    double u1 = 1.0 - rng_uniform(r); /* (0, 1] */
+    double u2 = rng_uniform(r);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+double dist_sample(const dist_t *d, rng_t *r) {
+    switch (d->kind) {
+    case DIST_UNIFORM:
+        return d->a + (d->b - d->a) * rng_uniform(r);
+    case DIST_NORMAL:
+        return d->a + d->b * normal(r);
+    case DIST_LOGNORMAL:
+        return d->a * exp(d->b * normal(r));
+    default:
+        return d->a;
+    }
+}
+
+void dist_format(const dist_t *d, char *buf, size_t len) {
+    if (d->kind == DIST_CONST)
+        snprintf(buf, len, "%g", d->a);
+    else
+        snprintf(buf, len, "%s:%g,%g", kind_names[d->kind], d->a, d->b);
+}
@@ -0,0 +1,34 @@
+#ifndef SIM_DIST_H
+#define SIM_DIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "rng.h"
+
+/*
+ * Parameter distributions for randomized simulations, given on the command line as
+ *
+ *   12                 constant (also "const:12")
+ *   uniform:6,18       uniform between the bounds
+ *   normal:12,3        mean, standard deviation
+ *   lognormal:12,0.4   median, sigma of the underlying normal (skewed, always positive)
+ */
+
+typedef enum { DIST_CONST, DIST_UNIFORM, DIST_NORMAL, DIST_LOGNORMAL } dist_kind_t;
+
+typedef struct {
+    dist_kind_t kind;
+    double a, b;
+} dist_t;
+
+/* Parse a spec as above. Returns false if it is malformed. */
+bool dist_parse(const char *spec, dist_t *out);
+
+/* Draw one value */
+double dist_sample(const dist_t *d, rng_t *r);
+
+/* Write the spec back in the form dist_parse accepts */
+void dist_format(const dist_t *d, char *buf, size_t len);
+
+#endif // SIM_DIST_H
@@ -0,0 +1,161 @@
+#include "headless.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HL_DEFAULT_STEP_MS 100
+#define HL_DEFAULT_MAX_SEC (6 * 3600)
+#define HL_PRESS_MS 60 /* Longer than the app's 50 ms debounce */
+
+static void hl_queue(hl_machine_t *m, hal_button_t btn, int times) {
+    for (int i = 0; i < times && m->script_len < sizeof(m->script); i++)
+        m->script[m->script_len++] = (uint8_t)btn;
+}
+
+void hl_machine_init(hl_machine_t *m, const hl_config_t *cfg) {
+    memset(m, 0, sizeof(*m));
+    m->cfg = *cfg;
+    if (!m->cfg.step_ms)
+        m->cfg.step_ms = HL_DEFAULT_STEP_MS;
+    if (!m->cfg.max_sec)
+        m->cfg.max_sec = HL_DEFAULT_MAX_SEC;
+
+    hal_sim_use_virtual_clock(&m->hal);
+    hal_sim_set_quiet(&m->hal, true);
+    app_init(&m->app, &m->hal);
+    phys_init(&m->phys, &m->cfg.phys, m->cfg.rng);
+
+    /* B selects the next option, A confirms the step; the last A starts the cycle */
+    hl_queue(m, HAL_BTN_B, cfg->program);
+    hl_queue(m, HAL_BTN_A, 1);
+    hl_queue(m, HAL_BTN_B, cfg->level);
+    hl_queue(m, HAL_BTN_A, 1);
+    hl_queue(m, HAL_BTN_B, cfg->power);
+    hl_queue(m, HAL_BTN_A, 1);
+
+    /* Presses within 50 ms of power-on are debounced away; wait one press length first */
+    m->hold = (uint16_t)((HL_PRESS_MS + m->cfg.step_ms - 1) / m->cfg.step_ms);
+}
+
+/* Drive the queued button presses, one edge per HL_PRESS_MS */
+static void hl_buttons(hl_machine_t *m) {
+    if (m->hold) {
+        m->hold--;
+        return;
+    }
+    if (m->script_pos >= m->script_len)
+        return;
+
+    hal_button_t btn = (hal_button_t)m->script[m->script_pos];
+    m->btn_down = !m->btn_down;
+    hal_sim_set_button(&m->hal, btn, m->btn_down);
+    if (!m->btn_down)
+        m->script_pos++;
+    m->hold = (uint16_t)((HL_PRESS_MS + m->cfg.step_ms - 1) / m->cfg.step_ms - 1);
+}
+
+static void hl_sample_eta(hl_machine_t *m) {
+    if (m->eta_count == m->eta_cap) {
+        uint32_t cap = m->eta_cap ? m->eta_cap * 2 : 4096;
+        uint32_t *p = realloc(m->eta_end_s, cap * sizeof(*p));
+        if (!p) {
+            perror("headless");
+            exit(1);
+        }
+        m->eta_end_s = p;
+        m->eta_cap = cap;
+    }
+    uint32_t elapsed_s = (m->now_ms - m->start_ms) / 1000;
+    m->eta_end_s[m->eta_count++] = elapsed_s + wm_get_time_remaining_sec(&m->app.ctrl);
+}
+
+bool hl_machine_control(hl_machine_t *m) {
+    if (m->finished || m->res.timed_out)
+        return false;
+
+    wm_controller_t *c = &m->app.ctrl;
+
+    phys_sense(&m->phys, &m->hal);
+    hl_buttons(m);
+    app_loop(&m->app);
+
+    if (!m->started && m->app.ui_state == UI_RUNNING) {
+        m->started = true;
+        m->start_ms = m->now_ms;
+        m->res.eta_start_err_s = wm_get_time_remaining_sec(c); /* Actual subtracted at end */
+    }
+
+    if (m->started) {
+        if (c->state == WM_COMPLETE || c->state == WM_ERROR) {
+            m->finished = true;
+            m->res.total_ms = m->now_ms - m->start_ms;
+            return false;
+        }
+
+        if ((m->now_ms - m->start_ms) % 1000 < m->cfg.step_ms)
+            hl_sample_eta(m);
+        m->res.state_ms[c->state] += m->cfg.step_ms;
+    }
+    return true;
+}
+
+bool hl_machine_advance(hl_machine_t *m) {
+    uint32_t dt = m->cfg.step_ms;
+    hal_sim_actuators_t acts = hal_sim_get_actuators(&m->hal);
+
+    if (m->started) {
+        m->res.on_ms[HL_ACT_MOTOR] += acts.motor_power ? dt : 0;
+        m->res.on_ms[HL_ACT_INLET] += acts.inlet ? dt : 0;
+        m->res.on_ms[HL_ACT_DRAIN] += acts.drain ? dt : 0;
+        m->res.on_ms[HL_ACT_SOAP] += acts.soap ? dt : 0;
+    }
+
+    hal_sim_advance(&m->hal, dt);
+    phys_step(&m->phys, &acts, dt);
+    m->now_ms += dt;
+
+    if (m->now_ms >= m->cfg.max_sec * 1000u) {
+        m->res.timed_out = true;
+        m->res.total_ms = m->started ? m->now_ms - m->start_ms : 0;
+        return false;
+    }
+    return true;
+}
+
+bool hl_machine_step(hl_machine_t *m) { return hl_machine_control(m) && hl_machine_advance(m); }
+
+void hl_machine_finish(hl_machine_t *m, hl_result_t *out) {
+    m->res.final_state = m->app.ctrl.state;
+    m->res.error = m->app.ctrl.error_code;
+    m->res.usage = m->app.ctrl.usage;
+    m->res.ticks_per_second = m->app.ctrl.program.ticks_per_second;
+
+    uint32_t total_s = m->res.total_ms / 1000;
+    m->res.eta_start_err_s -= (int32_t)total_s;
+
+    double sum = 0.0;
+    for (uint32_t i = 0; i < m->eta_count; i++) {
+        int32_t d = (int32_t)m->eta_end_s[i] - (int32_t)total_s;
+        sum += d < 0 ? -d : d;
+    }
+    m->res.eta_mae_s = m->eta_count ? sum / m->eta_count : 0.0;
+
+    free(m->eta_end_s);
+    m->eta_end_s = NULL;
+    m->eta_count = m->eta_cap = 0;
+    *out = m->res;
+}
+
+void hl_run(const hl_config_t *cfg, hl_result_t *out) {
+    hl_machine_t *m = malloc(sizeof(*m));
+    if (!m) {
+        perror("headless");
+        exit(1);
+    }
+    hl_machine_init(m, cfg);
+    while (hl_machine_step(m))
+        ;
+    hl_machine_finish(m, out);
+    free(m);
+}
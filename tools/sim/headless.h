@@ -0,0 +1,82 @@
+#ifndef SIM_HEADLESS_H
+#define SIM_HEADLESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "app.h"
+#include "hal.h"
+#include "physics.h"
+
+/*
+ * Headless machine: one App on its own silenced HAL with a virtual clock and the water
+ * model. It walks the menu with button presses and runs the selected cycle, collecting
+ * timing statistics. Machines share nothing, so any number can run on any threads.
+ */
+
+#define HL_STATES (WM_ERROR + 1)
+
+typedef enum { HL_ACT_MOTOR, HL_ACT_INLET, HL_ACT_DRAIN, HL_ACT_SOAP, HL_ACT_COUNT } hl_act_t;
+
+typedef struct {
+    int program, level, power; /* Menu option indices */
+    phys_params_t phys;
+    rng_t rng;        /* Stream for the physics noise */
+    uint32_t step_ms; /* Virtual time per app_loop call (0: 100 ms) */
+    uint32_t max_sec; /* Give up after this much virtual time (0: 6 h) */
+} hl_config_t;
+
+typedef struct {
+    wm_state_t final_state; /* COMPLETE or ERROR, else the state when max_sec ran out */
+    wm_error_t error;
+    bool timed_out;
+    uint32_t total_ms;            /* From the start press to COMPLETE/ERROR */
+    uint32_t state_ms[HL_STATES]; /* Time spent in each controller state */
+    uint32_t on_ms[HL_ACT_COUNT]; /* Actuator on-times */
+    int32_t eta_start_err_s;      /* ETA shown at start minus the actual duration */
+    double eta_mae_s;             /* Mean |ETA - actual remaining|, sampled every second */
+    wm_usage_t usage;             /* The controller's own output accounting (meter.h) */
+    uint8_t ticks_per_second;     /* Of the program that ran, to convert usage ticks */
+} hl_result_t;
+
+typedef struct {
+    hal_t hal;
+    App app;
+    phys_t phys;
+    hl_config_t cfg;
+
+    uint8_t script[24]; /* Buttons still to press to walk the menu */
+    uint8_t script_len, script_pos;
+    uint16_t hold; /* Steps left in the current press or release */
+    bool btn_down;
+
+    uint32_t now_ms;
+    uint32_t start_ms;
+    bool started, finished;
+    uint32_t *eta_end_s; /* Predicted end time (s since start), one per second */
+    uint32_t eta_count, eta_cap;
+    hl_result_t res;
+} hl_machine_t;
+
+/* Power on a machine and queue the menu presses for the configured selection */
+void hl_machine_init(hl_machine_t *m, const hl_config_t *cfg);
+
+/* Run one app_loop step and advance the clock and physics. Returns false once finished. */
+bool hl_machine_step(hl_machine_t *m);
+
+/*
+ * The two halves of hl_machine_step, for callers that adjust the outputs or the physics
+ * in between (e.g. a fleet coordinator). hl_machine_control runs app_loop and returns
+ * false once the cycle has finished; hl_machine_advance applies the current HAL outputs
+ * for one step and returns false once max_sec has run out.
+ */
+bool hl_machine_control(hl_machine_t *m);
+bool hl_machine_advance(hl_machine_t *m);
+
+/* Fill in the result (after the last step) and release the machine's buffers */
+void hl_machine_finish(hl_machine_t *m, hl_result_t *out);
+
+/* Run a whole cycle */
+void hl_run(const hl_config_t *cfg, hl_result_t *out);
+
+#endif // SIM_HEADLESS_H
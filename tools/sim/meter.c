@@ -0,0 +1,104 @@
+#include "meter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    size_t offset;
+} meter_key_t;
+
+static const meter_key_t keys[] = {
+    {"inlet_lpm", offsetof(meter_rates_t, inlet_lpm)},
+    {"motor_w", offsetof(meter_rates_t, motor_w)},
+    {"inlet_w", offsetof(meter_rates_t, inlet_w)},
+    {"drain_w", offsetof(meter_rates_t, drain_w)},
+    {"soap_w", offsetof(meter_rates_t, soap_w)},
+};
+#define KEYS (sizeof(keys) / sizeof(keys[0]))
+
+meter_rates_t meter_default_rates(void) {
+    meter_rates_t r = {
+        .inlet_lpm = 12.0,
+        .motor_w = 400.0,
+        .inlet_w = 6.0,
+        .drain_w = 40.0,
+        .soap_w = 15.0,
+    };
+    return r;
+}
+
+bool meter_parse(const char *spec, meter_rates_t *r) {
+    meter_rates_t out = *r;
+    for (const char *p = spec; *p;) {
+        const char *eq = strchr(p, '=');
+        if (!eq)
+            return false;
+        size_t len = (size_t)(eq - p);
+        size_t k;
+        for (k = 0; k < KEYS; k++) {
+            if (strlen(keys[k].name) == len && strncmp(p, keys[k].name, len) == 0)
+                break;
+        }
+        if (k == KEYS)
+            return false;
+        char *end;
+        double v = strtod(eq + 1, &end);
+        if (end == eq + 1 || v < 0.0 || (*end && *end != ','))
+            return false;
+        *(double *)((char *)&out + keys[k].offset) = v;
+        p = *end ? end + 1 : end;
+    }
+    *r = out;
+    return true;
+}
+
+void meter_format(const meter_rates_t *r, char *buf, size_t len) {
+    size_t n = 0;
+    for (size_t k = 0; k < KEYS && n < len; k++)
+        n += (size_t)snprintf(buf + n, len - n, "%s%s=%g", k ? "," : "", keys[k].name,
+                              *(const double *)((const char *)r + keys[k].offset));
+}
+
+void meter_read(const wm_usage_t *u, uint8_t ticks_per_second, const meter_rates_t *r,
+                meter_t *out) {
+    memset(out, 0, sizeof(*out));
+    double tick_s = ticks_per_second ? 1.0 / ticks_per_second : 0.0;
+    for (int ph = 0; ph < WM_PHASES; ph++) {
+        double motor = (u->motor_ticks[ph][0] + u->motor_ticks[ph][1]) * tick_s;
+        double inlet = u->inlet_ticks[ph] * tick_s;
+        double drain = u->drain_ticks[ph] * tick_s;
+        double soap = u->soap_ticks[ph] * tick_s;
+        out->litres[ph] = inlet / 60.0 * r->inlet_lpm;
+        out->kwh[ph] = (motor * r->motor_w + inlet * r->inlet_w + drain * r->drain_w +
+                        soap * r->soap_w) /
+                       3.6e6;
+        out->motor_s[0] += u->motor_ticks[ph][0] * tick_s;
+        out->motor_s[1] += u->motor_ticks[ph][1] * tick_s;
+        out->inlet_s += inlet;
+        out->drain_s += drain;
+        out->soap_s += soap;
+    }
+    for (int i = 0; i < WM_RELAYS; i++)
+        out->switches += u->switches[i];
+}
+
+double meter_litres(const meter_t *m) {
+    return m->litres[WM_PHASE_WASH] + m->litres[WM_PHASE_RINSE];
+}
+
+double meter_kwh(const meter_t *m) { return m->kwh[WM_PHASE_WASH] + m->kwh[WM_PHASE_RINSE]; }
+
+void meter_add(meter_t *sum, const meter_t *m) {
+    for (int ph = 0; ph < WM_PHASES; ph++) {
+        sum->litres[ph] += m->litres[ph];
+        sum->kwh[ph] += m->kwh[ph];
+    }
+    sum->motor_s[0] += m->motor_s[0];
+    sum->motor_s[1] += m->motor_s[1];
+    sum->inlet_s += m->inlet_s;
+    sum->drain_s += m->drain_s;
+    sum->soap_s += m->soap_s;
+    sum->switches += m->switches;
+}
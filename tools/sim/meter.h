@@ -0,0 +1,59 @@
+#ifndef SIM_METER_H
+#define SIM_METER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wm_control.h"
+
+/*
+ * Water and electricity estimates from a controller's usage counters (wm_usage_t).
+ *
+ * The controller only knows how long it kept each output on. Litres are inlet time times
+ * the rated inlet flow, kWh the on-time of each load times its rated draw. A machine whose
+ * supply runs slower than the rating (a shared supply, low pressure) uses the same time
+ * for less water, so the estimate is only as good as the rates. Rates are given as
+ *
+ *   inlet_lpm=12,motor_w=400,inlet_w=6,drain_w=40,soap_w=15
+ *
+ * with any subset of the keys; the rest keep their defaults.
+ */
+
+typedef struct {
+    double inlet_lpm; /* Flow through the open inlet valve, litres per minute */
+    double motor_w;   /* Draw of the running motor */
+    double inlet_w;   /* Draw of the open inlet valve's coil */
+    double drain_w;   /* Draw of the running drain pump */
+    double soap_w;    /* Draw of the running soap pump */
+} meter_rates_t;
+
+typedef struct {
+    double litres[WM_PHASES];
+    double kwh[WM_PHASES];
+    double motor_s[2]; /* CW, CCW */
+    double inlet_s, drain_s, soap_s;
+    uint32_t switches; /* Relay switches, all relays */
+} meter_t;
+
+/* The water model's 12 L/min inlet and the fleet simulator's loads */
+meter_rates_t meter_default_rates(void);
+
+/* Parse "key=value,..." into r (which holds the defaults). False if malformed. */
+bool meter_parse(const char *spec, meter_rates_t *r);
+
+/* Write the rates back in the form meter_parse accepts */
+void meter_format(const meter_rates_t *r, char *buf, size_t len);
+
+/* Estimate a cycle's water and energy */
+void meter_read(const wm_usage_t *u, uint8_t ticks_per_second, const meter_rates_t *r,
+                meter_t *out);
+
+/* Totals over both phases */
+double meter_litres(const meter_t *m);
+double meter_kwh(const meter_t *m);
+
+/* Add m to sum (fleet and per-program aggregates) */
+void meter_add(meter_t *sum, const meter_t *m);
+
+#endif // SIM_METER_H
@@ -0,0 +1,93 @@
+#include "physics.h"
+
+phys_params_t phys_default_params(void) {
+    phys_params_t p = {
+        .inlet_lpm = 12.0,
+        .drain_lpm = 25.0,
+        .sensor_noise = 0.0,
+        .level_l = {8.0, 20.0, 32.0},
+        .wet_l = 0.5,
+        .capacity_l = 45.0,
+        .motor_rpm = 700.0,
+        .drag_l = 10.0,
+        .spinup_ms = 1500.0,
+        .coast_ms = 4000.0,
+    };
+    return p;
+}
+
+void phys_init(phys_t *ph, const phys_params_t *params, rng_t rng) {
+    ph->p = *params;
+    ph->litres = 0.0;
+    ph->rpm = 0.0;
+    ph->now_ms = 0;
+    ph->synced = false;
+    ph->rng = rng;
+}
+
+void phys_step(phys_t *ph, const hal_sim_actuators_t *acts, uint32_t dt_ms) {
+    double min = dt_ms / 60000.0;
+
+    if (acts->inlet)
+        ph->litres += ph->p.inlet_lpm * min;
+    if (acts->drain)
+        ph->litres -= ph->p.drain_lpm * min;
+
+    if (ph->litres < 0.0)
+        ph->litres = 0.0;
+    if (ph->litres > ph->p.capacity_l)
+        ph->litres = ph->p.capacity_l; /* Overflow */
+
+    /* Explicit Euler on the speed lag; clamped so long steps settle instead of overshooting */
+    double target = 0.0, tau = ph->p.coast_ms;
+    if (acts->motor_power) {
+        target = ph->p.motor_rpm / (1.0 + ph->litres / ph->p.drag_l);
+        target = acts->motor_ccw ? -target : target;
+        tau = ph->p.spinup_ms;
+    }
+    double k = tau > 0.0 ? dt_ms / tau : 1.0;
+    ph->rpm += (target - ph->rpm) * (k < 1.0 ? k : 1.0);
+}
+
+uint32_t phys_sync(phys_t *ph, const hal_sim_actuators_t *acts, uint32_t now_ms) {
+    if (!ph->synced) {
+        ph->now_ms = now_ms;
+        ph->synced = true;
+        return 0;
+    }
+    if (now_ms - ph->now_ms > PHYS_MAX_CATCHUP_MS)
+        ph->now_ms = now_ms - PHYS_MAX_CATCHUP_MS;
+
+    uint32_t steps = 0;
+    while (now_ms - ph->now_ms >= PHYS_DT_MS) {
+        phys_step(ph, acts, PHYS_DT_MS);
+        ph->now_ms += PHYS_DT_MS;
+        steps++;
+    }
+    return steps;
+}
+
+void phys_read(phys_t *ph, wm_sensors_t *out) {
+    int level = WATER_EMPTY;
+    for (int i = 0; i < 3; i++) {
+        if (ph->litres >= ph->p.level_l[i])
+            level = WATER_LOW + i;
+    }
+
+    if (ph->p.sensor_noise > 0.0 && rng_uniform(&ph->rng) < ph->p.sensor_noise) {
+        level += (rng_next(&ph->rng) & 1) ? 1 : -1;
+        if (level < WATER_EMPTY)
+            level = WATER_EMPTY;
+        if (level > WATER_HIGH)
+            level = WATER_HIGH;
+    }
+
+    out->water_level = (water_level_t)level;
+    out->drain_check = ph->litres > ph->p.wet_l;
+}
+
+void phys_sense(phys_t *ph, hal_t *hal) {
+    wm_sensors_t s;
+    phys_read(ph, &s);
+    hal_sim_set_sensors(hal, s.drain_check, s.water_level);
+}
@@ -0,0 +1,72 @@
+#ifndef SIM_PHYSICS_H
+#define SIM_PHYSICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hal.h"
+#include "rng.h"
+#include "wm_control.h"
+
+/*
+ * Water model for host simulations.
+ *
+ * The drum holds a continuous volume of water. The inlet valve and drain pump move it at
+ * fixed flow rates, and the level sensor reports LOW/MED/HIGH once the volume passes
+ * the matching threshold; drain_check reports any water left. Sensor noise makes a level
+ * reading occasionally off by one level.
+ *
+ * The drum speed follows the motor with a first-order lag: it spins up towards the motor's
+ * speed, which water drag lowers as the drum fills, and coasts down when power is cut.
+ * Negative speeds are CCW. Speed does not feed back into the water or the sensors.
+ *
+ * Everything is plain arithmetic on the structs; nothing allocates.
+ */
+
+#define PHYS_DT_MS 10            /* Fixed timestep of phys_sync */
+#define PHYS_MAX_CATCHUP_MS 1000 /* Longer gaps (e.g. a stopped process) are cut to this */
+
+typedef struct {
+    double inlet_lpm;     /* Inlet flow, litres per minute */
+    double drain_lpm;     /* Drain pump flow, litres per minute */
+    double sensor_noise;  /* Probability that a level reading is off by one level */
+    double level_l[3];    /* Volume at which LOW, MED and HIGH read true */
+    double wet_l;         /* Volume above which drain_check reports water */
+    double capacity_l;    /* Drum volume */
+    double motor_rpm;     /* Drum speed with no water */
+    double drag_l;        /* Volume that halves the drum speed */
+    double spinup_ms;     /* Time constant of spin-up under power */
+    double coast_ms;      /* Time constant of coasting down without power */
+} phys_params_t;
+
+typedef struct {
+    phys_params_t p;
+    double litres;
+    double rpm;
+    uint32_t now_ms; /* Time phys_sync has simulated up to */
+    bool synced;
+    rng_t rng;
+} phys_t;
+
+/* Parameters of a typical top-loader: 12 L/min inlet, 25 L/min drain, 700 rpm, no noise */
+phys_params_t phys_default_params(void);
+
+void phys_init(phys_t *ph, const phys_params_t *params, rng_t rng);
+
+/* Advance the water volume and drum speed by dt_ms under the given actuator outputs */
+void phys_step(phys_t *ph, const hal_sim_actuators_t *acts, uint32_t dt_ms);
+
+/*
+ * Catch up to now_ms (any clock, e.g. hal_millis) in PHYS_DT_MS steps, so results do not
+ * depend on how often the caller runs. The first call only sets the start time. Returns
+ * the number of steps taken.
+ */
+uint32_t phys_sync(phys_t *ph, const hal_sim_actuators_t *acts, uint32_t now_ms);
+
+/* Sample the sensors (noisy) */
+void phys_read(phys_t *ph, wm_sensors_t *out);
+
+/* Sample the sensors (noisy) and feed them to the HAL */
+void phys_sense(phys_t *ph, hal_t *hal);
+
+#endif // SIM_PHYSICS_H
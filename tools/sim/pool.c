@@ -0,0 +1,123 @@
+#define _DEFAULT_SOURCE
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* One worker's remaining range, padded so neighbouring locks do not share a cache line */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t lo, hi;
+    char pad[64];
+} pool_range_t;
+
+typedef struct {
+    pool_range_t *ranges;
+    unsigned threads;
+    pool_fn_t fn;
+    void *ctx;
+} pool_t;
+
+typedef struct {
+    pool_t *pool;
+    unsigned id;
+} pool_worker_t;
+
+unsigned pool_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+}
+
+/* Take the next job from our own range */
+static int pool_take(pool_range_t *r, size_t *index) {
+    int ok = 0;
+    pthread_mutex_lock(&r->lock);
+    if (r->lo < r->hi) {
+        *index = r->lo++;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return ok;
+}
+
+/* Move the back half of a victim's range into ours. Returns 0 if every range is empty. */
+static int pool_steal(pool_t *p, unsigned self) {
+    for (unsigned k = 1; k < p->threads; k++) {
+        pool_range_t *v = &p->ranges[(self + k) % p->threads];
+        size_t lo = 0, hi = 0;
+
+        pthread_mutex_lock(&v->lock);
+        if (v->lo < v->hi) {
+            size_t mid = v->lo + (v->hi - v->lo) / 2;
+            lo = mid;
+            hi = v->hi;
+            v->hi = mid;
+        }
+        pthread_mutex_unlock(&v->lock);
+
+        if (lo < hi) {
+            pool_range_t *own = &p->ranges[self];
+            pthread_mutex_lock(&own->lock);
+            own->lo = lo;
+            own->hi = hi;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    /* No job is ever added, so empty everywhere means done */
+    return 0;
+}
+
+static void *pool_worker(void *arg) {
+    pool_worker_t *w = (pool_worker_t *)arg;
+    pool_t *p = w->pool;
+    size_t index;
+
+    do {
+        while (pool_take(&p->ranges[w->id], &index))
+            p->fn(p->ctx, index, w->id);
+    } while (pool_steal(p, w->id));
+    return NULL;
+}
+
+void pool_run(size_t count, unsigned threads, pool_fn_t fn, void *ctx) {
+    if (threads == 0)
+        threads = pool_cpu_count();
+    if (threads > count)
+        threads = count ? (unsigned)count : 1;
+
+    pool_t p = {NULL, threads, fn, ctx};
+    p.ranges = calloc(threads, sizeof(*p.ranges));
+    pthread_t *tids = calloc(threads, sizeof(*tids));
+    pool_worker_t *workers = calloc(threads, sizeof(*workers));
+    if (!p.ranges || !tids || !workers) {
+        perror("pool");
+        exit(1);
+    }
+
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_mutex_init(&p.ranges[i].lock, NULL);
+        p.ranges[i].lo = count * i / threads;
+        p.ranges[i].hi = count * (i + 1) / threads;
+        workers[i] = (pool_worker_t){&p, i};
+    }
+
+    /* Worker 0 is the calling thread */
+    for (unsigned i = 1; i < threads; i++) {
+        if (pthread_create(&tids[i], NULL, pool_worker, &workers[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    pool_worker(&workers[0]);
+    for (unsigned i = 1; i < threads; i++)
+        pthread_join(tids[i], NULL);
+
+    for (unsigned i = 0; i < threads; i++)
+        pthread_mutex_destroy(&p.ranges[i].lock);
+    free(workers);
+    free(tids);
+    free(p.ranges);
+}
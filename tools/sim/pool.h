@@ -0,0 +1,23 @@
+#ifndef SIM_POOL_H
+#define SIM_POOL_H
+
+#include <stddef.h>
+
+/*
+ * Work-stealing pool for batches of independent jobs.
+ *
+ * The index range [0, count) is split evenly between the workers. Each worker takes jobs
+ * from the front of its own range. When that range is empty, it steals the back half of
+ * another worker's range, so long jobs on one core do not leave the others idle.
+ */
+
+/* Job callback: run job 'index' on worker 'worker' (0 .. threads - 1) */
+typedef void (*pool_fn_t)(void *ctx, size_t index, unsigned worker);
+
+/* Online CPU count (at least 1) */
+unsigned pool_cpu_count(void);
+
+/* Run fn for every index in [0, count) on 'threads' workers (0 = one per CPU) and wait */
+void pool_run(size_t count, unsigned threads, pool_fn_t fn, void *ctx);
+
+#endif // SIM_POOL_H
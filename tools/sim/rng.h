@@ -0,0 +1,33 @@
+#ifndef SIM_RNG_H
+#define SIM_RNG_H
+
+#include <stdint.h>
+
+/*
+ * Small deterministic PRNG (splitmix64) for simulations. Each run derives its own
+ * stream from a base seed and its run index, so results do not depend on which
+ * thread ran it or in what order.
+ */
+
+typedef struct {
+    uint64_t s;
+} rng_t;
+
+static inline uint64_t rng_next(rng_t *r) {
+    uint64_t z = (r->s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/* Independent stream for run 'index' of a sweep seeded with 'seed' */
+static inline rng_t rng_for_run(uint64_t seed, uint64_t index) {
+    rng_t r = {seed ^ (index * 0xD1B54A32D192ED03ull)};
+    rng_next(&r);
+    return r;
+}
+
+/* Uniform in [0, 1) */
+static inline double rng_uniform(rng_t *r) { return (double)(rng_next(r) >> 11) * 0x1.0p-53; }
+
+#endif // SIM_RNG_H
@@ -0,0 +1,182 @@
+#define _DEFAULT_SOURCE
+#include "shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* --- Region --- */
+static size_t region_size(uint32_t slots) {
+    return sizeof(shm_region_t) + (size_t)slots * sizeof(shm_slot_t);
+}
+
+/* shm_open wants "/name" */
+static void shm_path(const char *name, char *path, size_t len) {
+    snprintf(path, len, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+shm_region_t *shm_create(const char *name, uint32_t slots) {
+    char path[256];
+    if (slots == 0 || slots > SHM_MAX_SLOTS) {
+        errno = EINVAL;
+        return NULL;
+    }
+    shm_path(name, path, sizeof(path));
+    int fd = shm_open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+        return NULL;
+    size_t size = region_size(slots);
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        return NULL;
+    }
+    shm_region_t *r = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED)
+        return NULL;
+
+    r->version = SHM_VERSION;
+    r->slots = slots;
+    r->slot_size = sizeof(shm_slot_t);
+    /* The magic last: attachers ignore a region still being set up */
+    __atomic_store_n(&r->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    return r;
+}
+
+shm_region_t *shm_attach(const char *name, char *why, unsigned why_len) {
+    char path[256];
+    struct stat st;
+    shm_path(name, path, sizeof(path));
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0) {
+        snprintf(why, why_len, "/dev/shm%s: %s", path, strerror(errno));
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(shm_region_t)) {
+        snprintf(why, why_len, "/dev/shm%s: not a machine region", path);
+        close(fd);
+        return NULL;
+    }
+    shm_region_t *r = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED) {
+        snprintf(why, why_len, "/dev/shm%s: %s", path, strerror(errno));
+        return NULL;
+    }
+    if (__atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+        r->version != SHM_VERSION || r->slot_size != sizeof(shm_slot_t) ||
+        region_size(r->slots) > (size_t)st.st_size) {
+        snprintf(why, why_len, "/dev/shm%s: not a version %d machine region", path,
+                 SHM_VERSION);
+        munmap(r, (size_t)st.st_size);
+        return NULL;
+    }
+    return r;
+}
+
+void shm_detach(shm_region_t *r) {
+    if (r)
+        munmap(r, region_size(r->slots));
+}
+
+bool shm_remove(const char *name) {
+    char path[256];
+    shm_path(name, path, sizeof(path));
+    return shm_unlink(path) == 0;
+}
+
+/* --- Seqlock --- */
+void shm_write(shm_image_t *img, const uint32_t *w, unsigned n) {
+    uint32_t seq = __atomic_load_n(&img->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&img->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (unsigned i = 0; i < n; i++)
+        __atomic_store_n(&img->w[i], w[i], __ATOMIC_RELAXED);
+    __atomic_store_n(&img->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+uint32_t shm_read(const shm_image_t *img, uint32_t *w, unsigned n, uint64_t *retries) {
+    for (uint32_t tries = 1; tries <= SHM_READ_TRIES; tries++) {
+        uint32_t seq = __atomic_load_n(&img->seq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1)) {
+            for (unsigned i = 0; i < n; i++)
+                w[i] = __atomic_load_n(&img->w[i], __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&img->seq, __ATOMIC_RELAXED) == seq)
+                return seq;
+        }
+        if (retries)
+            (*retries)++;
+        /* The writer may be descheduled mid-update (e.g. on the same core) */
+        if (tries % SHM_SPIN_TRIES == 0)
+            sched_yield();
+    }
+    return 0;
+}
+
+/* --- HAL link --- */
+static uint32_t link_input(void *ctx, hal_sim_input_t what, uint32_t value) {
+    shm_link_t *l = (shm_link_t *)ctx;
+    uint32_t in[SHM_IN_BUTTONS + 1];
+
+    if (what != HAL_SIM_IN_SENSORS && what != HAL_SIM_IN_BUTTON)
+        return value;
+    if (shm_read(&l->slot->in, in, SHM_IN_BUTTONS + 1, NULL) == 0)
+        return value; /* No physics process yet */
+    if (what == HAL_SIM_IN_SENSORS)
+        return in[SHM_IN_SENSORS];
+    return value | (in[SHM_IN_BUTTONS] >> (value >> 1) & 1);
+}
+
+static void link_output(void *ctx, hal_actuator_t act, bool active) {
+    shm_link_t *l = (shm_link_t *)ctx;
+    uint32_t bit = 1u << act;
+    uint32_t acts = active ? l->out[SHM_OUT_ACTS] | bit : l->out[SHM_OUT_ACTS] & ~bit;
+    if (acts == l->out[SHM_OUT_ACTS])
+        return;
+    l->out[SHM_OUT_ACTS] = acts;
+    l->out[SHM_OUT_UPDATES]++;
+    shm_write(&l->slot->out, l->out, SHM_OUT_UPDATES + 1);
+}
+
+void shm_link_attach(shm_link_t *l, hal_t *hal, shm_slot_t *slot) {
+    memset(l, 0, sizeof(*l));
+    l->hal = hal;
+    l->slot = slot;
+    l->tap.input = link_input;
+    l->tap.output = link_output;
+
+    hal_sim_actuators_t a = hal_sim_get_actuators(hal);
+    l->out[SHM_OUT_TIME] = hal_millis(hal);
+    l->out[SHM_OUT_ACTS] = (uint32_t)a.motor_power << HAL_ACT_MOTOR_POWER |
+                           (uint32_t)a.motor_ccw << HAL_ACT_MOTOR_DIR |
+                           (uint32_t)a.inlet << HAL_ACT_INLET |
+                           (uint32_t)a.drain << HAL_ACT_DRAIN | (uint32_t)a.soap << HAL_ACT_SOAP;
+    shm_write(&slot->out, l->out, SHM_OUT_UPDATES + 1);
+    hal_sim_set_tap(hal, &l->tap, l);
+}
+
+void shm_link_publish(shm_link_t *l, App *app) {
+    uint32_t now = hal_millis(l->hal);
+    uint32_t state = (uint32_t)app->ctrl.state;
+    uint32_t eta = wm_get_time_remaining_sec(&app->ctrl);
+    if (now == l->out[SHM_OUT_TIME] && state == l->out[SHM_OUT_STATE] &&
+        eta == l->out[SHM_OUT_ETA])
+        return;
+    l->out[SHM_OUT_TIME] = now;
+    l->out[SHM_OUT_STATE] = state;
+    l->out[SHM_OUT_ETA] = eta;
+    l->out[SHM_OUT_UPDATES]++;
+    shm_write(&l->slot->out, l->out, SHM_OUT_UPDATES + 1);
+}
+
+void shm_link_detach(shm_link_t *l) {
+    if (l->hal)
+        hal_sim_set_tap(l->hal, NULL, NULL);
+    l->hal = NULL;
+}
@@ -0,0 +1,109 @@
+#ifndef SIM_SHM_H
+#define SIM_SHM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "app.h"
+#include "hal.h"
+
+/*
+ * Shared-memory I/O images of simulated machines.
+ *
+ * A region in /dev/shm holds a number of slots, one per machine. A slot has two images of
+ * 32-bit words, each with a single writer and any number of readers:
+ *
+ *   out  HAL time, actuator bits, controller state, ETA and a loop counter, written by
+ *        the controller process
+ *   in   physics time, sensors and remote button presses, written by the physics process
+ *
+ * Each image is guarded by a sequence counter (a seqlock). The writer makes the counter
+ * odd, stores the words and makes it even again. A reader copies the words and starts over
+ * if the counter was odd or has moved. Nobody blocks or makes a system call, and readers
+ * use the mapping directly. Images are 64 bytes apart, so two writers never share a cache
+ * line.
+ *
+ * shm_link_attach() connects a hal_t to a slot through the hal_sim tap. Sensor reads then
+ * come from the in image, once a physics process has written it. Remote button bits are
+ * OR-ed into button reads. Actuator writes go to the out image, and clock reads pass
+ * through. The tap is the one trace.h uses, so a machine cannot do both at once.
+ */
+
+#define SHM_MAGIC 0x4D485357u /* "WSHM" */
+#define SHM_VERSION 1
+#define SHM_WORDS 15
+#define SHM_MAX_SLOTS 4096
+#define SHM_SPIN_TRIES 64    /* Torn reads before a reader yields the CPU */
+#define SHM_READ_TRIES 65536 /* Torn reads before it gives up (writer died mid-update) */
+
+typedef enum {
+    SHM_OUT_TIME,  /* hal_millis of the last update */
+    SHM_OUT_ACTS,  /* Bit (1 << hal_actuator_t) per output that is on */
+    SHM_OUT_STATE, /* wm_state_t */
+    SHM_OUT_ETA,   /* Remaining seconds the controller shows */
+    SHM_OUT_UPDATES, /* Updates published, as a heartbeat */
+} shm_out_word_t;
+
+typedef enum {
+    SHM_IN_TIME,    /* Time the physics has simulated up to (the slot's HAL clock) */
+    SHM_IN_SENSORS, /* (water_level_raw << 1) | drain_check, as hal_sensors_read */
+    SHM_IN_BUTTONS, /* Bit (1 << hal_button_t) per button held down remotely */
+} shm_in_word_t;
+
+typedef struct {
+    uint32_t seq; /* Odd while being written; 0: never written */
+    uint32_t w[SHM_WORDS];
+} shm_image_t;
+
+typedef struct {
+    shm_image_t out, in;
+} shm_slot_t;
+
+typedef struct {
+    uint32_t magic, version, slots, slot_size;
+    uint32_t reserved[12];
+    shm_slot_t slot[];
+} shm_region_t;
+
+/*
+ * Create (or reset) region 'name' (/dev/shm/<name>) with 'slots' slots and map it.
+ * NULL with errno on failure.
+ */
+shm_region_t *shm_create(const char *name, uint32_t slots);
+
+/* Map an existing region. NULL with a message in why if missing or of another format. */
+shm_region_t *shm_attach(const char *name, char *why, unsigned why_len);
+
+void shm_detach(shm_region_t *r);
+
+/* Delete the region's name; mappings stay valid until detached */
+bool shm_remove(const char *name);
+
+/* Writer side: publish n words (n <= SHM_WORDS) */
+void shm_write(shm_image_t *img, const uint32_t *w, unsigned n);
+
+/*
+ * Reader side: copy n consistent words. Returns the sequence number they belong to, or 0
+ * if the image was never written or stayed mid-update for SHM_READ_TRIES attempts.
+ * *retries (optional) is increased per torn attempt.
+ */
+uint32_t shm_read(const shm_image_t *img, uint32_t *w, unsigned n, uint64_t *retries);
+
+/* A hal_t connected to a slot */
+typedef struct {
+    hal_t *hal;
+    shm_slot_t *slot;
+    uint32_t out[SHM_WORDS];
+    hal_sim_tap_t tap;
+} shm_link_t;
+
+/* Route hal's sensor and button reads and actuator writes through slot */
+void shm_link_attach(shm_link_t *l, hal_t *hal, shm_slot_t *slot);
+
+/* Publish the controller state, ETA and HAL time (call after app_loop) */
+void shm_link_publish(shm_link_t *l, App *app);
+
+/* Disconnect the tap */
+void shm_link_detach(shm_link_t *l);
+
+#endif // SIM_SHM_H
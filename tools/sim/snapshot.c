@@ -0,0 +1,172 @@
+#include "snapshot.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+#include "wm_coverage.h"
+
+#define SNAP_MAGIC "WMSN"
+#define SNAP_PRESS_MS 60
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t layout; /* snap_layout() of the writer */
+    uint32_t size;   /* sizeof(snap_t) of the writer */
+    uint64_t count;
+} snap_header_t;
+
+/* FNV-1a over the sizes and offsets that a snapshot file depends on */
+static uint32_t snap_layout(void) {
+    const size_t dims[] = {sizeof(snap_t),
+                           sizeof(App),
+                           sizeof(hal_t),
+                           sizeof(phys_t),
+                           sizeof(wm_controller_t),
+                           sizeof(flight_recorder_t),
+                           offsetof(App, ctrl),
+                           offsetof(App, recorder),
+                           offsetof(App, upload_hi),
+                           offsetof(hal_t, storage),
+                           offsetof(hal_t, tap),
+                           offsetof(snap_machine_t, app),
+                           offsetof(snap_machine_t, phys),
+                           offsetof(snap_machine_t, now_ms),
+                           WM_CODE_MAX,
+                           FR_BUF_SIZE,
+                           HAL_STORAGE_SIZE};
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(dims) / sizeof(dims[0]); i++) {
+        for (int b = 0; b < 4; b++) {
+            h ^= (uint32_t)(dims[i] >> (8 * b)) & 0xFF;
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+/* --- Machine --- */
+void snap_machine_init(snap_machine_t *m, const phys_params_t *params, rng_t rng) {
+    memset(m, 0, sizeof(*m));
+    hal_sim_use_virtual_clock(&m->hal);
+    hal_sim_set_quiet(&m->hal, true);
+    app_init(&m->app, &m->hal);
+    phys_init(&m->phys, params, rng);
+    /* Presses within 50 ms of power-on are debounced away; wait one press length first */
+    snap_machine_run(m, SNAP_PRESS_MS);
+}
+
+void snap_machine_run(snap_machine_t *m, uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t += SNAP_STEP_MS) {
+        phys_sense(&m->phys, &m->hal);
+        app_loop(&m->app);
+
+        hal_sim_actuators_t acts = hal_sim_get_actuators(&m->hal);
+        hal_sim_advance(&m->hal, SNAP_STEP_MS);
+        phys_step(&m->phys, &acts, SNAP_STEP_MS);
+        m->now_ms += SNAP_STEP_MS;
+    }
+}
+
+void snap_machine_press(snap_machine_t *m, hal_button_t btn) {
+    hal_sim_set_button(&m->hal, btn, true);
+    snap_machine_run(m, SNAP_PRESS_MS);
+    hal_sim_set_button(&m->hal, btn, false);
+    snap_machine_run(m, SNAP_PRESS_MS);
+}
+
+void snap_machine_start(snap_machine_t *m, int program, int level, int power) {
+    const int sel[APP_MENU_STEPS] = {program, level, power};
+    for (int step = 0; step < APP_MENU_STEPS; step++) {
+        for (int i = 0; i < sel[step]; i++)
+            snap_machine_press(m, HAL_BTN_B);
+        snap_machine_press(m, HAL_BTN_A);
+    }
+}
+
+/* --- Snapshots --- */
+/* Coverage matrices belong to a thread of one process: never copy the pointers */
+static void snap_clear_cov(snap_machine_t *m) {
+#ifdef WM_COVERAGE
+    m->app.cov = NULL;
+    WM_COV_ATTACH(&m->app.ctrl, NULL);
+#else
+    (void)m;
+#endif
+}
+
+void snap_take(snap_t *s, const snap_machine_t *m) {
+    s->m = *m;
+    snap_clear_cov(&s->m);
+}
+
+void snap_restore(const snap_t *s, snap_machine_t *m) {
+    *m = s->m;
+    m->app.hal = &m->hal;
+    hal_sim_set_tap(&m->hal, NULL, NULL);
+    snap_clear_cov(m);
+}
+
+typedef struct {
+    const snap_t *snaps;
+    size_t branches;
+    snap_branch_fn_t fn;
+    void *ctx;
+} fork_ctx_t;
+
+static void fork_job(void *ctx, size_t index, unsigned worker) {
+    const fork_ctx_t *f = (const fork_ctx_t *)ctx;
+    snap_machine_t m;
+    (void)worker;
+    snap_restore(&f->snaps[index / f->branches], &m);
+    f->fn(f->ctx, index, &m);
+}
+
+void snap_fork(const snap_t *snaps, size_t n, size_t branches, unsigned threads,
+               snap_branch_fn_t fn, void *ctx) {
+    fork_ctx_t f = {snaps, branches, fn, ctx};
+    if (n && branches)
+        pool_run(n * branches, threads, fork_job, &f);
+}
+
+/* --- Files --- */
+bool snap_save(const char *path, const snap_t *snaps, size_t n) {
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    snap_header_t h = {{'W', 'M', 'S', 'N'}, SNAP_VERSION, 0, snap_layout(), sizeof(snap_t), n};
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(snaps, sizeof(*snaps), n, f) == n;
+    return fclose(f) == 0 && ok;
+}
+
+snap_t *snap_load(const char *path, size_t *n, char *why, size_t why_len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        snprintf(why, why_len, "%s: %s", path, strerror(errno));
+        return NULL;
+    }
+    snap_header_t h;
+    snap_t *snaps = NULL;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, SNAP_MAGIC, 4) != 0) {
+        snprintf(why, why_len, "%s: not a snapshot file", path);
+    } else if (h.version != SNAP_VERSION) {
+        snprintf(why, why_len, "%s: snapshot version %u, this build reads %d", path,
+                 (unsigned)h.version, SNAP_VERSION);
+    } else if (h.layout != snap_layout() || h.size != sizeof(snap_t)) {
+        snprintf(why, why_len, "%s: written by a build with another App/HAL layout", path);
+    } else if ((snaps = malloc(h.count ? h.count * sizeof(*snaps) : 1)) == NULL) {
+        snprintf(why, why_len, "%s: %s", path, strerror(errno));
+    } else if (fread(snaps, sizeof(*snaps), h.count, f) != h.count) {
+        snprintf(why, why_len, "%s: truncated", path);
+        free(snaps);
+        snaps = NULL;
+    } else {
+        *n = h.count;
+    }
+    fclose(f);
+    return snaps;
+}
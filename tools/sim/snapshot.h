@@ -0,0 +1,82 @@
+#ifndef SIM_SNAPSHOT_H
+#define SIM_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "app.h"
+#include "hal.h"
+#include "physics.h"
+
+/*
+ * Snapshots and forks of a whole simulated machine.
+ *
+ * A snap_machine_t is one App on its own silenced HAL with a virtual clock and the water
+ * model, stepped 10 ms at a time. Its complete state is plain data apart from the App's HAL
+ * pointer, the HAL tap and, in WM_COVERAGE builds, the coverage matrix pointers. So a
+ * snapshot is a copy and a restore is a copy plus fixing those up. Both take well under a
+ * microsecond. Snapshots and restored machines have no coverage matrix attached: set
+ * App.cov and attach it to the controller to count a restored machine.
+ *
+ * A fork restores one snapshot into many private machines and runs a callback on each
+ * across the pool's threads. Exploring "what if the user acted at second t" for every t
+ * of a cycle then costs one run up to each t plus the branches, instead of one run from
+ * power-on per branch.
+ *
+ * Snapshot files start with "WMSN", a format version and a fingerprint of the struct
+ * layouts, followed by the snapshots. A file is only loaded by a build with the same
+ * layout (same app version, compiler and WM_PROFILE setting).
+ */
+
+#define SNAP_VERSION 1
+#define SNAP_STEP_MS 10
+
+typedef struct {
+    hal_t hal;
+    App app;
+    phys_t phys;
+    uint32_t now_ms; /* Virtual time since power-on */
+} snap_machine_t;
+
+typedef struct {
+    snap_machine_t m;
+} snap_t;
+
+/* Power on a machine with the given water model; presses work from the first step on */
+void snap_machine_init(snap_machine_t *m, const phys_params_t *params, rng_t rng);
+
+/* Run app_loop and the water model for ms of virtual time (rounded up to steps) */
+void snap_machine_run(snap_machine_t *m, uint32_t ms);
+
+/* Press and release a button (60 ms each way, longer than the app's debounce) */
+void snap_machine_press(snap_machine_t *m, hal_button_t btn);
+
+/* Walk the menu to the given option indices and start the cycle */
+void snap_machine_start(snap_machine_t *m, int program, int level, int power);
+
+void snap_take(snap_t *s, const snap_machine_t *m);
+
+/* Restore into m; the App is pointed at m's HAL, and any tap and coverage matrix removed */
+void snap_restore(const snap_t *s, snap_machine_t *m);
+
+/* Fork callback: branch 'index' runs on its own restored machine */
+typedef void (*snap_branch_fn_t)(void *ctx, size_t index, snap_machine_t *m);
+
+/*
+ * Restore snaps[i / branches] into a private machine for each i in [0, n * branches) and
+ * call fn(ctx, i, m), on 'threads' pool workers (0 = one per CPU). Returns when all ran.
+ */
+void snap_fork(const snap_t *snaps, size_t n, size_t branches, unsigned threads,
+               snap_branch_fn_t fn, void *ctx);
+
+/* Write n snapshots to path. False (with errno) on I/O errors. */
+bool snap_save(const char *path, const snap_t *snaps, size_t n);
+
+/*
+ * Read the snapshots of a file into a malloc'd array (free it). NULL with a message in why
+ * if the file is missing, truncated, of another format version or another struct layout.
+ */
+snap_t *snap_load(const char *path, size_t *n, char *why, size_t why_len);
+
+#endif // SIM_SNAPSHOT_H
@@ -0,0 +1,275 @@
+#define _DEFAULT_SOURCE
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TRACE_MAGIC "WMTR"
+#define TRACE_VERSION 2
+#define TRACE_HEADER 8
+#define TRACE_ESCAPE 31
+
+/* Event kinds (top 3 bits of the tag); inputs follow hal_sim_input_t order */
+enum { EV_INIT, EV_LOOP, EV_COMMAND, EV_INPUT, EV_OUTPUT = EV_INPUT + 4 };
+
+static const char *const kind_names[] = {"app_init", "app_loop", "app_command", "millis",
+                                         "micros",   "button",   "sensors",     "output"};
+
+static uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+static bool is_clock(int kind) {
+    return kind == EV_INPUT + HAL_SIM_IN_MILLIS || kind == EV_INPUT + HAL_SIM_IN_MICROS;
+}
+
+/* --- Recording --- */
+static void put(trace_t *t, int kind, uint32_t arg) {
+    putc((kind << 5) | (arg < TRACE_ESCAPE ? arg : TRACE_ESCAPE), t->out);
+    if (arg >= TRACE_ESCAPE) {
+        for (; arg >= 0x80; arg >>= 7)
+            putc((int)(arg & 0x7F) | 0x80, t->out);
+        putc((int)arg, t->out);
+    }
+    t->events++;
+}
+
+static uint32_t record_input(void *ctx, hal_sim_input_t what, uint32_t value) {
+    trace_t *t = (trace_t *)ctx;
+    if (!t->in_app)
+        return value;
+    int kind = EV_INPUT + (int)what;
+    if (is_clock(kind)) {
+        put(t, kind, zigzag((int32_t)(value - t->last_clock[what])));
+        t->last_clock[what] = value;
+    } else {
+        put(t, kind, value);
+    }
+    return value;
+}
+
+/* Whether a write changes an output; writes that repeat the last value are not traced */
+static bool output_changes(trace_t *t, hal_actuator_t act, bool active) {
+    uint8_t acts = active ? t->acts | 1u << act : t->acts & ~(1u << act);
+    if (acts == t->acts)
+        return false;
+    t->acts = acts;
+    return true;
+}
+
+static void record_output(void *ctx, hal_actuator_t act, bool active) {
+    trace_t *t = (trace_t *)ctx;
+    if (t->in_app && output_changes(t, act, active)) {
+        put(t, EV_OUTPUT, ((uint32_t)act << 1) | active);
+        t->outputs++;
+    }
+}
+
+static const hal_sim_tap_t record_tap = {record_input, record_output};
+
+bool trace_record(trace_t *t, hal_t *hal, const char *path) {
+    memset(t, 0, sizeof(*t));
+    t->out = fopen(path, "wb");
+    if (!t->out)
+        return false;
+    const uint8_t header[TRACE_HEADER] = {'W', 'M', 'T', 'R', TRACE_VERSION, 0, 0, 0};
+    fwrite(header, 1, sizeof(header), t->out);
+    t->mode = TRACE_RECORD;
+    t->hal = hal;
+    hal_sim_set_tap(hal, &record_tap, t);
+    return !ferror(t->out);
+}
+
+/* --- Replay --- */
+static void diverge(trace_t *t, const char *fmt, ...) {
+    if (t->diverged)
+        return;
+    t->diverged = true;
+    int n = snprintf(t->why, sizeof(t->why), "event %llu (app_loop %llu, t=%u ms): ",
+                     (unsigned long long)t->events, (unsigned long long)t->loops,
+                     t->last_clock[HAL_SIM_IN_MILLIS]);
+    if (n > 0 && (size_t)n < sizeof(t->why)) {
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(t->why + n, sizeof(t->why) - (size_t)n, fmt, ap);
+        va_end(ap);
+    }
+}
+
+static const char *event_name(int kind) { return kind < 0 ? "end of trace" : kind_names[kind]; }
+
+/* A call must consume everything recorded in it before the next marker */
+static void check_consumed(trace_t *t) {
+    int next = t->pos < t->size ? t->data[t->pos] >> 5 : -1;
+    if (next >= EV_INPUT)
+        diverge(t, "app made no more I/O in this call, trace has %s", kind_names[next]);
+}
+
+/* Next event; -1 at the end of the trace or on a truncated one */
+static int get(trace_t *t, uint32_t *arg) {
+    if (t->pos >= t->size)
+        return -1;
+    uint8_t tag = t->data[t->pos++];
+    *arg = tag & TRACE_ESCAPE;
+    if (*arg == TRACE_ESCAPE) {
+        *arg = 0;
+        for (int shift = 0;; shift += 7) {
+            if (t->pos >= t->size || shift > 28)
+                return -1;
+            uint8_t b = t->data[t->pos++];
+            *arg |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+    }
+    t->events++;
+    return tag >> 5;
+}
+
+static uint32_t replay_input(void *ctx, hal_sim_input_t what, uint32_t value) {
+    trace_t *t = (trace_t *)ctx;
+    if (!t->in_app || t->diverged)
+        return value;
+    int want = EV_INPUT + (int)what;
+    uint32_t arg;
+    int kind = get(t, &arg);
+    if (kind != want) {
+        diverge(t, "app read %s, trace has %s", kind_names[want], event_name(kind));
+        return value;
+    }
+    if (is_clock(kind)) {
+        t->last_clock[what] += (uint32_t)unzigzag(arg);
+        return t->last_clock[what];
+    }
+    /* A button read must be for the same button */
+    if (what == HAL_SIM_IN_BUTTON && (arg >> 1) != (value >> 1))
+        diverge(t, "app read button %c, trace has button %c", 'A' + (int)(value >> 1),
+                'A' + (int)(arg >> 1));
+    return arg;
+}
+
+static void replay_output(void *ctx, hal_actuator_t act, bool active) {
+    static const char *const act_names[] = {"motor power", "motor dir", "inlet", "drain",
+                                            "soap"};
+    trace_t *t = (trace_t *)ctx;
+    if (!t->in_app || t->diverged || !output_changes(t, act, active))
+        return;
+    uint32_t arg;
+    int kind = get(t, &arg);
+    if (kind != EV_OUTPUT)
+        diverge(t, "app wrote %s, trace has %s", act_names[act], event_name(kind));
+    else if (arg != (((uint32_t)act << 1) | active))
+        diverge(t, "app set %s %s, trace has %s %s", act_names[act], active ? "on" : "off",
+                (arg >> 1) < 5 ? act_names[arg >> 1] : "?", (arg & 1) ? "on" : "off");
+    t->outputs++;
+}
+
+static const hal_sim_tap_t replay_tap = {replay_input, replay_output};
+
+bool trace_open_replay(trace_t *t, hal_t *hal, const char *path) {
+    memset(t, 0, sizeof(*t));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        snprintf(t->why, sizeof(t->why), "%s: %s", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    if (st.st_size < TRACE_HEADER) {
+        snprintf(t->why, sizeof(t->why), "%s: not a trace", path);
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        snprintf(t->why, sizeof(t->why), "%s: %s", path, strerror(errno));
+        return false;
+    }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    t->data = (const uint8_t *)map;
+    t->size = (size_t)st.st_size;
+    if (memcmp(t->data, TRACE_MAGIC, 4) != 0 || t->data[4] != TRACE_VERSION) {
+        snprintf(t->why, sizeof(t->why), "%s: not a version %d trace", path, TRACE_VERSION);
+        trace_close(t);
+        return false;
+    }
+    t->pos = TRACE_HEADER;
+    t->mode = TRACE_REPLAY;
+    t->hal = hal;
+    hal_sim_set_tap(hal, &replay_tap, t);
+    return true;
+}
+
+bool trace_replay_run(trace_t *t, App *app) {
+    uint32_t arg;
+    if (get(t, &arg) != EV_INIT) {
+        diverge(t, "trace does not start with app_init");
+        return false;
+    }
+    trace_app_init(t, app, t->hal);
+    check_consumed(t);
+
+    while (!t->diverged && t->pos < t->size) {
+        int kind = get(t, &arg);
+        if (kind == EV_LOOP) {
+            trace_app_loop(t, app);
+            t->loops++;
+        } else if (kind == EV_COMMAND && t->pos < t->size) {
+            trace_app_command(t, app, (char)t->data[t->pos++]);
+        } else {
+            diverge(t, "trace has %s outside any app call",
+                    kind < 0 || kind == EV_COMMAND ? "a truncated event" : kind_names[kind]);
+        }
+        check_consumed(t);
+    }
+    return !t->diverged;
+}
+
+/* --- Traced calls --- */
+void trace_app_init(trace_t *t, App *app, hal_t *hal) {
+    if (t->mode == TRACE_RECORD)
+        put(t, EV_INIT, 0);
+    t->in_app = t->mode != TRACE_OFF;
+    app_init(app, hal);
+    t->in_app = false;
+}
+
+void trace_app_loop(trace_t *t, App *app) {
+    if (t->mode == TRACE_RECORD) {
+        put(t, EV_LOOP, 0);
+        t->loops++;
+    }
+    t->in_app = t->mode != TRACE_OFF;
+    app_loop(app);
+    t->in_app = false;
+}
+
+void trace_app_command(trace_t *t, App *app, char cmd) {
+    if (t->mode == TRACE_RECORD) {
+        put(t, EV_COMMAND, 0);
+        putc((unsigned char)cmd, t->out);
+    }
+    t->in_app = t->mode != TRACE_OFF;
+    app_command(app, cmd);
+    t->in_app = false;
+}
+
+bool trace_close(trace_t *t) {
+    bool ok = true;
+    if (t->hal)
+        hal_sim_set_tap(t->hal, NULL, NULL);
+    if (t->out)
+        ok = !ferror(t->out) && fclose(t->out) == 0;
+    if (t->data)
+        munmap((void *)t->data, t->size);
+    t->out = NULL;
+    t->data = NULL;
+    t->mode = TRACE_OFF;
+    return ok;
+}
@@ -0,0 +1,71 @@
+#ifndef SIM_TRACE_H
+#define SIM_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "app.h"
+#include "hal.h"
+
+/*
+ * Record and replay of app sessions.
+ *
+ * A trace is the stream of everything the app exchanged with its HAL, taken through the
+ * hal_sim tap: each clock, button and sensor read, each actuator write that changes the
+ * output, and markers for the app_init, app_loop and app_command calls it happened in.
+ * Replaying feeds the recorded reads back to the same calls and checks that the app
+ * changes the same outputs in the same calls (writes that repeat the value are skipped on
+ * both sides; all outputs start off). Replay takes
+ * no wall time, so hours of session replay in seconds.
+ *
+ * Reads outside those calls (the simulator's own physics and timers) are not recorded.
+ *
+ * Encoding: an 8-byte header ("WMTR", version, 3 reserved), then one tag byte per event:
+ * kind in the top 3 bits, a 5-bit argument below. Clocks store the zigzag delta from the
+ * previous read of the same clock, buttons and sensors their value, outputs
+ * (act << 1) | on, commands nothing. Argument 31 means a LEB128 value follows. An
+ * app_loop costs about 9 bytes, nearly all for its clock, button and sensor reads. That
+ * is little at real-time speeds, but an unthrottled session (-x 0) makes well over a
+ * million app_loop calls per second, which adds about 15 MB per second. Replay maps the
+ * file instead of reading it.
+ */
+
+typedef enum { TRACE_OFF, TRACE_RECORD, TRACE_REPLAY } trace_mode_t;
+
+typedef struct {
+    trace_mode_t mode;
+    hal_t *hal;
+    bool in_app; /* Inside a traced call: taps record or replay */
+    uint32_t last_clock[2];
+    uint8_t acts; /* Bit (1 << hal_actuator_t) per output last written on in a traced call */
+
+    FILE *out; /* Recording */
+
+    const uint8_t *data; /* Replay (mapped) */
+    size_t size, pos;
+    bool diverged;
+    char why[160];
+
+    uint64_t events, loops, outputs;
+} trace_t;
+
+/* Start recording the app on hal to path (before trace_app_init). False on I/O errors. */
+bool trace_record(trace_t *t, hal_t *hal, const char *path);
+
+/* Map a trace for trace_replay_run. False (with t->why) if it is missing or not a trace. */
+bool trace_open_replay(trace_t *t, hal_t *hal, const char *path);
+
+/* The traced app calls; with mode TRACE_OFF they just make the call */
+void trace_app_init(trace_t *t, App *app, hal_t *hal);
+void trace_app_loop(trace_t *t, App *app);
+void trace_app_command(trace_t *t, App *app, char cmd);
+
+/* Replay the whole trace into app. False at the first divergence, described in t->why. */
+bool trace_replay_run(trace_t *t, App *app);
+
+/* Finish the file or drop the mapping. False if a recording could not be written. */
+bool trace_close(trace_t *t);
+
+#endif // SIM_TRACE_H
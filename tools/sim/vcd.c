@@ -0,0 +1,100 @@
+#include "vcd.h"
+
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    unsigned width;
+} vcd_var_t;
+
+static const vcd_var_t vars[VCD_SIGNALS] = {
+    [VCD_MOTOR_POWER] = {"motor_power", 1}, [VCD_MOTOR_CCW] = {"motor_ccw", 1},
+    [VCD_INLET] = {"inlet", 1},             [VCD_DRAIN] = {"drain", 1},
+    [VCD_SOAP] = {"soap", 1},               [VCD_BUZZER] = {"buzzer", 2},
+    [VCD_WATER_LEVEL] = {"water_level", 2}, [VCD_DRAIN_CHECK] = {"drain_check", 1},
+    [VCD_STATE] = {"state", 4},
+};
+
+/* Identifier codes: one printable character per signal */
+static char vcd_id(int sig) { return (char)('a' + sig); }
+
+static void vcd_write(vcd_t *v, int sig, uint32_t value) {
+    if (vars[sig].width == 1) {
+        fprintf(v->out, "%u%c\n", (unsigned)(value & 1), vcd_id(sig));
+    } else {
+        char bits[33];
+        unsigned n = 0;
+        for (int b = (int)vars[sig].width - 1; b >= 0; b--)
+            bits[n++] = (char)('0' + (value >> b & 1));
+        bits[n] = '\0';
+        fprintf(v->out, "b%s %c\n", bits, vcd_id(sig));
+    }
+    v->changes++;
+}
+
+bool vcd_open(vcd_t *v, const char *path) {
+    memset(v, 0, sizeof(*v));
+    v->out = fopen(path, "w");
+    if (!v->out)
+        return false;
+
+    fprintf(v->out, "$version washing machine simulator $end\n$comment state:");
+    for (int s = WM_IDLE; s <= WM_ERROR; s++)
+        fprintf(v->out, " %d=%s", s, wm_state_str((wm_state_t)s));
+    fprintf(v->out, " $end\n$timescale 1 ms $end\n$scope module washer $end\n");
+    for (int i = 0; i < VCD_SIGNALS; i++)
+        fprintf(v->out, "$var wire %u %c %s $end\n", vars[i].width, vcd_id(i), vars[i].name);
+    fprintf(v->out, "$upscope $end\n$enddefinitions $end\n");
+    return true;
+}
+
+void vcd_sample(vcd_t *v, hal_t *hal, const App *app) {
+    hal_sim_actuators_t a = hal_sim_get_actuators(hal);
+    uint32_t now[VCD_SIGNALS] = {
+        [VCD_MOTOR_POWER] = a.motor_power,
+        [VCD_MOTOR_CCW] = a.motor_ccw,
+        [VCD_INLET] = a.inlet,
+        [VCD_DRAIN] = a.drain,
+        [VCD_SOAP] = a.soap,
+        [VCD_BUZZER] = (uint32_t)app->actuators.buzzer,
+        [VCD_WATER_LEVEL] = (uint32_t)app->sensors.water_level,
+        [VCD_DRAIN_CHECK] = app->sensors.drain_check,
+        [VCD_STATE] = (uint32_t)app->ctrl.state,
+    };
+    uint32_t ms = hal_millis(hal);
+    v->last_ms = ms;
+
+    if (!v->started) {
+        v->started = true;
+        v->t0_ms = ms;
+        fprintf(v->out, "#0\n$dumpvars\n");
+        for (int i = 0; i < VCD_SIGNALS; i++)
+            vcd_write(v, i, now[i]);
+        fprintf(v->out, "$end\n");
+        memcpy(v->value, now, sizeof(now));
+        return;
+    }
+
+    bool stamped = false;
+    for (int i = 0; i < VCD_SIGNALS; i++) {
+        if (now[i] == v->value[i])
+            continue;
+        if (!stamped) {
+            fprintf(v->out, "#%lu\n", (unsigned long)(ms - v->t0_ms));
+            stamped = true;
+        }
+        vcd_write(v, i, now[i]);
+        v->value[i] = now[i];
+    }
+}
+
+bool vcd_close(vcd_t *v) {
+    if (!v->out)
+        return true;
+    if (v->started)
+        fprintf(v->out, "#%lu\n", (unsigned long)(v->last_ms - v->t0_ms));
+    bool ok = !ferror(v->out);
+    ok = fclose(v->out) == 0 && ok;
+    v->out = NULL;
+    return ok;
+}
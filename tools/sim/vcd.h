@@ -0,0 +1,54 @@
+#ifndef SIM_VCD_H
+#define SIM_VCD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "app.h"
+#include "hal.h"
+
+/*
+ * Value Change Dump of a simulated machine, for GTKWave and other waveform viewers.
+ *
+ * Each sample reads the HAL outputs (motor power and direction, inlet, drain, soap), the
+ * controller's buzzer mode, the water level and drain_check the controller last read, and
+ * the controller state. Only signals that differ from the previous sample are written,
+ * under a timestamp in ms of HAL time since the first sample (virtual time on a virtual
+ * clock). A sample without changes writes nothing. A whole cycle is a few KB.
+ *
+ * Vector signals are unsigned codes: water_level is water_level_t, buzzer is
+ * wm_buzzer_mode_t and state is wm_state_t; the header lists the state names.
+ */
+
+typedef enum {
+    VCD_MOTOR_POWER,
+    VCD_MOTOR_CCW,
+    VCD_INLET,
+    VCD_DRAIN,
+    VCD_SOAP,
+    VCD_BUZZER,
+    VCD_WATER_LEVEL,
+    VCD_DRAIN_CHECK,
+    VCD_STATE,
+    VCD_SIGNALS
+} vcd_signal_t;
+
+typedef struct {
+    FILE *out;
+    bool started;
+    uint32_t t0_ms, last_ms;
+    uint32_t value[VCD_SIGNALS];
+    uint64_t changes; /* Value changes written, including the initial values */
+} vcd_t;
+
+/* Create path and write the header. False (with errno) if it cannot be created. */
+bool vcd_open(vcd_t *v, const char *path);
+
+/* Record whatever changed since the last sample */
+void vcd_sample(vcd_t *v, hal_t *hal, const App *app);
+
+/* Stamp the time of the last sample, flush and close. False if anything could not be written. */
+bool vcd_close(vcd_t *v);
+
+#endif // SIM_VCD_H
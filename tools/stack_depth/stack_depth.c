@@ -0,0 +1,176 @@
+/*
+ * Host stack depth probe.
+ *
+ * Runs each workload on a thread whose stack is a buffer painted with a canary, then
+ * scans for the deepest overwritten byte. The cost of thread start-up is measured with
+ * an empty workload and subtracted, leaving the depth used by the calls under test.
+ *
+ * Host figures are not AVR figures (different ABI, glibc printf), but they show which
+ * paths are deep and catch regressions. On the MCU use the 's' command instead.
+ */
+#define _DEFAULT_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "hal.h"
+#include "wm_control.h"
+
+#define STACK_SIZE (256 * 1024)
+#define STACK_CANARY 0xC5
+
+typedef void (*workload_t)(void);
+
+static void *run_workload(void *arg) {
+    ((workload_t *)arg)[0]();
+    return NULL;
+}
+
+static size_t measure(workload_t work) {
+    uint8_t *stack = NULL;
+    if (posix_memalign((void **)&stack, 4096, STACK_SIZE) != 0) {
+        perror("posix_memalign");
+        exit(1);
+    }
+    memset(stack, STACK_CANARY, STACK_SIZE);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, STACK_SIZE);
+
+    pthread_t th;
+    if (pthread_create(&th, &attr, run_workload, &work) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    pthread_join(th, NULL);
+    pthread_attr_destroy(&attr);
+
+    /* The stack grows down: the lowest touched byte marks the deepest point */
+    size_t i = 0;
+    while (i < STACK_SIZE && stack[i] == STACK_CANARY)
+        i++;
+    free(stack);
+    return STACK_SIZE - i;
+}
+
+/* --- Workloads --- */
+
+static void work_empty(void) {}
+
+/* Drive one controller through every state, plus pause/resume and abort */
+static void work_wm_tick(void) {
+    wm_controller_t c;
+    wm_sensors_t s;
+    wm_actuators_t a;
+    wm_program_t program = {
+        .wash_count = 1,
+        .rinse_count = 1,
+        .spin_enable = true,
+        .soap_time_sec = 1,
+        .wash_agitate_time_sec = 2,
+        .rinse_agitate_time_sec = 2,
+        .agitate_run_ms = 2000,
+        .agitate_cycle_ms = 4000,
+        .target_water_level = WATER_HIGH,
+        .water_fill_timeout_sec = 10,
+        .drain_timeout_sec = 10,
+        .ticks_per_second = 10,
+    };
+
+    wm_init(&c, &s, &a, program);
+    wm_start(&c);
+    for (int i = 0; i < 2000 && c.state != WM_COMPLETE; i++) {
+        bool filling = (c.state == WM_FILL);
+        s.water_level = filling ? WATER_HIGH : s.water_level;
+        s.drain_check = (c.state != WM_DRAIN);
+        if (i == 30)
+            wm_pause(&c);
+        if (i == 35)
+            wm_resume(&c);
+        wm_tick(&c, &s, &a);
+        (void)wm_get_time_remaining_sec(&c);
+    }
+
+    wm_init(&c, &s, &a, program);
+    wm_start(&c);
+    wm_tick(&c, &s, &a);
+    wm_abort(&c);
+    wm_tick(&c, &s, &a);
+
+    /* Error path */
+    wm_init(&c, &s, &a, program);
+    wm_start(&c);
+    s.water_level = WATER_EMPTY;
+    for (int i = 0; i < 200 && c.state != WM_ERROR; i++)
+        wm_tick(&c, &s, &a);
+    wm_tick(&c, &s, &a);
+}
+
+static void press(App *app, hal_button_t btn) {
+    hal_sim_set_button(app->hal, btn, true);
+    app_loop(app);
+    hal_delay(app->hal, 60); /* Outlast the 50 ms debounce */
+    hal_sim_set_button(app->hal, btn, false);
+    app_loop(app);
+    hal_delay(app->hal, 60);
+}
+
+/* Walk the menu, then force controller ticks through a whole cycle and the commands */
+static void work_app_loop(void) {
+    static hal_t hal;
+    static App app;
+    hal_sim_use_virtual_clock(&hal); /* Debounce waits cost no wall time */
+    app_init(&app, &hal);
+
+    press(&app, HAL_BTN_B);
+    press(&app, HAL_BTN_A);
+    press(&app, HAL_BTN_A);
+    press(&app, HAL_BTN_A);
+
+    /* Restart with short agitation so the whole cycle fits in a few thousand ticks */
+    wm_program_t prog = app.ctrl.program;
+    prog.wash_agitate_time_sec = 3;
+    prog.rinse_agitate_time_sec = 3;
+    uint8_t code[WM_CODE_MAX];
+    uint8_t len = wm_compile_program(&prog, code, sizeof(code));
+    wm_init(&app.ctrl, &app.sensors, &app.actuators, prog);
+    wm_load_code(&app.ctrl, code, len);
+    wm_start(&app.ctrl);
+
+    for (int i = 0; i < 5000 && app.ctrl.state != WM_COMPLETE; i++) {
+        hal_sim_actuators_t acts = hal_sim_get_actuators(&hal);
+        int level = acts.inlet   ? WATER_HIGH
+                    : acts.drain ? WATER_EMPTY
+                                 : (int)app.sensors.water_level;
+        hal_sim_set_sensors(&hal, level > WATER_EMPTY, level);
+        if (i == 100)
+            press(&app, HAL_BTN_A); /* Pause */
+        if (i == 110)
+            press(&app, HAL_BTN_A); /* Resume */
+        app.last_tick_time -= 1000; /* Force a tick on this call */
+        app_loop(&app);
+    }
+    app_command(&app, 's');
+    app_command(&app, 'd');
+}
+
+int main(void) {
+    /* app_loop logs every tick; keep stdout quiet and report on stderr */
+    if (!freopen("/dev/null", "w", stdout)) {
+        perror("freopen");
+        return 1;
+    }
+
+    size_t base = measure(work_empty);
+    size_t tick = measure(work_wm_tick);
+    size_t loop = measure(work_app_loop);
+
+    fprintf(stderr, "Host stack depth (thread start-up of %zu B subtracted):\n", base);
+    fprintf(stderr, "  wm_tick  (+ wm_get_time_remaining_sec): %6zu B\n", tick - base);
+    fprintf(stderr, "  app_loop (+ app_command):              %6zu B\n", loop - base);
+    return 0;
+}
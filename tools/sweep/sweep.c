@@ -0,0 +1,277 @@
+/*
+ * Headless parameter sweep.
+ *
+ * Runs every program x water level x power combination from the app menu under every
+ * combination of the given physics parameters, on all cores, and writes one CSV row per
+ * run. Each run drives the real app through its menu on a virtual clock
+ * (tools/sim/headless.c), so results are deterministic for a given seed.
+ *
+ * Each row also has the water and energy the controller's usage counters add up to at the
+ * rates of -E (tools/sim/meter.h; litres use the run's own inlet flow), and stderr gets
+ * the mean litres and kWh per program.
+ *
+ * Usage: sweep [-j threads] [-o out.csv] [-f inlet_lpm,...] [-d drain_lpm,...]
+ *              [-n sensor_noise,...] [-r repeats] [-s seed] [-E rates]
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "headless.h"
+#include "meter.h"
+#include "pool.h"
+
+#define MAX_VALUES 16
+
+typedef struct {
+    double v[MAX_VALUES];
+    int n;
+} list_t;
+
+typedef struct {
+    int programs, levels, powers;
+    list_t inlet, drain, noise;
+    int repeats;
+    uint64_t seed;
+    meter_rates_t rates;
+    hl_result_t *results;
+} sweep_t;
+
+/* Decoded run index */
+typedef struct {
+    int program, level, power, inlet, drain, noise, rep;
+} run_t;
+
+static int parse_list(const char *arg, list_t *out) {
+    out->n = 0;
+    const char *p = arg;
+    while (*p && out->n < MAX_VALUES) {
+        char *end;
+        out->v[out->n++] = strtod(p, &end);
+        if (end == p)
+            return 0;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end && *end != ',')
+            return 0;
+    }
+    return out->n > 0;
+}
+
+static size_t run_count(const sweep_t *s) {
+    return (size_t)s->programs * s->levels * s->powers * s->inlet.n * s->drain.n * s->noise.n *
+           s->repeats;
+}
+
+static run_t decode(const sweep_t *s, size_t i) {
+    run_t r;
+    r.rep = (int)(i % s->repeats);
+    i /= s->repeats;
+    r.noise = (int)(i % s->noise.n);
+    i /= s->noise.n;
+    r.drain = (int)(i % s->drain.n);
+    i /= s->drain.n;
+    r.inlet = (int)(i % s->inlet.n);
+    i /= s->inlet.n;
+    r.power = (int)(i % s->powers);
+    i /= s->powers;
+    r.level = (int)(i % s->levels);
+    i /= s->levels;
+    r.program = (int)i;
+    return r;
+}
+
+static void run_job(void *ctx, size_t index, unsigned worker) {
+    sweep_t *s = (sweep_t *)ctx;
+    run_t r = decode(s, index);
+    (void)worker;
+
+    hl_config_t cfg = {0};
+    cfg.program = r.program;
+    cfg.level = r.level;
+    cfg.power = r.power;
+    cfg.phys = phys_default_params();
+    cfg.phys.inlet_lpm = s->inlet.v[r.inlet];
+    cfg.phys.drain_lpm = s->drain.v[r.drain];
+    cfg.phys.sensor_noise = s->noise.v[r.noise];
+    cfg.rng = rng_for_run(s->seed, index);
+    hl_run(&cfg, &s->results[index]);
+}
+
+static const char *result_str(const hl_result_t *res) {
+    if (res->timed_out)
+        return "TIMEOUT";
+    return wm_state_str(res->final_state);
+}
+
+/* Water and energy of run i, at the run's inlet flow */
+static void run_meter(const sweep_t *s, size_t i, meter_t *m) {
+    meter_rates_t rates = s->rates;
+    rates.inlet_lpm = s->inlet.v[decode(s, i).inlet];
+    meter_read(&s->results[i].usage, s->results[i].ticks_per_second, &rates, m);
+}
+
+static void write_csv(FILE *out, const sweep_t *s, const App *menu) {
+    fprintf(out, "program,level,power,inlet_lpm,drain_lpm,sensor_noise,rep,result,error,"
+                 "total_s,fill_s,soap_s,agitate_s,soak_s,drain_s,spin_s,"
+                 "motor_on_s,inlet_on_s,drain_on_s,soap_on_s,eta_start_err_s,eta_mae_s,"
+                 "wash_l,rinse_l,kwh,relay_switches\n");
+
+    size_t n = run_count(s);
+    for (size_t i = 0; i < n; i++) {
+        run_t r = decode(s, i);
+        const hl_result_t *res = &s->results[i];
+        fprintf(out, "%s,%s,%s,%g,%g,%g,%d,%s,%s,", app_menu_name(menu, APP_MENU_PROGRAM, r.program),
+                app_menu_name(menu, APP_MENU_LEVEL, r.level),
+                app_menu_name(menu, APP_MENU_POWER, r.power), s->inlet.v[r.inlet],
+                s->drain.v[r.drain], s->noise.v[r.noise], r.rep, result_str(res),
+                wm_error_str(res->error));
+        fprintf(out, "%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,", res->total_ms / 1000.0,
+                res->state_ms[WM_FILL] / 1000.0, res->state_ms[WM_SOAP] / 1000.0,
+                res->state_ms[WM_AGITATE] / 1000.0, res->state_ms[WM_SOAK] / 1000.0,
+                res->state_ms[WM_DRAIN] / 1000.0, res->state_ms[WM_SPIN] / 1000.0);
+        fprintf(out, "%.1f,%.1f,%.1f,%.1f,%d,%.1f,", res->on_ms[HL_ACT_MOTOR] / 1000.0,
+                res->on_ms[HL_ACT_INLET] / 1000.0, res->on_ms[HL_ACT_DRAIN] / 1000.0,
+                res->on_ms[HL_ACT_SOAP] / 1000.0, (int)res->eta_start_err_s, res->eta_mae_s);
+        meter_t m;
+        run_meter(s, i, &m);
+        fprintf(out, "%.1f,%.1f,%.4f,%u\n", m.litres[WM_PHASE_WASH], m.litres[WM_PHASE_RINSE],
+                meter_kwh(&m), (unsigned)m.switches);
+    }
+}
+
+/* Mean water and energy per program over its completed runs */
+static void print_programs(const sweep_t *s, const App *menu) {
+    char rates[128];
+    meter_format(&s->rates, rates, sizeof(rates));
+    fprintf(stderr, "%-10s %6s %8s %8s %8s %8s\n", "program", "runs", "wash_l", "rinse_l",
+            "litres", "kWh");
+    for (int p = 0; p < s->programs; p++) {
+        meter_t sum = {0};
+        unsigned runs = 0;
+        for (size_t i = 0; i < run_count(s); i++) {
+            if (decode(s, i).program != p || s->results[i].final_state != WM_COMPLETE)
+                continue;
+            meter_t m;
+            run_meter(s, i, &m);
+            meter_add(&sum, &m);
+            runs++;
+        }
+        double k = runs ? 1.0 / runs : 0.0;
+        fprintf(stderr, "%-10s %6u %8.1f %8.1f %8.1f %8.3f\n",
+                app_menu_name(menu, APP_MENU_PROGRAM, p), runs, sum.litres[WM_PHASE_WASH] * k,
+                sum.litres[WM_PHASE_RINSE] * k, meter_litres(&sum) * k, meter_kwh(&sum) * k);
+    }
+    fprintf(stderr, "(rates %s; litres at each run's inlet flow)\n", rates);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-j threads] [-o out.csv] [-f inlet_lpm,...] [-d drain_lpm,...]\n"
+            "          [-n sensor_noise,...] [-r repeats] [-s seed] [-E rates]\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    sweep_t s = {0};
+    unsigned threads = 0;
+    const char *out_path = NULL;
+    parse_list("12", &s.inlet);
+    parse_list("25", &s.drain);
+    parse_list("0", &s.noise);
+    s.repeats = 1;
+    s.seed = 1;
+    s.rates = meter_default_rates();
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:o:f:d:n:r:s:E:")) != -1) {
+        switch (opt) {
+        case 'j':
+            threads = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'f':
+            if (!parse_list(optarg, &s.inlet))
+                usage(argv[0]);
+            break;
+        case 'd':
+            if (!parse_list(optarg, &s.drain))
+                usage(argv[0]);
+            break;
+        case 'n':
+            if (!parse_list(optarg, &s.noise))
+                usage(argv[0]);
+            break;
+        case 'r':
+            s.repeats = atoi(optarg);
+            break;
+        case 's':
+            s.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'E':
+            if (!meter_parse(optarg, &s.rates))
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (s.repeats < 1)
+        usage(argv[0]);
+
+    /* A fresh machine tells us the menu (same as every run sees) */
+    static hal_t menu_hal;
+    static App menu;
+    hal_sim_set_quiet(&menu_hal, true);
+    app_init(&menu, &menu_hal);
+    s.programs = app_menu_count(&menu, APP_MENU_PROGRAM);
+    s.levels = app_menu_count(&menu, APP_MENU_LEVEL);
+    s.powers = app_menu_count(&menu, APP_MENU_POWER);
+
+    size_t n = run_count(&s);
+    s.results = calloc(n, sizeof(*s.results));
+    if (!s.results) {
+        perror("calloc");
+        return 1;
+    }
+    if (threads == 0)
+        threads = pool_cpu_count();
+
+    double t0 = now_sec();
+    pool_run(n, threads, run_job, &s);
+    double wall = now_sec() - t0;
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror("Failed to open output");
+        return 1;
+    }
+    write_csv(out, &s, &menu);
+    if (out != stdout)
+        fclose(out);
+    print_programs(&s, &menu);
+
+    double sim_sec = 0.0;
+    size_t failed = 0;
+    for (size_t i = 0; i < n; i++) {
+        sim_sec += s.results[i].total_ms / 1000.0;
+        failed += s.results[i].final_state != WM_COMPLETE || s.results[i].timed_out;
+    }
+    fprintf(stderr, "%zu runs on %u threads in %.2f s: %.1f runs/s, %.0fx real time per thread",
+            n, threads, wall, n / wall, sim_sec / wall / threads);
+    fprintf(stderr, ", %zu not COMPLETE\n", failed);
+
+    free(s.results);
+    return 0;
+}
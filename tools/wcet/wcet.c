@@ -0,0 +1,404 @@
+/*
+ * Worst-case execution time harness.
+ *
+ * Places the controller at every state/transition branch of wm_tick (including the error
+ * timeouts, abort from each state and pause/resume in each state) and times one tick of
+ * that branch, both for wm_tick alone and for a full app_loop tick (debounce, wm_tick,
+ * wm_actuators, flight recorder and the status print, with stdout sent to /dev/null).
+ * Branches are timed for a classic program and for a step program, the bytecode the app's
+ * presets run as: step fetches at phase boundaries, SOAK, LOOP jump-backs, and the step
+ * walk of wm_get_time_remaining_sec in the status print.
+ *
+ * Timing uses the TSC (rdtsc fenced with lfence) on x86 and nanoseconds elsewhere.
+ * Each path runs ROUNDS x REPS times. The "typical worst" (typwc) is the smallest of the
+ * per-round maxima: it rejects one-off preemption spikes while keeping slow paths, so it is
+ * not a bound. The true maximum over all samples (max) is printed beside it and includes
+ * those spikes. The budget applies to the typical worst; a path over budget is measured
+ * again up to RETRIES times before it counts as a failure.
+ *
+ * Usage: wcet [max_cycles]   exits 1 if any path's typical worst exceeds max_cycles
+ */
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_UNIT "cycles"
+static inline uint64_t cycles_now(void) {
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+}
+#else
+#define CYCLE_UNIT "ns"
+static inline uint64_t cycles_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#include "app.h"
+#include "hal.h"
+#include "wm_control.h"
+
+#define ROUNDS 21
+#define REPS 200
+#define RETRIES 3 /* Re-measurements of a path over budget before it fails */
+
+/* Operation applied right before the measured tick (and included in the timing) */
+typedef enum { OP_NONE, OP_ABORT, OP_PAUSE, OP_RESUME } path_op_t;
+
+typedef struct {
+    const char *name;
+    wm_state_t state;
+    uint16_t state_time;
+    bool is_wash_phase;
+    uint8_t wash_done;
+    uint8_t rinse_done;
+    bool spin_enable;
+    water_level_t level;
+    bool drain_check;
+    wm_state_t expect; /* State after the tick (for OP_NONE paths) */
+} path_t;
+
+/* 2 washes, 2 rinses, 10 ticks/s */
+static const wm_program_t program = {
+    .wash_count = 2,
+    .rinse_count = 2,
+    .spin_enable = true,
+    .soap_time_sec = 2,
+    .wash_agitate_time_sec = 10,
+    .rinse_agitate_time_sec = 10,
+    .agitate_run_ms = 1600,
+    .agitate_cycle_ms = 5000,
+    .target_water_level = WATER_MED,
+    .water_fill_timeout_sec = 20,
+    .drain_timeout_sec = 20,
+    .ticks_per_second = 10,
+};
+
+/* clang-format off */
+static const path_t paths[] = {
+    /* name                 state       time wash wd rd spin level        chk    expect */
+    {"idle",               WM_IDLE,      0, 0, 0, 0, 1, WATER_EMPTY, false, WM_IDLE},
+    {"start",              WM_START,     0, 1, 0, 0, 1, WATER_EMPTY, false, WM_FILL},
+    {"fill_wait",          WM_FILL,      5, 1, 0, 0, 1, WATER_LOW,   true,  WM_FILL},
+    {"fill_to_soap",       WM_FILL,      5, 1, 0, 0, 1, WATER_MED,   true,  WM_SOAP},
+    {"fill_to_agitate",    WM_FILL,      5, 0, 1, 0, 1, WATER_HIGH,  true,  WM_AGITATE},
+    {"fill_timeout",       WM_FILL,    199, 1, 0, 0, 1, WATER_LOW,   true,  WM_ERROR},
+    {"soap_wait",          WM_SOAP,      3, 1, 0, 0, 1, WATER_MED,   true,  WM_SOAP},
+    {"soap_to_agitate",    WM_SOAP,     19, 1, 0, 0, 1, WATER_MED,   true,  WM_AGITATE},
+    {"agitate_cw",         WM_AGITATE,   3, 1, 0, 0, 1, WATER_MED,   true,  WM_AGITATE},
+    {"agitate_cw_rest",    WM_AGITATE,  30, 1, 0, 0, 1, WATER_MED,   true,  WM_AGITATE},
+    {"agitate_ccw",        WM_AGITATE,  53, 1, 0, 0, 1, WATER_MED,   true,  WM_AGITATE},
+    {"agitate_ccw_rest",   WM_AGITATE,  80, 1, 0, 0, 1, WATER_MED,   true,  WM_AGITATE},
+    {"agitate_to_drain",   WM_AGITATE,  99, 1, 0, 0, 1, WATER_MED,   true,  WM_DRAIN},
+    {"drain_wait",         WM_DRAIN,     5, 1, 0, 0, 1, WATER_LOW,   true,  WM_DRAIN},
+    {"drain_next_wash",    WM_DRAIN,     5, 1, 0, 0, 1, WATER_EMPTY, false, WM_FILL},
+    {"drain_to_rinse",     WM_DRAIN,     5, 1, 1, 0, 1, WATER_EMPTY, false, WM_FILL},
+    {"drain_next_rinse",   WM_DRAIN,     5, 0, 2, 0, 1, WATER_EMPTY, false, WM_FILL},
+    {"drain_to_spin",      WM_DRAIN,     5, 0, 2, 1, 1, WATER_EMPTY, false, WM_SPIN},
+    {"drain_to_complete",  WM_DRAIN,     5, 0, 2, 1, 0, WATER_EMPTY, false, WM_COMPLETE},
+    {"drain_timeout",      WM_DRAIN,   199, 1, 0, 0, 1, WATER_LOW,   true,  WM_ERROR},
+    {"spin_run",           WM_SPIN,     10, 0, 2, 2, 1, WATER_EMPTY, false, WM_SPIN},
+    {"spin_to_complete",   WM_SPIN,     69, 0, 2, 2, 1, WATER_EMPTY, false, WM_COMPLETE},
+    {"complete",           WM_COMPLETE,  0, 0, 2, 2, 1, WATER_EMPTY, false, WM_COMPLETE},
+    {"error",              WM_ERROR,     0, 1, 0, 0, 1, WATER_LOW,   true,  WM_ERROR},
+};
+/* clang-format on */
+#define NUM_PATHS (sizeof(paths) / sizeof(paths[0]))
+
+/*
+ * The same cycle as a step program, with a SOAK: two wash passes and two rinse passes
+ * through LOOPs, then SPIN. Step paths are reached by running the program on a simple
+ * drum until the visit-th entry into 'state'.
+ */
+/* clang-format off */
+static const uint8_t step_code[] = {
+    WM_OP_FILL,  WATER_MED,                                  /* 0 */
+    WM_OP_SOAP,  20, 0,                                      /* 2 */
+    WM_OP_AGITATE, 16, 50, 10, 0,                            /* 5 */
+    WM_OP_SOAK,  5, 0,                                       /* 10 */
+    WM_OP_DRAIN,                                             /* 13 */
+    WM_OP_LOOP,  2, 14,                                      /* 14: back to FILL */
+    WM_OP_RINSE,                                             /* 17 */
+    WM_OP_FILL,  WATER_MED,                                  /* 18 */
+    WM_OP_AGITATE, 16, 50, 10, 0,                            /* 20 */
+    WM_OP_DRAIN,                                             /* 25 */
+    WM_OP_LOOP,  2, 8,                                       /* 26: back to FILL */
+    WM_OP_SPIN,  7, 0,                                       /* 29 */
+    WM_OP_END,
+};
+/* clang-format on */
+
+typedef struct {
+    const char *name;
+    wm_state_t state;
+    uint8_t visit; /* Entry into 'state' to stop at, from 1 */
+    uint16_t state_time;
+    water_level_t level;
+    bool drain_check;
+    wm_state_t expect;
+} step_path_t;
+
+/* clang-format off */
+static const step_path_t step_paths[] = {
+    /* name                     state     visit time level        chk    expect */
+    {"steps_fill_wait",         WM_FILL,    1,   5, WATER_LOW,   true,  WM_FILL},
+    {"steps_fill_to_soap",      WM_FILL,    1,   5, WATER_MED,   true,  WM_SOAP},
+    {"steps_agitate_to_soak",   WM_AGITATE, 1,  99, WATER_MED,   true,  WM_SOAK},
+    {"steps_soak",              WM_SOAK,    1,  20, WATER_MED,   true,  WM_SOAK},
+    {"steps_soak_to_drain",     WM_SOAK,    1,  49, WATER_MED,   true,  WM_DRAIN},
+    {"steps_loop_back",         WM_DRAIN,   1,   5, WATER_EMPTY, false, WM_FILL},
+    {"steps_to_rinse",          WM_DRAIN,   2,   5, WATER_EMPTY, false, WM_FILL},
+    {"steps_rinse_loop_back",   WM_DRAIN,   3,   5, WATER_EMPTY, false, WM_FILL},
+    {"steps_to_spin",           WM_DRAIN,   4,   5, WATER_EMPTY, false, WM_SPIN},
+    {"steps_spin_to_complete",  WM_SPIN,    1,  69, WATER_EMPTY, false, WM_COMPLETE},
+};
+/* clang-format on */
+#define NUM_STEP_PATHS (sizeof(step_paths) / sizeof(step_paths[0]))
+
+static const char *op_names[] = {"", "+abort", "+pause", "+resume"};
+
+static void setup(const path_t *p, wm_controller_t *c, wm_sensors_t *s) {
+    wm_actuators_t a;
+    wm_init(c, s, &a, program);
+    c->state = p->state;
+    c->state_time = p->state_time;
+    c->is_wash_phase = p->is_wash_phase;
+    c->wash_done = p->wash_done;
+    c->rinse_done = p->rinse_done;
+    c->program.spin_enable = p->spin_enable;
+    s->water_level = p->level;
+    s->drain_check = p->drain_check;
+}
+
+/* Run the step program until the visit-th entry into p->state, then place it there */
+static void setup_steps(const step_path_t *p, wm_controller_t *c, wm_sensors_t *s) {
+    wm_actuators_t a;
+    wm_init(c, s, &a, program);
+    if (!wm_load_code(c, step_code, sizeof(step_code))) {
+        fprintf(stderr, "Step program rejected\n");
+        exit(2);
+    }
+    wm_start(c);
+
+    unsigned visits = 0;
+    wm_state_t last = c->state;
+    for (int t = 0; t < 100000 && visits < p->visit; t++) {
+        wm_tick(c, s, &a);
+        visits += c->state == p->state && last != p->state;
+        last = c->state;
+        /* One level step per tick while filling or draining */
+        if (a.inlet_valve && s->water_level < WATER_HIGH)
+            s->water_level++;
+        if (a.drain_pump && s->water_level > WATER_EMPTY)
+            s->water_level--;
+        s->drain_check = s->water_level != WATER_EMPTY;
+    }
+    if (visits < p->visit) {
+        fprintf(stderr, "Path %s: state %s not reached\n", p->name, wm_state_str(p->state));
+        exit(2);
+    }
+    c->state_time = p->state_time;
+    s->water_level = p->level;
+    s->drain_check = p->drain_check;
+}
+
+/* Pause/resume/abort only make sense in active states */
+static bool op_applies(wm_state_t state, path_op_t op) {
+    if (op == OP_NONE)
+        return true;
+    return state != WM_IDLE && state != WM_COMPLETE && state != WM_ERROR;
+}
+
+static void apply_op(wm_controller_t *c, path_op_t op) {
+    switch (op) {
+    case OP_ABORT:
+        wm_abort(c);
+        break;
+    case OP_PAUSE:
+        wm_pause(c);
+        break;
+    case OP_RESUME:
+        wm_resume(c);
+        break;
+    default:
+        break;
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    uint64_t median;
+    uint64_t typ_worst; /* Min over rounds of the round maximum */
+    uint64_t max;       /* Max over all samples */
+} timing_t;
+
+static void summarize(uint64_t *samples, timing_t *out) {
+    out->typ_worst = UINT64_MAX;
+    out->max = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        uint64_t round_max = 0;
+        for (int i = 0; i < REPS; i++) {
+            uint64_t v = samples[r * REPS + i];
+            if (v > round_max)
+                round_max = v;
+        }
+        if (round_max < out->typ_worst)
+            out->typ_worst = round_max;
+        if (round_max > out->max)
+            out->max = round_max;
+    }
+    qsort(samples, ROUNDS * REPS, sizeof(uint64_t), cmp_u64);
+    out->median = samples[ROUNDS * REPS / 2];
+}
+
+/* Time wm_tick alone */
+static void time_tick(const char *name, const wm_controller_t *start, const wm_sensors_t *sens,
+                      wm_state_t expect, path_op_t op, timing_t *out) {
+    static uint64_t samples[ROUNDS * REPS];
+    wm_controller_t proto = *start, c;
+    wm_sensors_t s = *sens;
+    wm_actuators_t a;
+
+    if (op == OP_RESUME)
+        wm_pause(&proto);
+
+    for (int i = 0; i < ROUNDS * REPS; i++) {
+        c = proto;
+        uint64_t t0 = cycles_now();
+        apply_op(&c, op);
+        wm_tick(&c, &s, &a);
+        samples[i] = cycles_now() - t0;
+    }
+
+    if (op == OP_NONE && c.state != expect) {
+        fprintf(stderr, "Path %s ended in %s, expected %s\n", name, wm_state_str(c.state),
+                wm_state_str(expect));
+        exit(2);
+    }
+    summarize(samples, out);
+}
+
+/* Time one full app_loop tick */
+static void time_app(App *app, const wm_controller_t *start, const wm_sensors_t *s,
+                     path_op_t op, timing_t *out) {
+    static uint64_t samples[ROUNDS * REPS];
+    wm_controller_t proto = *start;
+
+    if (op == OP_RESUME)
+        wm_pause(&proto);
+    hal_sim_set_sensors(app->hal, s->drain_check, (int)s->water_level);
+
+    for (int i = 0; i < ROUNDS * REPS; i++) {
+        app->ctrl = proto;
+        app->ui_state = UI_RUNNING;
+        fr_thaw(&app->recorder); /* Error paths freeze it; keep recording cost in every path */
+        app->last_tick_time = hal_millis(app->hal) - 1000; /* Tick is due */
+        uint64_t t0 = cycles_now();
+        apply_op(&app->ctrl, op);
+        app_loop(app);
+        samples[i] = cycles_now() - t0;
+    }
+    summarize(samples, out);
+}
+
+typedef struct {
+    FILE *report;
+    uint64_t max_cycles;
+    uint64_t typ_worst; /* Largest typical worst app_loop tick, and its path */
+    const char *typ_worst_path;
+    uint64_t max; /* Largest single app_loop sample, and its path */
+    const char *max_path;
+    int failures;
+} summary_t;
+
+/* Time a path with each applicable operation and print its rows */
+static void measure(summary_t *sum, App *app, const char *name, const wm_controller_t *c,
+                    const wm_sensors_t *s, wm_state_t expect) {
+    for (path_op_t op = OP_NONE; op <= OP_RESUME; op++) {
+        if (!op_applies(c->state, op))
+            continue;
+
+        timing_t tick, loop;
+        time_tick(name, c, s, expect, op, &tick);
+        time_app(app, c, s, op, &loop);
+        /* A host that stalls us for a whole path's rounds looks like a slow path: re-measure */
+        for (int retry = 0; retry < RETRIES && sum->max_cycles && loop.typ_worst > sum->max_cycles;
+             retry++)
+            time_app(app, c, s, op, &loop);
+
+        char label[48];
+        snprintf(label, sizeof(label), "%s%s", name, op_names[op]);
+        bool over = sum->max_cycles && loop.typ_worst > sum->max_cycles;
+        fprintf(sum->report, "%-28s %10llu %10llu | %10llu %10llu %10llu%s\n", label,
+                (unsigned long long)tick.median, (unsigned long long)tick.typ_worst,
+                (unsigned long long)loop.median, (unsigned long long)loop.typ_worst,
+                (unsigned long long)loop.max, over ? "  <-- OVER BUDGET" : "");
+
+        if (loop.typ_worst > sum->typ_worst) {
+            sum->typ_worst = loop.typ_worst;
+            sum->typ_worst_path = name;
+        }
+        if (loop.max > sum->max) {
+            sum->max = loop.max;
+            sum->max_path = name;
+        }
+        sum->failures += over;
+    }
+}
+
+int main(int argc, char **argv) {
+    uint64_t max_cycles = argc > 1 ? strtoull(argv[1], NULL, 10) : 0;
+
+    /* The status print is part of the path, but its output is not */
+    FILE *report = fdopen(dup(1), "w");
+    if (!report || !freopen("/dev/null", "w", stdout)) {
+        perror("stdout redirect");
+        return 1;
+    }
+
+    static hal_t hal;
+    static App app;
+    app_init(&app, &hal);
+
+    fprintf(report, "%-28s %10s %10s | %10s %10s %10s  (%s)\n", "path", "tick_med", "tick_typwc",
+            "loop_med", "loop_typwc", "loop_max", CYCLE_UNIT);
+
+    summary_t sum = {report, max_cycles, 0, "", 0, "", 0};
+    for (size_t i = 0; i < NUM_PATHS; i++) {
+        wm_controller_t c;
+        wm_sensors_t s;
+        setup(&paths[i], &c, &s);
+        measure(&sum, &app, paths[i].name, &c, &s, paths[i].expect);
+    }
+    for (size_t i = 0; i < NUM_STEP_PATHS; i++) {
+        wm_controller_t c;
+        wm_sensors_t s;
+        setup_steps(&step_paths[i], &c, &s);
+        measure(&sum, &app, step_paths[i].name, &c, &s, step_paths[i].expect);
+    }
+
+    fprintf(report, "\nTypical worst app_loop tick: %llu %s (%s)\n",
+            (unsigned long long)sum.typ_worst, CYCLE_UNIT, sum.typ_worst_path);
+    fprintf(report, "Largest app_loop sample:      %llu %s (%s, includes host preemption)\n",
+            (unsigned long long)sum.max, CYCLE_UNIT, sum.max_path);
+    if (max_cycles) {
+        fprintf(report, "Budget: %llu %s -> %s\n", (unsigned long long)max_cycles, CYCLE_UNIT,
+                sum.failures ? "FAIL" : "PASS");
+    }
+    fclose(report);
+    return sum.failures ? 1 : 0;
+}